@@ -1,5 +1,6 @@
 #include "aes.h"
 
+#include "cpu.h"
 #include "util.h"
 
 unsigned long long AES_ctx_size() { return sizeof(struct AES_ctx); }
@@ -126,10 +127,12 @@ void AES_init_ctx_iv(struct AES_ctx *ctx, const unsigned char *key,
 		     const unsigned char *iv) {
 	KeyExpansion(ctx->RoundKey, key);
 	copy_bytes(ctx->Iv, iv, AES_BLOCKLEN);
+	ctx->bi = AES_BLOCKLEN;
 }
 
 void AES_ctx_set_iv(struct AES_ctx *ctx, const unsigned char *iv) {
 	copy_bytes(ctx->Iv, iv, AES_BLOCKLEN);
+	ctx->bi = AES_BLOCKLEN;
 }
 
 // This function adds the round key to state.
@@ -237,34 +240,217 @@ static void Cipher(state_t *state, const unsigned char *RoundKey) {
 	AddRoundKey(Nr, state, RoundKey);
 }
 
+// Hardware AES backends. The software Cipher above remains the
+// fallback; CipherHw runs one block through AES-NI or the ARMv8 crypto
+// extensions using the same expanded round keys (the byte-serialized
+// key schedule is the layout both instruction sets consume directly).
+// Selection goes through the cpu.h dispatch slot below, resolved off
+// cpu_features() on the first block.
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+__attribute__((target("aes,sse2"))) static void CipherHw(
+    state_t *state, const unsigned char *RoundKey) {
+	const __m128i *rk = (const __m128i *)RoundKey;
+	__m128i block = _mm_loadu_si128((const __m128i *)state);
+	block = _mm_xor_si128(block, _mm_loadu_si128(rk));
+	for (int round = 1; round < Nr; ++round)
+		block = _mm_aesenc_si128(block, _mm_loadu_si128(rk + round));
+	block = _mm_aesenclast_si128(block, _mm_loadu_si128(rk + Nr));
+	_mm_storeu_si128((__m128i *)state, block);
+}
+
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+
+__attribute__((target("+crypto"))) static void CipherHw(
+    state_t *state, const unsigned char *RoundKey) {
+	uint8x16_t block = vld1q_u8((const unsigned char *)state);
+	// vaese adds the round key first, so the final AddRoundKey is a
+	// plain XOR after the last SubBytes/ShiftRows
+	for (int round = 0; round < Nr - 1; ++round)
+		block = vaesmcq_u8(
+		    vaeseq_u8(block, vld1q_u8(RoundKey + 16 * round)));
+	block = vaeseq_u8(block, vld1q_u8(RoundKey + 16 * (Nr - 1)));
+	block = veorq_u8(block, vld1q_u8(RoundKey + 16 * Nr));
+	vst1q_u8((unsigned char *)state, block);
+}
+
+#else
+static void CipherHw(state_t *state, const unsigned char *RoundKey) {
+	Cipher(state, RoundKey);
+}
+#endif
+
+static void CipherResolve(state_t *state, const unsigned char *RoundKey);
+static void (*cipher_block)(state_t *, const unsigned char *) = CipherResolve;
+
+static void CipherResolve(state_t *state, const unsigned char *RoundKey) {
+	cipher_block = CPU_HAS(CPU_FEAT_AES) ? CipherHw : Cipher;
+	cipher_block(state, RoundKey);
+}
+
+/* Increment the big-endian counter block and handle overflow */
+static void CtrInc(unsigned char *iv) {
+	int bi;
+	for (bi = (AES_BLOCKLEN - 1); bi >= 0; --bi) {
+		/* inc will overflow */
+		if (iv[bi] == 255) {
+			iv[bi] = 0;
+			continue;
+		}
+		iv[bi] += 1;
+		break;
+	}
+}
+
+// Wide keystream generation. CTR blocks are independent, so running
+// several counters through the cipher at once fills the execution
+// pipelines instead of serializing on one block's round chain. The
+// hardware paths keep 8 blocks in flight per round-key load; the
+// software path interleaves 4 blocks at round granularity so each
+// round's work is independent across lanes. Each generator consumes
+// n counter values from iv and writes n*16 keystream bytes to ks,
+// n <= CTR_LANES.
+#define CTR_LANES 8
+#define CTR_SOFT_LANES 4
+
+static void CtrBlocksSoft(const unsigned char *RoundKey, unsigned char *iv,
+			  unsigned char *ks, int n) {
+	state_t st[CTR_SOFT_LANES];
+	unsigned char round;
+	int b;
+	for (b = 0; b < n; ++b) {
+		copy_bytes((unsigned char *)&st[b], iv, AES_BLOCKLEN);
+		CtrInc(iv);
+		AddRoundKey(0, &st[b], RoundKey);
+	}
+	for (round = 1;; ++round) {
+		for (b = 0; b < n; ++b) {
+			SubBytes(&st[b]);
+			ShiftRows(&st[b]);
+		}
+		if (round == Nr) break;
+		for (b = 0; b < n; ++b) {
+			MixColumns(&st[b]);
+			AddRoundKey(round, &st[b], RoundKey);
+		}
+	}
+	for (b = 0; b < n; ++b) {
+		AddRoundKey(Nr, &st[b], RoundKey);
+		copy_bytes(ks + AES_BLOCKLEN * b, (unsigned char *)&st[b],
+			   AES_BLOCKLEN);
+	}
+}
+
+static void CtrBlocks(const unsigned char *RoundKey, unsigned char *iv,
+		      unsigned char *ks, int n) {
+	while (n > CTR_SOFT_LANES) {
+		CtrBlocksSoft(RoundKey, iv, ks, CTR_SOFT_LANES);
+		ks += CTR_SOFT_LANES * AES_BLOCKLEN;
+		n -= CTR_SOFT_LANES;
+	}
+	CtrBlocksSoft(RoundKey, iv, ks, n);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("aes,sse2"))) static void CtrBlocksHw(
+    const unsigned char *RoundKey, unsigned char *iv, unsigned char *ks,
+    int n) {
+	const __m128i *rk = (const __m128i *)RoundKey;
+	__m128i blk[CTR_LANES], k;
+	int b, round;
+	for (b = 0; b < n; ++b) {
+		blk[b] = _mm_loadu_si128((const __m128i *)iv);
+		CtrInc(iv);
+	}
+	k = _mm_loadu_si128(rk);
+	for (b = 0; b < n; ++b) blk[b] = _mm_xor_si128(blk[b], k);
+	for (round = 1; round < Nr; ++round) {
+		k = _mm_loadu_si128(rk + round);
+		for (b = 0; b < n; ++b) blk[b] = _mm_aesenc_si128(blk[b], k);
+	}
+	k = _mm_loadu_si128(rk + Nr);
+	for (b = 0; b < n; ++b) blk[b] = _mm_aesenclast_si128(blk[b], k);
+	for (b = 0; b < n; ++b)
+		_mm_storeu_si128((__m128i *)(ks + AES_BLOCKLEN * b), blk[b]);
+}
+
+#elif defined(__aarch64__)
+__attribute__((target("+crypto"))) static void CtrBlocksHw(
+    const unsigned char *RoundKey, unsigned char *iv, unsigned char *ks,
+    int n) {
+	uint8x16_t blk[CTR_LANES], k;
+	int b, round;
+	for (b = 0; b < n; ++b) {
+		blk[b] = vld1q_u8(iv);
+		CtrInc(iv);
+	}
+	for (round = 0; round < Nr - 1; ++round) {
+		k = vld1q_u8(RoundKey + 16 * round);
+		for (b = 0; b < n; ++b)
+			blk[b] = vaesmcq_u8(vaeseq_u8(blk[b], k));
+	}
+	k = vld1q_u8(RoundKey + 16 * (Nr - 1));
+	for (b = 0; b < n; ++b) blk[b] = vaeseq_u8(blk[b], k);
+	k = vld1q_u8(RoundKey + 16 * Nr);
+	for (b = 0; b < n; ++b) blk[b] = veorq_u8(blk[b], k);
+	for (b = 0; b < n; ++b) vst1q_u8(ks + AES_BLOCKLEN * b, blk[b]);
+}
+
+#else
+static void CtrBlocksHw(const unsigned char *RoundKey, unsigned char *iv,
+			unsigned char *ks, int n) {
+	CtrBlocks(RoundKey, iv, ks, n);
+}
+#endif
+
+static void CtrBlocksResolve(const unsigned char *RoundKey, unsigned char *iv,
+			     unsigned char *ks, int n);
+static void (*ctr_blocks)(const unsigned char *, unsigned char *,
+			  unsigned char *, int) = CtrBlocksResolve;
+
+static void CtrBlocksResolve(const unsigned char *RoundKey, unsigned char *iv,
+			     unsigned char *ks, int n) {
+	ctr_blocks = CPU_HAS(CPU_FEAT_AES) ? CtrBlocksHw : CtrBlocks;
+	ctr_blocks(RoundKey, iv, ks, n);
+}
+
 /* Symmetrical operation: same function for encrypting as for decrypting. Note
  * any IV/nonce should never be reused with the same key */
 void AES_CTR_xcrypt_buffer(struct AES_ctx *ctx, unsigned char *buf,
 			   unsigned long long length) {
-	unsigned char buffer[AES_BLOCKLEN];
+	unsigned long long i = 0;
 
-	unsigned long long i;
-	int bi;
-	for (i = 0, bi = AES_BLOCKLEN; i < length; ++i, ++bi) {
-		if (bi == AES_BLOCKLEN) /* we need to regen xor compliment in
-					   buffer */
-		{
-			copy_bytes(buffer, ctx->Iv, AES_BLOCKLEN);
-			Cipher((state_t *)buffer, ctx->RoundKey);
-
-			/* Increment Iv and handle overflow */
-			for (bi = (AES_BLOCKLEN - 1); bi >= 0; --bi) {
-				/* inc will overflow */
-				if (ctx->Iv[bi] == 255) {
-					ctx->Iv[bi] = 0;
-					continue;
-				}
-				ctx->Iv[bi] += 1;
-				break;
-			}
-			bi = 0;
-		}
+	/* drain keystream bytes left over from a previous call */
+	while (i < length && ctx->bi != AES_BLOCKLEN) {
+		buf[i] = (buf[i] ^ ctx->Ks[ctx->bi]);
+		++i;
+		ctx->bi++;
+	}
 
-		buf[i] = (buf[i] ^ buffer[bi]);
+	/* bulk: generate up to CTR_LANES keystream blocks per pass and
+	 * xor them straight into buf */
+	while (length - i >= AES_BLOCKLEN) {
+		unsigned char ks[CTR_LANES * AES_BLOCKLEN];
+		int n = (int)((length - i) / AES_BLOCKLEN);
+		int b;
+		if (n > CTR_LANES) n = CTR_LANES;
+		ctr_blocks(ctx->RoundKey, ctx->Iv, ks, n);
+		for (b = 0; b < n * AES_BLOCKLEN; ++b) buf[i + b] ^= ks[b];
+		i += (unsigned long long)n * AES_BLOCKLEN;
+	}
+
+	/* tail: regen one keystream block, keep the remainder in ctx */
+	if (i < length) {
+		copy_bytes(ctx->Ks, ctx->Iv, AES_BLOCKLEN);
+		cipher_block((state_t *)ctx->Ks, ctx->RoundKey);
+		CtrInc(ctx->Iv);
+		ctx->bi = 0;
+		while (i < length) {
+			buf[i] = (buf[i] ^ ctx->Ks[ctx->bi]);
+			++i;
+			ctx->bi++;
+		}
 	}
 }
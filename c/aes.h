@@ -35,6 +35,11 @@
 struct AES_ctx {
 	unsigned char RoundKey[AES_keyExpSize];
 	unsigned char Iv[AES_BLOCKLEN];
+	/* current keystream block and how many of its bytes are consumed,
+	 * so a CTR stream can resume mid-block across xcrypt calls and the
+	 * two ends of a stream need not agree on chunk boundaries */
+	unsigned char Ks[AES_BLOCKLEN];
+	unsigned char bi;
 };
 
 unsigned long long AES_ctx_size();
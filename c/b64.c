@@ -60,6 +60,8 @@
 
 #include <string.h>
 
+#include "cpu.h"
+
 /* aaaack but it's fast and const should make it shared text page. */
 static const unsigned char pr2six[256] = {
     /* ASCII table */
@@ -78,6 +80,76 @@ static const unsigned char pr2six[256] = {
     64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
     64, 64, 64, 64, 64, 64, 64, 64, 64};
 
+/* Vectorized bulk paths. The scalar code below stays as the fallback
+ * and always handles the trailing quartet; the kernels only run over
+ * regions the pr2six scan (decode) or the length check (encode) has
+ * already bounded, so they never need their own validation.
+ */
+#if defined(__aarch64__)
+#include <arm_neon.h>
+
+/* decode one deinterleaved vector of base64 chars to 6-bit values;
+ * callers guarantee every lane holds a valid base64 character */
+static inline uint8x16_t b64_dec_neon1(uint8x16_t c) {
+	uint8x16_t ret = vdupq_n_u8(0);
+	uint8x16_t m;
+	m = vandq_u8(vcgeq_u8(c, vdupq_n_u8('A')), vcleq_u8(c, vdupq_n_u8('Z')));
+	ret = vbslq_u8(m, vsubq_u8(c, vdupq_n_u8('A')), ret);
+	m = vandq_u8(vcgeq_u8(c, vdupq_n_u8('a')), vcleq_u8(c, vdupq_n_u8('z')));
+	ret = vbslq_u8(m, vsubq_u8(c, vdupq_n_u8('a' - 26)), ret);
+	m = vandq_u8(vcgeq_u8(c, vdupq_n_u8('0')), vcleq_u8(c, vdupq_n_u8('9')));
+	ret = vbslq_u8(m, vaddq_u8(c, vdupq_n_u8(52 - '0')), ret);
+	m = vceqq_u8(c, vdupq_n_u8('+'));
+	ret = vbslq_u8(m, vdupq_n_u8(62), ret);
+	m = vceqq_u8(c, vdupq_n_u8('/'));
+	ret = vbslq_u8(m, vdupq_n_u8(63), ret);
+	return ret;
+}
+#elif defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+
+/* 12 input bytes (of the 16 loaded) to 16 base64 chars */
+__attribute__((target("ssse3"))) static __m128i b64_enc_ssse3(__m128i in) {
+	const __m128i shuf =
+	    _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	in = _mm_shuffle_epi8(in, shuf);
+	const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	const __m128i indices = _mm_or_si128(t1, t3);
+	/* map the 6-bit indices to ascii by adding a per-range offset */
+	__m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+	const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+	result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+	const __m128i lut = _mm_setr_epi8(
+	    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+	    '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+	    '/' - 63, 'A', 0, 0);
+	return _mm_add_epi8(_mm_shuffle_epi8(lut, result), indices);
+}
+
+/* 16 valid base64 chars to 12 plain bytes (low 12 of the result) */
+__attribute__((target("ssse3"))) static __m128i b64_dec_ssse3(__m128i in) {
+	/* per-high-nibble offset from ascii to 6-bit value; the +1 shift
+	 * from the '/' compare selects the slash entry */
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71,
+					       -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i eq_2f = _mm_cmpeq_epi8(in, _mm_set1_epi8(0x2f));
+	const __m128i hi_nibbles =
+	    _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+	const __m128i roll =
+	    _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+	const __m128i merged = _mm_add_epi8(in, roll);
+	/* pack four 6-bit values per dword into three bytes */
+	const __m128i mab =
+	    _mm_maddubs_epi16(merged, _mm_set1_epi32(0x01400140));
+	const __m128i out = _mm_madd_epi16(mab, _mm_set1_epi32(0x00011000));
+	return _mm_shuffle_epi8(out, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+						   14, 13, 12, -1, -1, -1, -1));
+}
+#endif /* __aarch64__ / __x86_64__ */
+
 int Base64decode_len(const char *bufcoded) {
 	int nbytesdecoded;
 	const unsigned char *bufin;
@@ -106,6 +178,41 @@ int Base64decode(char *bufplain, const char *bufcoded) {
 	bufout = (unsigned char *)bufplain;
 	bufin = (const unsigned char *)bufcoded;
 
+	/* the scan above proved the first nprbytes chars valid, so the
+	 * bulk kernels run without validation; the scalar loop finishes
+	 * the remainder and always owns the final quartet */
+#if defined(__aarch64__)
+	while (nprbytes >= 68) {
+		uint8x16x4_t in = vld4q_u8(bufin);
+		uint8x16_t a = b64_dec_neon1(in.val[0]);
+		uint8x16_t b = b64_dec_neon1(in.val[1]);
+		uint8x16_t c = b64_dec_neon1(in.val[2]);
+		uint8x16_t d = b64_dec_neon1(in.val[3]);
+		uint8x16x3_t out;
+		out.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+		out.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+		out.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+		vst3q_u8(bufout, out);
+		bufin += 64;
+		bufout += 48;
+		nprbytes -= 64;
+	}
+#elif defined(__x86_64__) && defined(__GNUC__)
+	if (CPU_HAS(CPU_FEAT_SIMD128)) {
+		while (nprbytes >= 20) {
+			unsigned char tmp[16];
+			_mm_storeu_si128(
+			    (__m128i *)tmp,
+			    b64_dec_ssse3(
+				_mm_loadu_si128((const __m128i *)bufin)));
+			memcpy(bufout, tmp, 12);
+			bufin += 16;
+			bufout += 12;
+			nprbytes -= 16;
+		}
+	}
+#endif /* __aarch64__ / __x86_64__ */
+
 	while (nprbytes > 4) {
 		*(bufout++) = (unsigned char)(pr2six[*bufin] << 2 |
 					      pr2six[bufin[1]] >> 4);
@@ -145,7 +252,52 @@ int Base64encode(char *encoded, const char *string, int len) {
 	char *p;
 
 	p = encoded;
-	for (i = 0; i < len - 2; i += 3) {
+	i = 0;
+#if defined(__aarch64__)
+	{
+		uint8x16x4_t tbl;
+		tbl.val[0] = vld1q_u8((const unsigned char *)basis_64);
+		tbl.val[1] = vld1q_u8((const unsigned char *)basis_64 + 16);
+		tbl.val[2] = vld1q_u8((const unsigned char *)basis_64 + 32);
+		tbl.val[3] = vld1q_u8((const unsigned char *)basis_64 + 48);
+		while (len - i >= 48) {
+			uint8x16x3_t in =
+			    vld3q_u8((const unsigned char *)string + i);
+			uint8x16x4_t out;
+			out.val[0] = vqtbl4q_u8(tbl, vshrq_n_u8(in.val[0], 2));
+			out.val[1] = vqtbl4q_u8(
+			    tbl, vorrq_u8(vshlq_n_u8(vandq_u8(in.val[0],
+							      vdupq_n_u8(3)),
+						     4),
+					  vshrq_n_u8(in.val[1], 4)));
+			out.val[2] = vqtbl4q_u8(
+			    tbl, vorrq_u8(vshlq_n_u8(vandq_u8(in.val[1],
+							      vdupq_n_u8(15)),
+						     2),
+					  vshrq_n_u8(in.val[2], 6)));
+			out.val[3] =
+			    vqtbl4q_u8(tbl, vandq_u8(in.val[2],
+						     vdupq_n_u8(0x3f)));
+			vst4q_u8((unsigned char *)p, out);
+			p += 64;
+			i += 48;
+		}
+	}
+#elif defined(__x86_64__) && defined(__GNUC__)
+	if (CPU_HAS(CPU_FEAT_SIMD128)) {
+		/* each step loads 16 bytes but consumes 12, so stop while a
+		 * full load stays in bounds; the store is all real output */
+		while (len - i >= 16) {
+			_mm_storeu_si128(
+			    (__m128i *)p,
+			    b64_enc_ssse3(_mm_loadu_si128(
+				(const __m128i *)(string + i))));
+			p += 16;
+			i += 12;
+		}
+	}
+#endif /* __aarch64__ / __x86_64__ */
+	for (; i < len - 2; i += 3) {
 		*p++ = basis_64[(string[i] >> 2) & 0x3F];
 		*p++ = basis_64[((string[i] & 0x3) << 4) |
 				((int)(string[i + 1] & 0xF0) >> 4)];
@@ -27,13 +27,21 @@ typedef struct Backtrace {
 	int size;
 } Backtrace;
 
+// cached so error construction does not pay a getenv per error; the
+// environment cannot change the setting after the first check
+int backtrace_enabled() {
+	static int enabled = -1;
+	if (enabled < 0) enabled = getenv("RUST_BACKTRACE") != NULL;
+	return enabled;
+}
+
 int backtrace_ptr(Backtrace *bt, int max_size) {
 	if (!bt || max_size <= 0) {
 		bt->size = 0;
 		return 0;
 	}
 
-	if (getenv("RUST_BACKTRACE") == NULL) {
+	if (!backtrace_enabled()) {
 		bt->size = 0;
 		return 0;
 	}
@@ -65,6 +73,208 @@ void backtrace_free(Backtrace *bt) {
 	}
 }
 
+// ===== symbol cache =====
+//
+// symbolization shells out to addr2line/atos once per frame, which is
+// the multi-millisecond cost when panic-adjacent logging captures in
+// bursts. Hot stacks repeat the same frames, so resolved text is kept
+// in a small address-keyed cache: open addressing with a short probe
+// window, evicting the least recently touched entry in the window.
+// Entries live for the process; they are deliberately not counted
+// against the test alloc balance
+#define SYM_CACHE_SLOTS 256
+#define SYM_CACHE_PROBES 8
+#define SYM_MAX_TEXT 4096
+
+typedef struct {
+	u64 addr;
+	u64 stamp;
+	char *text;
+} SymEntry;
+
+static SymEntry sym_cache[SYM_CACHE_SLOTS];
+static u64 sym_stamp = 1;
+static u64 sym_lock = 0;
+
+static void sym_cache_lock() {
+	while (__atomic_exchange_n(&sym_lock, 1, __ATOMIC_ACQUIRE));
+}
+
+static void sym_cache_unlock() {
+	__atomic_store_n(&sym_lock, 0, __ATOMIC_RELEASE);
+}
+
+static unsigned int sym_slot(u64 addr) {
+	return (unsigned int)((addr * 0x9E3779B97F4A7C15ULL) >> 56) &
+	       (SYM_CACHE_SLOTS - 1);
+}
+
+static int sym_cache_get(u64 addr, char *out, int cap) {
+	int hit = 0;
+	sym_cache_lock();
+	unsigned int base = sym_slot(addr);
+	for (int i = 0; i < SYM_CACHE_PROBES; i++) {
+		SymEntry *e = &sym_cache[(base + i) & (SYM_CACHE_SLOTS - 1)];
+		if (e->text && e->addr == addr) {
+			int l = strlen(e->text);
+			if (l >= cap) l = cap - 1;
+			memcpy(out, e->text, l);
+			out[l] = 0;
+			e->stamp = sym_stamp++;
+			hit = 1;
+			break;
+		}
+	}
+	sym_cache_unlock();
+	return hit;
+}
+
+static void sym_cache_put(u64 addr, const char *text) {
+	char *copy = malloc(strlen(text) + 1);
+	if (!copy) return;
+	strcpy(copy, text);
+	sym_cache_lock();
+	unsigned int base = sym_slot(addr);
+	SymEntry *victim = &sym_cache[base];
+	for (int i = 0; i < SYM_CACHE_PROBES; i++) {
+		SymEntry *e = &sym_cache[(base + i) & (SYM_CACHE_SLOTS - 1)];
+		if (e->text && e->addr == addr) {
+			// raced with another resolver; keep the incumbent
+			free(copy);
+			sym_cache_unlock();
+			return;
+		}
+		if (!e->text) {
+			victim = e;
+			break;
+		}
+		if (e->stamp < victim->stamp) victim = e;
+	}
+	if (victim->text) free(victim->text);
+	victim->addr = addr;
+	victim->stamp = sym_stamp++;
+	victim->text = copy;
+	sym_cache_unlock();
+}
+
+// pull the next fgets-style line (newline kept, 127 byte chunks) out
+// of a resolved text buffer
+static int next_line(char **cur, char *buffer, int cap) {
+	char *p = *cur;
+	if (!*p) return 0;
+	int len = 0;
+	while (p[len] && p[len] != '\n' && len < cap - 2) len++;
+	if (p[len] == '\n') {
+		memcpy(buffer, p, len + 1);
+		buffer[len + 1] = 0;
+		*cur = p + len + 1;
+	} else {
+		memcpy(buffer, p, len);
+		buffer[len] = 0;
+		*cur = p + len;
+	}
+	return 1;
+}
+
+#ifdef __linux__
+// resolve one backtrace_symbols() entry through the cache; a miss
+// pays the addr2line popen once and remembers its output. Returns 0
+// when the entry carries no parsable offset
+static int resolve_symbol(char *entry, char *binary, char *text, int cap) {
+	int len = strlen(entry);
+	int last_plus = -1;
+	while (len > 0) {
+		if (entry[len] == '+') {
+			last_plus = len;
+			break;
+		}
+		len--;
+	}
+	if (last_plus <= 0) return 0;
+	char *addr = entry + last_plus + 1;
+	int itt = 0;
+	while (addr[itt]) {
+		if (addr[itt] == ')') {
+			addr[itt] = 0;
+			break;
+		}
+		itt++;
+	}
+	u64 address = cstring_strtoull(addr, 16);
+	address -= 8;
+	if (sym_cache_get(address, text, cap)) return 1;
+	char command[256];
+	snprintf(command, sizeof(command), "addr2line -f -e %s %llx", binary,
+		 address);
+	void *fp = popen(command, "r");
+	if (fp == NULL) return 0;
+	int off = 0;
+	char buffer[128];
+	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+		int l = strlen(buffer);
+		if (off + l >= cap) break;
+		strcpy(text + off, buffer);
+		off += l;
+	}
+	pclose(fp);
+	text[off] = 0;
+	sym_cache_put(address, text);
+	return 1;
+}
+#elif defined(__APPLE__)
+// resolve one captured frame pointer through the cache; a miss pays
+// the atos popen once and remembers its output
+static int resolve_symbol(void *ptr, char *binary, char *text, int cap) {
+	u64 key = (u64)ptr;
+	if (sym_cache_get(key, text, cap)) return 1;
+	Dl_info info;
+	dladdr(ptr, &info);
+	u64 addr = 0x0000000100000000 + info.dli_saddr - info.dli_fbase;
+	u64 offset = (u64)ptr - (u64)info.dli_saddr;
+	addr += offset;
+	addr -= 4;
+	char address[256];
+	snprintf(address, sizeof(address), "0x%llx", addr);
+	char command[256];
+	snprintf(command, sizeof(command),
+		 "atos -fullPath -o %s -l 0x100000000 %s", binary, address);
+	void *fp = popen(command, "r");
+	if (fp == NULL) return 0;
+	int off = 0;
+	char buffer[128];
+	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+		int l = strlen(buffer);
+		if (off + l >= cap) break;
+		strcpy(text + off, buffer);
+		off += l;
+	}
+	pclose(fp);
+	text[off] = 0;
+	sym_cache_put(key, text);
+	return 1;
+}
+#endif
+
+// resolve the caller's current stack into the cache so a later burst
+// of captures on this path symbolizes from memory instead of a popen
+// round trip per frame; meant to run once at startup
+void backtrace_prewarm(char *binary) {
+	void *array[32];
+	int size = backtrace(array, 32);
+#ifdef __linux__
+	char **strings = backtrace_symbols(array, size);
+	if (!strings) return;
+	char text[SYM_MAX_TEXT];
+	for (int i = 0; i < size; i++)
+		resolve_symbol(strings[i], binary, text, sizeof(text));
+	free(strings);
+#elif defined(__APPLE__)
+	char text[SYM_MAX_TEXT];
+	for (int i = 0; i < size; i++)
+		resolve_symbol(array[i], binary, text, sizeof(text));
+#endif
+}
+
 char *backtrace_to_string(Backtrace *bt, char *binary) {
 	if (bt == NULL || binary == NULL) return NULL;
 	bool term = false;
@@ -81,88 +291,47 @@ char *backtrace_to_string(Backtrace *bt, char *binary) {
 #endif	// __linux__
 
 	for (int i = 0; i < bt->size; i++) {
-		char address[256];
 #ifdef __linux__
-		int len = strlen(strings[i]);
-		int last_plus = -1;
-
-		while (len > 0) {
-			if (strings[i][len] == '+') {
-				last_plus = len;
-				break;
-			}
-			len--;
-		}
-		if (last_plus > 0) {
-			char *addr = strings[i] + last_plus + 1;
-			int itt = 0;
-			while (addr[itt]) {
-				if (addr[itt] == ')') {
-					addr[itt] = 0;
-					break;
-				}
-				itt++;
-			}
-			u64 address = cstring_strtoull(addr, 16);
-			address -= 8;
-
-			char command[256];
-			snprintf(command, sizeof(command),
-				 "addr2line -f -e %s %llx", binary, address);
-
-			void *fp = popen(command, "r");
-			if (fp == NULL) continue;
-			char buffer[128];
-			while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-				int len = strlen(buffer);
-				if (strstr(buffer, ".rs:")) {
-					len_sum += len;
-					if (len_sum >= 4 * PAGE_SIZE) break;
-					if (term) {
-						if (buffer[len - 1] == '\n')
-							buffer[len - 1] = 0;
-						cstring_cat_n(ret, buffer,
-							      strlen(buffer));
-						i = bt->size;
-						break;
-					}
-					cstring_cat_n(ret, buffer,
-						      strlen(buffer));
-				} else if (cstring_is_alpha_numeric(buffer)) {
-					if (len && buffer[len - 1] == '\n') {
-						len--;
-						buffer[len] = ' ';
-					}
-
-					len_sum += len;
-					if (len_sum >= 4 * PAGE_SIZE) break;
+		char text[SYM_MAX_TEXT];
+		if (!resolve_symbol(strings[i], binary, text, sizeof(text)))
+			continue;
+		char *cur = text;
+		char buffer[128];
+		while (next_line(&cur, buffer, sizeof(buffer))) {
+			int len = strlen(buffer);
+			if (strstr(buffer, ".rs:")) {
+				len_sum += len;
+				if (len_sum >= 4 * PAGE_SIZE) break;
+				if (term) {
+					if (buffer[len - 1] == '\n')
+						buffer[len - 1] = 0;
 					cstring_cat_n(ret, buffer,
 						      strlen(buffer));
-					if (!cstring_compare(buffer, "main ")) {
-						term = true;
-					}
+					i = bt->size;
+					break;
+				}
+				cstring_cat_n(ret, buffer, strlen(buffer));
+			} else if (cstring_is_alpha_numeric(buffer)) {
+				if (len && buffer[len - 1] == '\n') {
+					len--;
+					buffer[len] = ' ';
 				}
-			}
 
-			pclose(fp);
+				len_sum += len;
+				if (len_sum >= 4 * PAGE_SIZE) break;
+				cstring_cat_n(ret, buffer, strlen(buffer));
+				if (!cstring_compare(buffer, "main ")) {
+					term = true;
+				}
+			}
 		}
 #elif defined(__APPLE__)
-		Dl_info info;
-		dladdr(bt->array[i], &info);
-		u64 addr = 0x0000000100000000 + info.dli_saddr - info.dli_fbase;
-		u64 offset = (u64)bt->array[i] - (u64)info.dli_saddr;
-		addr += offset;
-		addr -= 4;
-		snprintf(address, sizeof(address), "0x%llx", addr);
-		char command[256];
-		snprintf(command, sizeof(command),
-			 "atos -fullPath -o %s -l 0x100000000 %s", binary,
-			 address);
-		void *fp = popen(command, "r");
-		if (fp == NULL) continue;
+		char text[SYM_MAX_TEXT];
+		if (!resolve_symbol(bt->array[i], binary, text, sizeof(text)))
+			continue;
+		char *cur = text;
 		char buffer[128];
-
-		while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+		while (next_line(&cur, buffer, sizeof(buffer))) {
 			int len = strlen(buffer);
 			len_sum += len;
 			if (len_sum >= MAX_BACKTRACE_LEN) break;
@@ -170,7 +339,6 @@ char *backtrace_to_string(Backtrace *bt, char *binary) {
 				cstring_cat_n(ret, buffer, cstring_len(buffer));
 			}
 		}
-		pclose(fp);
 #else
 		printf("WARN: Unsupported OS: cannot build backtraces!\n");
 #endif
@@ -10,59 +10,162 @@ typedef struct Message {
 	unsigned char buffer[];
 } Message;
 
+// Channel with lock-free producers. channel_send pushes onto 'inbox' with
+// a CAS loop and never takes the mutex unless a consumer is parked.
+// Consumers drain the inbox with a single exchange and reverse it into
+// 'head' under the mutex (the Runtime shares one receiver across worker
+// threads, so the consumer side must still be serialized).
+// capacity == 0 means unbounded; bounded channels track 'count' so
+// producers can shed load instead of queueing without limit
 typedef struct Channel {
 	pthread_mutex_t lock;
 	pthread_cond_t cond;
+	Message *inbox;
 	Message *head;
-	Message *tail;
+	unsigned long long waiting;
+	unsigned long long capacity;
+	unsigned long long count;
 } Channel;
 
-_Bool channel_pending(Channel *handle) { return handle->head; }
+_Bool channel_pending(Channel *handle) {
+	return handle->head ||
+	       __atomic_load_n(&handle->inbox, __ATOMIC_ACQUIRE);
+}
 
 int channel_init(Channel *handle) {
 	if (pthread_mutex_init(&handle->lock, NULL)) return -1;
 	if (pthread_cond_init(&handle->cond, NULL)) return -1;
-	handle->head = handle->tail = NULL;
+	handle->inbox = NULL;
+	handle->head = NULL;
+	handle->waiting = 0;
+	handle->capacity = 0;
+	handle->count = 0;
+	return 0;
+}
+
+int channel_init_bounded(Channel *handle, unsigned long long capacity) {
+	if (channel_init(handle)) return -1;
+	handle->capacity = capacity;
+	return 0;
+}
+
+static int channel_push(Channel *handle, Message *msg) {
+	Message *prev = __atomic_load_n(&handle->inbox, __ATOMIC_ACQUIRE);
+	do {
+		msg->next = prev;
+	} while (!__atomic_compare_exchange_n(&handle->inbox, &prev, msg, 0,
+					      __ATOMIC_SEQ_CST,
+					      __ATOMIC_ACQUIRE));
+
+	// seq_cst push/load pairs with the waiting-increment/drain order in
+	// channel_recv: either our push is seen by the drain or the parked
+	// count is seen here.
+	if (__atomic_load_n(&handle->waiting, __ATOMIC_SEQ_CST)) {
+		if (pthread_mutex_lock(&handle->lock)) {
+			perror("pthread_mutex_lock");
+			_exit(-1);
+		}
+		if (pthread_cond_signal(&handle->cond)) {
+			perror("pthread_cond_signal");
+			_exit(-1);
+		}
+		if (pthread_mutex_unlock(&handle->lock)) {
+			perror("pthread_mutex_unlock");
+			_exit(-1);
+		}
+	}
+
 	return 0;
 }
+
 int channel_send(Channel *handle, Message *msg) {
+	if (handle->capacity)
+		__atomic_fetch_add(&handle->count, 1, __ATOMIC_SEQ_CST);
+	return channel_push(handle, msg);
+}
+
+// Non-blocking bounded send: fails instead of queueing when the channel
+// already holds 'capacity' undelivered messages. On failure the caller
+// keeps ownership of msg. Unbounded channels always have room.
+int channel_try_send(Channel *handle, Message *msg) {
+	if (handle->capacity) {
+		unsigned long long count = __atomic_fetch_add(
+		    &handle->count, 1, __ATOMIC_SEQ_CST);
+		if (count >= handle->capacity) {
+			__atomic_fetch_sub(&handle->count, 1,
+					   __ATOMIC_SEQ_CST);
+			return -1;
+		}
+	}
+	return channel_push(handle, msg);
+}
+
+// Drain the inbox (which is in LIFO order) and reverse it into head so
+// messages are delivered in send order. Caller must hold the mutex.
+static void channel_drain(Channel *handle) {
+	Message *list = __atomic_exchange_n(&handle->inbox, NULL,
+					    __ATOMIC_SEQ_CST);
+	while (list) {
+		Message *next = list->next;
+		list->next = handle->head;
+		handle->head = list;
+		list = next;
+	}
+}
+
+Message *channel_recv(Channel *handle) {
 	if (pthread_mutex_lock(&handle->lock)) {
 		perror("pthread_mutex_lock");
-		_exit(-1);
+		_exit(1);
 	}
 
-	msg->next = NULL;
-	if (handle->tail)
-		handle->tail->next = msg;
-	else
-		handle->head = msg;
-	handle->tail = msg;
-
-	if (pthread_cond_signal(&handle->cond)) {
-		perror("pthread_cond_signal");
-		_exit(-1);
+	while (1) {
+		if (!handle->head) {
+			__atomic_fetch_add(&handle->waiting, 1,
+					   __ATOMIC_SEQ_CST);
+			channel_drain(handle);
+			if (handle->head) {
+				__atomic_fetch_sub(&handle->waiting, 1,
+						   __ATOMIC_SEQ_CST);
+				break;
+			}
+			pthread_cond_wait(&handle->cond, &handle->lock);
+			__atomic_fetch_sub(&handle->waiting, 1,
+					   __ATOMIC_SEQ_CST);
+		} else
+			break;
 	}
 
+	Message *ret = handle->head;
+	handle->head = ret->next;
+	if (handle->capacity)
+		__atomic_fetch_sub(&handle->count, 1, __ATOMIC_SEQ_CST);
+
 	if (pthread_mutex_unlock(&handle->lock)) {
-		perror("pthread_mutex_unlock");
-		_exit(-1);
+		perror("pthread_mutex_lock");
+		_exit(1);
 	}
 
-	return 0;
+	return ret;
 }
-Message *channel_recv(Channel *handle) {
+
+// Non-blocking variant of channel_recv: returns NULL instead of parking
+// when the channel is empty. Used by work-stealing consumers.
+Message *channel_try_recv(Channel *handle) {
 	if (pthread_mutex_lock(&handle->lock)) {
 		perror("pthread_mutex_lock");
 		_exit(1);
 	}
 
-	while (!handle->head) {
-		pthread_cond_wait(&handle->cond, &handle->lock);
-	}
+	if (!handle->head) channel_drain(handle);
 
 	Message *ret = handle->head;
-	handle->head = handle->head->next;
-	if (!handle->head) handle->tail = NULL;
+	if (ret) {
+		handle->head = ret->next;
+		if (handle->capacity)
+			__atomic_fetch_sub(&handle->count, 1,
+					   __ATOMIC_SEQ_CST);
+	}
 
 	if (pthread_mutex_unlock(&handle->lock)) {
 		perror("pthread_mutex_lock");
@@ -71,7 +174,9 @@ Message *channel_recv(Channel *handle) {
 
 	return ret;
 }
+
 unsigned long long channel_handle_size() { return sizeof(Channel); }
+
 int channel_destroy(Channel *handle) {
 	if (pthread_mutex_destroy(&handle->lock)) {
 		perror("pthread_mutex_destroy");
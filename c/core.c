@@ -1,5 +1,7 @@
 #include <time.h>
 
+#include "cpu.h"
+
 int printf(const char *, ...);
 void *malloc(unsigned long);
 void *realloc(void *ptr, unsigned long);
@@ -8,12 +10,125 @@ int getentropy(void *buf, unsigned long long length);
 long long __alloc_count = 0;
 void _exit(int);
 
+// Opt-in transparent hugepage advice for large allocations. When a
+// threshold is set, alloc and resize ask the kernel to back any block at
+// least that large with hugepages (MADV_HUGEPAGE), cutting TLB misses on
+// big Vec and Hashtable arrays. Off by default and a no-op on platforms
+// without THP.
+#ifdef __linux__
+#define MADV_HUGEPAGE 14
+#define PAGE_SIZE 4096UL
+
+int madvise(void *, unsigned long, int);
+#endif	// __linux__
+
+static unsigned long long __hugepage_threshold = 0;
+
+void set_hugepage_threshold(unsigned long long threshold) {
+	__atomic_store_n(&__hugepage_threshold, threshold, __ATOMIC_RELAXED);
+}
+
+static void hugepage_advise(void *ptr, unsigned long long size) {
+#ifdef __linux__
+	unsigned long long threshold =
+	    __atomic_load_n(&__hugepage_threshold, __ATOMIC_RELAXED);
+	unsigned long long start, end;
+	if (!threshold || !ptr || size < threshold) return;
+	// madvise wants page granularity; advise the whole pages inside
+	// the block and ignore failure (older kernels, THP disabled)
+	start = ((unsigned long long)ptr + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	end = ((unsigned long long)ptr + size) & ~(PAGE_SIZE - 1);
+	if (end <= start) return;
+	madvise((void *)start, end - start, MADV_HUGEPAGE);
+#else
+	(void)ptr;
+	(void)size;
+#endif	// __linux__
+}
+
+// Production-safe allocator and fd telemetry. The TEST counters above
+// are single seq_cst cells -- too hot to leave enabled outside tests --
+// so these shard by thread over a small array of cacheline-sized cells
+// (relaxed adds, a thread keeps hitting its own line) and are summed on
+// read. Always on. Totals are cumulative: live allocations are
+// allocs - frees; bytes counts what was requested from the allocator
+// (plain release does not know its size, so there is no freed-bytes
+// total).
+#define STAT_SHARDS 64
+
+typedef struct StatShard {
+	unsigned long long allocs;
+	unsigned long long frees;
+	unsigned long long bytes;
+	unsigned long long fds_opened;
+	unsigned long long fds_closed;
+	unsigned long long pad[3];
+} StatShard;
+
+static StatShard __stat_shards[STAT_SHARDS];
+static __thread unsigned int __stat_slot = 0;
+static unsigned int __stat_next = 0;
+
+static StatShard *stat_shard(void) {
+	if (!__stat_slot)
+		__stat_slot =
+		    1 + __atomic_fetch_add(&__stat_next, 1, __ATOMIC_RELAXED);
+	return &__stat_shards[(__stat_slot - 1) & (STAT_SHARDS - 1)];
+}
+
+static void stat_alloc(unsigned long long size) {
+	StatShard *s = stat_shard();
+	__atomic_fetch_add(&s->allocs, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->bytes, size, __ATOMIC_RELAXED);
+}
+
+static void stat_free(void) {
+	__atomic_fetch_add(&stat_shard()->frees, 1, __ATOMIC_RELAXED);
+}
+
+// hooks for net.c, which tracks fd lifecycle at its accept/connect
+// and close sites
+void stat_fd_opened(unsigned long long n) {
+	__atomic_fetch_add(&stat_shard()->fds_opened, n, __ATOMIC_RELAXED);
+}
+
+void stat_fd_closed(unsigned long long n) {
+	__atomic_fetch_add(&stat_shard()->fds_closed, n, __ATOMIC_RELAXED);
+}
+
+void memstats(unsigned long long *allocs, unsigned long long *frees,
+	      unsigned long long *bytes) {
+	int i;
+	*allocs = *frees = *bytes = 0;
+	for (i = 0; i < STAT_SHARDS; i++) {
+		*allocs += __atomic_load_n(&__stat_shards[i].allocs,
+					   __ATOMIC_RELAXED);
+		*frees += __atomic_load_n(&__stat_shards[i].frees,
+					  __ATOMIC_RELAXED);
+		*bytes += __atomic_load_n(&__stat_shards[i].bytes,
+					  __ATOMIC_RELAXED);
+	}
+}
+
+void fdstats(unsigned long long *opened, unsigned long long *closed) {
+	int i;
+	*opened = *closed = 0;
+	for (i = 0; i < STAT_SHARDS; i++) {
+		*opened += __atomic_load_n(&__stat_shards[i].fds_opened,
+					   __ATOMIC_RELAXED);
+		*closed += __atomic_load_n(&__stat_shards[i].fds_closed,
+					   __ATOMIC_RELAXED);
+	}
+}
+
 void *alloc(unsigned long size) {
 	void *ptr = malloc(size);
 	// printf("malloc %p (%lu) (alloc=%lli)\n", ptr, size, __alloc_count);
 #ifdef TEST
 	__atomic_fetch_add(&__alloc_count, 1, __ATOMIC_SEQ_CST);
 #endif	// TEST
+	stat_alloc(size);
+	hugepage_advise(ptr, size);
 	return ptr;
 }
 
@@ -22,12 +137,345 @@ void release(void *ptr) {
 #ifdef TEST
 	__atomic_fetch_sub(&__alloc_count, 1, __ATOMIC_SEQ_CST);
 #endif	// TEST
+	stat_free();
 	free(ptr);
 }
 
+// Per-thread slab cache for the small fixed-size objects that churn on
+// the accept path (Box<Connection>, Rc<ConnectionInner>, channel
+// messages). Chunks are rounded up to a power-of-two class so a cached
+// chunk always satisfies any request mapped to its class. Large
+// requests fall through to alloc/free.
+#define SLAB_CLASSES 6
+#define SLAB_MIN_SHIFT 5 /* 32 bytes */
+#define SLAB_MAX_DEPTH 64
+
+typedef struct SlabChunk {
+	struct SlabChunk *next;
+} SlabChunk;
+
+static __thread SlabChunk *__slab_head[SLAB_CLASSES];
+static __thread int __slab_depth[SLAB_CLASSES];
+
+// pool observability, summed across threads: allocations served from a
+// cache (hits) vs falling through to malloc (misses), and frees that
+// refilled a cache (recycled). Relaxed adds keep the hot path at one
+// uncontended instruction
+static unsigned long long __slab_hits = 0;
+static unsigned long long __slab_misses = 0;
+static unsigned long long __slab_recycled = 0;
+
+void slab_stats(unsigned long long *hits, unsigned long long *misses,
+		unsigned long long *recycled) {
+	*hits = __atomic_load_n(&__slab_hits, __ATOMIC_RELAXED);
+	*misses = __atomic_load_n(&__slab_misses, __ATOMIC_RELAXED);
+	*recycled = __atomic_load_n(&__slab_recycled, __ATOMIC_RELAXED);
+}
+
+static int slab_class(unsigned long size) {
+	unsigned long csize = 1UL << SLAB_MIN_SHIFT;
+	int i;
+	for (i = 0; i < SLAB_CLASSES; i++) {
+		if (size <= csize) return i;
+		csize <<= 1;
+	}
+	return -1;
+}
+
+void *alloc_slab(unsigned long size) {
+	int class = slab_class(size);
+	if (class < 0) return alloc(size);
+#ifdef TEST
+	__atomic_fetch_add(&__alloc_count, 1, __ATOMIC_SEQ_CST);
+#endif	// TEST
+	stat_alloc(1UL << (SLAB_MIN_SHIFT + class));
+	SlabChunk *head = __slab_head[class];
+	if (head) {
+		__slab_head[class] = head->next;
+		__slab_depth[class]--;
+		__atomic_fetch_add(&__slab_hits, 1, __ATOMIC_RELAXED);
+		return head;
+	}
+	__atomic_fetch_add(&__slab_misses, 1, __ATOMIC_RELAXED);
+	return malloc(1UL << (SLAB_MIN_SHIFT + class));
+}
+
+void release_sized(void *ptr, unsigned long size) {
+	int class = slab_class(size);
+	if (class < 0) {
+		release(ptr);
+		return;
+	}
+#ifdef TEST
+	__atomic_fetch_sub(&__alloc_count, 1, __ATOMIC_SEQ_CST);
+#endif	// TEST
+	stat_free();
+	if (__slab_depth[class] >= SLAB_MAX_DEPTH) {
+		free(ptr);
+		return;
+	}
+	SlabChunk *chunk = ptr;
+	chunk->next = __slab_head[class];
+	__slab_head[class] = chunk;
+	__slab_depth[class]++;
+	__atomic_fetch_add(&__slab_recycled, 1, __ATOMIC_RELAXED);
+}
+
+// Hands every chunk cached by the calling thread back to the
+// allocator. Called when a thread that used the slab exits (its
+// __thread lists would otherwise be unreachable) and available to
+// long-lived threads that want to shed cache after a burst.
+void slab_flush() {
+	int class;
+	for (class = 0; class < SLAB_CLASSES; class++) {
+		SlabChunk *head = __slab_head[class];
+		while (head) {
+			SlabChunk *next = head->next;
+			free(head);
+			head = next;
+		}
+		__slab_head[class] = 0;
+		__slab_depth[class] = 0;
+	}
+}
+
+// Bump arena for request-scoped scratch. arena_alloc hands out 16 byte
+// aligned slices of a single block and arena_reset makes the whole
+// block reusable without returning to the allocator, so per-message
+// scratch costs no malloc/free pairs. Only the arena itself appears in
+// the TEST allocation count.
+typedef struct Arena {
+	unsigned long long capacity;
+	unsigned long long offset;
+	unsigned char data[];
+} Arena;
+
+Arena *arena_create(unsigned long long capacity) {
+	Arena *a = malloc(sizeof(Arena) + capacity);
+	if (!a) return 0;
+#ifdef TEST
+	__atomic_fetch_add(&__alloc_count, 1, __ATOMIC_SEQ_CST);
+#endif	// TEST
+	stat_alloc(sizeof(Arena) + capacity);
+	a->capacity = capacity;
+	a->offset = 0;
+	return a;
+}
+
+void *arena_alloc(Arena *a, unsigned long long size) {
+	void *ret;
+	size = (size + 15) & ~15ULL;
+	if (a->offset + size > a->capacity) return 0;
+	ret = a->data + a->offset;
+	a->offset += size;
+	return ret;
+}
+
+void arena_reset(Arena *a) { a->offset = 0; }
+
+void arena_destroy(Arena *a) {
+#ifdef TEST
+	__atomic_fetch_sub(&__alloc_count, 1, __ATOMIC_SEQ_CST);
+#endif	// TEST
+	stat_free();
+	free(a);
+}
+
+// Doubly-mapped ring buffer: the same physical pages are mapped twice
+// back to back, so any window of up to capacity bytes is contiguous in
+// virtual memory no matter where it starts. Readers and writers never
+// split a slice at the wrap point. Capacity must be a page multiple;
+// ringbuf_round rounds a request up to one.
+#define RB_PROT_NONE 0x0
+#define RB_PROT_READ 0x1
+#define RB_PROT_WRITE 0x2
+#define RB_MAP_SHARED 0x1
+#define RB_MAP_PRIVATE 0x2
+#define RB_MAP_FIXED 0x10
+#define RB_MAP_FAILED ((void *)-1)
+#ifdef __linux__
+#define RB_MAP_ANON 0x20
+int memfd_create(const char *, unsigned int);
+#endif	// __linux__
+#ifdef __APPLE__
+#define RB_MAP_ANON 0x1000
+#define RB_O_RDWR 0x2
+#define RB_O_CREAT 0x200
+#define RB_O_EXCL 0x800
+int shm_open(const char *, int, ...);
+int shm_unlink(const char *);
+int snprintf(char *, unsigned long, const char *, ...);
+int getpid(void);
+#endif	// __APPLE__
+int getpagesize(void);
+void *mmap(void *, unsigned long, int, int, int, long);
+int munmap(void *, unsigned long);
+int ftruncate(int, long);
+int close(int);
+
+unsigned long long ringbuf_round(unsigned long long size) {
+	unsigned long long page = (unsigned long long)getpagesize();
+	if (!size) size = 1;
+	return (size + page - 1) & ~(page - 1);
+}
+
+void *ringbuf_create(unsigned long long capacity) {
+	unsigned char *base;
+	int fd;
+	if (!capacity || capacity != ringbuf_round(capacity)) return 0;
+#ifdef __linux__
+	fd = memfd_create("ringbuf", 0);
+#endif	// __linux__
+#ifdef __APPLE__
+	char name[64];
+	snprintf(name, sizeof(name), "/fam_rb_%d_%p", getpid(), (void *)&fd);
+	fd = shm_open(name, RB_O_RDWR | RB_O_CREAT | RB_O_EXCL, 0600);
+	if (fd >= 0) shm_unlink(name);
+#endif	// __APPLE__
+	if (fd < 0) return 0;
+	if (ftruncate(fd, (long)capacity) < 0) {
+		close(fd);
+		return 0;
+	}
+	// reserve twice the capacity, then map the same pages into both
+	// halves of the reservation
+	base = mmap(0, capacity * 2, RB_PROT_NONE, RB_MAP_PRIVATE | RB_MAP_ANON,
+		    -1, 0);
+	if (base == RB_MAP_FAILED) {
+		close(fd);
+		return 0;
+	}
+	if (mmap(base, capacity, RB_PROT_READ | RB_PROT_WRITE,
+		 RB_MAP_SHARED | RB_MAP_FIXED, fd, 0) == RB_MAP_FAILED ||
+	    mmap(base + capacity, capacity, RB_PROT_READ | RB_PROT_WRITE,
+		 RB_MAP_SHARED | RB_MAP_FIXED, fd, 0) == RB_MAP_FAILED) {
+		munmap(base, capacity * 2);
+		close(fd);
+		return 0;
+	}
+	close(fd);
+#ifdef TEST
+	__atomic_fetch_add(&__alloc_count, 1, __ATOMIC_SEQ_CST);
+#endif	// TEST
+	stat_alloc(capacity);
+	return base;
+}
+
+void ringbuf_destroy(void *base, unsigned long long capacity) {
+	if (!base) return;
+	munmap(base, capacity * 2);
+#ifdef TEST
+	__atomic_fetch_sub(&__alloc_count, 1, __ATOMIC_SEQ_CST);
+#endif	// TEST
+	stat_free();
+}
+
+// File-backed cache for large precomputed blobs (the secp256k1 verify
+// context tables). The blob contains internal pointers, so it is only
+// valid at the virtual address it was built at: the header records
+// that base and ctx_cache_load maps the file back there copy-on-write
+// (MAP_PRIVATE), so the table pages are shared page-cache pages across
+// every process of the fleet and cold start is page-fault time. If the
+// address range is taken or the header does not match, load returns 0
+// and the caller rebuilds (and typically resaves).
+#define CTX_CACHE_MAGIC 0x30637874636d6166ULL /* "famctxc0" */
+#ifdef __linux__
+#define CC_O_RDONLY 0x0
+#define CC_O_WRONLY 0x1
+#define CC_O_CREAT 0x40
+#define CC_O_TRUNC 0x200
+#define CC_MAP_NOREPLACE 0x100000
+#endif	// __linux__
+#ifdef __APPLE__
+#define CC_O_RDONLY 0x0
+#define CC_O_WRONLY 0x1
+#define CC_O_CREAT 0x200
+#define CC_O_TRUNC 0x400
+#define CC_MAP_NOREPLACE 0x0 /* emulated by checking the result */
+#endif	// __APPLE__
+
+int open(const char *, int, ...);
+long read(int, void *, unsigned long);
+long write(int, const void *, unsigned long);
+
+typedef struct CtxCacheHdr {
+	unsigned long long magic;
+	unsigned long long len;
+	unsigned long long base;
+} CtxCacheHdr;
+
+// reserve page-aligned anonymous memory for the blob to be built in;
+// released with ctx_cache_release
+void *ctx_cache_reserve(unsigned long long len) {
+	void *p = mmap(0, len, RB_PROT_READ | RB_PROT_WRITE,
+		       RB_MAP_PRIVATE | RB_MAP_ANON, -1, 0);
+	if (p == RB_MAP_FAILED) return 0;
+	return p;
+}
+
+void ctx_cache_release(void *base, unsigned long long len) {
+	if (!base) return;
+	munmap(base, len);
+}
+
+// write header page + blob; the blob starts at a page boundary so the
+// loader can mmap it at a file offset
+int ctx_cache_save(const char *path, const void *base,
+		   unsigned long long len) {
+	unsigned char page[4096] = {0};
+	CtxCacheHdr *hdr = (CtxCacheHdr *)page;
+	unsigned long long off = 0;
+	int fd = open(path, CC_O_WRONLY | CC_O_CREAT | CC_O_TRUNC, 0644);
+	if (fd < 0) return -1;
+	hdr->magic = CTX_CACHE_MAGIC;
+	hdr->len = len;
+	hdr->base = (unsigned long long)base;
+	if (write(fd, page, sizeof(page)) != sizeof(page)) {
+		close(fd);
+		return -1;
+	}
+	while (off < len) {
+		long n = write(fd, (const unsigned char *)base + off,
+			       len - off);
+		if (n <= 0) {
+			close(fd);
+			return -1;
+		}
+		off += n;
+	}
+	close(fd);
+	return 0;
+}
+
+void *ctx_cache_load(const char *path, unsigned long long expect_len) {
+	CtxCacheHdr hdr;
+	void *base;
+	int fd = open(path, CC_O_RDONLY);
+	if (fd < 0) return 0;
+	if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    hdr.magic != CTX_CACHE_MAGIC || hdr.len != expect_len ||
+	    !hdr.base) {
+		close(fd);
+		return 0;
+	}
+	base = mmap((void *)hdr.base, hdr.len,
+		    RB_PROT_READ | RB_PROT_WRITE,
+		    RB_MAP_PRIVATE | CC_MAP_NOREPLACE, fd, 4096);
+	close(fd);
+	if (base == RB_MAP_FAILED) return 0;
+	if (base != (void *)hdr.base) {
+		// platforms without MAP_FIXED_NOREPLACE treat the address
+		// as a hint; anywhere else the internal pointers are junk
+		munmap(base, hdr.len);
+		return 0;
+	}
+	return base;
+}
+
 void *resize(void *ptr, unsigned long long len) {
 	void *ret = realloc(ptr, len);
 	// printf("realloc size=%llu [%p -> %p]\n", len, ptr, ret);
+	hugepage_advise(ret, len);
 	return ret;
 }
 
@@ -38,6 +486,22 @@ unsigned long long getmicros() {
 	       (unsigned long long)(now.tv_nsec / 1000);
 }
 
+// coarse monotonic clock for connection bookkeeping: on Linux
+// CLOCK_MONOTONIC_COARSE is a vvar read with tick resolution (~1-4ms),
+// which is plenty for idle timeouts and costs a fraction of the
+// precise vDSO call. Monotonic also means an NTP step can never make a
+// fresh connection look stale the way CLOCK_REALTIME can
+unsigned long long getmicros_coarse() {
+	struct timespec now;
+#ifdef CLOCK_MONOTONIC_COARSE
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+	return (unsigned long long)((__int128_t)now.tv_sec * 1000000) +
+	       (unsigned long long)(now.tv_nsec / 1000);
+}
+
 int sleep_millis(unsigned long long millis) {
 	struct timespec ts;
 	ts.tv_sec = millis / 1000;
@@ -50,5 +514,50 @@ int rand_bytes(unsigned char *buf, unsigned long long length) {
 	return getentropy(buf, length);
 }
 
+// CPU feature detection, probed once and cached. The probe itself is
+// idempotent so a racing first call from two threads just computes the
+// same mask twice; the published value always has the init bit set so
+// a zero-feature machine is still cached.
+#define CPU_FEAT_INIT (1UL << 63)
+
+static unsigned long cpu_probe(void) {
+	unsigned long feats = CPU_FEAT_INIT;
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (__builtin_cpu_supports("ssse3")) feats |= CPU_FEAT_SIMD128;
+	if (__builtin_cpu_supports("aes") && __builtin_cpu_supports("sse2"))
+		feats |= CPU_FEAT_AES;
+	if (__builtin_cpu_supports("avx2")) feats |= CPU_FEAT_AVX2;
+	if (__builtin_cpu_supports("pclmul")) feats |= CPU_FEAT_CLMUL;
+	if (__builtin_cpu_supports("sha")) feats |= CPU_FEAT_SHA2;
+#elif defined(__aarch64__)
+	// advanced simd is architectural on aarch64
+	feats |= CPU_FEAT_SIMD128;
+#if defined(__APPLE__)
+	// all Apple aarch64 cores have the crypto extensions
+	feats |= CPU_FEAT_AES | CPU_FEAT_CLMUL | CPU_FEAT_SHA2;
+#else
+	{
+		unsigned long getauxval(unsigned long);
+		// AT_HWCAP = 16; bits: AES 1<<3, PMULL 1<<4, SHA2 1<<6
+		unsigned long hwcap = getauxval(16);
+		if (hwcap & (1UL << 3)) feats |= CPU_FEAT_AES;
+		if (hwcap & (1UL << 4)) feats |= CPU_FEAT_CLMUL;
+		if (hwcap & (1UL << 6)) feats |= CPU_FEAT_SHA2;
+	}
+#endif	// __APPLE__
+#endif	// __x86_64__ / __aarch64__
+	return feats;
+}
+
+unsigned long cpu_features(void) {
+	static unsigned long __cpu_feats = 0;
+	unsigned long feats = __atomic_load_n(&__cpu_feats, __ATOMIC_RELAXED);
+	if (!feats) {
+		feats = cpu_probe();
+		__atomic_store_n(&__cpu_feats, feats, __ATOMIC_RELAXED);
+	}
+	return feats & ~CPU_FEAT_INIT;
+}
+
 long long getalloccount() { return __alloc_count; }
 
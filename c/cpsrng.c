@@ -21,6 +21,7 @@ int printf(const char *, ...);
 int rand_bytes(unsigned char *buf, unsigned long long length);
 void *alloc(unsigned long size);
 void release(void *);
+int pthread_atfork(void (*)(void), void (*)(void), void (*)(void));
 
 CsprngCtx *cpsrng_context_create() {
 	CsprngCtx *ret = alloc(sizeof(CsprngCtx));
@@ -62,9 +63,73 @@ void cpsrng_reseed() {
 	AES_init_ctx_iv(&aes_ctx, key, iv);
 }
 
+// per-thread buffered keystream: one AES pass refills a 4KB block and
+// small draws are handed out as slices of it, so the common case is a
+// copy with no AES call. Each thread seeds its own key/iv lazily so no
+// locking is needed and threads never share a counter.
+#define KEYSTREAM_SIZE 4096
+
+// bumped in the child after fork so every thread-local buffer reseeds
+// instead of replaying keystream the parent may also hand out
+static int fork_generation = 0;
+
+static __thread struct {
+	struct AES_ctx ctx;
+	byte buf[KEYSTREAM_SIZE];
+	unsigned int pos;
+	unsigned int init;
+	int generation;
+} tl_state;
+
+static void __cpsrng_atfork_child() { fork_generation++; }
+
+static void tl_reseed() {
+	byte iv[16];
+	byte key[32];
+	if (rand_bytes(key, 32) || rand_bytes(iv, 16)) {
+		printf("Could not generate entropy for AES key generation\n");
+		_exit(-1);
+	}
+	AES_init_ctx_iv(&tl_state.ctx, key, iv);
+	tl_state.pos = KEYSTREAM_SIZE;
+	tl_state.init = 1;
+	tl_state.generation = fork_generation;
+}
+
+static void tl_refill() {
+	unsigned int i;
+	// AES-CTR over zeroes yields raw keystream
+	for (i = 0; i < KEYSTREAM_SIZE; i++) tl_state.buf[i] = 0;
+	AES_CTR_xcrypt_buffer(&tl_state.ctx, tl_state.buf, KEYSTREAM_SIZE);
+	tl_state.pos = 0;
+}
+
+void cpsrng_rand_bytes_tl(void *v, unsigned long long size) {
+	byte *out = (byte *)v;
+	if (!tl_state.init || tl_state.generation != fork_generation) tl_reseed();
+	// large draws skip the buffer: one AES pass directly into the output
+	if (size >= KEYSTREAM_SIZE) {
+		AES_CTR_xcrypt_buffer(&tl_state.ctx, out, size);
+		return;
+	}
+	while (size) {
+		unsigned long long avail, i;
+		if (tl_state.pos == KEYSTREAM_SIZE) tl_refill();
+		avail = KEYSTREAM_SIZE - tl_state.pos;
+		if (avail > size) avail = size;
+		for (i = 0; i < avail; i++) out[i] = tl_state.buf[tl_state.pos + i];
+		tl_state.pos += avail;
+		out += avail;
+		size -= avail;
+	}
+}
+
 // __attribute__ ((constructor)) guaranteed to be called before main.
 // This will either succeed or exit before main is called.
-void __attribute__((constructor)) __init_cpsrng() { cpsrng_reseed(); }
+void __attribute__((constructor)) __init_cpsrng() {
+	cpsrng_reseed();
+	pthread_atfork(0, 0, __cpsrng_atfork_child);
+}
 
 // note: not thread safe as user must ensure thread safety. This allows for
 // flexible usage in a single thread, no locking is needed. In multi-threaded
@@ -27,6 +27,7 @@ void cpsrng_rand_byte(byte *v);
 void cpsrng_rand_i64(int64 *v);
 void cpsrng_rand_int(int *v);
 void cpsrng_rand_bytes(void *v, unsigned long long size);
+void cpsrng_rand_bytes_tl(void *v, unsigned long long size);
 
 CsprngCtx *cpsrng_context_create();
 void cpsrng_context_destroy(CsprngCtx *);
@@ -0,0 +1,33 @@
+#ifndef _CPU_H__
+#define _CPU_H__
+
+// Unified CPU feature bits, mapped onto whatever the architecture
+// calls them so accelerated kernels test one mask instead of each
+// reinventing CPUID/HWCAP probing. SIMD128 means the baseline 16-byte
+// shuffle set (SSSE3 on x86-64, NEON on aarch64).
+#define CPU_FEAT_SIMD128 (1UL << 0)
+#define CPU_FEAT_AES (1UL << 1)
+#define CPU_FEAT_AVX2 (1UL << 2)
+#define CPU_FEAT_CLMUL (1UL << 3)
+#define CPU_FEAT_SHA2 (1UL << 4)
+
+// detected once on first call and cached; always safe to call, returns
+// 0 for every bit on architectures without a probe
+unsigned long cpu_features(void);
+
+#define CPU_HAS(feat) ((cpu_features() & (feat)) != 0)
+
+// Dispatch pattern for accelerated kernels: keep a static function
+// pointer initialized to a resolver with the same signature; the
+// resolver picks the implementation off cpu_features(), patches the
+// pointer and forwards the first call. Every later call is one
+// indirect jump with no per-call feature branch:
+//
+//	static void kernel_resolve(args);
+//	static void (*kernel)(args) = kernel_resolve;
+//	static void kernel_resolve(args) {
+//		kernel = CPU_HAS(CPU_FEAT_X) ? kernel_hw : kernel_sw;
+//		kernel(args);
+//	}
+
+#endif	// _CPU_H__
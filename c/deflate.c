@@ -0,0 +1,461 @@
+// Copyright (c) 2024, The MyFamily Developers
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Raw DEFLATE (RFC 1951) codec for permessage-deflate (RFC 7692).
+// The compressor emits fixed-Huffman blocks with a greedy, head-only
+// LZ77 matcher; the decompressor handles stored, fixed and dynamic
+// blocks so foreign peers interoperate. Both sides keep a 32K window
+// across messages (context takeover), optionally primed with a shared
+// dictionary, so repeated payload shapes compress against earlier
+// traffic. Every message ends on the RFC 7692 sync flush: the trailing
+// 00 00 ff ff is never emitted by deflate_message and is supplied as a
+// virtual tail by inflate_message.
+
+#include "types.h"
+#include "util.h"
+
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_HASH_BITS 12
+#define DEFLATE_HASH_SIZE (1 << DEFLATE_HASH_BITS)
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+
+// context layouts are mirrored by DEFLATE_CTX_LEN / INFLATE_CTX_LEN in
+// rust/net/ws.rs, which allocates them as raw byte buffers
+typedef struct {
+	// history (up to 32K) followed by the chunk being compressed
+	unsigned char win[2 * DEFLATE_WINDOW];
+	unsigned int have;
+	// most recent window position per 3-byte hash, -1 when empty
+	int head[DEFLATE_HASH_SIZE];
+	unsigned int _pad;
+} DeflateCtx;
+
+typedef struct {
+	unsigned char win[DEFLATE_WINDOW];
+	unsigned int have;
+	unsigned int _pad;
+} InflateCtx;
+
+_Static_assert(sizeof(DeflateCtx) == 81928,
+	       "DeflateCtx size is mirrored in ws.rs");
+_Static_assert(sizeof(InflateCtx) == 32776,
+	       "InflateCtx size is mirrored in ws.rs");
+
+// RFC 1951 length/distance code tables, shared by both directions
+static const unsigned short len_base[29] = {
+    3,	4,  5,	6,  7,	8,  9,	10, 11,	 13,  15,  17,	19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned char len_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+					    1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+					    4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const unsigned short dist_base[30] = {
+    1,	  2,   3,   4,	 5,   7,    9,	  13,	17,   25,
+    33,	  49,  65,  97,	 129, 193,  257,  385,	513,  769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const unsigned char dist_extra[30] = {0, 0, 0,  0,  1,  1,  2,  2,
+					     3, 3, 4,  4,  5,  5,  6,  6,
+					     7, 7, 8,  8,  9,  9,  10, 10,
+					     11, 11, 12, 12, 13, 13};
+
+// ===== bit writer (compressor) =====
+
+typedef struct {
+	unsigned char *out;
+	unsigned long long cap;
+	unsigned long long len;
+	unsigned int bitbuf;
+	int bitcnt;
+	int overflow;
+} BitWriter;
+
+static void bw_put(BitWriter *w, unsigned int bits, int n) {
+	w->bitbuf |= bits << w->bitcnt;
+	w->bitcnt += n;
+	while (w->bitcnt >= 8) {
+		if (w->len < w->cap)
+			w->out[w->len++] = (unsigned char)w->bitbuf;
+		else
+			w->overflow = 1;
+		w->bitbuf >>= 8;
+		w->bitcnt -= 8;
+	}
+}
+
+// Huffman codes go out most significant bit first while the writer is
+// least significant first, so codes are bit-reversed once on emit
+static unsigned int bit_reverse(unsigned int v, int n) {
+	unsigned int r = 0;
+	while (n--) {
+		r = (r << 1) | (v & 1);
+		v >>= 1;
+	}
+	return r;
+}
+
+// fixed-Huffman literal/length symbol (RFC 1951 3.2.6)
+static void put_sym(BitWriter *w, unsigned int sym) {
+	if (sym < 144)
+		bw_put(w, bit_reverse(0x30 + sym, 8), 8);
+	else if (sym < 256)
+		bw_put(w, bit_reverse(0x190 + (sym - 144), 9), 9);
+	else if (sym < 280)
+		bw_put(w, bit_reverse(sym - 256, 7), 7);
+	else
+		bw_put(w, bit_reverse(0xC0 + (sym - 280), 8), 8);
+}
+
+static void put_match(BitWriter *w, int len, unsigned int dist) {
+	int c = 28;
+	while (len_base[c] > len) c--;
+	put_sym(w, 257 + c);
+	bw_put(w, (unsigned int)(len - len_base[c]), len_extra[c]);
+	c = 29;
+	while (dist_base[c] > dist) c--;
+	bw_put(w, bit_reverse((unsigned int)c, 5), 5);
+	bw_put(w, dist - dist_base[c], dist_extra[c]);
+}
+
+// ===== compressor =====
+
+static unsigned int dhash(const unsigned char *p) {
+	unsigned int v =
+	    ((unsigned int)p[0] << 16) | ((unsigned int)p[1] << 8) | p[2];
+	return (v * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+static void deflate_insert(DeflateCtx *c, unsigned int from,
+			   unsigned int to) {
+	for (unsigned int i = from; i < to; i++)
+		c->head[dhash(c->win + i)] = (int)i;
+}
+
+// drop the oldest history so the newest DEFLATE_WINDOW bytes remain;
+// hash heads shift with it and entries that fall off go empty
+static void deflate_slide(DeflateCtx *c) {
+	unsigned int s = c->have - DEFLATE_WINDOW;
+	copy_bytes(c->win, c->win + s, DEFLATE_WINDOW);
+	c->have = DEFLATE_WINDOW;
+	for (int i = 0; i < DEFLATE_HASH_SIZE; i++)
+		c->head[i] = c->head[i] >= (int)s ? c->head[i] - (int)s : -1;
+}
+
+void deflate_reset(DeflateCtx *c, const unsigned char *dict,
+		   unsigned long long dict_len) {
+	for (int i = 0; i < DEFLATE_HASH_SIZE; i++) c->head[i] = -1;
+	if (dict_len > DEFLATE_WINDOW) {
+		dict += dict_len - DEFLATE_WINDOW;
+		dict_len = DEFLATE_WINDOW;
+	}
+	copy_bytes(c->win, dict, dict_len);
+	c->have = (unsigned int)dict_len;
+	if (c->have >= DEFLATE_MIN_MATCH)
+		deflate_insert(c, 0, c->have - (DEFLATE_MIN_MATCH - 1));
+}
+
+static int match_len(const unsigned char *a, const unsigned char *b,
+		     unsigned int limit) {
+	unsigned int max =
+	    limit < DEFLATE_MAX_MATCH ? limit : DEFLATE_MAX_MATCH;
+	unsigned int i = 0;
+	while (i < max && a[i] == b[i]) i++;
+	return (int)i;
+}
+
+// compress one complete message as a continuation of the stream:
+// fixed-Huffman blocks with BFINAL clear, closed by the sync flush
+// whose 00 00 ff ff tail RFC 7692 strips. Returns bytes written, or
+// -2 if out_cap is too small (2 * in_len + 16 can never be)
+long long deflate_message(DeflateCtx *c, const unsigned char *in,
+			  unsigned long long in_len, unsigned char *out,
+			  unsigned long long out_cap) {
+	BitWriter w = {out, out_cap, 0, 0, 0, 0};
+	bw_put(&w, 0, 1);
+	bw_put(&w, 1, 2);
+	while (in_len > 0) {
+		unsigned long long n =
+		    in_len < DEFLATE_WINDOW ? in_len : DEFLATE_WINDOW;
+		copy_bytes(c->win + c->have, in, n);
+		unsigned int end = c->have + (unsigned int)n;
+		unsigned int pos = c->have;
+		while (pos < end) {
+			int best = 0;
+			unsigned int dist = 0;
+			if (pos + DEFLATE_MIN_MATCH <= end) {
+				unsigned int h = dhash(c->win + pos);
+				int cand = c->head[h];
+				c->head[h] = (int)pos;
+				if (cand >= 0 &&
+				    pos - (unsigned int)cand <= DEFLATE_WINDOW) {
+					best = match_len(c->win + cand,
+							 c->win + pos,
+							 end - pos);
+					dist = pos - (unsigned int)cand;
+				}
+			}
+			if (best >= DEFLATE_MIN_MATCH) {
+				put_match(&w, best, dist);
+				unsigned int stop =
+				    pos + (unsigned int)best;
+				if (stop + DEFLATE_MIN_MATCH > end)
+					stop = end >= DEFLATE_MIN_MATCH
+						   ? end - DEFLATE_MIN_MATCH
+						   : 0;
+				if (stop > pos + 1)
+					deflate_insert(c, pos + 1, stop);
+				pos += (unsigned int)best;
+			} else {
+				put_sym(&w, c->win[pos]);
+				pos++;
+			}
+		}
+		c->have = end;
+		if (c->have > DEFLATE_WINDOW) deflate_slide(c);
+		in += n;
+		in_len -= n;
+	}
+	// end of block, then the empty stored block header of the sync
+	// flush: pad to the byte boundary and stop before LEN/NLEN
+	put_sym(&w, 256);
+	bw_put(&w, 0, 3);
+	if (w.bitcnt > 0) bw_put(&w, 0, 8 - w.bitcnt);
+	if (w.overflow) return -2;
+	return (long long)w.len;
+}
+
+// ===== bit reader (decompressor) =====
+
+typedef struct {
+	const unsigned char *in;
+	unsigned long long in_len;
+	unsigned long long pos;
+	unsigned int bitbuf;
+	int bitcnt;
+	int error;
+} BitReader;
+
+// the sync flush tail the sender stripped, replayed virtually after
+// the real input
+static const unsigned char inflate_tail[4] = {0x00, 0x00, 0xff, 0xff};
+
+static int br_byte(BitReader *r) {
+	if (r->pos < r->in_len) return r->in[r->pos++];
+	if (r->pos < r->in_len + 4) return inflate_tail[r->pos++ - r->in_len];
+	r->error = 1;
+	return 0;
+}
+
+static unsigned int br_bits(BitReader *r, int n) {
+	while (r->bitcnt < n) {
+		r->bitbuf |= (unsigned int)br_byte(r) << r->bitcnt;
+		r->bitcnt += 8;
+	}
+	unsigned int v = r->bitbuf & ((1u << n) - 1);
+	r->bitbuf >>= n;
+	r->bitcnt -= n;
+	return v;
+}
+
+// ===== canonical Huffman decode (puff-style counts and offsets) =====
+
+typedef struct {
+	unsigned short count[16];
+	unsigned short sym[288];
+} Huff;
+
+static void huff_build(Huff *h, const unsigned char *lens, int n) {
+	unsigned short offs[16];
+	int i;
+	for (i = 0; i < 16; i++) h->count[i] = 0;
+	for (i = 0; i < n; i++) h->count[lens[i]]++;
+	h->count[0] = 0;
+	offs[1] = 0;
+	for (i = 1; i < 15; i++) offs[i + 1] = offs[i] + h->count[i];
+	for (i = 0; i < n; i++)
+		if (lens[i]) h->sym[offs[lens[i]]++] = (unsigned short)i;
+}
+
+static int huff_decode(BitReader *r, const Huff *h) {
+	int code = 0, first = 0, index = 0;
+	for (int len = 1; len <= 15; len++) {
+		code |= (int)br_bits(r, 1);
+		int count = h->count[len];
+		if (code - first < count)
+			return h->sym[index + (code - first)];
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
+	}
+	r->error = 1;
+	return -1;
+}
+
+// ===== decompressor =====
+
+void inflate_reset(InflateCtx *c, const unsigned char *dict,
+		   unsigned long long dict_len) {
+	if (dict_len > DEFLATE_WINDOW) {
+		dict += dict_len - DEFLATE_WINDOW;
+		dict_len = DEFLATE_WINDOW;
+	}
+	copy_bytes(c->win, dict, dict_len);
+	c->have = (unsigned int)dict_len;
+}
+
+// decode literal/length + distance symbols until end of block.
+// Returns 0, -1 on corrupt input, -2 when out_cap is exhausted
+static int inflate_block(BitReader *r, const InflateCtx *c, const Huff *lit,
+			 const Huff *dst, unsigned char *out,
+			 unsigned long long out_cap,
+			 unsigned long long *olen) {
+	for (;;) {
+		int sym = huff_decode(r, lit);
+		if (r->error) return -1;
+		if (sym < 256) {
+			if (*olen >= out_cap) return -2;
+			out[(*olen)++] = (unsigned char)sym;
+		} else if (sym == 256) {
+			return 0;
+		} else {
+			sym -= 257;
+			if (sym >= 29) return -1;
+			unsigned int len =
+			    len_base[sym] + br_bits(r, len_extra[sym]);
+			int d = huff_decode(r, dst);
+			if (r->error || d < 0 || d >= 30) return -1;
+			unsigned long long dv =
+			    dist_base[d] + br_bits(r, dist_extra[d]);
+			if (r->error || dv > *olen + c->have) return -1;
+			if (*olen + len > out_cap) return -2;
+			while (len--) {
+				unsigned char b;
+				if (dv <= *olen)
+					b = out[*olen - dv];
+				else
+					b = c->win[c->have -
+						   (unsigned int)(dv - *olen)];
+				out[(*olen)++] = b;
+			}
+		}
+	}
+}
+
+// keep the most recent DEFLATE_WINDOW bytes of (history || message) as
+// the next message's history
+static void inflate_commit(InflateCtx *c, const unsigned char *out,
+			   unsigned long long olen) {
+	if (olen >= DEFLATE_WINDOW) {
+		copy_bytes(c->win, out + (olen - DEFLATE_WINDOW),
+			   DEFLATE_WINDOW);
+		c->have = DEFLATE_WINDOW;
+	} else {
+		unsigned int keep = c->have;
+		if (keep + (unsigned int)olen > DEFLATE_WINDOW)
+			keep = DEFLATE_WINDOW - (unsigned int)olen;
+		copy_bytes(c->win, c->win + (c->have - keep), keep);
+		copy_bytes(c->win + keep, out, olen);
+		c->have = keep + (unsigned int)olen;
+	}
+}
+
+// decompress one complete message. Returns bytes written; -1 on
+// corrupt input, -2 when out_cap is too small (the context is only
+// committed on success, so the caller may retry with a larger buffer)
+long long inflate_message(InflateCtx *c, const unsigned char *in,
+			  unsigned long long in_len, unsigned char *out,
+			  unsigned long long out_cap) {
+	static const unsigned char clorder[19] = {16, 17, 18, 0, 8,  7, 9,
+						  6,  10, 5,  11, 4, 12, 3,
+						  13, 2,  14, 1,  15};
+	BitReader r = {in, in_len, 0, 0, 0, 0};
+	unsigned long long olen = 0;
+	Huff lit, dst;
+	for (;;) {
+		int bfinal = (int)br_bits(&r, 1);
+		int btype = (int)br_bits(&r, 2);
+		if (r.error) return -1;
+		if (btype == 0) {
+			// stored: drop the partial byte, LEN/NLEN, raw copy
+			br_bits(&r, r.bitcnt & 7);
+			unsigned int len = br_bits(&r, 16);
+			unsigned int nlen = br_bits(&r, 16);
+			if (r.error || len != (~nlen & 0xffff)) return -1;
+			if (olen + len > out_cap) return -2;
+			while (len--) {
+				out[olen++] = (unsigned char)br_bits(&r, 8);
+				if (r.error) return -1;
+			}
+		} else if (btype == 1 || btype == 2) {
+			unsigned char lens[320];
+			int i;
+			if (btype == 1) {
+				for (i = 0; i < 144; i++) lens[i] = 8;
+				for (; i < 256; i++) lens[i] = 9;
+				for (; i < 280; i++) lens[i] = 7;
+				for (; i < 288; i++) lens[i] = 8;
+				huff_build(&lit, lens, 288);
+				for (i = 0; i < 30; i++) lens[i] = 5;
+				huff_build(&dst, lens, 30);
+			} else {
+				Huff cl;
+				unsigned char cl_lens[19];
+				int hlit = (int)br_bits(&r, 5) + 257;
+				int hdist = (int)br_bits(&r, 5) + 1;
+				int hclen = (int)br_bits(&r, 4) + 4;
+				if (r.error || hlit > 286 || hdist > 30)
+					return -1;
+				for (i = 0; i < 19; i++) cl_lens[i] = 0;
+				for (i = 0; i < hclen; i++)
+					cl_lens[clorder[i]] =
+					    (unsigned char)br_bits(&r, 3);
+				huff_build(&cl, cl_lens, 19);
+				i = 0;
+				while (i < hlit + hdist) {
+					int s = huff_decode(&r, &cl);
+					if (r.error || s < 0) return -1;
+					int rep;
+					unsigned char v = 0;
+					if (s < 16) {
+						lens[i++] = (unsigned char)s;
+						continue;
+					} else if (s == 16) {
+						if (i == 0) return -1;
+						v = lens[i - 1];
+						rep = 3 + (int)br_bits(&r, 2);
+					} else if (s == 17) {
+						rep = 3 + (int)br_bits(&r, 3);
+					} else {
+						rep = 11 + (int)br_bits(&r, 7);
+					}
+					if (r.error || i + rep > hlit + hdist)
+						return -1;
+					while (rep--) lens[i++] = v;
+				}
+				huff_build(&lit, lens, hlit);
+				huff_build(&dst, lens + hlit, hdist);
+			}
+			int res = inflate_block(&r, c, &lit, &dst, out,
+						out_cap, &olen);
+			if (res < 0) return res;
+		} else {
+			return -1;
+		}
+		if (bfinal) break;
+		// a sender using the RFC 7692 flush ends exactly after
+		// the virtual tail, byte aligned, without BFINAL
+		if (r.pos >= r.in_len + 4 && r.bitcnt == 0) break;
+	}
+	inflate_commit(c, out, olen);
+	return (long long)olen;
+}
@@ -0,0 +1,60 @@
+// field_5x52 benchmark kernel, __int128 inner multiply. Counterpart of
+// field5x52asm.c: compiles field_5x52_int128_impl.h standalone so the
+// portable inner implementation can be timed against the x86_64 inline
+// assembly one regardless of which of the two configure baked into the
+// library. fieldbench.c dispatches between the pair.
+#include "secp256k1-zkp/include/secp256k1.h"
+
+#if defined(__SIZEOF_INT128__)
+
+#define USE_NUM_NONE 1
+#define USE_FIELD_5X52 1
+#define HAVE___INT128 1
+#include "secp256k1-zkp/src/util.h"
+#include "secp256k1-zkp/src/field_5x52_impl.h"
+
+long long getmicros(void);
+
+int field_int128_available(void) { return 1; }
+
+// op: 0=mul, 1=sqr. Returns elapsed micros and leaves the normalized
+// final element in out32 so the caller can cross-check the two inner
+// implementations against each other.
+long long field_bench_int128(int op, unsigned long long iters,
+			     unsigned char *out32) {
+	static const unsigned char seed[32] = {
+	    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b,
+	    0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+	    0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20};
+	secp256k1_fe a, r;
+	unsigned long long i;
+	long long start, end;
+
+	secp256k1_fe_set_b32(&a, seed);
+	r = a;
+	start = getmicros();
+	for (i = 0; i < iters; i++) {
+		if (op == 0)
+			secp256k1_fe_mul(&r, &r, &a);
+		else
+			secp256k1_fe_sqr(&r, &r);
+	}
+	end = getmicros();
+	secp256k1_fe_normalize(&r);
+	secp256k1_fe_get_b32(out32, &r);
+	return end - start;
+}
+
+#else  /* __SIZEOF_INT128__ */
+
+int field_int128_available(void) { return 0; }
+
+long long field_bench_int128(int op, unsigned long long iters,
+			     unsigned char *out32) {
+	(void)op;
+	(void)iters;
+	(void)out32;
+	return -1;
+}
+
+#endif /* __SIZEOF_INT128__ */
@@ -0,0 +1,33 @@
+// Runtime selection between the field_5x52 inner-multiply kernels in
+// field5x52asm.c / field5x52int128.c, plus introspection of which one
+// the vendored library itself was configured with. The inner multiply
+// is a static inline frozen into every compiled function at configure
+// time, so as with the scalar representations (scalarbench.c) the
+// runtime part is measurement and verification: a deployment times
+// both paths on its own hardware and reconfigures with
+// `--with-asm=x86_64|no` when the baked-in one is not the fast one.
+#include "secp256k1-zkp/src/libsecp256k1-config.h"
+
+long long field_bench_asm(int op, unsigned long long iters,
+			  unsigned char *out32);
+long long field_bench_int128(int op, unsigned long long iters,
+			     unsigned char *out32);
+
+// inner multiply compiled into libsecp256k1: 1 when the x86_64 inline
+// assembly path is baked in, 0 for the __int128 path
+int field_asm_active(void) {
+#if defined(USE_ASM_X86_64)
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+// use_asm: 1 for the inline assembly kernel, 0 for __int128; op:
+// 0=mul, 1=sqr. Returns elapsed micros, -1 when the kernel cannot run
+// on this build (asm off x86_64, int128 without __int128)
+long long field_bench_impl(int use_asm, int op, unsigned long long iters,
+			   unsigned char *out32) {
+	if (use_asm) return field_bench_asm(op, iters, out32);
+	return field_bench_int128(op, iters, out32);
+}
@@ -0,0 +1,214 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int snprintf(char *, unsigned long, const char *, ...);
+
+#define ERROR_JOURNAL_OPEN -1
+#define ERROR_JOURNAL_GEOMETRY -2
+#define ERROR_JOURNAL_SYNC -3
+
+#define JOURNAL_MAGIC 0x316c6e6a6d6166ULL /* "famjnl1" */
+#define JOURNAL_HDR_PAGE 4096ULL
+
+// Append-only message journal: fixed-size segment files mapped
+// read-write, records appended with the same length-prefixed framing
+// channel.c uses and made durable in batches (group commit). Appends
+// are a memcpy into the mapping; msync runs only when the dirty window
+// passes the configured threshold, when the caller forces a commit, or
+// on rotation, so per-message cost stays off the ack path. The header
+// lives alone on the first page and its committed watermark is synced
+// strictly after the records it covers, so a crash can lose the tail
+// of the current batch but never admits a torn record: reopen resumes
+// at the watermark.
+typedef struct JournalHdr {
+	unsigned long long magic;
+	unsigned long long segment_size;
+	unsigned long long segno;
+	// bytes of this segment durable on disk, header page included
+	unsigned long long committed;
+} JournalHdr;
+
+typedef struct Journal {
+	unsigned char *base;
+	unsigned long long segment_size;
+	unsigned long long tail;
+	unsigned long long synced;
+	unsigned long long threshold;
+	unsigned long long segno;
+	char path[160];
+} Journal;
+
+unsigned long long journal_handle_size() { return sizeof(Journal); }
+
+static unsigned long long journal_stride(unsigned long long len) {
+	return sizeof(unsigned long long) + ((len + 7) & ~7ULL);
+}
+
+static void journal_segment_name(Journal *j, char *buf,
+				 unsigned long long capacity,
+				 unsigned long long segno) {
+	snprintf(buf, capacity, "%s.%llu", j->path, segno);
+}
+
+static int journal_segment_open(Journal *j, unsigned long long segno) {
+	char name[176];
+	JournalHdr *hdr;
+	unsigned char *base;
+	int fd;
+
+	journal_segment_name(j, name, sizeof(name), segno);
+	fd = open(name, O_CREAT | O_RDWR, 0600);
+	if (fd < 0) return ERROR_JOURNAL_OPEN;
+	if (ftruncate(fd, j->segment_size) < 0) {
+		close(fd);
+		return ERROR_JOURNAL_OPEN;
+	}
+	base = mmap(NULL, j->segment_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) return ERROR_JOURNAL_OPEN;
+
+	hdr = (JournalHdr *)base;
+	if (hdr->magic == JOURNAL_MAGIC) {
+		// existing segment: resume at the durable watermark; bytes
+		// past it were never acked and are overwritten
+		if (hdr->segment_size != j->segment_size ||
+		    hdr->segno != segno ||
+		    hdr->committed < JOURNAL_HDR_PAGE ||
+		    hdr->committed > j->segment_size) {
+			munmap(base, j->segment_size);
+			return ERROR_JOURNAL_OPEN;
+		}
+	} else {
+		hdr->segment_size = j->segment_size;
+		hdr->segno = segno;
+		hdr->committed = JOURNAL_HDR_PAGE;
+		// the magic lands last so a resume never trusts a segment
+		// whose header did not finish reaching disk
+		if (msync(base, JOURNAL_HDR_PAGE, MS_SYNC) < 0) {
+			munmap(base, j->segment_size);
+			return ERROR_JOURNAL_SYNC;
+		}
+		hdr->magic = JOURNAL_MAGIC;
+		if (msync(base, JOURNAL_HDR_PAGE, MS_SYNC) < 0) {
+			munmap(base, j->segment_size);
+			return ERROR_JOURNAL_SYNC;
+		}
+	}
+	j->base = base;
+	j->segno = segno;
+	j->tail = hdr->committed;
+	j->synced = hdr->committed;
+	return 0;
+}
+
+int journal_open(Journal *j, const char *path, unsigned long long segment_size,
+		 unsigned long long sync_threshold) {
+	struct stat st;
+	char name[176];
+	unsigned long long segno = 0;
+
+	if (segment_size < 2 * JOURNAL_HDR_PAGE ||
+	    (segment_size & (JOURNAL_HDR_PAGE - 1)) ||
+	    strlen(path) >= sizeof(j->path))
+		return ERROR_JOURNAL_GEOMETRY;
+	memset(j->path, 0, sizeof(j->path));
+	strncpy(j->path, path, sizeof(j->path) - 1);
+	j->segment_size = segment_size;
+	j->threshold = sync_threshold;
+
+	// resume the newest segment of a previous run; appends pick up at
+	// its watermark and rotation continues the numbering
+	for (;;) {
+		journal_segment_name(j, name, sizeof(name), segno + 1);
+		if (stat(name, &st) < 0) break;
+		segno++;
+	}
+	return journal_segment_open(j, segno);
+}
+
+int journal_commit(Journal *j) {
+	JournalHdr *hdr = (JournalHdr *)j->base;
+	unsigned long long from;
+
+	if (j->tail == j->synced) return 0;
+	from = j->synced & ~(JOURNAL_HDR_PAGE - 1);
+	if (msync(j->base + from, j->tail - from, MS_SYNC) < 0)
+		return ERROR_JOURNAL_SYNC;
+	// the watermark only moves once the records under it are durable
+	hdr->committed = j->tail;
+	if (msync(j->base, JOURNAL_HDR_PAGE, MS_SYNC) < 0)
+		return ERROR_JOURNAL_SYNC;
+	j->synced = j->tail;
+	return 0;
+}
+
+static int journal_rotate(Journal *j) {
+	int ret = journal_commit(j);
+	if (ret) return ret;
+	if (j->base) munmap(j->base, j->segment_size);
+	j->base = 0;
+	return journal_segment_open(j, j->segno + 1);
+}
+
+long long journal_append(Journal *j, const unsigned char *buf,
+			 unsigned long long len) {
+	unsigned long long stride = journal_stride(len);
+	long long off;
+	int ret;
+
+	if (JOURNAL_HDR_PAGE + stride > j->segment_size)
+		return ERROR_JOURNAL_GEOMETRY;
+	if (j->tail + stride > j->segment_size) {
+		ret = journal_rotate(j);
+		if (ret) return ret;
+	}
+	off = (long long)(j->segno * j->segment_size + j->tail);
+	*(unsigned long long *)(j->base + j->tail) = len;
+	memcpy(j->base + j->tail + sizeof(unsigned long long), buf, len);
+	j->tail += stride;
+	if (j->tail - j->synced >= j->threshold) {
+		ret = journal_commit(j);
+		if (ret) return ret;
+	}
+	return off;
+}
+
+// dirty bytes not yet covered by a commit
+unsigned long long journal_pending(Journal *j) { return j->tail - j->synced; }
+
+// global durable offset: everything below it survives a crash
+unsigned long long journal_committed(Journal *j) {
+	return j->segno * j->segment_size + j->synced;
+}
+
+// read back a record by the offset append returned. Only the live
+// segment is mapped, so offsets from rotated-out segments are refused;
+// replay of old segments is an offline concern, not a hot-path one
+long long journal_read(Journal *j, unsigned long long off, unsigned char *buf,
+		       unsigned long long capacity) {
+	unsigned long long local, len;
+
+	if (off / j->segment_size != j->segno) return ERROR_JOURNAL_GEOMETRY;
+	local = off % j->segment_size;
+	if (local < JOURNAL_HDR_PAGE ||
+	    local + sizeof(unsigned long long) > j->tail)
+		return ERROR_JOURNAL_GEOMETRY;
+	len = *(unsigned long long *)(j->base + local);
+	if (local + journal_stride(len) > j->tail) return ERROR_JOURNAL_GEOMETRY;
+	if (len > capacity) len = capacity;
+	memcpy(buf, j->base + local + sizeof(unsigned long long), len);
+	return (long long)len;
+}
+
+int journal_close(Journal *j) {
+	int ret;
+	if (!j->base) return 0;
+	ret = journal_commit(j);
+	munmap(j->base, j->segment_size);
+	j->base = 0;
+	return ret;
+}
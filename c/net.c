@@ -1,6 +1,10 @@
+#ifdef __linux__
+#define _GNU_SOURCE /* recvmmsg */
+#endif	// __linux__
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <netinet/tcp.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -9,13 +13,22 @@
 #endif	// __APPLE__
 #ifdef __linux__
 #include <sys/epoll.h>
+#ifdef USE_IORING
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif	// USE_IORING
 #endif	// __linux__
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 
 #define MULTIPLEX_REGISTER_TYPE_NONE 0
 #define MULTIPLEX_REGISTER_TYPE_FLAG_READ 0x1
 #define MULTIPLEX_REGISTER_TYPE_FLAG_WRITE (0x1 << 1)
+#define MULTIPLEX_REGISTER_TYPE_FLAG_EDGE (0x1 << 2)
 
 #define ERROR_SOCKET -1
 #define ERROR_CONNECT -2
@@ -33,12 +46,18 @@ long long __fd_count = 0;
 
 long long getfdcount() { return __fd_count; }
 
+// production fd telemetry, implemented next to memstats in core.c;
+// unlike __fd_count these stay on outside TEST builds
+void stat_fd_opened(unsigned long long n);
+void stat_fd_closed(unsigned long long n);
+
 int close_impl(int fd) {
 	int ret = close(fd);
 	if (ret == 0) {
 #ifdef TEST
 		__atomic_fetch_sub(&__fd_count, 1, __ATOMIC_SEQ_CST);
 #endif	// TEST
+		stat_fd_closed(1);
 	}
 	return ret;
 }
@@ -51,13 +70,85 @@ typedef struct MultiplexHandle {
 	int fd;
 } MultiplexHandle;
 
+#ifdef USE_IORING
+/* Completion-ring backend for the multiplex layer. Readiness is driven
+ * by multishot IORING_OP_POLL_ADD requests so the socket_multiplex_*
+ * contract (and the buffer ownership in the rust event loop) is
+ * unchanged: the ring replaces epoll_ctl/epoll_wait, not recv/send.
+ * MultiplexHandle keeps only the ring fd; the mapped rings live in a
+ * process-global table keyed by it. Ring operations for one handle all
+ * happen on its worker thread. */
+#define URING_MAX_RINGS 128
+#define URING_ENTRIES 256
+
+/* user_data tagging: connection pointers are 8-byte aligned, so the
+ * low bits distinguish the request types that share a ring */
+#define URING_UD_WAKEUP_TAG 0x1 /* fd << 3 | 1: registered with ptr NULL */
+#define URING_UD_WRITE_TAG 0x2	/* ptr | 2: the write-direction poll */
+#define URING_UD_INTERNAL 0x6	/* poll-remove bookkeeping, never surfaced */
+
+typedef struct UringRing {
+	int ring_fd;
+	unsigned sq_entries;
+	unsigned cq_entries;
+	unsigned char *sq_ptr;
+	unsigned long long sq_map_len;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+} UringRing;
+
+static UringRing __urings[URING_MAX_RINGS];
+
+static UringRing *__uring_lookup(int ring_fd) {
+	int i;
+	for (i = 0; i < URING_MAX_RINGS; i++)
+		if (__urings[i].ring_fd == ring_fd) return &__urings[i];
+	return NULL;
+}
+
+/* queue one sqe; the caller flushes via __uring_enter */
+static void __uring_push(UringRing *r, unsigned char opcode, int fd,
+			 unsigned poll_events, unsigned len_flags,
+			 unsigned long long addr,
+			 unsigned long long user_data) {
+	unsigned tail = *r->sq_tail;
+	unsigned idx = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->poll32_events = poll_events;
+	sqe->len = len_flags;
+	sqe->addr = addr;
+	sqe->user_data = user_data;
+	r->sq_array[idx] = idx;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int __uring_enter(UringRing *r, unsigned to_submit) {
+	return syscall(__NR_io_uring_enter, r->ring_fd, to_submit, 0, 0, NULL,
+		       0);
+}
+#endif	// USE_IORING
+
 unsigned long long int socket_handle_size() { return sizeof(SocketHandle); }
 unsigned long long socket_event_size() {
 #ifdef __APPLE__
 	return sizeof(struct kevent);
 #endif	// __APPLE__
 #ifdef __linux__
+#ifdef USE_IORING
+	return sizeof(struct io_uring_cqe);
+#else
 	return sizeof(struct epoll_event);
+#endif	// USE_IORING
 #endif	// __linux__
 }
 unsigned long long socket_multiplex_handle_size() {
@@ -68,12 +159,20 @@ _Bool socket_handle_eq(SocketHandle *h1, SocketHandle *h2) {
 	return h1->fd == h2->fd;
 }
 
+// disable Nagle on every data socket: writes are coalesced at the
+// connection layer instead, so small frames go out immediately
+static void socket_nodelay(int fd) {
+	int opt = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+}
+
 int socket_connect(SocketHandle *s, unsigned char addr[4], int port) {
 	s->fd = socket(AF_INET, SOCK_STREAM, 0);
 	if (s->fd < 0) return ERROR_SOCKET;
 #ifdef TEST
 	__atomic_fetch_add(&__fd_count, 1, __ATOMIC_SEQ_CST);
 #endif	// TEST
+	stat_fd_opened(1);
 
 	struct sockaddr_in serv_addr;
 	memset(&serv_addr, 0, sizeof(serv_addr));
@@ -98,6 +197,7 @@ int socket_connect(SocketHandle *s, unsigned char addr[4], int port) {
 		close_impl(s->fd);
 		return ERROR_FCNTL;
 	}
+	socket_nodelay(s->fd);
 
 	return 0;
 }
@@ -123,6 +223,7 @@ int open_pipe(int *handles) {
 #ifdef TEST
 		__atomic_fetch_add(&__fd_count, 2, __ATOMIC_SEQ_CST);
 #endif	// TEST
+		stat_fd_opened(2);
 		int flags = fcntl(handles[0], F_GETFL, 0);
 		if (flags == -1) {
 			perror("fcntl");
@@ -170,6 +271,7 @@ int socket_listen(SocketHandle *s, unsigned char addr[4], int port,
 #ifdef TEST
 	__atomic_fetch_add(&__fd_count, 1, __ATOMIC_SEQ_CST);
 #endif	// TEST
+	stat_fd_opened(1);
 	if (s->fd < 0) return ERROR_SOCKET;
 	if (setsockopt(s->fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
 		close_impl(s->fd);
@@ -229,6 +331,7 @@ int socket_accept(SocketHandle *s, SocketHandle *accepted) {
 #ifdef TEST
 	__atomic_fetch_add(&__fd_count, 1, __ATOMIC_SEQ_CST);
 #endif	// TEST
+	stat_fd_opened(1);
 
 	int flags = fcntl(accepted->fd, F_GETFL, 0);
 
@@ -236,10 +339,43 @@ int socket_accept(SocketHandle *s, SocketHandle *accepted) {
 		close_impl(accepted->fd);
 		return ERROR_FCNTL;
 	}
+	socket_nodelay(accepted->fd);
 
 	return 0;
 }
 
+int socket_accept_batch(SocketHandle *s, SocketHandle *accepted, int max) {
+	int count = 0;
+	while (count < max) {
+		struct sockaddr_in client_addr;
+		socklen_t client_len = sizeof(client_addr);
+		int fd =
+		    accept(s->fd, (struct sockaddr *)&client_addr, &client_len);
+		if (fd < 0) {
+			if (errno == EAGAIN) {
+				if (count) break;
+				return ERROR_EAGAIN;
+			}
+			if (count) break;
+			return ERROR_ACCEPT;
+		}
+
+#ifdef TEST
+		__atomic_fetch_add(&__fd_count, 1, __ATOMIC_SEQ_CST);
+#endif	// TEST
+		stat_fd_opened(1);
+
+		int flags = fcntl(fd, F_GETFL, 0);
+		if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+			close_impl(fd);
+			continue;
+		}
+		socket_nodelay(fd);
+		accepted[count++].fd = fd;
+	}
+	return count;
+}
+
 long long socket_send(SocketHandle *s, const char *buf,
 		      unsigned long long len) {
 	long long ret = write(s->fd, buf, len);
@@ -251,6 +387,23 @@ long long socket_send(SocketHandle *s, const char *buf,
 	return ret;
 }
 
+long long socket_writev(SocketHandle *s, const char *hdr,
+			unsigned long long hlen, const char *payload,
+			unsigned long long plen) {
+	struct iovec iov[2];
+	iov[0].iov_base = (void *)hdr;
+	iov[0].iov_len = hlen;
+	iov[1].iov_base = (void *)payload;
+	iov[1].iov_len = plen;
+	long long ret = writev(s->fd, iov, plen ? 2 : 1);
+	if (ret < 0) {
+		if (errno == EAGAIN) {
+			return ERROR_EAGAIN;
+		}
+	}
+	return ret;
+}
+
 long long socket_recv(SocketHandle *s, char *buf, unsigned long long capacity) {
 	int ret = read(s->fd, buf, capacity);
 	if (ret < 0) {
@@ -260,6 +413,238 @@ long long socket_recv(SocketHandle *s, char *buf, unsigned long long capacity) {
 	}
 	return ret;
 }
+
+long long socket_recvv(SocketHandle *s, char *buf1, unsigned long long len1,
+		       char *buf2, unsigned long long len2) {
+	struct iovec iov[2];
+	iov[0].iov_base = (void *)buf1;
+	iov[0].iov_len = len1;
+	iov[1].iov_base = (void *)buf2;
+	iov[1].iov_len = len2;
+	long long ret = readv(s->fd, iov, len2 ? 2 : 1);
+	if (ret < 0) {
+		if (errno == EAGAIN) {
+			return ERROR_EAGAIN;
+		}
+	}
+	return ret;
+}
+
+/* UDP transport. Market-data style feeds are natively multicast, so
+ * these open datagram sockets that plug into the same
+ * socket_multiplex_* readiness layer as the TCP handles above: a bind
+ * that returns the bound port (as socket_listen does), a multicast
+ * join, and a batch receive that drains a burst of datagrams in one
+ * call (recvmmsg on linux, a recv loop elsewhere). */
+int socket_udp_bind(SocketHandle *s, unsigned char addr[4], int port) {
+	int opt = 1;
+	struct sockaddr_in address;
+
+	s->fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (s->fd < 0) return ERROR_SOCKET;
+#ifdef TEST
+	__atomic_fetch_add(&__fd_count, 1, __ATOMIC_SEQ_CST);
+#endif	// TEST
+	stat_fd_opened(1);
+	if (setsockopt(s->fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+		close_impl(s->fd);
+		return ERROR_SETSOCKOPT;
+	}
+
+	int flags = fcntl(s->fd, F_GETFL, 0);
+	if (flags < 0) {
+		close_impl(s->fd);
+		return ERROR_FCNTL;
+	}
+
+	if (fcntl(s->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		close_impl(s->fd);
+		return ERROR_FCNTL;
+	}
+
+	/* unlike socket_listen this binds the given address: a multicast
+	 * consumer binds the group (or INADDR_ANY via 0.0.0.0) so only
+	 * that group's datagrams land here */
+	address.sin_family = AF_INET;
+	memcpy(&address.sin_addr.s_addr, addr, 4);
+	address.sin_port = htons(port);
+
+	if (bind(s->fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+		close_impl(s->fd);
+		return ERROR_BIND;
+	}
+
+	socklen_t addr_len = sizeof(address);
+	if (getsockname(s->fd, (struct sockaddr *)&address, &addr_len) < 0) {
+		close_impl(s->fd);
+		return ERROR_GETSOCKNAME;
+	}
+	port = ntohs(address.sin_port);
+	return port;
+}
+
+int socket_udp_join(SocketHandle *s, unsigned char group[4],
+		    unsigned char iface[4]) {
+	struct ip_mreq mreq;
+	memcpy(&mreq.imr_multiaddr.s_addr, group, 4);
+	memcpy(&mreq.imr_interface.s_addr, iface, 4);
+	if (setsockopt(s->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq,
+		       sizeof(mreq))) {
+		return ERROR_SETSOCKOPT;
+	}
+	return 0;
+}
+
+long long socket_udp_sendto(SocketHandle *s, unsigned char addr[4], int port,
+			    const char *buf, unsigned long long len) {
+	struct sockaddr_in dest;
+	memset(&dest, 0, sizeof(dest));
+	dest.sin_family = AF_INET;
+	dest.sin_port = htons(port);
+	memcpy(&dest.sin_addr.s_addr, addr, 4);
+	long long ret = sendto(s->fd, buf, len, 0, (struct sockaddr *)&dest,
+			       sizeof(dest));
+	if (ret < 0) {
+		if (errno == EAGAIN) {
+			return ERROR_EAGAIN;
+		}
+	}
+	return ret;
+}
+
+/* one datagram plus its source: addr/port receive the sender so a
+ * reply can go back where the datagram came from. Returns the length,
+ * ERROR_EAGAIN when the socket is dry. */
+long long socket_udp_recvfrom(SocketHandle *s, char *buf,
+			      unsigned long long capacity, unsigned char addr[4],
+			      int *port) {
+	struct sockaddr_in src;
+	socklen_t slen = sizeof(src);
+	long long ret =
+	    recvfrom(s->fd, buf, capacity, 0, (struct sockaddr *)&src, &slen);
+	if (ret < 0) {
+		if (errno == EAGAIN) {
+			return ERROR_EAGAIN;
+		}
+		return -1;
+	}
+	memcpy(addr, &src.sin_addr.s_addr, 4);
+	*port = ntohs(src.sin_port);
+	return ret;
+}
+
+/* drains up to max datagrams into bufs, a flat region of max slots of
+ * msg_capacity bytes each; lens[i] receives each datagram's length
+ * (truncated at msg_capacity). Returns the count, ERROR_EAGAIN when
+ * the socket is dry. */
+int socket_udp_recv_batch(SocketHandle *s, char *bufs,
+			  unsigned long long msg_capacity, unsigned int *lens,
+			  int max) {
+#ifdef __linux__
+	struct mmsghdr msgs[max];
+	struct iovec iovs[max];
+	int i;
+	for (i = 0; i < max; i++) {
+		iovs[i].iov_base = bufs + (unsigned long long)i * msg_capacity;
+		iovs[i].iov_len = msg_capacity;
+		memset(&msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	int ret = recvmmsg(s->fd, msgs, max, 0, NULL);
+	if (ret < 0) {
+		if (errno == EAGAIN) {
+			return ERROR_EAGAIN;
+		}
+		return -1;
+	}
+	for (i = 0; i < ret; i++) lens[i] = msgs[i].msg_len;
+	return ret;
+#else
+	int count = 0;
+	while (count < max) {
+		long long ret =
+		    recv(s->fd, bufs + (unsigned long long)count * msg_capacity,
+			 msg_capacity, 0);
+		if (ret < 0) {
+			if (errno == EAGAIN) {
+				if (count) break;
+				return ERROR_EAGAIN;
+			}
+			if (count) break;
+			return -1;
+		}
+		lens[count++] = (unsigned int)ret;
+	}
+	return count;
+#endif	// __linux__
+}
+#ifdef USE_IORING
+int socket_multiplex_init(MultiplexHandle *multiplex) {
+	struct io_uring_params p;
+	UringRing *r = NULL;
+	unsigned long long sq_len, cq_len;
+	int i, fd;
+
+	for (i = 0; i < URING_MAX_RINGS; i++) {
+		if (__urings[i].ring_fd == 0) {
+			r = &__urings[i];
+			break;
+		}
+	}
+	if (!r) return ERROR_MULTIPLEX_INIT;
+
+	memset(&p, 0, sizeof(p));
+	fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+	if (fd < 0) return ERROR_MULTIPLEX_INIT;
+	/* single-mmap keeps the mapping logic simple and nodrop keeps
+	 * multishot polls alive across cq pressure; both predate the
+	 * kernels this backend targets */
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) ||
+	    !(p.features & IORING_FEAT_NODROP)) {
+		close(fd);
+		return ERROR_MULTIPLEX_INIT;
+	}
+
+	sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (cq_len > sq_len) sq_len = cq_len;
+	r->sq_ptr = mmap(NULL, sq_len, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (r->sq_ptr == MAP_FAILED) {
+		close(fd);
+		return ERROR_MULTIPLEX_INIT;
+	}
+	r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+		       IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		munmap(r->sq_ptr, sq_len);
+		close(fd);
+		return ERROR_MULTIPLEX_INIT;
+	}
+
+	r->sq_map_len = sq_len;
+	r->sq_entries = p.sq_entries;
+	r->cq_entries = p.cq_entries;
+	r->sq_head = (unsigned *)(r->sq_ptr + p.sq_off.head);
+	r->sq_tail = (unsigned *)(r->sq_ptr + p.sq_off.tail);
+	r->sq_mask = (unsigned *)(r->sq_ptr + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *)(r->sq_ptr + p.sq_off.array);
+	r->cq_head = (unsigned *)(r->sq_ptr + p.cq_off.head);
+	r->cq_tail = (unsigned *)(r->sq_ptr + p.cq_off.tail);
+	r->cq_mask = (unsigned *)(r->sq_ptr + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(r->sq_ptr + p.cq_off.cqes);
+	r->ring_fd = fd;
+	multiplex->fd = fd;
+
+#ifdef TEST
+	__atomic_fetch_add(&__fd_count, 1, __ATOMIC_SEQ_CST);
+#endif	// TEST
+	stat_fd_opened(1);
+	return 0;
+}
+#else
 int socket_multiplex_init(MultiplexHandle *multiplex) {
 #ifdef __APPLE__
 	multiplex->fd = kqueue();
@@ -272,8 +657,10 @@ int socket_multiplex_init(MultiplexHandle *multiplex) {
 #ifdef TEST
 	__atomic_fetch_add(&__fd_count, 1, __ATOMIC_SEQ_CST);
 #endif	// TEST
+	stat_fd_opened(1);
 	return 0;
 }
+#endif	// USE_IORING
 #ifdef __APPLE__
 int socket_multiplex_register(MultiplexHandle *multiplex, SocketHandle *s,
 			      int flags, void *ptr) {
@@ -300,7 +687,42 @@ int socket_multiplex_register(MultiplexHandle *multiplex, SocketHandle *s,
 	return 0;
 }
 #endif	// __APPLE__
-#ifdef __linux__
+#if defined(__linux__) && defined(USE_IORING)
+/* re-arming an existing direction first removes the old poll so the
+ * call stays idempotent like EPOLL_CTL_MOD; multishot polls keep
+ * firing on readiness, which matches the edge-driven drain loops on
+ * the rust side for both level and edge registrations */
+int socket_multiplex_register(MultiplexHandle *multiplex, SocketHandle *s,
+			      int flags, void *ptr) {
+	UringRing *r = __uring_lookup(multiplex->fd);
+	unsigned long long rud, wud;
+	unsigned n = 0;
+
+	if (!r) return ERROR_REGISTER;
+	if (ptr == NULL)
+		rud = ((unsigned long long)s->fd << 3) | URING_UD_WAKEUP_TAG;
+	else
+		rud = (unsigned long long)ptr;
+	wud = (unsigned long long)ptr | URING_UD_WRITE_TAG;
+
+	if (flags & MULTIPLEX_REGISTER_TYPE_FLAG_READ) {
+		__uring_push(r, IORING_OP_POLL_REMOVE, -1, 0, 0, rud,
+			     URING_UD_INTERNAL);
+		__uring_push(r, IORING_OP_POLL_ADD, s->fd, POLLIN,
+			     IORING_POLL_ADD_MULTI, 0, rud);
+		n += 2;
+	}
+	if (flags & MULTIPLEX_REGISTER_TYPE_FLAG_WRITE) {
+		__uring_push(r, IORING_OP_POLL_REMOVE, -1, 0, 0, wud,
+			     URING_UD_INTERNAL);
+		__uring_push(r, IORING_OP_POLL_ADD, s->fd, POLLOUT,
+			     IORING_POLL_ADD_MULTI, 0, wud);
+		n += 2;
+	}
+	if (n && __uring_enter(r, n) < 0) return ERROR_REGISTER;
+	return 0;
+}
+#elif defined(__linux__)
 int socket_multiplex_register(MultiplexHandle *multiplex, SocketHandle *s,
 			      int flags, void *ptr) {
 	struct epoll_event ev;
@@ -314,9 +736,18 @@ int socket_multiplex_register(MultiplexHandle *multiplex, SocketHandle *s,
 		event_flags |= EPOLLOUT;
 	}
 
+	if (flags & MULTIPLEX_REGISTER_TYPE_FLAG_EDGE) {
+		event_flags |= EPOLLET;
+	}
+
+	/* same user-data protocol as the io_uring backend: fd-keyed
+	 * registrations (ptr NULL, the wakeup pipes) carry fd << 3 | 1,
+	 * everything else carries the caller's 8-aligned value as-is.
+	 * data is a union, so an untagged scheme cannot tell a small
+	 * attachment value apart from a wakeup fd */
 	ev.events = event_flags;
 	if (ptr == NULL)
-		ev.data.fd = s->fd;
+		ev.data.u64 = ((unsigned long long)s->fd << 3) | 0x1;
 	else
 		ev.data.ptr = ptr;
 
@@ -349,7 +780,18 @@ int socket_multiplex_unregister_write(MultiplexHandle *multiplex,
 	return 0;
 }
 #endif	// __APPLE__
-#ifdef __linux__
+#if defined(__linux__) && defined(USE_IORING)
+int socket_multiplex_unregister_write(MultiplexHandle *multiplex,
+				      SocketHandle *s, void *ptr) {
+	UringRing *r = __uring_lookup(multiplex->fd);
+	if (!r) return ERROR_REGISTER;
+	__uring_push(r, IORING_OP_POLL_REMOVE, -1, 0, 0,
+		     (unsigned long long)ptr | URING_UD_WRITE_TAG,
+		     URING_UD_INTERNAL);
+	if (__uring_enter(r, 1) < 0) return ERROR_REGISTER;
+	return 0;
+}
+#elif defined(__linux__)
 int socket_multiplex_unregister_write(MultiplexHandle *multiplex,
 				      SocketHandle *s, void *ptr) {
 	struct epoll_event event;
@@ -363,6 +805,57 @@ int socket_multiplex_unregister_write(MultiplexHandle *multiplex,
 }
 #endif	// __linux__
 
+/* Drop every registration for a socket before it is closed. epoll and
+ * kqueue do this implicitly on close; the uring backend must remove
+ * its outstanding polls explicitly or they keep a reference to the
+ * file and could complete against a freed connection pointer. */
+int socket_multiplex_unregister(MultiplexHandle *multiplex, SocketHandle *s,
+				void *ptr) {
+#ifdef __APPLE__
+	struct kevent change_event[2];
+	EV_SET(&change_event[0], s->fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+	EV_SET(&change_event[1], s->fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+	/* either filter may not be registered; errors are reported in
+	 * the eventlist we do not collect */
+	kevent(multiplex->fd, change_event, 2, NULL, 0, NULL);
+	return 0;
+#endif	// __APPLE__
+#if defined(__linux__) && defined(USE_IORING)
+	UringRing *r = __uring_lookup(multiplex->fd);
+	unsigned long long rud;
+	if (!r) return ERROR_REGISTER;
+	if (ptr == NULL)
+		rud = ((unsigned long long)s->fd << 3) | URING_UD_WAKEUP_TAG;
+	else
+		rud = (unsigned long long)ptr;
+	__uring_push(r, IORING_OP_POLL_REMOVE, -1, 0, 0, rud,
+		     URING_UD_INTERNAL);
+	__uring_push(r, IORING_OP_POLL_REMOVE, -1, 0, 0,
+		     (unsigned long long)ptr | URING_UD_WRITE_TAG,
+		     URING_UD_INTERNAL);
+	if (__uring_enter(r, 2) < 0) return ERROR_REGISTER;
+	return 0;
+#elif defined(__linux__)
+	epoll_ctl(multiplex->fd, EPOLL_CTL_DEL, s->fd, NULL);
+	return 0;
+#endif	// __linux__
+}
+
+/* Tear down the multiplexer itself. Closing the ring fd cancels any
+ * remaining requests; the mappings and the registry slot are released
+ * here so a long-lived process can cycle servers. */
+int socket_multiplex_destroy(MultiplexHandle *multiplex) {
+#if defined(__linux__) && defined(USE_IORING)
+	UringRing *r = __uring_lookup(multiplex->fd);
+	if (r) {
+		munmap(r->sqes, r->sq_entries * sizeof(struct io_uring_sqe));
+		munmap(r->sq_ptr, r->sq_map_len);
+		memset(r, 0, sizeof(*r));
+	}
+#endif	// USE_IORING
+	return close_impl(multiplex->fd);
+}
+
 /*
 int socket_multiplex_wait(MultiplexHandle *multiplex, void *events,
 			  int max_events, long long timeout_millis) {
@@ -377,6 +870,55 @@ int socket_multiplex_wait(MultiplexHandle *multiplex, void *events,
 }
 */
 
+#if defined(__linux__) && defined(USE_IORING)
+int socket_multiplex_wait(MultiplexHandle *multiplex, void *events,
+			  int max_events, long long timeout_millis) {
+	UringRing *r = __uring_lookup(multiplex->fd);
+	struct io_uring_cqe *out = (struct io_uring_cqe *)events;
+	int count = 0, waited = 0;
+
+	if (!r) return -1;
+	while (1) {
+		unsigned head = *r->cq_head;
+		unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+		while (head != tail && count < max_events) {
+			struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+			/* bookkeeping completions (poll removes) and
+			 * cancelled polls never reach the event loop */
+			if (cqe->user_data != URING_UD_INTERNAL &&
+			    cqe->res >= 0)
+				out[count++] = *cqe;
+			head++;
+		}
+		__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+		if (count > 0 || waited) return count;
+
+		if (timeout_millis >= 0) {
+			struct __kernel_timespec kts;
+			struct io_uring_getevents_arg arg;
+			memset(&arg, 0, sizeof(arg));
+			kts.tv_sec = timeout_millis / 1000;
+			kts.tv_nsec = (timeout_millis % 1000) * 1000000;
+			arg.ts = (unsigned long long)&kts;
+			if (syscall(__NR_io_uring_enter, r->ring_fd, 0, 1,
+				    IORING_ENTER_GETEVENTS |
+					IORING_ENTER_EXT_ARG,
+				    &arg, sizeof(arg)) < 0) {
+				if (errno != ETIME && errno != EINTR)
+					return -1;
+			}
+			/* one final drain picks up anything that landed
+			 * with the timeout */
+			waited = 1;
+		} else {
+			if (syscall(__NR_io_uring_enter, r->ring_fd, 0, 1,
+				    IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+				if (errno != EINTR) return -1;
+			}
+		}
+	}
+}
+#else
 int socket_multiplex_wait(MultiplexHandle *multiplex, void *events,
 			  int max_events, long long timeout_millis) {
 #ifdef __APPLE__
@@ -400,6 +942,7 @@ int socket_multiplex_wait(MultiplexHandle *multiplex, void *events,
 			  max_events, timeout);
 #endif	// __linux__
 }
+#endif	// USE_IORING
 
 int socket_fd(SocketHandle *s) { return s->fd; }
 
@@ -407,8 +950,13 @@ void *socket_event_ptr(void *event) {
 #ifdef __APPLE__
 	struct kevent *kv = (struct kevent *)event;
 	return kv->udata;
+#elif defined(__linux__) && defined(USE_IORING)
+	struct io_uring_cqe *cqe = (struct io_uring_cqe *)event;
+	if (cqe->user_data & URING_UD_WAKEUP_TAG) return NULL;
+	return (void *)(cqe->user_data & ~7ULL);
 #elif defined(__linux__)
 	struct epoll_event *epoll_ev = (struct epoll_event *)event;
+	if (epoll_ev->data.u64 & 0x1) return NULL;
 	return epoll_ev->data.ptr;
 #else
 	return NULL;
@@ -420,9 +968,22 @@ void socket_event_handle(SocketHandle *s, void *event) {
 	struct kevent *kv = event;
 	s->fd = kv->ident;
 #endif	// __APPLE__
-#ifdef __linux__
+#if defined(__linux__) && defined(USE_IORING)
+	/* only fd-keyed registrations (the wakeup pipes) carry an fd in
+	 * user_data; connection events are identified by pointer */
+	struct io_uring_cqe *cqe = event;
+	if (cqe->user_data & URING_UD_WAKEUP_TAG)
+		s->fd = (int)(cqe->user_data >> 3);
+	else
+		s->fd = -1;
+#elif defined(__linux__)
+	/* only fd-keyed registrations carry an fd; see
+	 * socket_multiplex_register */
 	struct epoll_event *epoll_ev = event;
-	s->fd = epoll_ev->data.fd;
+	if (epoll_ev->data.u64 & 0x1)
+		s->fd = (int)(epoll_ev->data.u64 >> 3);
+	else
+		s->fd = -1;
 #endif	// __linux__
 }
 
@@ -431,9 +992,16 @@ _Bool socket_event_is_read(void *event) {
 	struct kevent *kv = event;
 	return kv->filter == EVFILT_READ;
 #endif	// __APPLE__
-#ifdef __linux__
+	/* error and hangup conditions count as readable: the read path
+	 * observes the failure on its next recv and runs the close
+	 * sequence, whereas the write path with nothing buffered would
+	 * swallow the event and leave the connection stranded */
+#if defined(__linux__) && defined(USE_IORING)
+	struct io_uring_cqe *cqe = event;
+	return cqe->res & (POLLIN | POLLERR | POLLHUP);
+#elif defined(__linux__)
 	struct epoll_event *epoll_ev = event;
-	return epoll_ev->events & EPOLLIN;
+	return epoll_ev->events & (EPOLLIN | EPOLLERR | EPOLLHUP);
 #endif	// __linux__
 }
 
@@ -442,8 +1010,31 @@ _Bool socket_event_is_write(void *event) {
 	struct kevent *kv = event;
 	return kv->filter == EVFILT_WRITE;
 #endif	// __APPLE__
-#ifdef __linux__
+#if defined(__linux__) && defined(USE_IORING)
+	struct io_uring_cqe *cqe = event;
+	return cqe->res & POLLOUT;
+#elif defined(__linux__)
 	struct epoll_event *epoll_ev = event;
 	return epoll_ev->events & EPOLLOUT;
 #endif	// __linux__
 }
+
+/* On io_uring a completion without IORING_CQE_F_MORE means the kernel
+ * retired the multishot poll behind it (an error condition, cq
+ * pressure, or a kernel that downgrades multishot to one-shot) and no
+ * further events will arrive until it is re-armed. Reports which
+ * registration died so the event loop can re-register it: 0 none,
+ * 1 the read poll, 2 the write poll, 3 a wakeup pipe. epoll and
+ * kqueue registrations persist on their own and always return 0. */
+int socket_event_resub(void *event) {
+#if defined(__linux__) && defined(USE_IORING)
+	struct io_uring_cqe *cqe = event;
+	if (cqe->flags & IORING_CQE_F_MORE) return 0;
+	if (cqe->user_data & URING_UD_WAKEUP_TAG) return 3;
+	if (cqe->user_data & URING_UD_WRITE_TAG) return 2;
+	return 1;
+#else
+	(void)event;
+	return 0;
+#endif	// USE_IORING
+}
@@ -0,0 +1,64 @@
+// 4x64 scalar representation benchmark kernel. The vendored
+// secp256k1-zkp bakes exactly one scalar representation into the
+// library at configure time; this TU compiles the 64-bit one
+// standalone (every function in the repr header is static, so it
+// coexists with whatever the library itself was built with) so one
+// binary can time both representations on the hardware it actually
+// landed on. scalarbench.c dispatches between this and scalar8x32.c.
+#include "secp256k1-zkp/include/secp256k1.h"
+
+#if defined(__SIZEOF_INT128__)
+
+#define USE_NUM_NONE 1
+#define USE_SCALAR_4X64 1
+#define HAVE___INT128 1
+#include "secp256k1-zkp/src/util.h"
+#include "secp256k1-zkp/src/scalar_4x64_impl.h"
+
+long long getmicros(void);
+
+int scalar_rep_4x64_available(void) { return 1; }
+
+// op: 0=mul, 1=sqr, 2=add. Returns elapsed micros and leaves the final
+// scalar in out32 so the caller can cross-check the representations
+// against each other.
+long long scalar_bench_4x64(int op, unsigned long long iters,
+			    unsigned char *out32) {
+	static const unsigned char seed[32] = {
+	    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b,
+	    0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+	    0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20};
+	secp256k1_scalar a, r;
+	unsigned long long i;
+	long long start, end;
+	int overflow = 0;
+
+	secp256k1_scalar_set_b32(&a, seed, &overflow);
+	r = a;
+	start = getmicros();
+	for (i = 0; i < iters; i++) {
+		if (op == 0)
+			secp256k1_scalar_mul(&r, &r, &a);
+		else if (op == 1)
+			secp256k1_scalar_sqr(&r, &r);
+		else
+			secp256k1_scalar_add(&r, &r, &a);
+	}
+	end = getmicros();
+	secp256k1_scalar_get_b32(out32, &r);
+	return end - start;
+}
+
+#else  /* __SIZEOF_INT128__ */
+
+int scalar_rep_4x64_available(void) { return 0; }
+
+long long scalar_bench_4x64(int op, unsigned long long iters,
+			    unsigned char *out32) {
+	(void)op;
+	(void)iters;
+	(void)out32;
+	return -1;
+}
+
+#endif /* __SIZEOF_INT128__ */
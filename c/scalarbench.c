@@ -0,0 +1,40 @@
+// Runtime selection between the scalar representation kernels in
+// scalar4x64.c / scalar8x32.c, plus introspection of what the vendored
+// library itself was configured with. We ship one binary to
+// heterogeneous hardware; the representation inside libsecp256k1 is
+// frozen at configure time (every compiled function bakes it in), so
+// what CAN vary at runtime is measurement and verification: these
+// entry points let a deployment confirm the baked-in representation is
+// the fast one for the host, and reconfigure with
+// `--with-scalar=64bit|32bit` when it is not.
+#include "secp256k1-zkp/src/libsecp256k1-config.h"
+
+long long scalar_bench_4x64(int op, unsigned long long iters,
+			    unsigned char *out32);
+long long scalar_bench_8x32(int op, unsigned long long iters,
+			    unsigned char *out32);
+int scalar_rep_4x64_available(void);
+
+// representation compiled into libsecp256k1: 64 or 32
+int scalar_rep_active(void) {
+#if defined(USE_SCALAR_4X64)
+	return 64;
+#else
+	return 32;
+#endif
+}
+
+// representation this host should be running: 4x64 whenever the
+// compiler had a 128-bit multiply for the target
+int scalar_rep_preferred(void) {
+	return scalar_rep_4x64_available() ? 64 : 32;
+}
+
+// rep: 64 or 32; op: 0=mul, 1=sqr, 2=add. Returns elapsed micros, -1
+// when the representation cannot run on this build (4x64 without
+// __int128)
+long long scalar_bench_rep(int rep, int op, unsigned long long iters,
+			   unsigned char *out32) {
+	if (rep == 64) return scalar_bench_4x64(op, iters, out32);
+	return scalar_bench_8x32(op, iters, out32);
+}
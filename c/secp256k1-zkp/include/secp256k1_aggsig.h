@@ -2,6 +2,7 @@
 # define _SECP256K1_AGGSIG_
 
 # include "secp256k1.h"
+# include <stdint.h>
 
 # ifdef __cplusplus
 extern "C" {
@@ -226,6 +227,61 @@ SECP256K1_API int secp256k1_aggsig_verify_single(
     const int is_partial)
 SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(5) SECP256K1_WARN_UNUSED_RESULT;
 
+/** Opaque precomputed multiplication table for a pinned public key.
+ *
+ *  Holds the affine odd-multiples table that verification otherwise
+ *  rebuilds from the public key on every call. Fill it once with
+ *  `secp256k1_aggsig_pin_pubkey` and reuse it across any number of
+ *  `secp256k1_aggsig_verify_single_pinned` calls against the same key.
+ *  Contains no secret data. Guaranteed to be 4096 bytes.
+ */
+typedef struct {
+    uint64_t data[512];
+} secp256k1_aggsig_pinned_key;
+
+/** Precompute the multiplication table for a public key
+ *
+ *  Returns: 1 on success, 0 if the public key could not be loaded
+ *  Args:    ctx: an existing context object (cannot be NULL)
+ *  Out:  pinned: the table to fill (cannot be NULL)
+ *  In:   pubkey: the public key to pin (cannot be NULL)
+ */
+SECP256K1_API int secp256k1_aggsig_pin_pubkey(
+    const secp256k1_context* ctx,
+    secp256k1_aggsig_pinned_key *pinned,
+    const secp256k1_pubkey *pubkey)
+SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_WARN_UNUSED_RESULT;
+
+/** Verify a single-signer signature against a pinned public key
+ *
+ *  Identical to `secp256k1_aggsig_verify_single` with the public key
+ *  replaced by its pinned table: the per-call odd-multiples table
+ *  construction and the scratch-space allocation both disappear, which
+ *  is the dominant fixed cost when the same few keys verify many
+ *  signatures.
+ *
+ *  Returns: 1 on success, 0 on failure
+ *  Args:    ctx: an existing context object, initialized for verification (cannot be NULL)
+ *  In:      sig64: signature (cannot be NULL)
+ *           msg32: the message to verify (cannot be NULL)
+ *           pubnonce: if non-NULL, override the public nonce used to calculate e
+ *           pinned: the pinned public key (cannot be NULL)
+ *           pubkey_total: if non-NULL, encode this value in e
+ *           extra_pubkey: if non-NULL, subtract this pubkey from sG
+ *           is_partial: whether to ignore the jacobi symbol of the combined R, set this to 1
+ *               to verify partial signatures that may have had their secret nonces negated
+ */
+SECP256K1_API int secp256k1_aggsig_verify_single_pinned(
+    const secp256k1_context* ctx,
+    const unsigned char *sig64,
+    const unsigned char *msg32,
+    const secp256k1_pubkey *pubnonce,
+    const secp256k1_aggsig_pinned_key *pinned,
+    const secp256k1_pubkey *pubkey_total,
+    const secp256k1_pubkey *extra_pubkey,
+    const int is_partial)
+SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(5) SECP256K1_WARN_UNUSED_RESULT;
+
 /** Verify an aggregate signature
  *
  *  Returns: 1 if the signature is valid, 0 if not
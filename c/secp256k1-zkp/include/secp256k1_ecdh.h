@@ -24,6 +24,27 @@ SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_ecdh(
   const unsigned char *privkey
 ) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4);
 
+/** Compute EC Diffie-Hellman secrets for one scalar against a batch of points.
+ *  The point multiplications are constant time as in secp256k1_ecdh, but the
+ *  conversions back to affine coordinates share a single field inversion across
+ *  the whole batch (secp256k1_fe_inv_all_var), which is variable time; use the
+ *  single-point function when that matters.
+ *  Returns: 1: all exponentiations were successful
+ *           0: scalar was invalid (zero or overflow)
+ *  Args:    ctx:        pointer to a context object (cannot be NULL)
+ *  Out:     results:    a 32*n byte array filled with one ECDH secret per point
+ *  In:      pubkeys:    pointer to n initialized public keys
+ *           n:          number of public keys
+ *           privkey:    a 32-byte scalar with which to multiply the points
+ */
+SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_ecdh_batch(
+  const secp256k1_context* ctx,
+  unsigned char *results,
+  const secp256k1_pubkey *pubkeys,
+  size_t n,
+  const unsigned char *privkey
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(5);
+
 #ifdef __cplusplus
 }
 #endif
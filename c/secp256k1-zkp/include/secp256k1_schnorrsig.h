@@ -122,6 +122,52 @@ SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_schnorrsig_verify_batch
 	size_t n_sigs
 ) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2);
 
+/** Half-aggregate a set of Schnorr signatures.
+ *
+ *  Returns 1 on success, 0 on failure.
+ *
+ *  Args:    ctx: a secp256k1 context object.
+ *  Out:  aggsig: pointer to a 32*(n_sigs+1) byte array receiving the r parts
+ *                of all signatures followed by the randomized sum of the
+ *                s parts (cannot be NULL)
+ *  In:      sig: array of signatures (cannot be NULL)
+ *         msg32: array of messages (cannot be NULL)
+ *            pk: array of public keys (cannot be NULL)
+ *        n_sigs: number of signatures. Must be greater than 0 and smaller
+ *                than 2^31.
+ */
+SECP256K1_API int secp256k1_schnorrsig_half_aggregate(
+	const secp256k1_context* ctx,
+	unsigned char* aggsig,
+	const secp256k1_schnorrsig* const* sig,
+	const unsigned char* const* msg32,
+	const secp256k1_pubkey* const* pk,
+	size_t n_sigs
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4) SECP256K1_ARG_NONNULL(5);
+
+/** Verify a half-aggregate signature.
+ *
+ *  Returns 1 if the aggregate is valid for the given messages and keys,
+ *  0 otherwise.
+ *
+ *  Args:    ctx: a secp256k1 context object, initialized for verification.
+ *       scratch: scratch space used for the multiexponentiation
+ *  In:   aggsig: a 32*(n_sigs+1) byte aggregate produced by
+ *                secp256k1_schnorrsig_half_aggregate (cannot be NULL)
+ *         msg32: array of messages (cannot be NULL)
+ *            pk: array of public keys (cannot be NULL)
+ *        n_sigs: number of signatures in the aggregate. Must be greater
+ *                than 0 and smaller than 2^31.
+ */
+SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_schnorrsig_half_agg_verify(
+	const secp256k1_context* ctx,
+	secp256k1_scratch_space* scratch,
+	const unsigned char* aggsig,
+	const unsigned char* const* msg32,
+	const secp256k1_pubkey* const* pk,
+	size_t n_sigs
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4) SECP256K1_ARG_NONNULL(5);
+
 # ifdef __cplusplus
 }
 # endif
@@ -589,6 +589,94 @@ static void secp256k1_ecmult(const secp256k1_ecmult_context *ctx, secp256k1_gej
     secp256k1_ecmult_strauss_wnaf(ctx, &state, r, 1, a, na, ng);
 }
 
+/** Window size for pinned-point tables: 64 affine odd multiples per
+ *  point (4 KiB as secp256k1_ge_storage), built once per pinned key and
+ *  reused across calls, unlike the per-call WINDOW_A tables above. */
+#define ECMULT_PINNED_WINDOW 8
+#define ECMULT_PINNED_TABLE_SIZE ECMULT_TABLE_SIZE(ECMULT_PINNED_WINDOW)
+
+static void secp256k1_ecmult_pinned_table_build(secp256k1_ge_storage *pre, const secp256k1_ge *a) {
+    secp256k1_gej aj;
+    secp256k1_gej_set_ge(&aj, a);
+    secp256k1_ecmult_odd_multiples_table_storage_var(ECMULT_PINNED_TABLE_SIZE, pre, &aj);
+}
+
+/** Compute r = na * A + ng * G where A is a point pinned through
+ *  secp256k1_ecmult_pinned_table_build. Both tables hold true affine
+ *  points (the pinned table paid its field inversion at build time, the
+ *  G table at context build), so there is no per-call odd-multiples
+ *  table construction and no global-Z bookkeeping: every lookup is a
+ *  plain affine addition. */
+static void secp256k1_ecmult_pinned(const secp256k1_ecmult_context *ctx, secp256k1_gej *r, const secp256k1_ge_storage *pre, const secp256k1_scalar *na, const secp256k1_scalar *ng) {
+    secp256k1_ge tmpa;
+    int wnaf_na[256];
+    int bits_na = 0;
+#ifdef USE_ENDOMORPHISM
+    secp256k1_scalar ng_1, ng_128;
+    int wnaf_ng_1[129];
+    int bits_ng_1 = 0;
+    int wnaf_ng_128[129];
+    int bits_ng_128 = 0;
+#else
+    int wnaf_ng[256];
+    int bits_ng = 0;
+#endif
+    int i;
+    int bits = 0;
+
+    if (!secp256k1_scalar_is_zero(na)) {
+        bits_na = secp256k1_ecmult_wnaf(wnaf_na, 256, na, ECMULT_PINNED_WINDOW);
+        bits = bits_na;
+    }
+
+#ifdef USE_ENDOMORPHISM
+    if (ng) {
+        secp256k1_scalar_split_128(&ng_1, &ng_128, ng);
+        bits_ng_1   = secp256k1_ecmult_wnaf(wnaf_ng_1,   129, &ng_1,   WINDOW_G);
+        bits_ng_128 = secp256k1_ecmult_wnaf(wnaf_ng_128, 129, &ng_128, WINDOW_G);
+        if (bits_ng_1 > bits) {
+            bits = bits_ng_1;
+        }
+        if (bits_ng_128 > bits) {
+            bits = bits_ng_128;
+        }
+    }
+#else
+    if (ng) {
+        bits_ng = secp256k1_ecmult_wnaf(wnaf_ng, 256, ng, WINDOW_G);
+        if (bits_ng > bits) {
+            bits = bits_ng;
+        }
+    }
+#endif
+
+    secp256k1_gej_set_infinity(r);
+
+    for (i = bits - 1; i >= 0; i--) {
+        int n;
+        secp256k1_gej_double_var(r, r, NULL);
+        if (i < bits_na && (n = wnaf_na[i])) {
+            ECMULT_TABLE_GET_GE_STORAGE(&tmpa, pre, n, ECMULT_PINNED_WINDOW);
+            secp256k1_gej_add_ge_var(r, r, &tmpa, NULL);
+        }
+#ifdef USE_ENDOMORPHISM
+        if (i < bits_ng_1 && (n = wnaf_ng_1[i])) {
+            ECMULT_TABLE_GET_GE_STORAGE(&tmpa, *ctx->pre_g, n, WINDOW_G);
+            secp256k1_gej_add_ge_var(r, r, &tmpa, NULL);
+        }
+        if (i < bits_ng_128 && (n = wnaf_ng_128[i])) {
+            ECMULT_TABLE_GET_GE_STORAGE(&tmpa, *ctx->pre_g_128, n, WINDOW_G);
+            secp256k1_gej_add_ge_var(r, r, &tmpa, NULL);
+        }
+#else
+        if (i < bits_ng && (n = wnaf_ng[i])) {
+            ECMULT_TABLE_GET_GE_STORAGE(&tmpa, *ctx->pre_g, n, WINDOW_G);
+            secp256k1_gej_add_ge_var(r, r, &tmpa, NULL);
+        }
+#endif
+    }
+}
+
 static size_t secp256k1_strauss_scratch_size(size_t n_points) {
 #ifdef USE_ENDOMORPHISM
     static const size_t point_size = (2 * sizeof(secp256k1_ge) + sizeof(secp256k1_gej) + sizeof(secp256k1_fe)) * ECMULT_TABLE_SIZE(WINDOW_A) + sizeof(struct secp256k1_strauss_point_state) + sizeof(secp256k1_gej) + sizeof(secp256k1_scalar);
@@ -724,6 +724,98 @@ int secp256k1_aggsig_verify_single(
 
 }
 
+int secp256k1_aggsig_pin_pubkey(
+    const secp256k1_context* ctx,
+    secp256k1_aggsig_pinned_key *pinned,
+    const secp256k1_pubkey *pubkey) {
+
+    secp256k1_ge ge;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(pinned != NULL);
+    ARG_CHECK(pubkey != NULL);
+
+    if (!secp256k1_pubkey_load(ctx, &ge, pubkey)) {
+        return 0;
+    }
+    secp256k1_ecmult_pinned_table_build((secp256k1_ge_storage *)pinned->data, &ge);
+    return 1;
+}
+
+int secp256k1_aggsig_verify_single_pinned(
+    const secp256k1_context* ctx,
+    const unsigned char *sig64,
+    const unsigned char *msg32,
+    const secp256k1_pubkey *pubnonce,
+    const secp256k1_aggsig_pinned_key *pinned,
+    const secp256k1_pubkey *pubkey_total,
+    const secp256k1_pubkey *extra_pubkey,
+    const int is_partial){
+
+    secp256k1_scalar g_sc;
+    secp256k1_fe r_x;
+    secp256k1_gej pk_sum;
+    secp256k1_ge pk_sum_ge;
+    secp256k1_scalar sighash;
+    secp256k1_ge tmp_ge;
+    secp256k1_pubkey tmp_pk;
+
+    int overflow;
+    int return_check=0;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(sig64 != NULL);
+    ARG_CHECK(msg32 != NULL);
+    ARG_CHECK(pinned != NULL);
+
+    /* extract R */
+    if (!secp256k1_fe_set_b32(&r_x, sig64)) {
+        return 0;
+    }
+
+    /* extract s */
+    secp256k1_scalar_set_b32(&g_sc, sig64 + 32, &overflow);
+    if (overflow) {
+        return 0;
+    }
+
+    /* compute e = sighash */
+    if (pubnonce != NULL) {
+        secp256k1_compute_sighash_single(ctx, &sighash, pubnonce, pubkey_total, msg32);
+    } else {
+        secp256k1_ge_set_xquad(&tmp_ge, &r_x);
+        secp256k1_pubkey_save(&tmp_pk, &tmp_ge);
+        secp256k1_compute_sighash_single(ctx, &sighash, &tmp_pk, pubkey_total, msg32);
+    }
+
+    /* Compute sG - eP, which should be R. The pinned table replaces the
+     * per-call odd-multiples table the generic path builds for P, and
+     * no scratch space is needed. */
+    secp256k1_scalar_negate(&sighash, &sighash);
+    secp256k1_ecmult_pinned(&ctx->ecmult_ctx, &pk_sum, (const secp256k1_ge_storage *)pinned->data, &sighash, &g_sc);
+
+    if (extra_pubkey != NULL) {
+        /* Subtract an extra public key */
+        secp256k1_pubkey_load(ctx, &tmp_ge, extra_pubkey);
+        secp256k1_ge_neg(&tmp_ge, &tmp_ge);
+        secp256k1_gej_add_ge(&pk_sum, &pk_sum, &tmp_ge);
+    }
+
+    if (pk_sum.infinity) {
+        return 0;
+    }
+    secp256k1_ge_set_gej(&pk_sum_ge, &pk_sum);
+
+    return_check = secp256k1_fe_equal_var(&r_x, &pk_sum_ge.x);
+    if (!is_partial){
+        return return_check && secp256k1_gej_has_quad_y_var(&pk_sum);
+    } else {
+        return return_check;
+    }
+
+}
+
 void secp256k1_aggsig_context_destroy(secp256k1_aggsig_context *aggctx) {
     if (aggctx == NULL) {
         return;
@@ -51,4 +51,62 @@ int secp256k1_ecdh(const secp256k1_context* ctx, unsigned char *result, const se
     return ret;
 }
 
+int secp256k1_ecdh_batch(const secp256k1_context* ctx, unsigned char *results, const secp256k1_pubkey *pubkeys, size_t n, const unsigned char *scalar) {
+    secp256k1_gej *res;
+    secp256k1_ge *pt;
+    secp256k1_scalar s;
+    int overflow = 0;
+    size_t i;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(results != NULL);
+    ARG_CHECK(pubkeys != NULL || n == 0);
+    ARG_CHECK(scalar != NULL);
+    if (n == 0) {
+        return 1;
+    }
+
+    secp256k1_scalar_set_b32(&s, scalar, &overflow);
+    if (overflow || secp256k1_scalar_is_zero(&s)) {
+        secp256k1_scalar_clear(&s);
+        return 0;
+    }
+
+    res = (secp256k1_gej *)checked_malloc(&ctx->error_callback, n * sizeof(*res));
+    pt = (secp256k1_ge *)checked_malloc(&ctx->error_callback, n * sizeof(*pt));
+
+    for (i = 0; i < n; i++) {
+        secp256k1_pubkey_load(ctx, &pt[i], &pubkeys[i]);
+        secp256k1_ecmult_const(&res[i], &pt[i], &s, 256);
+    }
+    /* One shared field inversion brings the whole batch back to affine
+     * coordinates, instead of one inversion per point inside
+     * secp256k1_ge_set_gej. */
+    secp256k1_ge_set_all_gej_var(pt, res, n);
+
+    for (i = 0; i < n; i++) {
+        unsigned char x[32];
+        unsigned char y[1];
+        secp256k1_sha256 sha;
+
+        /* Hash the point in compressed form, exactly as secp256k1_ecdh
+         * does, so batch and single derivations agree. */
+        secp256k1_fe_normalize(&pt[i].x);
+        secp256k1_fe_normalize(&pt[i].y);
+        secp256k1_fe_get_b32(x, &pt[i].x);
+        y[0] = 0x02 | secp256k1_fe_is_odd(&pt[i].y);
+
+        secp256k1_sha256_initialize(&sha);
+        secp256k1_sha256_write(&sha, y, sizeof(y));
+        secp256k1_sha256_write(&sha, x, sizeof(x));
+        secp256k1_sha256_finalize(&sha, results + 32 * i);
+    }
+
+    memset(res, 0, n * sizeof(*res));
+    memset(pt, 0, n * sizeof(*pt));
+    free(res);
+    free(pt);
+    secp256k1_scalar_clear(&s);
+    return 1;
+}
+
 #endif /* SECP256K1_MODULE_ECDH_MAIN_H */
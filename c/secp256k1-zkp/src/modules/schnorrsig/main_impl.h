@@ -335,4 +335,159 @@ int secp256k1_schnorrsig_verify_batch(const secp256k1_context *ctx, secp256k1_sc
             && secp256k1_gej_is_infinity(&rj);
 }
 
+/* Data that is used by the half-aggregation verification ecmult callback */
+typedef struct {
+    const secp256k1_context *ctx;
+    /* Seed for the randomizer PRNG, derived from the public data only */
+    unsigned char chacha_seed[32];
+    secp256k1_scalar randomizer_cache[2];
+    /* r parts of the aggregate signature, 32 bytes each */
+    const unsigned char *r32;
+    const unsigned char *const *msg32;
+    const secp256k1_pubkey *const *pk;
+    size_t n_sigs;
+} secp256k1_schnorrsig_half_agg_ecmult_context;
+
+/** Helper function for half-aggregation. Hashes the r parts, messages and
+ *  public keys into a seed for the randomizer PRNG. Unlike the batch
+ *  verification seed this must not commit to the s parts: a verifier of an
+ *  aggregate signature only has their randomized sum. */
+static void secp256k1_schnorrsig_half_agg_seed(const secp256k1_context *ctx, unsigned char *seed32, const unsigned char *r32, const unsigned char *const *msg32, const secp256k1_pubkey *const *pk, size_t n_sigs) {
+    secp256k1_sha256 sha;
+    size_t i;
+
+    secp256k1_sha256_initialize(&sha);
+    for (i = 0; i < n_sigs; i++) {
+        unsigned char buf[33];
+        size_t buflen = sizeof(buf);
+        secp256k1_sha256_write(&sha, &r32[32 * i], 32);
+        secp256k1_sha256_write(&sha, msg32[i], 32);
+        secp256k1_ec_pubkey_serialize(ctx, buf, &buflen, pk[i], SECP256K1_EC_COMPRESSED);
+        secp256k1_sha256_write(&sha, buf, buflen);
+    }
+    secp256k1_sha256_finalize(&sha, seed32);
+}
+
+/* Callback for half-aggregation verification. Identical in structure to the
+ * batch verification callback, but reads the r parts out of the aggregate
+ * signature instead of individual signatures. */
+static int secp256k1_schnorrsig_half_agg_ecmult_callback(secp256k1_scalar *sc, secp256k1_ge *pt, size_t idx, void *data) {
+    secp256k1_schnorrsig_half_agg_ecmult_context *ecmult_context = (secp256k1_schnorrsig_half_agg_ecmult_context *) data;
+
+    if (idx % 4 == 2) {
+        secp256k1_scalar_chacha20(&ecmult_context->randomizer_cache[0], &ecmult_context->randomizer_cache[1], ecmult_context->chacha_seed, idx / 4);
+    }
+
+    /* R */
+    if (idx % 2 == 0) {
+        secp256k1_fe rx;
+        *sc = ecmult_context->randomizer_cache[(idx / 2) % 2];
+        if (!secp256k1_fe_set_b32(&rx, &ecmult_context->r32[32 * (idx / 2)])) {
+            return 0;
+        }
+        if (!secp256k1_ge_set_xquad(pt, &rx)) {
+            return 0;
+        }
+    /* eP */
+    } else {
+        unsigned char buf[33];
+        size_t buflen = sizeof(buf);
+        secp256k1_sha256 sha;
+        secp256k1_sha256_initialize(&sha);
+        secp256k1_sha256_write(&sha, &ecmult_context->r32[32 * (idx / 2)], 32);
+        secp256k1_ec_pubkey_serialize(ecmult_context->ctx, buf, &buflen, ecmult_context->pk[idx / 2], SECP256K1_EC_COMPRESSED);
+        secp256k1_sha256_write(&sha, buf, buflen);
+        secp256k1_sha256_write(&sha, ecmult_context->msg32[idx / 2], 32);
+        secp256k1_sha256_finalize(&sha, buf);
+
+        secp256k1_scalar_set_b32(sc, buf, NULL);
+        secp256k1_scalar_mul(sc, sc, &ecmult_context->randomizer_cache[(idx / 2) % 2]);
+
+        if (!secp256k1_pubkey_load(ecmult_context->ctx, pt, ecmult_context->pk[idx / 2])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Half-aggregate n signatures: keep every r part but collapse the s parts
+ * into a single randomized sum s = s1 + a2*s2 + ... + an*sn, where the ai
+ * are derived from the public data. The aggregate is 32*(n_sigs+1) bytes. */
+int secp256k1_schnorrsig_half_aggregate(const secp256k1_context *ctx, unsigned char *aggsig, const secp256k1_schnorrsig *const *sig, const unsigned char *const *msg32, const secp256k1_pubkey *const *pk, size_t n_sigs) {
+    unsigned char seed[32];
+    secp256k1_scalar randomizer_cache[2];
+    secp256k1_scalar s;
+    size_t i;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(aggsig != NULL);
+    ARG_CHECK(sig != NULL);
+    ARG_CHECK(msg32 != NULL);
+    ARG_CHECK(pk != NULL);
+    ARG_CHECK(n_sigs > 0);
+    ARG_CHECK(n_sigs < (size_t)(1 << 31));
+
+    for (i = 0; i < n_sigs; i++) {
+        memcpy(&aggsig[32 * i], sig[i]->data, 32);
+    }
+    secp256k1_schnorrsig_half_agg_seed(ctx, seed, aggsig, msg32, pk, n_sigs);
+
+    secp256k1_scalar_set_int(&randomizer_cache[0], 1);
+    secp256k1_scalar_clear(&s);
+    for (i = 0; i < n_sigs; i++) {
+        int overflow;
+        secp256k1_scalar term;
+        if (i % 2 == 1) {
+            secp256k1_scalar_chacha20(&randomizer_cache[0], &randomizer_cache[1], seed, i / 2);
+        }
+        secp256k1_scalar_set_b32(&term, &sig[i]->data[32], &overflow);
+        if (overflow) {
+            return 0;
+        }
+        secp256k1_scalar_mul(&term, &term, &randomizer_cache[i % 2]);
+        secp256k1_scalar_add(&s, &s, &term);
+    }
+    secp256k1_scalar_get_b32(&aggsig[32 * n_sigs], &s);
+    return 1;
+}
+
+/* Verify a half-aggregate signature produced by
+ * secp256k1_schnorrsig_half_aggregate. Recomputes the randomizers from the
+ * public data and checks
+ * 0 == -sG + R1 + a2*R2 + ... + an*Rn + e1*P1 + (a2*e2)P2 + ... + (an*en)Pn
+ * with a single multi-exponentiation. */
+int secp256k1_schnorrsig_half_agg_verify(const secp256k1_context *ctx, secp256k1_scratch *scratch, const unsigned char *aggsig, const unsigned char *const *msg32, const secp256k1_pubkey *const *pk, size_t n_sigs) {
+    secp256k1_schnorrsig_half_agg_ecmult_context ecmult_context;
+    secp256k1_scalar s;
+    secp256k1_gej rj;
+    int overflow;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(scratch != NULL);
+    ARG_CHECK(aggsig != NULL);
+    ARG_CHECK(msg32 != NULL);
+    ARG_CHECK(pk != NULL);
+    ARG_CHECK(n_sigs > 0);
+    ARG_CHECK(n_sigs <= SIZE_MAX / 2);
+    ARG_CHECK(n_sigs < (size_t)(1 << 31));
+
+    ecmult_context.ctx = ctx;
+    ecmult_context.r32 = aggsig;
+    ecmult_context.msg32 = msg32;
+    ecmult_context.pk = pk;
+    ecmult_context.n_sigs = n_sigs;
+    secp256k1_schnorrsig_half_agg_seed(ctx, ecmult_context.chacha_seed, aggsig, msg32, pk, n_sigs);
+    secp256k1_scalar_set_int(&ecmult_context.randomizer_cache[0], 1);
+
+    secp256k1_scalar_set_b32(&s, &aggsig[32 * n_sigs], &overflow);
+    if (overflow) {
+        return 0;
+    }
+    secp256k1_scalar_negate(&s, &s);
+
+    return secp256k1_ecmult_multi_var(&ctx->ecmult_ctx, scratch, &rj, &s, secp256k1_schnorrsig_half_agg_ecmult_callback, (void *) &ecmult_context, 2 * n_sigs)
+            && secp256k1_gej_is_infinity(&rj);
+}
+
 #endif
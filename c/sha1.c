@@ -148,3 +148,16 @@ void SHA1(const unsigned char *data, size_t size, unsigned char hash[]) {
 	SHA1_Final(&ctx, hash);
 }
 
+// One-shot hash of two discontiguous slices, saving the caller a copy
+// into a combined buffer.
+void SHA1_2(const unsigned char *data1, size_t size1,
+	    const unsigned char *data2, size_t size2, unsigned char hash[]) {
+	SHA1_CTX ctx;
+	SHA1_Init(&ctx);
+	SHA1_Update(&ctx, data1, size1);
+	SHA1_Update(&ctx, data2, size2);
+	SHA1_Final(&ctx, hash);
+}
+
+unsigned long long sha1_ctx_size() { return sizeof(SHA1_CTX); }
+
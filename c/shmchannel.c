@@ -0,0 +1,273 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+
+long syscall(long number, ...);
+
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#else
+#include <time.h>
+#endif	// __linux__
+
+#define ERROR_SHM_CREATE -1
+#define ERROR_SHM_OPEN -2
+#define ERROR_SHM_FULL -3
+#define ERROR_SHM_GEOMETRY -4
+#define ERROR_SHM_EMPTY -5
+
+#define SHM_MAGIC 0x66616d7368616e31ULL
+
+// Cross-process channel: a bounded ring of fixed-size slots in a shm
+// segment. Producers claim a slot with the vyukov ticket protocol
+// (per-slot sequence word, CAS on head) so multiple senders in any
+// process stay lock-free; consumers mirror it on tail. A full ring
+// sheds the message like channel_try_send rather than blocking the
+// producer. Wakeup is a futex on the publish counter so an idle
+// consumer parks in the kernel instead of polling.
+//
+// The layout is shared across address spaces: only offsets and plain
+// integers live in the segment, never pointers.
+typedef struct ShmRing {
+	unsigned long long magic;
+	unsigned long long slot_size;
+	unsigned long long nslots;
+	unsigned long long head;
+	unsigned long long tail;
+	unsigned int seq;
+	unsigned int waiting;
+} ShmRing;
+
+// per-slot: the ticket word, then the same length-prefixed framing
+// channel.c's Message buffer uses -- minus the intrusive next pointer,
+// which cannot cross an address-space boundary
+typedef struct ShmSlot {
+	unsigned long long seq;
+	unsigned long long len;
+	unsigned char buffer[];
+} ShmSlot;
+
+typedef struct ShmChannel {
+	ShmRing *ring;
+	unsigned long long map_len;
+	int owner;
+	char name[64];
+} ShmChannel;
+
+unsigned long long shmchannel_handle_size() { return sizeof(ShmChannel); }
+
+static unsigned long long shm_stride(unsigned long long slot_size) {
+	return sizeof(ShmSlot) + ((slot_size + 7) & ~7ULL);
+}
+
+static ShmSlot *shm_slot(ShmRing *r, unsigned long long idx) {
+	return (ShmSlot *)((unsigned char *)r + sizeof(ShmRing) +
+			   idx * shm_stride(r->slot_size));
+}
+
+static void shm_wait(ShmRing *r, unsigned int expect) {
+#ifdef __linux__
+	syscall(SYS_futex, &r->seq, FUTEX_WAIT, expect, NULL, NULL, 0);
+#else
+	// no cross-process futex on this platform: a short sleep poll
+	// keeps the api identical at the cost of wakeup latency
+	struct timespec ts = {0, 100000};
+	if (__atomic_load_n(&r->seq, __ATOMIC_SEQ_CST) == expect)
+		nanosleep(&ts, NULL);
+#endif	// __linux__
+}
+
+static void shm_wake(ShmRing *r) {
+#ifdef __linux__
+	syscall(SYS_futex, &r->seq, FUTEX_WAKE, 0x7fffffff, NULL, NULL, 0);
+#else
+	(void)r;
+#endif	// __linux__
+}
+
+static int shmchannel_setup(ShmChannel *handle, const char *name, int fd,
+			    unsigned long long map_len, int owner) {
+	ShmRing *ring = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			     fd, 0);
+	close(fd);
+	if (ring == MAP_FAILED) return ERROR_SHM_OPEN;
+	handle->ring = ring;
+	handle->map_len = map_len;
+	handle->owner = owner;
+	memset(handle->name, 0, sizeof(handle->name));
+	strncpy(handle->name, name, sizeof(handle->name) - 1);
+	return 0;
+}
+
+int shmchannel_create(ShmChannel *handle, const char *name,
+		      unsigned long long slot_size, unsigned long long slots) {
+	unsigned long long nslots = 1, map_len, i;
+	int fd, ret;
+
+	if (!slot_size || !slots || strlen(name) >= sizeof(handle->name))
+		return ERROR_SHM_GEOMETRY;
+	while (nslots < slots) nslots <<= 1;
+	map_len = sizeof(ShmRing) + nslots * shm_stride(slot_size);
+
+	// a stale segment from a crashed owner would replay old messages;
+	// the creator always starts from a fresh one
+	shm_unlink(name);
+	fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0) return ERROR_SHM_CREATE;
+	if (ftruncate(fd, map_len) < 0) {
+		close(fd);
+		shm_unlink(name);
+		return ERROR_SHM_CREATE;
+	}
+	ret = shmchannel_setup(handle, name, fd, map_len, 1);
+	if (ret) {
+		shm_unlink(name);
+		return ret;
+	}
+
+	handle->ring->slot_size = slot_size;
+	handle->ring->nslots = nslots;
+	handle->ring->head = 0;
+	handle->ring->tail = 0;
+	handle->ring->seq = 0;
+	handle->ring->waiting = 0;
+	for (i = 0; i < nslots; i++)
+		__atomic_store_n(&shm_slot(handle->ring, i)->seq, i,
+				 __ATOMIC_RELAXED);
+	// the magic lands last so an attacher never sees a half-built ring
+	__atomic_store_n(&handle->ring->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int shmchannel_attach(ShmChannel *handle, const char *name) {
+	struct stat st;
+	int fd, ret;
+
+	if (strlen(name) >= sizeof(handle->name)) return ERROR_SHM_GEOMETRY;
+	fd = shm_open(name, O_RDWR, 0600);
+	if (fd < 0) return ERROR_SHM_OPEN;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return ERROR_SHM_OPEN;
+	}
+	ret = shmchannel_setup(handle, name, fd, st.st_size, 0);
+	if (ret) return ret;
+	if (__atomic_load_n(&handle->ring->magic, __ATOMIC_ACQUIRE) !=
+		SHM_MAGIC ||
+	    sizeof(ShmRing) + handle->ring->nslots *
+				  shm_stride(handle->ring->slot_size) !=
+		handle->map_len) {
+		munmap(handle->ring, handle->map_len);
+		return ERROR_SHM_OPEN;
+	}
+	return 0;
+}
+
+int shmchannel_send(ShmChannel *handle, const unsigned char *buf,
+		    unsigned long long len) {
+	ShmRing *r = handle->ring;
+	unsigned long long mask = r->nslots - 1;
+	unsigned long long pos, seq;
+	ShmSlot *slot;
+
+	if (len > r->slot_size) return ERROR_SHM_GEOMETRY;
+	pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = shm_slot(r, pos & mask);
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&r->head, &pos,
+							pos + 1, 0,
+							__ATOMIC_SEQ_CST,
+							__ATOMIC_RELAXED))
+				break;
+		} else if ((long long)(seq - pos) < 0) {
+			// consumer is a full lap behind: shed the message
+			// like channel_try_send instead of queueing
+			return ERROR_SHM_FULL;
+		} else {
+			pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+		}
+	}
+	memcpy(slot->buffer, buf, len);
+	slot->len = len;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	// seq_cst publish/waiting pair as in channel_push: either the
+	// bump is seen by the parked-count recheck or the parked count is
+	// seen here
+	__atomic_fetch_add(&r->seq, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&r->waiting, __ATOMIC_SEQ_CST)) shm_wake(r);
+	return 0;
+}
+
+long long shmchannel_try_recv(ShmChannel *handle, unsigned char *buf,
+			      unsigned long long capacity) {
+	ShmRing *r = handle->ring;
+	unsigned long long mask = r->nslots - 1;
+	unsigned long long pos, seq, len;
+	ShmSlot *slot;
+
+	pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = shm_slot(r, pos & mask);
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos + 1) {
+			if (__atomic_compare_exchange_n(&r->tail, &pos,
+							pos + 1, 0,
+							__ATOMIC_SEQ_CST,
+							__ATOMIC_RELAXED))
+				break;
+		} else if ((long long)(seq - (pos + 1)) < 0) {
+			return ERROR_SHM_EMPTY;
+		} else {
+			pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+		}
+	}
+	len = slot->len;
+	if (len > capacity) len = capacity;
+	memcpy(buf, slot->buffer, len);
+	// hand the slot back to producers one lap ahead
+	__atomic_store_n(&slot->seq, pos + r->nslots, __ATOMIC_RELEASE);
+	return (long long)len;
+}
+
+long long shmchannel_recv(ShmChannel *handle, unsigned char *buf,
+			  unsigned long long capacity) {
+	ShmRing *r = handle->ring;
+	long long ret;
+	unsigned int s;
+
+	for (;;) {
+		ret = shmchannel_try_recv(handle, buf, capacity);
+		if (ret >= 0) return ret;
+		s = __atomic_load_n(&r->seq, __ATOMIC_SEQ_CST);
+		__atomic_fetch_add(&r->waiting, 1, __ATOMIC_SEQ_CST);
+		// recheck after advertising the park so a publish that
+		// raced the increment is not slept through
+		ret = shmchannel_try_recv(handle, buf, capacity);
+		if (ret >= 0) {
+			__atomic_fetch_sub(&r->waiting, 1, __ATOMIC_SEQ_CST);
+			return ret;
+		}
+		shm_wait(r, s);
+		__atomic_fetch_sub(&r->waiting, 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+_Bool shmchannel_pending(ShmChannel *handle) {
+	ShmRing *r = handle->ring;
+	unsigned long long pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	ShmSlot *slot = shm_slot(r, pos & (r->nslots - 1));
+	return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == pos + 1;
+}
+
+int shmchannel_destroy(ShmChannel *handle) {
+	int ret = munmap(handle->ring, handle->map_len);
+	if (handle->owner) shm_unlink(handle->name);
+	return ret;
+}
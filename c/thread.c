@@ -15,6 +15,24 @@ int thread_create(void *(*start_routine)(void *), void *arg) {
 	return ret;
 }
 
+// detached spawn with an explicit stack size. The default 8MB stack is
+// pure wasted address space for small workers; callers that spawn
+// thousands of them can shrink it. Requests below the pthread minimum
+// are rounded up rather than failing the spawn.
+int thread_create_stacksize(void *(*start_routine)(void *), void *arg,
+			    unsigned long long stack_size) {
+	pthread_t th;
+	pthread_attr_t attr;
+	int ret;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (stack_size < 16384) stack_size = 16384;
+	pthread_attr_setstacksize(&attr, stack_size);
+	ret = pthread_create(&th, &attr, start_routine, arg);
+	pthread_attr_destroy(&attr);
+	return ret;
+}
+
 unsigned long long thread_handle_size() { return sizeof(ThreadHandle); }
 
 int thread_create_joinable(ThreadHandle *handle, void *(*start_routine)(void *),
@@ -22,9 +40,122 @@ int thread_create_joinable(ThreadHandle *handle, void *(*start_routine)(void *),
 	return pthread_create(&handle->handle, NULL, start_routine, arg);
 }
 
+int thread_create_joinable_stacksize(ThreadHandle *handle,
+				     void *(*start_routine)(void *), void *arg,
+				     unsigned long long stack_size) {
+	pthread_attr_t attr;
+	int ret;
+	pthread_attr_init(&attr);
+	if (stack_size < 16384) stack_size = 16384;
+	pthread_attr_setstacksize(&attr, stack_size);
+	ret = pthread_create(&handle->handle, &attr, start_routine, arg);
+	pthread_attr_destroy(&attr);
+	return ret;
+}
+
+#ifdef __linux__
+// forward declared to avoid requiring _GNU_SOURCE; the mask is the
+// kernel's plain cpu bitmask
+int sched_setaffinity(int pid, unsigned long cpusetsize,
+		      const unsigned long *mask);
+#endif	// __linux__
+
+// pin the calling thread to one cpu. With first-touch allocation this
+// keeps what the thread allocates on that cpu's NUMA node. No-op on
+// platforms without sched_setaffinity.
+int thread_set_affinity(unsigned long long cpu) {
+#ifdef __linux__
+	unsigned long mask[16] = {0};
+	unsigned long bits = 8 * sizeof(unsigned long);
+	if (cpu >= 16 * bits) return -1;
+	mask[cpu / bits] |= 1UL << (cpu % bits);
+	return sched_setaffinity(0, sizeof(mask), mask);
+#else
+	(void)cpu;
+	return 0;
+#endif	// __linux__
+}
+
 int thread_join(ThreadHandle *handle) {
 	return pthread_join(handle->handle, NULL);
 }
 int thread_detach(ThreadHandle *handle) {
 	return pthread_detach(handle->handle);
 }
+
+// Parking support for the adaptive lock in rust/std/lock.rs. A parker
+// re-checks the lock word under the mutex before sleeping (futex style)
+// so a wakeup between the caller's last observation and the wait cannot
+// be lost. One global mutex/cond pair is enough: wakeups broadcast and
+// spurious ones are absorbed by the caller's retry loop. lock_wake_all
+// is a single atomic load when nothing is parked.
+static pthread_mutex_t __park_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __park_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long long __park_waiters = 0;
+
+void lock_park(unsigned long long *state, unsigned long long expect) {
+	pthread_mutex_lock(&__park_lock);
+	__atomic_fetch_add(&__park_waiters, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(state, __ATOMIC_SEQ_CST) == expect)
+		pthread_cond_wait(&__park_cond, &__park_lock);
+	__atomic_fetch_sub(&__park_waiters, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&__park_lock);
+}
+
+void lock_wake_all() {
+	if (!__atomic_load_n(&__park_waiters, __ATOMIC_SEQ_CST)) return;
+	pthread_mutex_lock(&__park_lock);
+	pthread_cond_broadcast(&__park_cond);
+	pthread_mutex_unlock(&__park_lock);
+}
+
+// Small stable per-thread integer, assigned on first use from a global
+// counter (same scheme as the stat shards in core.c). The sharded lock
+// in rust/std/lock.rs keys its reader slot off this so two threads
+// only share a slot once more threads than slots exist.
+static __thread unsigned int __thread_slot = 0;
+static unsigned int __thread_slot_next = 0;
+
+unsigned int thread_slot(void) {
+	if (!__thread_slot)
+		__thread_slot = 1 + __atomic_fetch_add(&__thread_slot_next, 1,
+						       __ATOMIC_RELAXED);
+	return __thread_slot - 1;
+}
+
+// Stall backtraces for the websocket watchdog. A monitor thread cannot
+// capture another thread's stack directly, so it signals the wedged
+// thread and the handler dumps from inside it: SIGUSR2 is delivered
+// even while the target is blocked on a lock, which is exactly the
+// wedge being diagnosed. backtrace_symbols_fd writes straight to the
+// fd with no malloc, so the handler stays safe in a wedged process.
+#include <signal.h>
+
+int backtrace(void **array, int capacity);
+void backtrace_symbols_fd(void *const *array, int size, int fd);
+long write(int fd, const void *buf, unsigned long len);
+
+static void thread_stall_handler(int sig) {
+	void *frames[64];
+	int n = backtrace(frames, 64);
+	(void)sig;
+	write(2, "=== stalled thread backtrace ===\n", 33);
+	backtrace_symbols_fd(frames, n, 2);
+}
+
+unsigned long long thread_self_id() {
+	return (unsigned long long)pthread_self();
+}
+
+int thread_dump_backtrace(unsigned long long th) {
+	static int installed = 0;
+	if (!installed) {
+		struct sigaction sa;
+		sa.sa_handler = thread_stall_handler;
+		sa.sa_flags = 0;
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(SIGUSR2, &sa, 0)) return -1;
+		installed = 1;
+	}
+	return pthread_kill((pthread_t)th, SIGUSR2);
+}
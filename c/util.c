@@ -2,22 +2,97 @@
 
 #include "limits.h"
 
+// zero-byte detection for word-at-a-time string scans: a byte of w is
+// zero iff the corresponding high bit survives (w - ones) & ~w & highs
+#define WORD_ONES 0x0101010101010101ULL
+#define WORD_HIGHS 0x8080808080808080ULL
+#define word_has_zero(w) (((w)-WORD_ONES) & ~(w)&WORD_HIGHS)
+
 void copy_bytes(unsigned char *X, const unsigned char *Y,
 		unsigned long long x) {
+	typedef unsigned char Vector16
+	    __attribute__((vector_size(16), aligned(1)));
+	// the vector path stores 16 bytes at a time so it needs the
+	// regions disjoint; overlapping copies keep the byte loop
+	if (x >= 16 && (X + x <= Y || Y + x <= X)) {
+		while (x >= 16) {
+			*(Vector16 *)X = *(const Vector16 *)Y;
+			X += 16;
+			Y += 16;
+			x -= 16;
+		}
+	}
 	while (x--) *(X)++ = *(Y)++;
 }
 
 void set_bytes(unsigned char *X, unsigned char x, unsigned long long y) {
+	typedef unsigned char Vector16
+	    __attribute__((vector_size(16), aligned(1)));
+	if (y >= 16) {
+		Vector16 v;
+		for (int j = 0; j < 16; j++) v[j] = x;
+		while (y >= 16) {
+			*(Vector16 *)X = v;
+			X += 16;
+			y -= 16;
+		}
+	}
 	while (y--) *(X++) = x;
 }
 
+// XOR a repeating 4 byte key over a buffer (websocket client frame
+// unmasking). The vector typedef compiles to SSE2/NEON when available
+// and plain word ops otherwise; the tail falls back to byte XORs.
+void unmask_bytes(unsigned char *X, unsigned long long x,
+		  const unsigned char *key) {
+	typedef unsigned char Vector16
+	    __attribute__((vector_size(16), aligned(1)));
+	unsigned long long i = 0;
+	if (x >= 16) {
+		Vector16 k;
+		for (int j = 0; j < 16; j++) k[j] = key[j & 0x3];
+		while (i + 16 <= x) {
+			*(Vector16 *)(X + i) ^= k;
+			i += 16;
+		}
+	}
+	while (i < x) {
+		X[i] ^= key[i & 0x3];
+		i++;
+	}
+}
+
 unsigned long long cstring_len(const char *X) {
 	const char *Y = X;
-	while (*X) X++;
+	// byte-step to word alignment, then scan a word at a time;
+	// aligned reads cannot cross a page so overreading the
+	// terminator's word is safe
+	while (((unsigned long long)X & 7) && *X) X++;
+	if (*X) {
+		while (!word_has_zero(*(const unsigned long long *)X)) X += 8;
+		while (*X) X++;
+	}
 	return X - Y;
 }
 
 int cstring_compare(const char *X, const char *Y) {
+	// co-aligned strings compare a word at a time until a word
+	// differs or holds a zero byte, then bytes decide the verdict
+	if ((((unsigned long long)X ^ (unsigned long long)Y) & 7) == 0) {
+		while (((unsigned long long)X & 7) && *X == *Y && *X) {
+			X++;
+			Y++;
+		}
+		if (!((unsigned long long)X & 7)) {
+			while (*(const unsigned long long *)X ==
+				   *(const unsigned long long *)Y &&
+			       !word_has_zero(
+				   *(const unsigned long long *)X)) {
+				X += 8;
+				Y += 8;
+			}
+		}
+	}
 	while (*X == *Y && *X) {
 		X++;
 		Y++;
@@ -39,13 +114,30 @@ int cstring_compare_n(const char *X, const char *Y, unsigned long long n) {
 }
 
 const char *cstring_strstr(const char *X, const char *Y) {
-	for (; *X; X++) {
+	unsigned char c = *Y;
+	if (!c) return X;
+	while (*X) {
+		// skip to the next candidate: byte-step to alignment,
+		// then word-step until a word holds the terminator or
+		// the first needle byte
+		while (((unsigned long long)X & 7) && *X &&
+		       (unsigned char)*X != c)
+			X++;
+		if (!((unsigned long long)X & 7)) {
+			while (!word_has_zero(*(const unsigned long long *)X) &&
+			       !word_has_zero(*(const unsigned long long *)X ^
+					      (WORD_ONES * c)))
+				X += 8;
+			while (*X && (unsigned char)*X != c) X++;
+		}
+		if (!*X) return 0;
 		const char *tmpX = X, *tmpY = Y;
 		while (*tmpX == *tmpY && *tmpX) {
 			tmpX++;
 			tmpY++;
 		}
 		if (!*tmpY) return X;
+		X++;
 	}
 	return 0;
 }
@@ -4,6 +4,8 @@
 void copy_bytes(unsigned char *dest, const unsigned char *src,
 		unsigned long long n);
 void set_bytes(unsigned char *dst, unsigned char b, unsigned long long n);
+void unmask_bytes(unsigned char *buf, unsigned long long n,
+		  const unsigned char *key);
 unsigned long long cstring_len(const char *S);
 int cstring_compare(const char *s1, const char *s2);
 int cstring_compare_n(const char *s1, const char *s2, unsigned long long n);
@@ -0,0 +1,24 @@
+// Fused websocket accept-key kernel: SHA1(key || magic guid) straight
+// into base64, one call and two stack buffers. The handshake path in
+// rust/net/ws.rs previously crossed the FFI once for the hash and once
+// for the encode; during reconnect storms the upgrade runs tens of
+// thousands of times a second, so the extra crossing and the exposed
+// intermediate digest are worth folding away.
+#include <stddef.h>
+
+void SHA1_2(const unsigned char *data1, size_t size1,
+	    const unsigned char *data2, size_t size2, unsigned char hash[]);
+int Base64encode(char *encoded, const char *string, int len);
+
+// the protocol guid every accept key is salted with (RFC 6455 4.2.2)
+static const char WS_MAGIC[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// key/key_len is the client's Sec-WebSocket-Key value as sent (base64
+// text, not decoded); out receives exactly 28 accept-token bytes
+void ws_accept_key(const unsigned char *key, unsigned long long key_len,
+		   unsigned char *out) {
+	unsigned char digest[20];
+	SHA1_2(key, key_len, (const unsigned char *)WS_MAGIC,
+	       sizeof(WS_MAGIC) - 1, digest);
+	Base64encode((char *)out, (const char *)digest, sizeof(digest));
+}
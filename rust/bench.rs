@@ -0,0 +1,363 @@
+// Microbenchmarks for the hot paths: channel send/recv, hashtable
+// insert/find, rbtree insert, murmur hashing, AES-CTR (cpsrng), aggsig
+// sign/verify and websocket echo round trips. Each bench prints one
+// machine-parsable line per measurement:
+//
+//	bench: name=<name> ops=<ops> ns_per_op=<ns> ops_per_sec=<ops>
+//
+// The benches are #[ignore]d so `fam test` skips them; `fam bench`
+// builds an optimized binary, runs them and gates the results against
+// docs/bench_baseline.txt via scripts/bench.sh. The websocket echo
+// bench lives in the ws.rs test module (the config fields it needs are
+// module-private).
+use ffi::{
+	cpsrng_context_create, cpsrng_context_destroy, cpsrng_rand_bytes_ctx, cpsrng_rand_bytes_tl,
+	getalloccount, getmicros,
+};
+use prelude::*;
+use secp256k1::aggsig::{sign_single, verify_single};
+use secp256k1::types::{Message, PublicKey, Secp256k1, SecretKey, MESSAGE_SIZE};
+
+pub fn report(name: &str, ops: u64, start: i64, end: i64) {
+	let micros = if end > start { (end - start) as u64 } else { 1 };
+	let ns_per_op = (micros * 1000) / ops;
+	let ops_per_sec = (ops * 1_000_000) / micros;
+	println!(
+		"bench: name={} ops={} ns_per_op={} ops_per_sec={}",
+		name, ops, ns_per_op, ops_per_sec
+	);
+}
+
+#[test]
+#[ignore]
+fn bench_channel() {
+	let initial = unsafe { getalloccount() };
+	{
+		let ops = 100_000u64;
+		let (sender, receiver) = channel().unwrap();
+		let start = unsafe { getmicros() };
+		for i in 0..ops {
+			sender.send(i).unwrap();
+			assert_eq!(receiver.recv(), i);
+		}
+		let end = unsafe { getmicros() };
+		report("channel_send_recv", ops, start, end);
+	}
+	assert_eq!(initial, unsafe { getalloccount() });
+}
+
+#[test]
+#[ignore]
+fn bench_hashtable() {
+	let initial = unsafe { getalloccount() };
+	{
+		let ops = 100_000u64;
+		let mut hash = Hashtable::new(65536).unwrap();
+		let mut nodes = Vec::new();
+		for i in 0..ops {
+			let node = Ptr::alloc(Node::new(i)).unwrap();
+			nodes.push(node).unwrap();
+		}
+
+		let start = unsafe { getmicros() };
+		for i in 0..ops as usize {
+			assert!(hash.insert(nodes[i]));
+		}
+		let end = unsafe { getmicros() };
+		report("hashtable_insert", ops, start, end);
+
+		let start = unsafe { getmicros() };
+		for i in 0..ops {
+			assert!(hash.find(&i).is_some());
+		}
+		let end = unsafe { getmicros() };
+		report("hashtable_find", ops, start, end);
+
+		for i in 0..ops {
+			hash.remove(&i).unwrap().release();
+		}
+	}
+	assert_eq!(initial, unsafe { getalloccount() });
+}
+
+#[test]
+#[ignore]
+fn bench_rbtree() {
+	let initial = unsafe { getalloccount() };
+	{
+		let mut tree = RbTree::new();
+		let mut search = move |base: Ptr<RbTreeNode<u64>>, value: Ptr<RbTreeNode<u64>>| {
+			let mut is_right = false;
+			let mut cur = base;
+			let mut parent = Ptr::null();
+
+			while !cur.is_null() {
+				let cmp = (*value).value.compare(&(*cur).value);
+				if cmp == 0 {
+					break;
+				} else if cmp < 0 {
+					parent = cur;
+					is_right = false;
+					cur = cur.left;
+				} else {
+					parent = cur;
+					is_right = true;
+					cur = cur.right;
+				}
+			}
+
+			RbNodePair {
+				cur,
+				parent,
+				is_right,
+			}
+		};
+
+		let ops = 100_000u64;
+		let mut nodes = Vec::new();
+		for i in 0..ops {
+			// hash the index so inserts arrive in a shuffled order
+			let v = murmur3_32_of_u64(i, 0x1234) as u64 * 100_000 + i;
+			let node = Ptr::alloc(RbTreeNode::new(v)).unwrap();
+			nodes.push(node).unwrap();
+		}
+
+		let start = unsafe { getmicros() };
+		for i in 0..ops as usize {
+			assert!(tree.insert(nodes[i], &mut search).is_none());
+		}
+		let end = unsafe { getmicros() };
+		report("rbtree_insert", ops, start, end);
+
+		for i in 0..ops as usize {
+			tree.remove(nodes[i], &mut search).unwrap().release();
+		}
+	}
+	assert_eq!(initial, unsafe { getalloccount() });
+}
+
+#[test]
+#[ignore]
+fn bench_murmur() {
+	let initial = unsafe { getalloccount() };
+	{
+		let ops = 1_000_000u64;
+		let mut buf = [0u8; 64];
+		let mut acc = 0u64;
+		let start = unsafe { getmicros() };
+		for i in 0..ops {
+			buf[0] = i as u8;
+			acc += murmur3_32_of_slice(&buf, get_murmur_seed()) as u64;
+		}
+		let end = unsafe { getmicros() };
+		assert!(acc != 0);
+		report("murmur3_32_64b", ops, start, end);
+	}
+	assert_eq!(initial, unsafe { getalloccount() });
+}
+
+#[test]
+#[ignore]
+fn bench_aes_ctr() {
+	let initial = unsafe { getalloccount() };
+	{
+		// cpsrng is AES-256-CTR over an incrementing counter; one op
+		// fills a 16k buffer
+		let ops = 4_096u64;
+		let mut buf = [0u8; 16384];
+		let rand = unsafe { cpsrng_context_create() };
+		let start = unsafe { getmicros() };
+		for _i in 0..ops {
+			unsafe { cpsrng_rand_bytes_ctx(rand, &mut buf as *mut u8, 16384) };
+		}
+		let end = unsafe { getmicros() };
+		unsafe { cpsrng_context_destroy(rand) };
+		report("aes_ctr_16k", ops, start, end);
+	}
+	assert_eq!(initial, unsafe { getalloccount() });
+}
+
+#[test]
+#[ignore]
+fn bench_cpsrng_tl() {
+	let initial = unsafe { getalloccount() };
+	{
+		// 32 byte draws (nonce/seed sized) from the per-thread buffered
+		// keystream; most ops are a copy out of the 4k block
+		let ops = 1_000_000u64;
+		let mut buf = [0u8; 32];
+		let mut acc = 0u64;
+		let start = unsafe { getmicros() };
+		for _i in 0..ops {
+			unsafe { cpsrng_rand_bytes_tl(&mut buf as *mut u8, 32) };
+			acc += buf[0] as u64;
+		}
+		let end = unsafe { getmicros() };
+		assert!(acc > 0);
+		report("cpsrng_tl_32", ops, start, end);
+	}
+	assert_eq!(initial, unsafe { getalloccount() });
+}
+
+#[test]
+#[ignore]
+fn bench_aggsig() {
+	let initial = unsafe { getalloccount() };
+	{
+		let ops = 250u64;
+		let secp = Secp256k1::new().unwrap();
+		let rand = unsafe { cpsrng_context_create() };
+		let sk = SecretKey::generate(rand);
+		let mut pk = PublicKey::new();
+		let retval = unsafe {
+			crate::ffi::secp256k1_ec_pubkey_create(secp.ctx, pk.as_mut_ptr(), sk.as_ptr() as *const u8)
+		};
+		assert_eq!(retval, 1);
+		let msg = Message([7u8; MESSAGE_SIZE]);
+
+		let start = unsafe { getmicros() };
+		for _i in 0..ops {
+			sign_single(&secp, &msg, &sk, None, None, None, None, None, rand).unwrap();
+		}
+		let end = unsafe { getmicros() };
+		report("aggsig_sign", ops, start, end);
+
+		let sig = sign_single(&secp, &msg, &sk, None, None, None, None, None, rand).unwrap();
+		let start = unsafe { getmicros() };
+		for _i in 0..ops {
+			assert!(verify_single(&secp, &sig, &msg, None, &pk, None, None, false));
+		}
+		let end = unsafe { getmicros() };
+		report("aggsig_verify", ops, start, end);
+
+		unsafe { cpsrng_context_destroy(rand) };
+	}
+	assert_eq!(initial, unsafe { getalloccount() });
+}
+
+#[test]
+#[ignore]
+fn bench_rwlock_read() {
+	let initial = unsafe { getalloccount() };
+	{
+		// 4 threads hammering read acquisitions: the plain lock bounces
+		// one counter cacheline between cores, the sharded lock gives
+		// each thread its own line
+		const THREADS: usize = 4;
+		let ops = 250_000u64;
+
+		let lock = Rc::new(Lock::new()).unwrap();
+		let start = unsafe { getmicros() };
+		let mut jhs = Vec::new();
+		for _t in 0..THREADS {
+			let lock = lock.clone().unwrap();
+			jhs.push(
+				spawnj(move || {
+					for _i in 0..ops {
+						let _r = lock.read();
+					}
+				})
+				.unwrap(),
+			)
+			.unwrap();
+		}
+		for i in 0..jhs.len() {
+			let _ = jhs[i].join();
+		}
+		let end = unsafe { getmicros() };
+		report("lock_read_4t", ops * THREADS as u64, start, end);
+
+		let lock = Rc::new(ShardedLock::new()).unwrap();
+		let start = unsafe { getmicros() };
+		let mut jhs = Vec::new();
+		for _t in 0..THREADS {
+			let lock = lock.clone().unwrap();
+			jhs.push(
+				spawnj(move || {
+					for _i in 0..ops {
+						let _r = lock.read();
+					}
+				})
+				.unwrap(),
+			)
+			.unwrap();
+		}
+		for i in 0..jhs.len() {
+			let _ = jhs[i].join();
+		}
+		let end = unsafe { getmicros() };
+		report("sharded_lock_read_4t", ops * THREADS as u64, start, end);
+	}
+	assert_eq!(initial, unsafe { getalloccount() });
+}
+
+#[test]
+#[ignore]
+fn bench_scalar_reps() {
+	let initial = unsafe { getalloccount() };
+	{
+		// both scalar representations compiled standalone
+		// (c/scalarbench.c); the report shows which one this host
+		// should be baking into libsecp256k1 (fam --with-scalar=...)
+		let active = unsafe { crate::ffi::scalar_rep_active() };
+		let preferred = unsafe { crate::ffi::scalar_rep_preferred() };
+		println!("scalar_rep: active={} preferred={}", active, preferred);
+
+		let ops = 1_000_000u64;
+		let names64 = ["scalar_mul_4x64", "scalar_sqr_4x64", "scalar_add_4x64"];
+		let names32 = ["scalar_mul_8x32", "scalar_sqr_8x32", "scalar_add_8x32"];
+		let mut out = [0u8; 32];
+		for op in 0..3 {
+			let micros = unsafe { crate::ffi::scalar_bench_rep(64, op, ops, out.as_mut_ptr()) };
+			// 4x64 is absent only on targets without __int128
+			if micros >= 0 {
+				report(names64[op as usize], ops, 0, micros);
+			}
+		}
+		for op in 0..3 {
+			let micros = unsafe { crate::ffi::scalar_bench_rep(32, op, ops, out.as_mut_ptr()) };
+			assert!(micros >= 0);
+			report(names32[op as usize], ops, 0, micros);
+		}
+	}
+	assert_eq!(initial, unsafe { getalloccount() });
+}
+
+#[test]
+#[ignore]
+fn bench_field_impls() {
+	let initial = unsafe { getalloccount() };
+	{
+		// both field_5x52 inner multiplies compiled standalone
+		// (c/fieldbench.c); the report shows whether this host should
+		// be configuring the vendored library with --with-asm=x86_64
+		let active = unsafe { crate::ffi::field_asm_active() };
+		let available = unsafe { crate::ffi::field_asm_available() };
+		println!("field_asm: active={} available={}", active, available);
+
+		let ops = 1_000_000u64;
+		let names_asm = ["field_mul_asm", "field_sqr_asm"];
+		let names_int128 = ["field_mul_int128", "field_sqr_int128"];
+		let mut out_asm = [0u8; 32];
+		let mut out_int128 = [0u8; 32];
+		for op in 0..2 {
+			let micros =
+				unsafe { crate::ffi::field_bench_impl(1, op, ops, out_asm.as_mut_ptr()) };
+			// the asm kernel exists only on x86_64
+			if micros >= 0 {
+				report(names_asm[op as usize], ops, 0, micros);
+			}
+			let int128_micros =
+				unsafe { crate::ffi::field_bench_impl(0, op, ops, out_int128.as_mut_ptr()) };
+			// absent only on targets without __int128
+			if int128_micros >= 0 {
+				report(names_int128[op as usize], ops, 0, int128_micros);
+			}
+			// both kernels ran the same chain: the results must agree
+			if micros >= 0 && int128_micros >= 0 {
+				assert_eq!(out_asm, out_int128);
+			}
+		}
+	}
+	assert_eq!(initial, unsafe { getalloccount() });
+}
@@ -13,24 +13,138 @@ extern "C" {
 
 	// Contexts
 	pub fn secp256k1_context_create(flags: u32) -> *mut Context;
+	pub fn secp256k1_context_preallocated_size(flags: u32) -> usize;
+	pub fn secp256k1_context_preallocated_create(prealloc: *mut u8, flags: u32) -> *mut Context;
+	pub fn secp256k1_context_preallocated_clone_size(cx: *const Context) -> usize;
+	pub fn secp256k1_context_preallocated_clone(cx: *const Context, prealloc: *mut u8)
+		-> *mut Context;
+	pub fn secp256k1_context_preallocated_destroy(cx: *mut Context);
 
 	pub fn secp256k1_context_clone(cx: *mut Context) -> *mut Context;
 
 	pub fn secp256k1_context_destroy(cx: *mut Context);
 
 	pub fn secp256k1_context_randomize(cx: *mut Context, seed32: *const u8) -> i32;
+	// only used to re-point a cache-loaded context at this process's
+	// default handlers (fun NULL restores the default); not exposed
+	// beyond that, see the note below about callbacks
+	pub fn secp256k1_context_set_illegal_callback(
+		cx: *mut Context,
+		fun: *const u8,
+		data: *const u8,
+	);
+	pub fn secp256k1_context_set_error_callback(cx: *mut Context, fun: *const u8, data: *const u8);
 	// Scratch space
 	pub fn secp256k1_scratch_space_create(cx: *mut Context, max_size: usize) -> *mut ScratchSpace;
 
 	pub fn secp256k1_scratch_space_destroy(sp: *mut ScratchSpace);
 
 	// Generator
+	pub static secp256k1_generator_const_g: Generator;
+
+	pub static secp256k1_generator_const_h: Generator;
+
 	pub fn secp256k1_generator_generate(
 		cx: *const Context,
 		gen: *mut Generator,
 		seed32: *const u8,
 	) -> i32;
 
+	pub fn secp256k1_generator_generate_blinded(
+		cx: *const Context,
+		gen: *mut Generator,
+		key32: *const u8,
+		blind32: *const u8,
+	) -> i32;
+
+	// Surjection proofs. The proof pointers are the in-memory
+	// secp256k1_surjectionproof representation mirrored by
+	// secp256k1::surjection::SurjectionProof
+	pub fn secp256k1_surjectionproof_initialize(
+		cx: *const Context,
+		proof: *mut u8,
+		input_index: *mut usize,
+		fixed_input_tags: *const u8,
+		n_input_tags: usize,
+		n_input_tags_to_use: usize,
+		fixed_output_tag: *const u8,
+		n_max_iterations: usize,
+		random_seed32: *const u8,
+	) -> i32;
+
+	pub fn secp256k1_surjectionproof_generate(
+		cx: *const Context,
+		proof: *mut u8,
+		ephemeral_input_tags: *const u8,
+		n_ephemeral_input_tags: usize,
+		ephemeral_output_tag: *const u8,
+		input_index: usize,
+		input_blinding_key: *const u8,
+		output_blinding_key: *const u8,
+	) -> i32;
+
+	pub fn secp256k1_surjectionproof_verify(
+		cx: *const Context,
+		proof: *const u8,
+		ephemeral_input_tags: *const u8,
+		n_ephemeral_input_tags: usize,
+		ephemeral_output_tag: *const u8,
+	) -> i32;
+
+	pub fn secp256k1_surjectionproof_serialize(
+		cx: *const Context,
+		output: *mut u8,
+		outputlen: *mut usize,
+		proof: *const u8,
+	) -> i32;
+
+	pub fn secp256k1_surjectionproof_parse(
+		cx: *const Context,
+		proof: *mut u8,
+		input: *const u8,
+		inputlen: usize,
+	) -> i32;
+
+	// Whitelist proofs. The signature pointers are the in-memory
+	// secp256k1_whitelist_signature representation mirrored by
+	// secp256k1::whitelist::WhitelistSignature
+	pub fn secp256k1_whitelist_sign(
+		cx: *const Context,
+		sig: *mut u8,
+		online_pubkeys: *const PublicKey,
+		offline_pubkeys: *const PublicKey,
+		n_keys: usize,
+		sub_pubkey: *const PublicKey,
+		online_seckey: *const u8,
+		summed_seckey: *const u8,
+		index: usize,
+		noncefp: *const u8,
+		noncedata: *const u8,
+	) -> i32;
+
+	pub fn secp256k1_whitelist_verify(
+		cx: *const Context,
+		sig: *const u8,
+		online_pubkeys: *const PublicKey,
+		offline_pubkeys: *const PublicKey,
+		n_keys: usize,
+		sub_pubkey: *const PublicKey,
+	) -> i32;
+
+	pub fn secp256k1_whitelist_signature_serialize(
+		cx: *const Context,
+		output: *mut u8,
+		outputlen: *mut usize,
+		sig: *const u8,
+	) -> i32;
+
+	pub fn secp256k1_whitelist_signature_parse(
+		cx: *const Context,
+		sig: *mut u8,
+		input: *const u8,
+		inputlen: usize,
+	) -> i32;
+
 	// TODO secp256k1_context_set_illegal_callback
 	// TODO secp256k1_context_set_error_callback
 	// (Actually, I don't really want these exposed; if either of these
@@ -187,6 +301,17 @@ extern "C" {
 		n_pubkeys: usize,
 	) -> i32;
 
+	// like build_scratch_and_verify but with a caller-owned scratch
+	// space, so repeated verifies reuse one allocation
+	pub fn secp256k1_aggsig_verify(
+		cx: *const Context,
+		scratch: *mut ScratchSpace,
+		sig64: *const Signature,
+		msg32: *const Message,
+		pks: *const PublicKey,
+		n_pubkeys: usize,
+	) -> i32;
+
 	// AGGSIG (single sig or single-signer Schnorr)
 	pub fn secp256k1_aggsig_export_secnonce_single(
 		cx: *const Context,
@@ -218,6 +343,23 @@ extern "C" {
 		is_partial: u32,
 	) -> i32;
 
+	pub fn secp256k1_aggsig_pin_pubkey(
+		cx: *const Context,
+		pinned: *mut PinnedPublicKey,
+		pk: *const PublicKey,
+	) -> i32;
+
+	pub fn secp256k1_aggsig_verify_single_pinned(
+		cx: *const Context,
+		sig: *const Signature,
+		msg32: *const Message,
+		pubnonce: *const PublicKey,
+		pinned: *const PinnedPublicKey,
+		pk_total: *const PublicKey,
+		extra_pubkey: *const PublicKey,
+		is_partial: u32,
+	) -> i32;
+
 	pub fn secp256k1_schnorrsig_verify_batch(
 		cx: *const Context,
 		scratch: *mut ScratchSpace,
@@ -227,6 +369,24 @@ extern "C" {
 		n_sigs: usize,
 	) -> i32;
 
+	pub fn secp256k1_schnorrsig_half_aggregate(
+		cx: *const Context,
+		aggsig: *mut u8,
+		sig: *const *const u8,
+		msg32: *const *const u8,
+		pk: *const *const PublicKey,
+		n_sigs: usize,
+	) -> i32;
+
+	pub fn secp256k1_schnorrsig_half_agg_verify(
+		cx: *const Context,
+		scratch: *mut ScratchSpace,
+		aggsig: *const u8,
+		msg32: *const *const u8,
+		pk: *const *const PublicKey,
+		n_sigs: usize,
+	) -> i32;
+
 	pub fn secp256k1_aggsig_add_signatures_single(
 		cx: *const Context,
 		ret_sig: *mut Signature,
@@ -285,6 +445,14 @@ extern "C" {
 		scalar: *const u8,
 	) -> i32;
 
+	pub fn secp256k1_ecdh_batch(
+		cx: *const Context,
+		out: *mut SharedSecret,
+		points: *const PublicKey,
+		n: usize,
+		scalar: *const u8,
+	) -> i32;
+
 	// Parse a 33-byte commitment into 64 byte internal commitment object
 	pub fn secp256k1_pedersen_commitment_parse(
 		cx: *const Context,
@@ -515,13 +683,54 @@ extern "C" {
 		message: *mut u8,
 	) -> i32;
 
+	// scalar representation probes (c/scalarbench.c): both secp256k1
+	// scalar representations are compiled into the binary as
+	// standalone kernels so a deployment can time them and confirm the
+	// one baked into the library is the fast one for the host
+	pub fn scalar_rep_active() -> i32;
+	pub fn scalar_rep_preferred() -> i32;
+	pub fn scalar_bench_rep(rep: i32, op: i32, iters: u64, out32: *mut u8) -> i64;
+
+	// field_5x52 inner-multiply probes (c/fieldbench.c): the x86_64
+	// inline assembly and __int128 field kernels are compiled
+	// standalone so a deployment can time them against each other and
+	// pick the configure-time --with-asm setting for the host
+	pub fn field_asm_active() -> i32;
+	pub fn field_asm_available() -> i32;
+	pub fn field_bench_impl(use_asm: i32, op: i32, iters: u64, out32: *mut u8) -> i64;
+
 	// MISC
 	pub fn rand_bytes(data: *mut u8, len: usize) -> i32;
 	pub fn write(fd: i32, buf: *const u8, len: usize) -> i64;
+	pub fn remove(path: *const u8) -> i32;
 	pub fn _exit(code: i32);
 	pub fn alloc(len: usize) -> *const u8;
+	pub fn alloc_slab(len: usize) -> *const u8;
 	pub fn resize(ptr: *const u8, len: usize) -> *const u8;
 	pub fn release(ptr: *const u8);
+	pub fn release_sized(ptr: *const u8, len: usize);
+	pub fn slab_stats(hits: *mut u64, misses: *mut u64, recycled: *mut u64);
+	pub fn memstats(allocs: *mut u64, frees: *mut u64, bytes: *mut u64);
+	pub fn fdstats(opened: *mut u64, closed: *mut u64);
+	pub fn slab_flush();
+	// unified CPU feature mask (c/cpu.h bit layout), detected once at
+	// first call; accelerated kernels dispatch off it on the c side
+	pub fn cpu_features() -> u64;
+
+	// context table cache (c/core.c): maps a serialized context blob
+	// back at the address it was built at, copy-on-write
+	pub fn ctx_cache_reserve(len: usize) -> *mut u8;
+	pub fn ctx_cache_release(base: *mut u8, len: usize);
+	pub fn ctx_cache_save(path: *const u8, base: *const u8, len: usize) -> i32;
+	pub fn ctx_cache_load(path: *const u8, expect_len: usize) -> *mut u8;
+	pub fn set_hugepage_threshold(threshold: u64);
+	pub fn arena_create(capacity: u64) -> *mut u8;
+	pub fn arena_alloc(arena: *mut u8, size: u64) -> *mut u8;
+	pub fn arena_reset(arena: *mut u8);
+	pub fn arena_destroy(arena: *mut u8);
+	pub fn ringbuf_round(size: u64) -> u64;
+	pub fn ringbuf_create(capacity: u64) -> *mut u8;
+	pub fn ringbuf_destroy(base: *mut u8, capacity: u64);
 	pub fn sleep_millis(millis: u64) -> i32;
 	pub fn ptr_add(p: *mut u8, v: i64);
 	pub fn getalloccount() -> i64;
@@ -533,32 +742,102 @@ extern "C" {
 	pub fn cas_release(ptr: *mut u64, expect: *const u64, desired: u64) -> bool;
 	pub fn f64_to_str(d: f64, buf: *mut u8, capacity: u64) -> i32;
 	pub fn sched_yield() -> i32;
+	pub fn lock_park(state: *mut u64, expect: u64);
+	pub fn lock_wake_all();
+	pub fn thread_slot() -> u32;
 	pub fn cstring_len(s: *const u8) -> usize;
+	pub fn unmask_bytes(buf: *mut u8, n: u64, key: *const u8);
+	pub fn deflate_reset(ctx: *mut u8, dict: *const u8, dict_len: usize);
+	pub fn deflate_message(
+		ctx: *mut u8,
+		input: *const u8,
+		in_len: usize,
+		out: *mut u8,
+		out_cap: usize,
+	) -> i64;
+	pub fn inflate_reset(ctx: *mut u8, dict: *const u8, dict_len: usize);
+	pub fn inflate_message(
+		ctx: *mut u8,
+		input: *const u8,
+		in_len: usize,
+		out: *mut u8,
+		out_cap: usize,
+	) -> i64;
+	pub fn backtrace_enabled() -> i32;
 	pub fn backtrace_ptr(bin: *const u8, len: usize) -> usize;
 	pub fn backtrace_to_string(bt: *const u8, bin: *const u8) -> *const u8;
 	pub fn backtrace_size() -> usize;
 	pub fn backtrace_free(bt: *const u8);
+	pub fn backtrace_prewarm(bin: *const u8);
 	pub fn getmicros() -> i64;
+	pub fn getmicros_coarse() -> i64;
 
 	// THREAD
 	pub fn thread_create(start_routine: extern "C" fn(*mut u8), arg: *mut u8) -> i32;
+	pub fn thread_create_stacksize(
+		start_routine: extern "C" fn(*mut u8),
+		arg: *mut u8,
+		stack_size: u64,
+	) -> i32;
+	pub fn thread_create_joinable_stacksize(
+		handle: *const u8,
+		start_routine: extern "C" fn(*mut u8),
+		arg: *mut u8,
+		stack_size: u64,
+	) -> i32;
 	pub fn thread_create_joinable(
 		handle: *const u8,
 		start_routine: extern "C" fn(*mut u8),
 		arg: *mut u8,
 	) -> i32;
 	pub fn thread_join(handle: *const u8) -> i32;
+	pub fn thread_set_affinity(cpu: u64) -> i32;
 	pub fn thread_detach(handle: *const u8) -> i32;
 	pub fn thread_handle_size() -> usize;
+	pub fn thread_self_id() -> u64;
+	pub fn thread_dump_backtrace(th: u64) -> i32;
 
 	// CHANNEL
 	pub fn channel_init(channel: *const u8) -> i32;
+	pub fn channel_init_bounded(channel: *const u8, capacity: u64) -> i32;
 	pub fn channel_send(channel: *const u8, ptr: *const u8) -> i32;
+	pub fn channel_try_send(channel: *const u8, ptr: *const u8) -> i32;
 	pub fn channel_recv(channel: *const u8) -> *mut u8;
+	pub fn channel_try_recv(channel: *const u8) -> *mut u8;
 	pub fn channel_handle_size() -> usize;
 	pub fn channel_destroy(channel: *const u8) -> i32;
 	pub fn channel_pending(channel: *const u8) -> bool;
 
+	// SHMCHANNEL
+	pub fn shmchannel_create(
+		channel: *const u8,
+		name: *const u8,
+		slot_size: u64,
+		slots: u64,
+	) -> i32;
+	pub fn shmchannel_attach(channel: *const u8, name: *const u8) -> i32;
+	pub fn shmchannel_send(channel: *const u8, buf: *const u8, len: u64) -> i32;
+	pub fn shmchannel_recv(channel: *const u8, buf: *mut u8, capacity: u64) -> i64;
+	pub fn shmchannel_try_recv(channel: *const u8, buf: *mut u8, capacity: u64) -> i64;
+	pub fn shmchannel_pending(channel: *const u8) -> bool;
+	pub fn shmchannel_handle_size() -> u64;
+	pub fn shmchannel_destroy(channel: *const u8) -> i32;
+
+	// JOURNAL
+	pub fn journal_handle_size() -> u64;
+	pub fn journal_open(
+		handle: *const u8,
+		path: *const u8,
+		segment_size: u64,
+		sync_threshold: u64,
+	) -> i32;
+	pub fn journal_append(handle: *const u8, buf: *const u8, len: u64) -> i64;
+	pub fn journal_commit(handle: *const u8) -> i32;
+	pub fn journal_pending(handle: *const u8) -> u64;
+	pub fn journal_committed(handle: *const u8) -> u64;
+	pub fn journal_read(handle: *const u8, off: u64, buf: *mut u8, capacity: u64) -> i64;
+	pub fn journal_close(handle: *const u8) -> i32;
+
 	// SOCKET
 	pub fn socket_handle_size() -> usize;
 	pub fn socket_event_size() -> usize;
@@ -569,9 +848,47 @@ extern "C" {
 	pub fn socket_close(handle: *const u8) -> i32;
 	pub fn socket_listen(handle: *mut u8, addr: *const u8, port: u16, backlog: i32) -> i32;
 	pub fn socket_accept(handle: *const u8, nhandle: *mut u8) -> i32;
+	pub fn socket_accept_batch(handle: *const u8, nhandles: *mut u8, max: i32) -> i32;
 	pub fn socket_send(handle: *const u8, buf: *const u8, len: usize) -> i64;
+	pub fn socket_writev(
+		handle: *const u8,
+		hdr: *const u8,
+		hlen: usize,
+		payload: *const u8,
+		plen: usize,
+	) -> i64;
 	pub fn socket_recv(handle: *const u8, buf: *mut u8, capacity: usize) -> i64;
+	pub fn socket_recvv(
+		handle: *const u8,
+		buf1: *mut u8,
+		len1: usize,
+		buf2: *mut u8,
+		len2: usize,
+	) -> i64;
 	pub fn socket_clear_pipe(handle: *const u8) -> i32;
+	pub fn socket_udp_bind(handle: *mut u8, addr: *const u8, port: i32) -> i32;
+	pub fn socket_udp_join(handle: *const u8, group: *const u8, iface: *const u8) -> i32;
+	pub fn socket_udp_sendto(
+		handle: *const u8,
+		addr: *const u8,
+		port: i32,
+		buf: *const u8,
+		len: usize,
+	) -> i64;
+	pub fn socket_udp_recvfrom(
+		handle: *const u8,
+		buf: *mut u8,
+		capacity: usize,
+		addr: *mut u8,
+		port: *mut i32,
+	) -> i64;
+	pub fn socket_udp_recv_batch(
+		handle: *const u8,
+		bufs: *mut u8,
+		msg_capacity: usize,
+		lens: *mut u32,
+		max: i32,
+	) -> i32;
 
 	pub fn socket_multiplex_init(handle: *mut u8) -> i32;
 	pub fn socket_multiplex_register(
@@ -585,6 +902,12 @@ extern "C" {
 		socket: *const u8,
 		connptr: *const u8,
 	) -> i32;
+	pub fn socket_multiplex_unregister(
+		handle: *const u8,
+		socket: *const u8,
+		connptr: *const u8,
+	) -> i32;
+	pub fn socket_multiplex_destroy(handle: *const u8) -> i32;
 	pub fn socket_multiplex_wait(
 		handle: *const u8,
 		events: *mut u8,
@@ -595,15 +918,35 @@ extern "C" {
 	pub fn socket_event_is_read(event: *const u8) -> bool;
 	pub fn socket_event_is_write(event: *const u8) -> bool;
 	pub fn socket_event_ptr(event: *const u8) -> *const u8;
+	pub fn socket_event_resub(event: *const u8) -> i32;
 	pub fn socket_handle_eq(handle1: *const u8, handle2: *const u8) -> bool;
 
 	pub fn open_pipe(pair: *mut u8) -> i32;
 	pub fn Base64decode(output: *mut u8, input: *mut u8);
 	pub fn Base64encode(input: *const u8, output: *mut u8, len: usize);
+	// fused handshake kernel (c/wskey.c): SHA1(key || magic guid)
+	// base64-encoded into a 28 byte accept token, one crossing
+	pub fn ws_accept_key(key: *const u8, key_len: u64, out: *mut u8);
 	pub fn SHA1(data: *const u8, size: usize, hash: *mut u8);
+	pub fn SHA1_2(
+		data1: *const u8,
+		size1: usize,
+		data2: *const u8,
+		size2: usize,
+		hash: *mut u8,
+	);
+	pub fn SHA1_Init(ctx: *mut u8);
+	pub fn SHA1_Update(ctx: *mut u8, data: *const u8, len: usize);
+	pub fn SHA1_Final(ctx: *mut u8, hash: *mut u8);
+	pub fn sha1_ctx_size() -> u64;
+
+	// AES (c/aes.c): raw AES-256-CTR contexts for the ws secure transport
+	pub fn AES_init_ctx_iv(ctx: *mut u8, key: *const u8, iv: *const u8);
+	pub fn AES_CTR_xcrypt_buffer(ctx: *mut u8, buf: *mut u8, length: usize);
 
 	// CPSRNG
 	pub fn cpsrng_rand_bytes(v: *mut u8, len: usize);
+	pub fn cpsrng_rand_bytes_tl(v: *mut u8, len: usize);
 	pub fn cpsrng_context_create() -> *mut u8;
 	pub fn cpsrng_context_destroy(ctx: *mut u8);
 	pub fn cpsrng_rand_bytes_ctx(ctx: *mut u8, v: *mut u8, len: usize);
@@ -9,6 +9,8 @@
 #[macro_use]
 pub mod std;
 
+#[cfg(test)]
+mod bench;
 mod ffi;
 pub mod net;
 pub mod prelude;
@@ -0,0 +1,322 @@
+// zero-copy flat binary codec for websocket payloads. A schema declared
+// with codec! turns the &[u8] the frame parser already holds into typed
+// fields in one validating pass: integers decode in place and byte
+// fields borrow straight out of the frame buffer, so a handler goes
+// from WsRequest::msg() to fields with no allocation at all. Fields are
+// little-endian -- the native order of every supported target -- so
+// fixed-width reads compile to plain loads.
+
+use core::marker::Sized;
+use prelude::*;
+
+// decoded types implement this so WsRequest::decode can name them; the
+// codec! macro writes the impl
+pub trait Codec<'a>: Sized {
+	fn decode(buf: &'a [u8]) -> Result<Self, Error>;
+}
+
+// sequential zero-copy reader over a payload. Each read validates the
+// remaining length, so a schema decoded to completion has been bounds
+// checked exactly once per field
+pub struct CodecReader<'a> {
+	buf: &'a [u8],
+	off: usize,
+}
+
+impl<'a> CodecReader<'a> {
+	pub fn new(buf: &'a [u8]) -> Self {
+		CodecReader { buf, off: 0 }
+	}
+
+	pub fn remaining(&self) -> usize {
+		self.buf.len() - self.off
+	}
+
+	fn take(&mut self, n: usize) -> Result<&'a [u8], Error> {
+		if self.remaining() < n {
+			return Err(err!(CorruptedData));
+		}
+		let ret = &self.buf[self.off..self.off + n];
+		self.off += n;
+		Ok(ret)
+	}
+
+	pub fn read_u8(&mut self) -> Result<u8, Error> {
+		match self.take(1) {
+			Ok(b) => Ok(b[0]),
+			Err(e) => Err(e),
+		}
+	}
+
+	pub fn read_u16(&mut self) -> Result<u16, Error> {
+		match self.take(2) {
+			Ok(b) => Ok(b[0] as u16 | (b[1] as u16) << 8),
+			Err(e) => Err(e),
+		}
+	}
+
+	pub fn read_u32(&mut self) -> Result<u32, Error> {
+		match self.take(4) {
+			Ok(b) => {
+				let mut v = 0u32;
+				for i in 0..4 {
+					v |= (b[i] as u32) << (8 * i);
+				}
+				Ok(v)
+			}
+			Err(e) => Err(e),
+		}
+	}
+
+	pub fn read_u64(&mut self) -> Result<u64, Error> {
+		match self.take(8) {
+			Ok(b) => {
+				let mut v = 0u64;
+				for i in 0..8 {
+					v |= (b[i] as u64) << (8 * i);
+				}
+				Ok(v)
+			}
+			Err(e) => Err(e),
+		}
+	}
+
+	// u16 length-prefixed byte field borrowed from the payload
+	pub fn read_bytes(&mut self) -> Result<&'a [u8], Error> {
+		let len = match self.read_u16() {
+			Ok(len) => len as usize,
+			Err(e) => return Err(e),
+		};
+		self.take(len)
+	}
+
+	// a fully decoded payload has no bytes left over; trailing garbage
+	// is treated as corruption rather than silently ignored
+	pub fn finish(&self) -> Result<(), Error> {
+		if self.remaining() != 0 {
+			return Err(err!(CorruptedData));
+		}
+		Ok(())
+	}
+}
+
+// symmetric encoder for building payloads to send back
+pub struct CodecWriter {
+	buf: Vec<u8>,
+}
+
+impl CodecWriter {
+	pub fn new() -> Self {
+		CodecWriter { buf: Vec::new() }
+	}
+
+	pub fn write_u8(&mut self, v: u8) -> Result<(), Error> {
+		self.buf.push(v)
+	}
+
+	pub fn write_u16(&mut self, v: u16) -> Result<(), Error> {
+		let b = [v as u8, (v >> 8) as u8];
+		self.buf.append_ptr(&b as *const u8, 2)
+	}
+
+	pub fn write_u32(&mut self, v: u32) -> Result<(), Error> {
+		let mut b = [0u8; 4];
+		for i in 0..4 {
+			b[i] = (v >> (8 * i)) as u8;
+		}
+		self.buf.append_ptr(&b as *const u8, 4)
+	}
+
+	pub fn write_u64(&mut self, v: u64) -> Result<(), Error> {
+		let mut b = [0u8; 8];
+		for i in 0..8 {
+			b[i] = (v >> (8 * i)) as u8;
+		}
+		self.buf.append_ptr(&b as *const u8, 8)
+	}
+
+	pub fn write_bytes(&mut self, v: &[u8]) -> Result<(), Error> {
+		if v.len() > 0xffff {
+			return Err(err!(CapacityExceeded));
+		}
+		match self.write_u16(v.len() as u16) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+		self.buf.append_ptr(v.as_ptr(), v.len())
+	}
+
+	pub fn into_vec(self) -> Vec<u8> {
+		self.buf
+	}
+}
+
+// maps a codec! field type token to its rust type; bytes fields borrow
+// the payload
+#[macro_export]
+macro_rules! codec_type {
+	($lt:lifetime, u8) => { u8 };
+	($lt:lifetime, u16) => { u16 };
+	($lt:lifetime, u32) => { u32 };
+	($lt:lifetime, u64) => { u64 };
+	($lt:lifetime, bytes) => { &$lt [u8] };
+}
+
+#[macro_export]
+macro_rules! codec_read {
+	($r:expr, u8) => {
+		$r.read_u8()
+	};
+	($r:expr, u16) => {
+		$r.read_u16()
+	};
+	($r:expr, u32) => {
+		$r.read_u32()
+	};
+	($r:expr, u64) => {
+		$r.read_u64()
+	};
+	($r:expr, bytes) => {
+		$r.read_bytes()
+	};
+}
+
+#[macro_export]
+macro_rules! codec_write {
+	($w:expr, $v:expr, u8) => {
+		$w.write_u8($v)
+	};
+	($w:expr, $v:expr, u16) => {
+		$w.write_u16($v)
+	};
+	($w:expr, $v:expr, u32) => {
+		$w.write_u32($v)
+	};
+	($w:expr, $v:expr, u64) => {
+		$w.write_u64($v)
+	};
+	($w:expr, $v:expr, bytes) => {
+		$w.write_bytes($v)
+	};
+}
+
+// declares a payload schema. Generates a view struct whose fields are
+// plain integers and slices borrowed from the decoded buffer, a
+// validating decode (via the Codec trait, so WsRequest::decode names
+// it) and a symmetric encode:
+//
+//   codec!(Order { id: u64, qty: u32, side: u8, symbol: bytes });
+//   let order = req.decode::<Order>()?;
+#[macro_export]
+macro_rules! codec {
+	($name:ident { $($field:ident: $ftype:tt),* $(,)? }) => {
+		pub struct $name<'a> {
+			$(pub $field: codec_type!('a, $ftype),)*
+			_marker: ::core::marker::PhantomData<&'a [u8]>,
+		}
+
+		impl<'a> crate::net::codec::Codec<'a> for $name<'a> {
+			fn decode(buf: &'a [u8]) -> Result<Self, Error> {
+				let mut r = crate::net::codec::CodecReader::new(buf);
+				$(
+					let $field = match codec_read!(r, $ftype) {
+						Ok(v) => v,
+						Err(e) => return Err(e),
+					};
+				)*
+				match r.finish() {
+					Ok(_) => {}
+					Err(e) => return Err(e),
+				}
+				Ok($name {
+					$($field,)*
+					_marker: ::core::marker::PhantomData,
+				})
+			}
+		}
+
+		impl<'a> $name<'a> {
+			#[allow(dead_code)]
+			pub fn encode(&self) -> Result<Vec<u8>, Error> {
+				let mut w = crate::net::codec::CodecWriter::new();
+				$(
+					match codec_write!(w, self.$field, $ftype) {
+						Ok(_) => {}
+						Err(e) => return Err(e),
+					}
+				)*
+				Ok(w.into_vec())
+			}
+		}
+	};
+}
+
+#[cfg(test)]
+mod test {
+	use super::{Codec, CodecReader};
+	use ffi::getalloccount;
+	use prelude::*;
+
+	codec!(Order {
+		id: u64,
+		qty: u32,
+		side: u8,
+		symbol: bytes,
+	});
+
+	#[test]
+	fn test_codec_roundtrip() {
+		let initial = unsafe { getalloccount() };
+		{
+			let order = Order {
+				id: 0x1122334455667788,
+				qty: 1500,
+				side: 1,
+				symbol: b"BTCUSD",
+				_marker: ::core::marker::PhantomData,
+			};
+			let buf = order.encode().unwrap();
+			assert_eq!(buf.len(), 8 + 4 + 1 + 2 + 6);
+
+			let dec = Order::decode(&buf[0..buf.len()]).unwrap();
+			assert_eq!(dec.id, 0x1122334455667788);
+			assert_eq!(dec.qty, 1500);
+			assert_eq!(dec.side, 1);
+			assert_eq!(dec.symbol, b"BTCUSD");
+			// the byte field is a view into the buffer, not a copy
+			assert_eq!(dec.symbol.as_ptr() as usize, unsafe {
+				buf.as_slice().as_ptr().add(15) as usize
+			});
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_codec_corrupt() {
+		let initial = unsafe { getalloccount() };
+		{
+			let order = Order {
+				id: 1,
+				qty: 2,
+				side: 0,
+				symbol: b"X",
+				_marker: ::core::marker::PhantomData,
+			};
+			let buf = order.encode().unwrap();
+			// truncation anywhere fails validation
+			assert!(Order::decode(&buf[0..buf.len() - 1]).unwrap_err().kind == ErrorKind::CorruptedData);
+			assert!(Order::decode(&buf[0..7]).unwrap_err().kind == ErrorKind::CorruptedData);
+			assert!(Order::decode(&buf[0..0]).unwrap_err().kind == ErrorKind::CorruptedData);
+			// trailing garbage fails too
+			let mut long = Vec::new();
+			long.append_ptr(buf.as_slice().as_ptr(), buf.len()).unwrap();
+			long.push(0u8).unwrap();
+			assert!(Order::decode(&long[0..long.len()]).unwrap_err().kind == ErrorKind::CorruptedData);
+			// a reader over a partially consumed payload reports what is left
+			let mut r = CodecReader::new(&buf[0..buf.len()]);
+			r.read_u64().unwrap();
+			assert_eq!(r.remaining(), buf.len() - 8);
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+}
@@ -1 +1,3 @@
+#[macro_use]
+pub mod codec;
 pub mod ws;
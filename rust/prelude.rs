@@ -1,23 +1,32 @@
 // Internal
+pub use std::arena::Arena;
 pub use std::backtrace::Backtrace;
 pub use std::boxed::Box;
 pub use std::channel::*;
 pub use std::clone::Clone;
-pub use std::error::{Error, ErrorKind, ErrorKind::*};
+pub use std::error::{ErrCode, Error, ErrorKind, ErrorKind::*};
 pub use std::format::Formatter;
-pub use std::lock::{Lock, LockBox};
+pub use std::histogram::Histogram;
+pub use std::journal::{Journal, JournalConfig};
+pub use std::lock::{Lock, LockBox, ShardedLock};
+pub use std::log::{LogConfig, LogSink};
 pub use std::murmur32::*;
 pub use std::option::{Option, Option::None, Option::Some};
 pub use std::ptr::Ptr;
 pub use std::rc::Rc;
 pub use std::result::{Result, Result::Err, Result::Ok};
+pub use std::ringbuf::RingBuf;
+pub use std::sha1::Sha1;
+pub use std::shmchannel::*;
 pub use std::string::String;
 pub use std::thread::*;
 pub use std::traits::*;
 pub use std::util::*;
 pub use std::vec::Vec;
 pub use util::hashtable::*;
+pub use util::merkle::*;
 pub use util::rbtree::*;
+pub use util::rbtreearena::*;
 pub use util::runtime::*;
 
 // External
@@ -200,6 +200,93 @@ pub fn verify_single(
 	}
 }
 
+/// Precompute the ecmult window table for a well-known public key
+/// Returns: Ok(PinnedPublicKey) on success
+/// In:
+/// pubkey: the public key to pin
+pub fn pin_pubkey(secp: &Secp256k1, pubkey: &PublicKey) -> Result<PinnedPublicKey, Error> {
+	let mut is_ok = false;
+	for i in 0..pubkey.0.len() {
+		if pubkey.0[i] != 0 {
+			is_ok = true;
+		}
+	}
+	if !is_ok {
+		return Err(err!(InvalidPublicKey));
+	}
+
+	let mut pinned = PinnedPublicKey::new();
+	let retval = unsafe {
+		ffi::secp256k1_aggsig_pin_pubkey(secp.ctx, pinned.as_mut_ptr(), pubkey.as_ptr())
+	};
+	if retval == 0 {
+		return Err(err!(InvalidPublicKey));
+	}
+	Ok(pinned)
+}
+
+/// Single-Signer signature verification against a pinned public key.
+/// Same semantics as verify_single with the key replaced by the table
+/// from pin_pubkey, so a hot signer set skips re-deriving its window
+/// tables on every call
+/// Returns: true on success
+/// In:
+/// sig: The signature
+/// msg: the message to verify
+/// pubnonce: if Some(PublicKey) overrides the public nonce used to calculate e
+/// pinned: the pinned public key
+/// pubkey_total: The total of all public keys (for the message in e)
+/// is_partial: whether this is a partial sig, or a fully-combined sig
+pub fn verify_single_pinned(
+	secp: &Secp256k1,
+	sig: &Signature,
+	msg: &Message,
+	pubnonce: Option<&PublicKey>,
+	pinned: &PinnedPublicKey,
+	pubkey_total_for_e: Option<&PublicKey>,
+	extra_pubkey: Option<&PublicKey>,
+	is_partial: bool,
+) -> bool {
+	let pubnonce = is_zero_pubkey!(retfalse => pubnonce);
+
+	let pe = is_zero_pubkey!(retfalse => pubkey_total_for_e);
+
+	let extra = is_zero_pubkey!(retfalse => extra_pubkey);
+
+	let is_partial = match is_partial {
+		true => 1,
+		false => 0,
+	};
+
+	let mut is_ok = false;
+	for i in 0..sig.0.len() {
+		if sig.0[i] != 0 {
+			is_ok = true;
+		}
+	}
+	if !is_ok {
+		return false;
+	}
+
+	let retval = unsafe {
+		ffi::secp256k1_aggsig_verify_single_pinned(
+			secp.ctx,
+			sig.as_ptr(),
+			msg.as_ptr(),
+			pubnonce,
+			pinned.as_ptr(),
+			pe,
+			extra,
+			is_partial,
+		)
+	};
+	match retval {
+		0 => false,
+		1 => true,
+		_ => false,
+	}
+}
+
 /// Batch Schnorr signature verification
 /// Returns: true on success
 /// In:
@@ -252,7 +339,10 @@ pub fn verify_batch(
 	}
 
 	unsafe {
-		let scratch = ffi::secp256k1_scratch_space_create(secp.ctx, SCRATCH_SPACE_SIZE);
+		let scratch = crate::secp256k1::scratch_checkout(secp.ctx, SCRATCH_SPACE_SIZE);
+		if scratch.is_null() {
+			return false;
+		}
 		let result = ffi::secp256k1_schnorrsig_verify_batch(
 			secp.ctx,
 			scratch,
@@ -261,7 +351,163 @@ pub fn verify_batch(
 			pub_keys_vec.as_ptr() as *const *const PublicKey,
 			sigs.len(),
 		);
-		ffi::secp256k1_scratch_space_destroy(scratch);
+		crate::secp256k1::scratch_checkin(scratch, SCRATCH_SPACE_SIZE);
+		result == 1
+	}
+}
+
+/// Batch Schnorr signature verification over a slice of tuples
+/// Returns: true if every signature in the batch is valid
+/// In:
+/// batch: (signature, pubkey, message) tuples, verified with a single
+/// multi-scalar multiplication rather than one secp256k1_ecmult each
+pub fn verify_batch_slice(secp: &Secp256k1, batch: &[(Signature, PublicKey, Message)]) -> bool {
+	let mut sigs_vec = Vec::new();
+	let mut msgs_vec = Vec::new();
+	let mut pub_keys_vec = Vec::new();
+
+	for (sig, pk, msg) in batch {
+		let mut is_ok = false;
+		for j in 0..pk.0.len() {
+			if pk.0[j] != 0 {
+				is_ok = true;
+			}
+		}
+		if !is_ok {
+			return false;
+		}
+		match sigs_vec.push(sig.0.as_ptr()) {
+			Ok(_) => {}
+			Err(_) => return false,
+		}
+		match msgs_vec.push(msg.0.as_ptr()) {
+			Ok(_) => {}
+			Err(_) => return false,
+		}
+		match pub_keys_vec.push(pk.as_ptr()) {
+			Ok(_) => {}
+			Err(_) => return false,
+		}
+	}
+
+	unsafe {
+		let scratch = crate::secp256k1::scratch_checkout(secp.ctx, SCRATCH_SPACE_SIZE);
+		if scratch.is_null() {
+			return false;
+		}
+		let result = ffi::secp256k1_schnorrsig_verify_batch(
+			secp.ctx,
+			scratch,
+			sigs_vec.as_ptr() as *const *const u8,
+			msgs_vec.as_ptr() as *const *const u8,
+			pub_keys_vec.as_ptr() as *const *const PublicKey,
+			batch.len(),
+		);
+		crate::secp256k1::scratch_checkin(scratch, SCRATCH_SPACE_SIZE);
+		result == 1
+	}
+}
+
+/// Half-aggregate Schnorr signatures for relay
+/// Returns: Ok(Vec<u8>) of 32*(n+1) bytes: the r part of every signature
+/// followed by a randomized sum of the s parts, so n signatures relay at
+/// roughly half the size of n separate 64 byte signatures
+/// In:
+/// batch: (signature, pubkey, message) tuples to aggregate
+pub fn aggregate_half(
+	secp: &Secp256k1,
+	batch: &[(Signature, PublicKey, Message)],
+) -> Result<Vec<u8>, Error> {
+	if batch.len() == 0 {
+		return Err(err!(IllegalArgument));
+	}
+	let mut sigs_vec = Vec::new();
+	let mut msgs_vec = Vec::new();
+	let mut pub_keys_vec = Vec::new();
+
+	for (sig, pk, msg) in batch {
+		match sigs_vec.push(sig.0.as_ptr()) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+		match msgs_vec.push(msg.0.as_ptr()) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+		match pub_keys_vec.push(pk.as_ptr()) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+	}
+
+	let mut aggsig: Vec<u8> = Vec::new();
+	match aggsig.resize(32 * (batch.len() + 1)) {
+		Ok(_) => {}
+		Err(e) => return Err(e),
+	}
+	let retval = unsafe {
+		ffi::secp256k1_schnorrsig_half_aggregate(
+			secp.ctx,
+			aggsig.as_mut_ptr(),
+			sigs_vec.as_ptr() as *const *const u8,
+			msgs_vec.as_ptr() as *const *const u8,
+			pub_keys_vec.as_ptr() as *const *const PublicKey,
+			batch.len(),
+		)
+	};
+	if retval == 0 {
+		return Err(err!(InvalidSignature));
+	}
+	Ok(aggsig)
+}
+
+/// Verify a half-aggregate signature produced by aggregate_half
+/// Returns: true if the aggregate is valid for every (pubkey, message)
+/// In:
+/// aggsig: the 32*(n+1) byte aggregate
+/// batch: (pubkey, message) tuples in aggregation order, verified with a
+/// single multi-scalar multiplication
+pub fn verify_half(secp: &Secp256k1, aggsig: &[u8], batch: &[(PublicKey, Message)]) -> bool {
+	if batch.len() == 0 || aggsig.len() != 32 * (batch.len() + 1) {
+		return false;
+	}
+	let mut msgs_vec = Vec::new();
+	let mut pub_keys_vec = Vec::new();
+
+	for (pk, msg) in batch {
+		let mut is_ok = false;
+		for j in 0..pk.0.len() {
+			if pk.0[j] != 0 {
+				is_ok = true;
+			}
+		}
+		if !is_ok {
+			return false;
+		}
+		match msgs_vec.push(msg.0.as_ptr()) {
+			Ok(_) => {}
+			Err(_) => return false,
+		}
+		match pub_keys_vec.push(pk.as_ptr()) {
+			Ok(_) => {}
+			Err(_) => return false,
+		}
+	}
+
+	unsafe {
+		let scratch = crate::secp256k1::scratch_checkout(secp.ctx, SCRATCH_SPACE_SIZE);
+		if scratch.is_null() {
+			return false;
+		}
+		let result = ffi::secp256k1_schnorrsig_half_agg_verify(
+			secp.ctx,
+			scratch,
+			aggsig.as_ptr(),
+			msgs_vec.as_ptr() as *const *const u8,
+			pub_keys_vec.as_ptr() as *const *const PublicKey,
+			batch.len(),
+		);
+		crate::secp256k1::scratch_checkin(scratch, SCRATCH_SPACE_SIZE);
 		result == 1
 	}
 }
@@ -493,6 +739,166 @@ impl Drop for AggSigContext {
 	}
 }
 
+/// Multi-round signing session. AggSigContext keeps the aggsig state on
+/// the C side but its callers still re-marshal the pubkey set on every
+/// verify and rebuild scratch space per call; with thousands of
+/// concurrent interactive sessions that marshaling dominates. A session
+/// owns the aggsig context, the contiguous pubkey array, one reusable
+/// scratch space and the partial-signature accumulator, pre-generates
+/// every secnonce up front, and each round is then a single FFI
+/// crossing that passes only cached pointers.
+pub struct AggSigSession {
+	ctx: *mut Context,
+	aggsig_ctx: *mut crate::secp256k1::types::AggSigContext,
+	pubkeys: Vec<PublicKey>,
+	scratch: *mut ScratchSpace,
+	partials: Vec<AggSigPartialSignature>,
+}
+
+impl AggSigSession {
+	/// Builds the session state once: pubkeys are copied into one
+	/// contiguous array, the aggsig context is created over it and a
+	/// secnonce is generated for every index, so no round pays setup
+	pub fn new(
+		secp: &Secp256k1,
+		pubkeys_vec: &Vec<PublicKey>,
+		rand: *mut u8,
+	) -> Result<AggSigSession, Error> {
+		let n = pubkeys_vec.len();
+		if n == 0 {
+			return Err(err!(IllegalArgument));
+		}
+		let pubkeys = match pubkeys_vec.clone() {
+			Ok(pubkeys) => pubkeys,
+			Err(e) => return Err(e),
+		};
+		let mut partials = Vec::new();
+		match partials.reserve(n) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+		let mut seed = [0u8; 32];
+		unsafe { cpsrng_rand_bytes_ctx(rand, &mut seed as *mut u8, 32) };
+		let aggsig_ctx = unsafe {
+			ffi::secp256k1_aggsig_context_create(secp.ctx, pubkeys.as_ptr() as *const PublicKey, n, seed.as_ptr())
+		};
+		if aggsig_ctx.is_null() {
+			return Err(err!(SecpInit));
+		}
+		let scratch = crate::secp256k1::scratch_checkout(secp.ctx, SCRATCH_SPACE_SIZE);
+		if scratch.is_null() {
+			unsafe {
+				ffi::secp256k1_aggsig_context_destroy(aggsig_ctx);
+			}
+			return Err(err!(SecpInit));
+		}
+		for i in 0..n {
+			if unsafe { ffi::secp256k1_aggsig_generate_nonce(secp.ctx, aggsig_ctx, i) } != 1 {
+				unsafe {
+					crate::secp256k1::scratch_checkin(scratch, SCRATCH_SPACE_SIZE);
+					ffi::secp256k1_aggsig_context_destroy(aggsig_ctx);
+				}
+				return Err(err!(SecpInit));
+			}
+		}
+		Ok(AggSigSession {
+			ctx: secp.ctx,
+			aggsig_ctx,
+			pubkeys,
+			scratch,
+			partials,
+		})
+	}
+
+	/// Produce this signer's partial signature for the round and add it
+	/// to the accumulator: one FFI call, the secnonce was generated at
+	/// session setup
+	pub fn sign_index(
+		&mut self,
+		msg: &Message,
+		seckey: &SecretKey,
+		index: usize,
+	) -> Result<AggSigPartialSignature, Error> {
+		let mut retsig = AggSigPartialSignature::new();
+		let retval = unsafe {
+			ffi::secp256k1_aggsig_partial_sign(
+				self.ctx,
+				self.aggsig_ctx,
+				retsig.as_mut_ptr(),
+				msg.as_ptr(),
+				seckey.as_ptr(),
+				index,
+			)
+		};
+		if retval == 0 {
+			return Err(err!(PartialSigFailure));
+		}
+		match self.add_partial(retsig) {
+			Ok(_) => Ok(retsig),
+			Err(e) => Err(e),
+		}
+	}
+
+	/// Accumulate a partial signature received from another party; no
+	/// FFI crossing, the accumulator is the contiguous array combine
+	/// consumes directly
+	pub fn add_partial(&mut self, sig: AggSigPartialSignature) -> Result<(), Error> {
+		self.partials.push(sig)
+	}
+
+	/// Combine everything accumulated so far into one signature
+	pub fn combine(&mut self) -> Result<Signature, Error> {
+		if self.partials.len() == 0 {
+			return Err(err!(IllegalArgument));
+		}
+		let mut retsig = Signature::new();
+		let retval = unsafe {
+			ffi::secp256k1_aggsig_combine_signatures(
+				self.ctx,
+				self.aggsig_ctx,
+				retsig.as_mut_ptr(),
+				self.partials.as_ptr() as *const AggSigPartialSignature,
+				self.partials.len(),
+			)
+		};
+		if retval == 0 {
+			return Err(err!(PartialSigFailure));
+		}
+		Ok(retsig)
+	}
+
+	/// Verify against the cached pubkey array with the session's
+	/// scratch space; nothing is re-marshaled per call
+	pub fn verify(&self, sig: &Signature, msg: &Message) -> bool {
+		let retval = unsafe {
+			ffi::secp256k1_aggsig_verify(
+				self.ctx,
+				self.scratch,
+				sig.as_ptr(),
+				msg.as_ptr(),
+				self.pubkeys.as_ptr() as *const PublicKey,
+				self.pubkeys.len(),
+			)
+		};
+		retval == 1
+	}
+
+	/// Drop the accumulated partials for the next round, keeping their
+	/// capacity
+	pub fn reset_partials(&mut self) {
+		self.partials.truncate(0);
+	}
+}
+
+impl Drop for AggSigSession {
+	fn drop(&mut self) {
+		unsafe {
+			crate::secp256k1::scratch_checkin(self.scratch, SCRATCH_SPACE_SIZE);
+			ffi::secp256k1_aggsig_context_destroy(self.aggsig_ctx);
+		}
+	}
+}
+
 /*
 
 #[cfg(test)]
@@ -874,3 +1280,114 @@ use crate::ffi;
 	}
 }
 */
+
+#[cfg(test)]
+mod test {
+	use super::{pin_pubkey, sign_single, verify_single, verify_single_pinned, AggSigSession};
+	use ffi::{cpsrng_context_create, cpsrng_context_destroy, getalloccount};
+	use prelude::*;
+	use secp256k1::types::{ContextFlag, Message, PublicKey, Secp256k1, SecretKey, MESSAGE_SIZE};
+
+	#[test]
+	fn test_aggsig_pinned() {
+		let initial = unsafe { getalloccount() };
+		{
+			let secp = Secp256k1::with_caps(ContextFlag::Full).unwrap();
+			let rand = unsafe { cpsrng_context_create() };
+
+			let sk = SecretKey::generate(rand);
+			let mut pk = PublicKey::new();
+			let retval = unsafe {
+				crate::ffi::secp256k1_ec_pubkey_create(
+					secp.ctx,
+					pk.as_mut_ptr(),
+					sk.as_ptr() as *const u8,
+				)
+			};
+			assert_eq!(retval, 1);
+
+			// the pinned table accepts and rejects exactly what the
+			// generic path does
+			let pinned = pin_pubkey(&secp, &pk).unwrap();
+			for i in 0..8 {
+				let msg = Message([i as u8 + 1; MESSAGE_SIZE]);
+				let sig =
+					sign_single(&secp, &msg, &sk, None, None, None, None, None, rand).unwrap();
+				assert!(verify_single(&secp, &sig, &msg, None, &pk, None, None, false));
+				assert!(verify_single_pinned(
+					&secp, &sig, &msg, None, &pinned, None, None, false
+				));
+				let wrong = Message([99u8; MESSAGE_SIZE]);
+				assert!(!verify_single_pinned(
+					&secp, &sig, &wrong, None, &pinned, None, None, false
+				));
+			}
+
+			// another signer's signature does not verify against the
+			// pinned table
+			let sk2 = SecretKey::generate(rand);
+			let msg = Message([42u8; MESSAGE_SIZE]);
+			let sig2 = sign_single(&secp, &msg, &sk2, None, None, None, None, None, rand).unwrap();
+			assert!(!verify_single_pinned(
+				&secp, &sig2, &msg, None, &pinned, None, None, false
+			));
+
+			// the zero key cannot be pinned
+			let zero = PublicKey::new();
+			assert!(pin_pubkey(&secp, &zero).is_err());
+
+			unsafe {
+				cpsrng_context_destroy(rand);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_aggsig_session() {
+		let initial = unsafe { getalloccount() };
+		{
+			let secp = Secp256k1::with_caps(ContextFlag::Full).unwrap();
+			let rand = unsafe { cpsrng_context_create() };
+
+			let mut sks = Vec::new();
+			let mut pks = Vec::new();
+			for _ in 0..3 {
+				let sk = SecretKey::generate(rand);
+				let mut pk = PublicKey::new();
+				let retval = unsafe {
+					crate::ffi::secp256k1_ec_pubkey_create(
+						secp.ctx,
+						pk.as_mut_ptr(),
+						sk.as_ptr() as *const u8,
+					)
+				};
+				assert_eq!(retval, 1);
+				sks.push(sk).unwrap();
+				pks.push(pk).unwrap();
+			}
+
+			// setup marshals the pubkeys and generates every secnonce;
+			// each round below is a single ffi call
+			let mut session = AggSigSession::new(&secp, &pks, rand).unwrap();
+			let msg = Message([3u8; MESSAGE_SIZE]);
+			for i in 0..3 {
+				session.sign_index(&msg, &sks[i], i).unwrap();
+			}
+			let sig = session.combine().unwrap();
+			assert!(session.verify(&sig, &msg));
+			let other = Message([4u8; MESSAGE_SIZE]);
+			assert!(!session.verify(&sig, &other));
+
+			// a fresh round over the same session reuses every cached
+			// structure; partials from the last round are dropped
+			session.reset_partials();
+			assert!(session.combine().is_err());
+
+			unsafe {
+				cpsrng_context_destroy(rand);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+}
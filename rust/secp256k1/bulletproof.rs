@@ -0,0 +1,799 @@
+// Rust secp256k1 bindings for bulletproof rangeproof functions
+//
+// To the extent possible under law, the author(s) have dedicated all
+// copyright and related and neighboring rights to this software to
+// the public domain worldwide. This software is distributed without
+// any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication
+// along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//
+
+//! # Aggregated Bulletproof Rangeproof Functionality
+
+use core::marker::Copy;
+use core::ptr;
+use ffi;
+use prelude::*;
+use secp256k1::pedersen::Commitment;
+use secp256k1::types::*;
+
+/// The maximum size (in bytes) of a serialized bulletproof
+/// (SECP256K1_BULLETPROOF_MAX_PROOF in the vendored library)
+pub const MAX_PROOF_SIZE: usize = 160 + 36 * 32 + 7;
+
+/// The number of bits proven for each committed value
+pub const PROOF_NBITS: usize = 64;
+
+const SCRATCH_SPACE_SIZE: usize = 1024 * 1024;
+
+/// An aggregated bulletproof rangeproof covering one or more commitments
+#[repr(C)]
+#[derive(Clone)]
+pub struct RangeProof {
+	/// The proof itself, at most MAX_PROOF_SIZE bytes in length
+	pub proof: [u8; MAX_PROOF_SIZE],
+	/// The length of the proof
+	pub plen: usize,
+}
+impl Copy for RangeProof {}
+
+impl RangeProof {
+	/// The proof as a byte slice
+	pub fn bytes(&self) -> &[u8] {
+		&self.proof[0..self.plen]
+	}
+}
+
+/// Precomputed generators shared by all proofs of a given maximum
+/// aggregation size. Creating them walks the curve once, so they should
+/// be built up front and reused for every prove/verify call.
+pub struct BulletGenerators {
+	ctx: *mut Context,
+	gens: *mut crate::secp256k1::types::BulletproofGenerators,
+	// false when gens points at the process-wide cached set, which
+	// outlives this handle and is destroyed only by bullet_gens_drain
+	owned: bool,
+}
+
+impl BulletGenerators {
+	/// Creates generators sufficient for aggregated proofs over up to
+	/// `max_commits` commitments (2 * PROOF_NBITS generators per commitment)
+	pub fn new(secp: &Secp256k1, max_commits: usize) -> Result<BulletGenerators, Error> {
+		let n = 2 * PROOF_NBITS * max_commits;
+		let gens = unsafe {
+			ffi::secp256k1_bulletproof_generators_create(
+				secp.ctx,
+				ffi::secp256k1_generator_const_g.0.as_ptr(),
+				n as u64,
+			)
+		};
+		if gens.is_null() {
+			return Err(err!(SecpInit));
+		}
+		Ok(BulletGenerators {
+			ctx: secp.ctx,
+			gens,
+			owned: true,
+		})
+	}
+
+	/// A handle to the process-wide cached set (bullet_gens_init) when
+	/// it covers `max_commits`; falls back to building a private set,
+	/// so callers take the cache opportunistically without a second
+	/// code path
+	pub fn cached(secp: &Secp256k1, max_commits: usize) -> Result<BulletGenerators, Error> {
+		let gens = crate::secp256k1::bullet_gens_cached(max_commits);
+		if !gens.is_null() {
+			return Ok(BulletGenerators {
+				ctx: secp.ctx,
+				gens,
+				owned: false,
+			});
+		}
+		Self::new(secp, max_commits)
+	}
+}
+
+impl Drop for BulletGenerators {
+	fn drop(&mut self) {
+		if self.owned {
+			unsafe {
+				ffi::secp256k1_bulletproof_generators_destroy(self.ctx, self.gens);
+			}
+		}
+	}
+}
+
+/// Produces one aggregated rangeproof over a slice of values
+/// Returns: Ok(RangeProof) on success
+/// In:
+/// gens: precomputed generators covering at least values.len() commitments
+/// values: the committed values, all proven in range with a single proof
+/// blinds: the blinding factor for each value
+/// nonce: rewind nonce
+pub fn prove_aggregated(
+	secp: &Secp256k1,
+	gens: &BulletGenerators,
+	values: &[u64],
+	blinds: &[SecretKey],
+	nonce: &SecretKey,
+) -> Result<RangeProof, Error> {
+	if values.len() == 0 || values.len() != blinds.len() {
+		return Err(err!(IllegalArgument));
+	}
+	let mut blind_ptrs: Vec<*const u8> = Vec::new();
+	for blind in blinds {
+		match blind_ptrs.push(blind.0.as_ptr()) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+	}
+
+	let mut proof = [0u8; MAX_PROOF_SIZE];
+	let mut plen = MAX_PROOF_SIZE as u64;
+	let retval = unsafe {
+		let scratch = crate::secp256k1::scratch_checkout(secp.ctx, SCRATCH_SPACE_SIZE);
+		if scratch.is_null() {
+			return Err(err!(Alloc));
+		}
+		let retval = ffi::secp256k1_bulletproof_rangeproof_prove(
+			secp.ctx,
+			scratch,
+			gens.gens,
+			proof.as_mut_ptr(),
+			&mut plen,
+			ptr::null_mut(),
+			ptr::null_mut(),
+			ptr::null_mut(),
+			values.as_ptr(),
+			ptr::null(),
+			blind_ptrs.as_ptr() as *const *const u8,
+			ptr::null(),
+			values.len() as u64,
+			ffi::secp256k1_generator_const_h.0.as_ptr(),
+			PROOF_NBITS as u64,
+			nonce.0.as_ptr(),
+			ptr::null(),
+			ptr::null(),
+			0,
+			ptr::null(),
+		);
+		crate::secp256k1::scratch_checkin(scratch, SCRATCH_SPACE_SIZE);
+		retval
+	};
+	if retval == 0 {
+		return Err(err!(SecpErr));
+	}
+	Ok(RangeProof {
+		proof,
+		plen: plen as usize,
+	})
+}
+
+// parse serialized commitments into one contiguous array of the 64 byte
+// internal form the verify entry points index into
+fn parse_commits(ctx: *mut Context, commits: &[Commitment]) -> Result<Vec<[u8; 64]>, Error> {
+	let mut internal = Vec::new();
+	for c in commits {
+		let mut i = [0u8; 64];
+		let retval = unsafe {
+			ffi::secp256k1_pedersen_commitment_parse(ctx, i.as_mut_ptr(), c.as_ptr())
+		};
+		if retval == 0 {
+			return Err(err!(SecpErr));
+		}
+		match internal.push(i) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+	}
+	Ok(internal)
+}
+
+/// Verifies one aggregated rangeproof against its commitments
+/// Returns: true if every committed value is in range
+/// In:
+/// gens: precomputed generators covering at least commits.len() commitments
+/// proof: the aggregated proof
+/// commits: the commitments the proof covers, in proving order
+pub fn verify_aggregated(
+	secp: &Secp256k1,
+	gens: &BulletGenerators,
+	proof: &RangeProof,
+	commits: &[Commitment],
+) -> bool {
+	if commits.len() == 0 {
+		return false;
+	}
+	let internal = match parse_commits(secp.ctx, commits) {
+		Ok(i) => i,
+		Err(_) => return false,
+	};
+	unsafe {
+		let scratch = crate::secp256k1::scratch_checkout(secp.ctx, SCRATCH_SPACE_SIZE);
+		if scratch.is_null() {
+			return false;
+		}
+		let retval = ffi::secp256k1_bulletproof_rangeproof_verify(
+			secp.ctx,
+			scratch,
+			gens.gens,
+			proof.proof.as_ptr(),
+			proof.plen as u64,
+			ptr::null(),
+			internal.as_ptr() as *const u8,
+			commits.len() as u64,
+			PROOF_NBITS as u64,
+			ffi::secp256k1_generator_const_h.0.as_ptr(),
+			ptr::null(),
+			0,
+		);
+		crate::secp256k1::scratch_checkin(scratch, SCRATCH_SPACE_SIZE);
+		retval == 1
+	}
+}
+
+/// Batch verification of multiple rangeproofs with one multiexponentiation
+/// Returns: true if every proof in the batch is valid
+/// In:
+/// gens: precomputed generators covering the aggregation size
+/// batch: (proof, commitments) pairs. All proofs must cover the same
+/// number of commitments and have equal length, which the aggregated
+/// prover guarantees for a fixed aggregation size
+pub fn verify_batch(
+	secp: &Secp256k1,
+	gens: &BulletGenerators,
+	batch: &[(RangeProof, Vec<Commitment>)],
+) -> bool {
+	verify_batch_impl(secp.ctx, gens.gens, batch)
+}
+
+fn verify_batch_impl(
+	ctx: *mut Context,
+	gens: *mut crate::secp256k1::types::BulletproofGenerators,
+	batch: &[(RangeProof, Vec<Commitment>)],
+) -> bool {
+	if batch.len() == 0 {
+		return false;
+	}
+	let n_commits = batch[0].1.len();
+	let plen = batch[0].0.plen;
+	if n_commits == 0 {
+		return false;
+	}
+
+	let mut proof_ptrs: Vec<*const u8> = Vec::new();
+	let mut internal = Vec::new();
+	for (proof, commits) in batch {
+		if commits.len() != n_commits || proof.plen != plen {
+			return false;
+		}
+		match proof_ptrs.push(proof.proof.as_ptr()) {
+			Ok(_) => {}
+			Err(_) => return false,
+		}
+		match parse_commits(ctx, &commits[0..commits.len()]) {
+			Ok(i) => match internal.push(i) {
+				Ok(_) => {}
+				Err(_) => return false,
+			},
+			Err(_) => return false,
+		}
+	}
+	let mut commit_ptrs: Vec<*const u8> = Vec::new();
+	for i in 0..internal.len() {
+		match commit_ptrs.push(internal[i].as_ptr() as *const u8) {
+			Ok(_) => {}
+			Err(_) => return false,
+		}
+	}
+	// the multi entry point takes one value generator per proof
+	let mut value_gens: Vec<Generator> = Vec::new();
+	for _ in 0..batch.len() {
+		match value_gens.push(unsafe { ffi::secp256k1_generator_const_h }) {
+			Ok(_) => {}
+			Err(_) => return false,
+		}
+	}
+
+	unsafe {
+		let scratch = crate::secp256k1::scratch_checkout(ctx, SCRATCH_SPACE_SIZE);
+		if scratch.is_null() {
+			return false;
+		}
+		let retval = ffi::secp256k1_bulletproof_rangeproof_verify_multi(
+			ctx,
+			scratch,
+			gens,
+			proof_ptrs.as_ptr() as *const *const u8,
+			batch.len() as u64,
+			plen as u64,
+			ptr::null(),
+			commit_ptrs.as_ptr() as *const *const u8,
+			n_commits as u64,
+			PROOF_NBITS as u64,
+			value_gens.as_ptr() as *const u8,
+			ptr::null(),
+			ptr::null(),
+		);
+		crate::secp256k1::scratch_checkin(scratch, SCRATCH_SPACE_SIZE);
+		retval == 1
+	}
+}
+
+/// Verifies a large batch by splitting it into `workers` chunks executed
+/// concurrently on the runtime and joining via Handle::block_on
+/// Returns: true only if every chunk verifies
+/// In:
+/// gens: precomputed generators covering the aggregation size
+/// runtime: a started Runtime whose workers run the chunks
+/// workers: number of chunks, typically the pool's thread count
+/// batch: (proof, commitments) pairs, same constraints as verify_batch
+pub fn verify_parallel(
+	secp: &Secp256k1,
+	gens: &BulletGenerators,
+	runtime: &mut Runtime<bool>,
+	workers: usize,
+	batch: &[(RangeProof, Vec<Commitment>)],
+) -> bool {
+	if batch.len() == 0 {
+		return false;
+	}
+	let workers = if workers == 0 { 1 } else { workers };
+	let chunk = (batch.len() + workers - 1) / workers;
+	// verification only reads the context and generators, so raw
+	// pointers to them are shared across the workers; each chunk
+	// creates its own scratch space
+	let ctx = secp.ctx as usize;
+	let gens_ptr = gens.gens as usize;
+	let mut handles = Vec::new();
+	let mut i = 0;
+	while i < batch.len() {
+		let end = if i + chunk > batch.len() {
+			batch.len()
+		} else {
+			i + chunk
+		};
+		// tasks must be 'static, so each owns a copy of its chunk
+		let mut owned: Vec<(RangeProof, Vec<Commitment>)> = Vec::new();
+		for j in i..end {
+			let mut commits = Vec::new();
+			for k in 0..batch[j].1.len() {
+				match commits.push(batch[j].1[k]) {
+					Ok(_) => {}
+					Err(_) => return false,
+				}
+			}
+			match owned.push((batch[j].0, commits)) {
+				Ok(_) => {}
+				Err(_) => return false,
+			}
+		}
+		let h = runtime.execute(move || {
+			verify_batch_impl(
+				ctx as *mut Context,
+				gens_ptr as *mut crate::secp256k1::types::BulletproofGenerators,
+				&owned[0..owned.len()],
+			)
+		});
+		match h {
+			Ok(h) => match handles.push(h) {
+				Ok(_) => {}
+				Err(_) => return false,
+			},
+			Err(_) => return false,
+		}
+		i = end;
+	}
+	let mut ok = true;
+	for i in 0..handles.len() {
+		if !handles[i].block_on() {
+			ok = false;
+		}
+	}
+	ok
+}
+
+/// Attempts to open one single-commitment proof with a viewing nonce
+/// Returns: Some((value, blind)) when the nonce rewinds the proof, None
+/// when the proof belongs to someone else (or is malformed)
+pub fn rewind(
+	secp: &Secp256k1,
+	proof: &RangeProof,
+	commit: &Commitment,
+	nonce: &SecretKey,
+) -> Option<(u64, SecretKey)> {
+	rewind_one(secp.ctx, proof, commit, nonce)
+}
+
+fn rewind_one(
+	ctx: *mut Context,
+	proof: &RangeProof,
+	commit: &Commitment,
+	nonce: &SecretKey,
+) -> Option<(u64, SecretKey)> {
+	let mut internal = [0u8; 64];
+	let retval = unsafe {
+		ffi::secp256k1_pedersen_commitment_parse(ctx, internal.as_mut_ptr(), commit.as_ptr())
+	};
+	if retval == 0 {
+		return None;
+	}
+	let mut value = 0u64;
+	let mut blind = SecretKey([0u8; 32]);
+	let retval = unsafe {
+		ffi::secp256k1_bulletproof_rangeproof_rewind(
+			ctx,
+			&mut value,
+			blind.0.as_mut_ptr(),
+			proof.proof.as_ptr(),
+			proof.plen as u64,
+			0,
+			internal.as_ptr(),
+			ffi::secp256k1_generator_const_h.0.as_ptr(),
+			nonce.0.as_ptr(),
+			ptr::null(),
+			0,
+			ptr::null_mut(),
+		)
+	};
+	if retval == 1 {
+		Some((value, blind))
+	} else {
+		None
+	}
+}
+
+/// Rewinds a slice of (commitment, proof) pairs with one viewing key,
+/// sharing the context across the whole batch instead of paying the
+/// wrapper setup per output. A pair that does not rewind (not ours, or
+/// malformed) yields None in its slot, so a wallet rescan keeps going
+/// Returns: one Option per input pair, in input order
+pub fn rewind_batch(
+	secp: &Secp256k1,
+	nonce: &SecretKey,
+	batch: &[(Commitment, RangeProof)],
+) -> Result<Vec<Option<(u64, SecretKey)>>, Error> {
+	rewind_batch_impl(secp.ctx, nonce, batch)
+}
+
+fn rewind_batch_impl(
+	ctx: *mut Context,
+	nonce: &SecretKey,
+	batch: &[(Commitment, RangeProof)],
+) -> Result<Vec<Option<(u64, SecretKey)>>, Error> {
+	let mut ret = Vec::new();
+	match ret.reserve(batch.len()) {
+		Ok(_) => {}
+		Err(e) => return Err(e),
+	}
+	for (commit, proof) in batch {
+		match ret.push(rewind_one(ctx, proof, commit, nonce)) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+	}
+	Ok(ret)
+}
+
+/// Rewinds a large batch by splitting it into `workers` chunks executed
+/// concurrently on the runtime and joining via Handle::block_on; the
+/// rescan path for millions of historical outputs
+/// Returns: one Option per input pair, in input order
+/// In:
+/// runtime: a started Runtime whose workers run the chunks
+/// workers: number of chunks, typically the pool's thread count
+pub fn rewind_parallel(
+	secp: &Secp256k1,
+	runtime: &mut Runtime<Result<Vec<Option<(u64, SecretKey)>>, Error>>,
+	workers: usize,
+	nonce: &SecretKey,
+	batch: &[(Commitment, RangeProof)],
+) -> Result<Vec<Option<(u64, SecretKey)>>, Error> {
+	if batch.len() == 0 {
+		return Ok(Vec::new());
+	}
+	let workers = if workers == 0 { 1 } else { workers };
+	let chunk = (batch.len() + workers - 1) / workers;
+	// rewind only reads the context, so a raw pointer to it is shared
+	// across the workers like in verify_parallel
+	let ctx = secp.ctx as usize;
+	let mut handles = Vec::new();
+	let mut i = 0;
+	while i < batch.len() {
+		let end = if i + chunk > batch.len() {
+			batch.len()
+		} else {
+			i + chunk
+		};
+		// tasks must be 'static, so each owns a copy of its chunk and
+		// of the viewing key (SecretKey scrubs on drop, so no Copy)
+		let mut owned: Vec<(Commitment, RangeProof)> = Vec::new();
+		for j in i..end {
+			match owned.push(batch[j]) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			}
+		}
+		let task_nonce = SecretKey(nonce.0);
+		let h = runtime.execute(move || {
+			rewind_batch_impl(ctx as *mut Context, &task_nonce, &owned[0..owned.len()])
+		});
+		match h {
+			Ok(h) => match handles.push(h) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			},
+			Err(e) => return Err(e),
+		}
+		i = end;
+	}
+	let mut ret = Vec::new();
+	match ret.reserve(batch.len()) {
+		Ok(_) => {}
+		Err(e) => return Err(e),
+	}
+	for i in 0..handles.len() {
+		match handles[i].block_on() {
+			Ok(part) => {
+				for v in part {
+					match ret.push(v) {
+						Ok(_) => {}
+						Err(e) => return Err(e),
+					}
+				}
+			}
+			Err(e) => return Err(e),
+		}
+	}
+	Ok(ret)
+}
+
+#[cfg(test)]
+mod test {
+	use super::{
+		prove_aggregated, rewind, rewind_batch, rewind_parallel, verify_aggregated, verify_batch,
+		verify_parallel, BulletGenerators,
+	};
+	use ffi::{cpsrng_context_create, cpsrng_context_destroy, getalloccount};
+	use prelude::*;
+	use secp256k1::pedersen::commit;
+	use secp256k1::types::{ContextFlag, Secp256k1, SecretKey};
+
+	#[test]
+	fn test_bulletproof_aggregated() {
+		let initial = unsafe { getalloccount() };
+		{
+			let secp = Secp256k1::with_caps(ContextFlag::Commit).unwrap();
+			let gens = BulletGenerators::new(&secp, 2).unwrap();
+			let rand = unsafe { cpsrng_context_create() };
+
+			// one aggregated proof over two values
+			let values = [5u64, 7u64];
+			let blinds = [SecretKey::generate(rand), SecretKey::generate(rand)];
+			let nonce = SecretKey::generate(rand);
+			let proof =
+				prove_aggregated(&secp, &gens, &values, &blinds, &nonce).unwrap();
+
+			let mut commits = Vec::new();
+			commits.push(commit(&secp, values[0], &blinds[0]).unwrap()).unwrap();
+			commits.push(commit(&secp, values[1], &blinds[1]).unwrap()).unwrap();
+			assert!(verify_aggregated(
+				&secp,
+				&gens,
+				&proof,
+				&commits[0..commits.len()]
+			));
+			// swapped commitments must not verify
+			let mut swapped = Vec::new();
+			swapped.push(commits[1]).unwrap();
+			swapped.push(commits[0]).unwrap();
+			assert!(!verify_aggregated(
+				&secp,
+				&gens,
+				&proof,
+				&swapped[0..swapped.len()]
+			));
+
+			// batch verify two aggregated proofs at once
+			let values2 = [11u64, 13u64];
+			let blinds2 = [SecretKey::generate(rand), SecretKey::generate(rand)];
+			let nonce2 = SecretKey::generate(rand);
+			let proof2 =
+				prove_aggregated(&secp, &gens, &values2, &blinds2, &nonce2).unwrap();
+			let mut commits2 = Vec::new();
+			commits2
+				.push(commit(&secp, values2[0], &blinds2[0]).unwrap())
+				.unwrap();
+			commits2
+				.push(commit(&secp, values2[1], &blinds2[1]).unwrap())
+				.unwrap();
+
+			let mut batch = Vec::new();
+			batch.push((proof, commits)).unwrap();
+			batch.push((proof2, commits2)).unwrap();
+			assert!(verify_batch(&secp, &gens, &batch[0..batch.len()]));
+
+			// corrupt one proof in the batch
+			batch[1].0.proof[32] ^= 1;
+			assert!(!verify_batch(&secp, &gens, &batch[0..batch.len()]));
+
+			unsafe {
+				cpsrng_context_destroy(rand);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_bulletproof_gens_cache() {
+		let initial = unsafe { getalloccount() };
+		{
+			let secp = Secp256k1::with_caps(ContextFlag::Commit).unwrap();
+			let rand = unsafe { cpsrng_context_create() };
+			crate::secp256k1::bullet_gens_init(&secp, 2).unwrap();
+
+			// cached handles share the parked set instead of re-deriving
+			let gens = BulletGenerators::cached(&secp, 2).unwrap();
+			let gens2 = BulletGenerators::cached(&secp, 2).unwrap();
+			assert_eq!(gens.gens, gens2.gens);
+			assert!(!gens.owned);
+
+			// prove and verify through the cache
+			let values = [5u64, 7u64];
+			let blinds = [SecretKey::generate(rand), SecretKey::generate(rand)];
+			let nonce = SecretKey::generate(rand);
+			let proof = prove_aggregated(&secp, &gens, &values, &blinds, &nonce).unwrap();
+			let mut commits = Vec::new();
+			commits.push(commit(&secp, values[0], &blinds[0]).unwrap()).unwrap();
+			commits.push(commit(&secp, values[1], &blinds[1]).unwrap()).unwrap();
+			assert!(verify_aggregated(
+				&secp,
+				&gens2,
+				&proof,
+				&commits[0..commits.len()]
+			));
+
+			// an aggregation the cache cannot cover builds a private set
+			let big = BulletGenerators::cached(&secp, 4).unwrap();
+			assert!(big.owned);
+			assert!(big.gens != gens.gens);
+
+			crate::secp256k1::bullet_gens_drain(&secp);
+			unsafe {
+				cpsrng_context_destroy(rand);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_bulletproof_rewind() {
+		let initial = unsafe { getalloccount() };
+		{
+			let secp = Secp256k1::with_caps(ContextFlag::Commit).unwrap();
+			let gens = BulletGenerators::new(&secp, 1).unwrap();
+			let rand = unsafe { cpsrng_context_create() };
+			// one viewing key across the whole batch, as a wallet scan
+			// derives it from the commitment plus the view secret
+			let nonce = SecretKey::generate(rand);
+			let other = SecretKey::generate(rand);
+
+			let mut batch = Vec::new();
+			for i in 0..4 {
+				let value = 100u64 + i;
+				let blinds = [SecretKey::generate(rand)];
+				// the last output belongs to someone else
+				let n = if i == 3 { &other } else { &nonce };
+				let proof = prove_aggregated(&secp, &gens, &[value], &blinds, n).unwrap();
+				let c = commit(&secp, value, &blinds[0]).unwrap();
+				batch.push((c, proof)).unwrap();
+			}
+
+			// single rewind recovers the committed value and blind
+			let (v, blind) = rewind(&secp, &batch[0].1, &batch[0].0, &nonce).unwrap();
+			assert_eq!(v, 100);
+			assert_eq!(commit(&secp, v, &blind).unwrap().0, batch[0].0 .0);
+			assert!(rewind(&secp, &batch[0].1, &batch[0].0, &other).is_none());
+
+			// batch rewind: ours open in order, the foreign one is None
+			let res = rewind_batch(&secp, &nonce, &batch[0..batch.len()]).unwrap();
+			assert_eq!(res.len(), 4);
+			for i in 0..3 {
+				match &res[i] {
+					Some((v, blind)) => {
+						assert_eq!(*v, 100 + i as u64);
+						assert_eq!(commit(&secp, *v, blind).unwrap().0, batch[i].0 .0);
+					}
+					None => panic!("expected rewind to open this output"),
+				}
+			}
+			assert!(res[3].is_none());
+
+			// parallel chunks agree with the serial result
+			let mut runtime = Runtime::new(RuntimeConfig {
+				min_threads: 2,
+				max_threads: 2,
+				..RuntimeConfig::default()
+			})
+			.unwrap();
+			runtime.start().unwrap();
+			let pres =
+				rewind_parallel(&secp, &mut runtime, 2, &nonce, &batch[0..batch.len()]).unwrap();
+			assert_eq!(pres.len(), 4);
+			for i in 0..4 {
+				assert_eq!(pres[i].is_some(), res[i].is_some());
+				match (&pres[i], &res[i]) {
+					(Some((va, ba)), Some((vb, bb))) => {
+						assert_eq!(va, vb);
+						assert_eq!(ba.0, bb.0);
+					}
+					_ => {}
+				}
+			}
+			runtime.stop().unwrap();
+
+			unsafe {
+				cpsrng_context_destroy(rand);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_bulletproof_parallel() {
+		let initial = unsafe { getalloccount() };
+		{
+			let secp = Secp256k1::with_caps(ContextFlag::Commit).unwrap();
+			let gens = BulletGenerators::new(&secp, 1).unwrap();
+			let rand = unsafe { cpsrng_context_create() };
+			let mut runtime: Runtime<bool> = Runtime::new(RuntimeConfig {
+				min_threads: 2,
+				max_threads: 2,
+				..RuntimeConfig::default()
+			})
+			.unwrap();
+			runtime.start().unwrap();
+
+			// four single-commitment proofs split across two workers
+			let mut batch = Vec::new();
+			for i in 0..4 {
+				let values = [10u64 + i];
+				let blinds = [SecretKey::generate(rand)];
+				let nonce = SecretKey::generate(rand);
+				let proof =
+					prove_aggregated(&secp, &gens, &values, &blinds, &nonce).unwrap();
+				let mut commits = Vec::new();
+				commits
+					.push(commit(&secp, values[0], &blinds[0]).unwrap())
+					.unwrap();
+				batch.push((proof, commits)).unwrap();
+			}
+			assert!(verify_parallel(
+				&secp,
+				&gens,
+				&mut runtime,
+				2,
+				&batch[0..batch.len()]
+			));
+			// parallel and serial agree on a corrupted batch
+			batch[3].0.proof[40] ^= 1;
+			assert!(!verify_parallel(
+				&secp,
+				&gens,
+				&mut runtime,
+				2,
+				&batch[0..batch.len()]
+			));
+			assert!(!verify_batch(&secp, &gens, &batch[0..batch.len()]));
+
+			runtime.stop().unwrap();
+			unsafe {
+				cpsrng_context_destroy(rand);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+}
@@ -14,4 +14,228 @@
 //
 
 pub mod aggsig;
+pub mod bulletproof;
+pub mod ecdh;
+pub mod pedersen;
+pub mod surjection;
 pub mod types;
+pub mod whitelist;
+
+use core::ptr::null_mut;
+use ffi::{
+	secp256k1_bulletproof_generators_create, secp256k1_bulletproof_generators_destroy,
+	secp256k1_generator_const_g, secp256k1_scratch_space_create, secp256k1_scratch_space_destroy,
+	thread_slot,
+};
+use prelude::*;
+use secp256k1::types::{BulletproofGenerators, Context, ScratchSpace, Secp256k1};
+
+// Per-thread pool of secp256k1 scratch spaces. The bulletproof and
+// multi-exp entry points used to create and destroy a multi-megabyte
+// scratch region around every call, and that malloc/free pair is a
+// measurable slice of batch-verify wall time. Each thread parks one
+// scratch of the configured size in its own slot (thread_slot, the same
+// per-thread slot scheme the stat shards use) and checks it out and
+// back in around each call; requests larger than the pooled size fall
+// back to the plain create/destroy path. Slots are claimed with an
+// atomic swap, so a slot collision between threads costs only a fresh
+// allocation, never a shared scratch.
+const SCRATCH_POOL_SLOTS: usize = 64;
+const SCRATCH_POOL_DEFAULT: usize = 1024 * 1024;
+
+static mut SCRATCH_POOL: [u64; SCRATCH_POOL_SLOTS] = [0; SCRATCH_POOL_SLOTS];
+static mut SCRATCH_POOL_MAX: u64 = SCRATCH_POOL_DEFAULT as u64;
+
+fn scratch_pool_slot() -> usize {
+	(unsafe { thread_slot() } as usize) & (SCRATCH_POOL_SLOTS - 1)
+}
+
+/// Sizes the pool and parks a scratch of that size in the calling
+/// thread's slot, so the first hot call pays no setup. Meant to run
+/// once per worker at startup with the size from config; later calls
+/// only matter if the size changes, and scratches pooled under the old
+/// size are destroyed as they check back in.
+pub fn scratch_pool_init(secp: &Secp256k1, size: usize) -> Result<(), Error> {
+	astore!(&raw mut SCRATCH_POOL_MAX, size as u64);
+	let scratch = unsafe { secp256k1_scratch_space_create(secp.ctx, size) };
+	if scratch.is_null() {
+		return Err(err!(Alloc));
+	}
+	scratch_checkin(scratch, size);
+	Ok(())
+}
+
+/// Destroys every pooled scratch. For orderly shutdown and leak-checked
+/// tests; safe only once the threads using the pool have quiesced.
+pub fn scratch_pool_drain() {
+	for i in 0..SCRATCH_POOL_SLOTS {
+		let slot = unsafe { &raw mut SCRATCH_POOL[i] };
+		loop {
+			let cached = aload!(slot);
+			if cached == 0 {
+				break;
+			}
+			if cas!(slot, &cached, 0) {
+				unsafe {
+					secp256k1_scratch_space_destroy(cached as *mut ScratchSpace);
+				}
+				break;
+			}
+		}
+	}
+}
+
+// takes the calling thread's pooled scratch when it is present and
+// large enough, otherwise creates one. Never returns another thread's
+// live scratch; null only if allocation fails, as with create
+pub(crate) fn scratch_checkout(ctx: *mut Context, size: usize) -> *mut ScratchSpace {
+	let max = aload!(&raw const SCRATCH_POOL_MAX) as usize;
+	if size <= max {
+		let slot = unsafe { &raw mut SCRATCH_POOL[scratch_pool_slot()] };
+		let cached = aload!(slot);
+		if cached != 0 && cas!(slot, &cached, 0) {
+			return cached as *mut ScratchSpace;
+		}
+		// pooled scratches are always the configured size so a slot
+		// never under-serves a later, larger checkout
+		unsafe { secp256k1_scratch_space_create(ctx, max) }
+	} else {
+		unsafe { secp256k1_scratch_space_create(ctx, size) }
+	}
+}
+
+// returns a scratch from checkout; size is the same value the checkout
+// was made with. Parks it in the thread's slot when it is pool-sized
+// and the slot is free, destroys it otherwise
+pub(crate) fn scratch_checkin(scratch: *mut ScratchSpace, size: usize) {
+	if scratch.is_null() {
+		return;
+	}
+	let max = aload!(&raw const SCRATCH_POOL_MAX) as usize;
+	if size <= max {
+		let slot = unsafe { &raw mut SCRATCH_POOL[scratch_pool_slot()] };
+		let zero = 0u64;
+		if cas!(slot, &zero, scratch as u64) {
+			return;
+		}
+	}
+	unsafe {
+		secp256k1_scratch_space_destroy(scratch);
+	}
+}
+
+// Process-wide bulletproof generator cache. Deriving the 2 * 64
+// generators per committed value walks the curve and is a fixed ~1ms
+// tax on every verify that rebuilds them, so the set is built once and
+// shared: generators are read-only after creation, which makes one
+// static set safe for every thread at once (unlike the scratch spaces
+// above, which are mutable and therefore pooled per thread). The
+// pointer is the authority; its commitment capacity is published
+// separately and a reader that races the init simply sees a set too
+// small and builds a private one.
+const BULLET_GENS_PER_COMMIT: usize = 2 * 64;
+
+static mut BULLET_GENS: u64 = 0;
+static mut BULLET_GENS_COMMITS: u64 = 0;
+
+/// Builds a generator set covering aggregated proofs over up to
+/// max_commits commitments and parks it for the whole process. Meant to
+/// run once at startup with the largest aggregation size in use; the
+/// first successful init wins and later calls are no-ops. Resizing
+/// requires bullet_gens_drain once every verifier has quiesced.
+pub fn bullet_gens_init(secp: &Secp256k1, max_commits: usize) -> Result<(), Error> {
+	if aload!(&raw const BULLET_GENS) != 0 {
+		return Ok(());
+	}
+	let gens = unsafe {
+		secp256k1_bulletproof_generators_create(
+			secp.ctx,
+			secp256k1_generator_const_g.0.as_ptr(),
+			(BULLET_GENS_PER_COMMIT * max_commits) as u64,
+		)
+	};
+	if gens.is_null() {
+		return Err(err!(SecpInit));
+	}
+	let zero = 0u64;
+	if cas!(&raw mut BULLET_GENS, &zero, gens as u64) {
+		// capacity follows the pointer; a reader in the window sees a
+		// zero-capacity set and falls back to a private one
+		astore!(&raw mut BULLET_GENS_COMMITS, max_commits as u64);
+	} else {
+		// lost to a concurrent init; that set stays authoritative
+		unsafe {
+			secp256k1_bulletproof_generators_destroy(secp.ctx, gens);
+		}
+	}
+	Ok(())
+}
+
+/// Destroys the cached generator set. For orderly shutdown and
+/// leak-checked tests; safe only once no verification is in flight.
+pub fn bullet_gens_drain(secp: &Secp256k1) {
+	loop {
+		let cached = aload!(&raw const BULLET_GENS);
+		if cached == 0 {
+			break;
+		}
+		if cas!(&raw mut BULLET_GENS, &cached, 0) {
+			astore!(&raw mut BULLET_GENS_COMMITS, 0);
+			unsafe {
+				secp256k1_bulletproof_generators_destroy(
+					secp.ctx,
+					cached as *mut BulletproofGenerators,
+				);
+			}
+			break;
+		}
+	}
+}
+
+// the cached set when it covers max_commits, null otherwise. The cache
+// is never destroyed while verifiers run (see bullet_gens_drain), so a
+// returned pointer stays valid without a checkin
+pub(crate) fn bullet_gens_cached(max_commits: usize) -> *mut BulletproofGenerators {
+	let gens = aload!(&raw const BULLET_GENS);
+	if gens != 0 && aload!(&raw const BULLET_GENS_COMMITS) >= max_commits as u64 {
+		gens as *mut BulletproofGenerators
+	} else {
+		null_mut()
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test]
+	fn test_scratch_pool() {
+		let secp = Secp256k1::new().unwrap();
+		scratch_pool_drain();
+
+		// a checked-in scratch comes back on the next checkout
+		let s1 = scratch_checkout(secp.ctx, SCRATCH_POOL_DEFAULT);
+		assert!(!s1.is_null());
+		scratch_checkin(s1, SCRATCH_POOL_DEFAULT);
+		let s2 = scratch_checkout(secp.ctx, SCRATCH_POOL_DEFAULT);
+		assert_eq!(s1, s2);
+
+		// with the slot empty a second checkout gets a fresh scratch
+		// and the first one back in wins the slot
+		let s3 = scratch_checkout(secp.ctx, SCRATCH_POOL_DEFAULT);
+		assert!(!s3.is_null());
+		assert!(s2 != s3);
+		scratch_checkin(s2, SCRATCH_POOL_DEFAULT);
+		scratch_checkin(s3, SCRATCH_POOL_DEFAULT);
+		let s4 = scratch_checkout(secp.ctx, SCRATCH_POOL_DEFAULT);
+		assert_eq!(s4, s2);
+
+		// oversized requests bypass the pool entirely
+		let big = scratch_checkout(secp.ctx, SCRATCH_POOL_DEFAULT * 2);
+		assert!(!big.is_null());
+		scratch_checkin(big, SCRATCH_POOL_DEFAULT * 2);
+		scratch_checkin(s4, SCRATCH_POOL_DEFAULT);
+
+		scratch_pool_drain();
+	}
+}
@@ -0,0 +1,315 @@
+// Rust secp256k1 bindings for pedersen commitment functions
+//
+// To the extent possible under law, the author(s) have dedicated all
+// copyright and related and neighboring rights to this software to
+// the public domain worldwide. This software is distributed without
+// any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication
+// along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//
+
+//! # Pedersen Commitment Functionality
+
+use core::marker::Copy;
+use ffi;
+use prelude::*;
+use secp256k1::types::*;
+
+/// The size (in bytes) of a serialized commitment
+pub const COMMITMENT_SIZE: usize = 33;
+
+/// A Pedersen commitment in its 33 byte serialized form
+#[repr(C)]
+#[derive(Clone)]
+pub struct Commitment(pub [u8; COMMITMENT_SIZE]);
+impl Copy for Commitment {}
+
+impl Commitment {
+	/// Create a new (zeroed) commitment usable for the FFI interface
+	pub fn new() -> Commitment {
+		Commitment([0; COMMITMENT_SIZE])
+	}
+
+	pub fn as_mut_ptr(&mut self) -> *mut u8 {
+		self.0.as_mut_ptr()
+	}
+
+	pub fn as_ptr(&self) -> *const u8 {
+		self.0.as_ptr()
+	}
+}
+
+// parse a serialized commitment into the 64 byte internal form the
+// summing/tally entry points operate on
+fn parse_internal(secp: &Secp256k1, commit: &Commitment) -> Result<[u8; 64], Error> {
+	let mut internal = [0u8; 64];
+	let retval = unsafe {
+		ffi::secp256k1_pedersen_commitment_parse(
+			secp.ctx,
+			internal.as_mut_ptr(),
+			commit.as_ptr(),
+		)
+	};
+	if retval == 0 {
+		return Err(err!(SecpErr));
+	}
+	Ok(internal)
+}
+
+// serialize a 64 byte internal commitment into the 33 byte wire form
+fn serialize_internal(secp: &Secp256k1, internal: &[u8; 64]) -> Result<Commitment, Error> {
+	let mut ret = Commitment::new();
+	let retval = unsafe {
+		ffi::secp256k1_pedersen_commitment_serialize(
+			secp.ctx,
+			ret.as_mut_ptr(),
+			internal.as_ptr(),
+		)
+	};
+	if retval == 0 {
+		return Err(err!(SecpErr));
+	}
+	Ok(ret)
+}
+
+/// Creates a single pedersen commitment: blind * G + value * H
+/// Returns: Ok(Commitment) on success
+/// In:
+/// value: the value to commit to
+/// blind: the blinding factor
+pub fn commit(secp: &Secp256k1, value: u64, blind: &SecretKey) -> Result<Commitment, Error> {
+	let mut internal = [0u8; 64];
+	let retval = unsafe {
+		ffi::secp256k1_pedersen_commit(
+			secp.ctx,
+			internal.as_mut_ptr(),
+			blind.0.as_ptr(),
+			value,
+			ffi::secp256k1_generator_const_h.0.as_ptr(),
+			ffi::secp256k1_generator_const_g.0.as_ptr(),
+		)
+	};
+	if retval == 0 {
+		return Err(err!(SecpErr));
+	}
+	serialize_internal(secp, &internal)
+}
+
+/// Creates pedersen commitments for a slice of (blind, value) pairs
+/// Returns: Ok(Vec<Commitment>) on success
+/// In:
+/// batch: (blinding factor, value) pairs, committed against a single
+/// context so the precomputed tables are set up once for the whole batch
+pub fn commit_batch(
+	secp: &Secp256k1,
+	batch: &[(SecretKey, u64)],
+) -> Result<Vec<Commitment>, Error> {
+	let mut ret = Vec::new();
+	let mut internal = [0u8; 64];
+	for (blind, value) in batch {
+		let retval = unsafe {
+			ffi::secp256k1_pedersen_commit(
+				secp.ctx,
+				internal.as_mut_ptr(),
+				blind.0.as_ptr(),
+				*value,
+				ffi::secp256k1_generator_const_h.0.as_ptr(),
+				ffi::secp256k1_generator_const_g.0.as_ptr(),
+			)
+		};
+		if retval == 0 {
+			return Err(err!(SecpErr));
+		}
+		match serialize_internal(secp, &internal) {
+			Ok(c) => match ret.push(c) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			},
+			Err(e) => return Err(e),
+		}
+	}
+	Ok(ret)
+}
+
+/// Computes the sum of positive commitments minus negative commitments
+/// Returns: Ok(Commitment) on success
+/// In:
+/// positives: the commitments to add
+/// negatives: the commitments to subtract
+pub fn commit_sum(
+	secp: &Secp256k1,
+	positives: &[Commitment],
+	negatives: &[Commitment],
+) -> Result<Commitment, Error> {
+	let mut pos = Vec::new();
+	let mut neg = Vec::new();
+	let mut pos_ptrs: Vec<*const u8> = Vec::new();
+	let mut neg_ptrs: Vec<*const u8> = Vec::new();
+	for c in positives {
+		match parse_internal(secp, c) {
+			Ok(i) => match pos.push(i) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			},
+			Err(e) => return Err(e),
+		}
+	}
+	for c in negatives {
+		match parse_internal(secp, c) {
+			Ok(i) => match neg.push(i) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			},
+			Err(e) => return Err(e),
+		}
+	}
+	for i in 0..pos.len() {
+		match pos_ptrs.push(pos[i].as_ptr()) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+	}
+	for i in 0..neg.len() {
+		match neg_ptrs.push(neg[i].as_ptr()) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+	}
+
+	let mut internal = [0u8; 64];
+	let retval = unsafe {
+		ffi::secp256k1_pedersen_commit_sum(
+			secp.ctx,
+			internal.as_mut_ptr(),
+			pos_ptrs.as_ptr() as *const *const u8,
+			pos_ptrs.len() as u64,
+			neg_ptrs.as_ptr() as *const *const u8,
+			neg_ptrs.len() as u64,
+		)
+	};
+	if retval == 0 {
+		return Err(err!(SecpErr));
+	}
+	serialize_internal(secp, &internal)
+}
+
+/// Verifies that the sums of positive and negative commitments are equal
+/// Returns: true if the commitments sum to zero
+/// In:
+/// positives: the commitments treated with positive sign
+/// negatives: the commitments treated with negative sign
+pub fn verify_commit_sum(
+	secp: &Secp256k1,
+	positives: &[Commitment],
+	negatives: &[Commitment],
+) -> bool {
+	let mut pos = Vec::new();
+	let mut neg = Vec::new();
+	let mut pos_ptrs: Vec<*const u8> = Vec::new();
+	let mut neg_ptrs: Vec<*const u8> = Vec::new();
+	for c in positives {
+		match parse_internal(secp, c) {
+			Ok(i) => match pos.push(i) {
+				Ok(_) => {}
+				Err(_) => return false,
+			},
+			Err(_) => return false,
+		}
+	}
+	for c in negatives {
+		match parse_internal(secp, c) {
+			Ok(i) => match neg.push(i) {
+				Ok(_) => {}
+				Err(_) => return false,
+			},
+			Err(_) => return false,
+		}
+	}
+	for i in 0..pos.len() {
+		match pos_ptrs.push(pos[i].as_ptr()) {
+			Ok(_) => {}
+			Err(_) => return false,
+		}
+	}
+	for i in 0..neg.len() {
+		match neg_ptrs.push(neg[i].as_ptr()) {
+			Ok(_) => {}
+			Err(_) => return false,
+		}
+	}
+
+	let retval = unsafe {
+		ffi::secp256k1_pedersen_verify_tally(
+			secp.ctx,
+			pos_ptrs.as_ptr() as *const *const u8,
+			pos_ptrs.len() as u64,
+			neg_ptrs.as_ptr() as *const *const u8,
+			neg_ptrs.len() as u64,
+		)
+	};
+	match retval {
+		0 => false,
+		1 => true,
+		_ => false,
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::{commit, commit_batch, commit_sum, verify_commit_sum};
+	use ffi::{cpsrng_context_create, cpsrng_context_destroy, getalloccount};
+	use prelude::*;
+	use secp256k1::types::{ContextFlag, Secp256k1, SecretKey};
+
+	#[test]
+	fn test_pedersen_commit_batch() {
+		let initial = unsafe { getalloccount() };
+		{
+			let secp = Secp256k1::with_caps(ContextFlag::Commit).unwrap();
+			let rand = unsafe { cpsrng_context_create() };
+
+			// commit to 5 + 7 and to 12 with the same total blinding
+			// factor, then check the sums tally
+			let b1 = SecretKey::generate(rand);
+			let b2 = SecretKey::generate(rand);
+			let mut b3 = SecretKey([0u8; 32]);
+			for i in 0..32 {
+				b3.0[i] = b1.0[i];
+			}
+			let mut batch = Vec::new();
+			batch.push((b1, 5)).unwrap();
+			batch.push((b2, 7)).unwrap();
+			let commits = commit_batch(&secp, &batch[0..batch.len()]).unwrap();
+			assert_eq!(commits.len(), 2);
+
+			let c3 = commit(&secp, 12, &b3).unwrap();
+			let c4 = commit(&secp, 0, &batch[1].0).unwrap();
+			let mut pos = Vec::new();
+			pos.push(commits[0]).unwrap();
+			pos.push(commits[1]).unwrap();
+			let mut neg = Vec::new();
+			neg.push(c3).unwrap();
+			neg.push(c4).unwrap();
+			assert!(verify_commit_sum(
+				&secp,
+				&pos[0..pos.len()],
+				&neg[0..neg.len()]
+			));
+			// unbalanced sums must not tally
+			assert!(!verify_commit_sum(&secp, &pos[0..pos.len()], &neg[0..1]));
+
+			// the sum of the batch equals the explicit sum commitment
+			let sum = commit_sum(&secp, &pos[0..pos.len()], &neg[1..2]).unwrap();
+			for i in 0..sum.0.len() {
+				assert_eq!(sum.0[i], c3.0[i]);
+			}
+
+			unsafe {
+				cpsrng_context_destroy(rand);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+}
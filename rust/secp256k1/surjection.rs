@@ -0,0 +1,416 @@
+// Rust secp256k1 bindings for surjection proof functions
+//
+// To the extent possible under law, the author(s) have dedicated all
+// copyright and related and neighboring rights to this software to
+// the public domain worldwide. This software is distributed without
+// any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication
+// along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//
+
+//! # Surjection Proof Functionality
+//!
+//! Proves that an output asset tag is a blinded version of one of a set
+//! of input asset tags without revealing which one. Confidential-asset
+//! transactions carry one proof per output; `create_batch` proves a
+//! whole slice of outputs against the shared input set in one pass.
+
+use core::marker::Copy;
+use ffi;
+use prelude::*;
+use secp256k1::types::*;
+
+/// The maximum number of inputs a surjection proof may cover
+/// (SECP256K1_SURJECTIONPROOF_MAX_N_INPUTS in the vendored library)
+pub const MAX_N_INPUTS: usize = 256;
+
+/// The maximum size (in bytes) of a serialized surjection proof
+pub const MAX_PROOF_SIZE: usize = 2 + MAX_N_INPUTS / 8 + 32 * (1 + MAX_N_INPUTS);
+
+// iterations of random input selection before initialize gives up
+const MAX_N_ITERATIONS: usize = 100;
+
+/// A 32 byte fixed asset tag. Its contents have no meaning to the
+/// library; transactions use the hash of the asset identifier
+#[repr(C)]
+#[derive(Clone)]
+pub struct FixedAssetTag(pub [u8; 32]);
+impl Copy for FixedAssetTag {}
+
+/// A surjection proof in the in-memory representation of the vendored
+/// library (secp256k1_surjectionproof). Use serialize/parse for a
+/// well-defined wire format
+#[repr(C)]
+#[derive(Clone)]
+pub struct SurjectionProof {
+	n_inputs: usize,
+	used_inputs: [u8; MAX_N_INPUTS / 8],
+	data: [u8; 32 * (1 + MAX_N_INPUTS)],
+}
+impl Copy for SurjectionProof {}
+
+impl SurjectionProof {
+	fn new() -> Self {
+		SurjectionProof {
+			n_inputs: 0,
+			used_inputs: [0u8; MAX_N_INPUTS / 8],
+			data: [0u8; 32 * (1 + MAX_N_INPUTS)],
+		}
+	}
+
+	fn as_mut_ptr(&mut self) -> *mut u8 {
+		self as *mut SurjectionProof as *mut u8
+	}
+
+	fn as_ptr(&self) -> *const u8 {
+		self as *const SurjectionProof as *const u8
+	}
+}
+
+/// One output of a confidential-asset transaction as the prover sees it
+pub struct SurjectionOutput {
+	/// The fixed asset tag of the output. Must equal one of the fixed
+	/// input tags or proving fails
+	pub fixed_tag: FixedAssetTag,
+	/// The blinded (ephemeral) asset tag committed to in the output
+	pub ephemeral_tag: Generator,
+	/// The blinding key the ephemeral tag was generated with
+	pub blinding_key: SecretKey,
+}
+
+/// Blinds a fixed asset tag into the ephemeral generator form carried
+/// by a transaction output
+pub fn blind_tag(
+	secp: &Secp256k1,
+	tag: &FixedAssetTag,
+	blind: &SecretKey,
+) -> Result<Generator, Error> {
+	let mut gen = Generator([0u8; 64]);
+	let retval = unsafe {
+		ffi::secp256k1_generator_generate_blinded(
+			secp.ctx,
+			&mut gen as *mut Generator,
+			tag.0.as_ptr(),
+			blind.0.as_ptr(),
+		)
+	};
+	if retval == 0 {
+		return Err(err!(SecpErr));
+	}
+	Ok(gen)
+}
+
+// initialize + generate one proof against the shared input set. The
+// caller validated slice lengths
+fn create_impl(
+	secp: &Secp256k1,
+	fixed_input_tags: &[FixedAssetTag],
+	n_inputs_to_use: usize,
+	ephemeral_input_tags: &[Generator],
+	input_blinding_keys: &[SecretKey],
+	output: &SurjectionOutput,
+	seed: &[u8; 32],
+) -> Result<SurjectionProof, Error> {
+	let mut proof = SurjectionProof::new();
+	let mut input_index = 0usize;
+	let retval = unsafe {
+		ffi::secp256k1_surjectionproof_initialize(
+			secp.ctx,
+			proof.as_mut_ptr(),
+			&mut input_index,
+			fixed_input_tags.as_ptr() as *const u8,
+			fixed_input_tags.len(),
+			n_inputs_to_use,
+			output.fixed_tag.0.as_ptr(),
+			MAX_N_ITERATIONS,
+			seed.as_ptr(),
+		)
+	};
+	if retval == 0 {
+		return Err(err!(SecpErr));
+	}
+	let retval = unsafe {
+		ffi::secp256k1_surjectionproof_generate(
+			secp.ctx,
+			proof.as_mut_ptr(),
+			ephemeral_input_tags.as_ptr() as *const u8,
+			ephemeral_input_tags.len(),
+			output.ephemeral_tag.0.as_ptr(),
+			input_index,
+			input_blinding_keys[input_index].0.as_ptr(),
+			output.blinding_key.0.as_ptr(),
+		)
+	};
+	if retval == 0 {
+		return Err(err!(SecpErr));
+	}
+	Ok(proof)
+}
+
+/// Produces a surjection proof for one output
+/// Returns: Ok(SurjectionProof) on success
+/// In:
+/// fixed_input_tags: fixed asset tags of all transaction inputs
+/// n_inputs_to_use: size of the randomly selected anonymity set
+/// ephemeral_input_tags: blinded input tags, in the same order
+/// input_blinding_keys: blinding key of each input tag
+/// output: the output being proven
+/// seed: randomizes input selection
+pub fn create(
+	secp: &Secp256k1,
+	fixed_input_tags: &[FixedAssetTag],
+	n_inputs_to_use: usize,
+	ephemeral_input_tags: &[Generator],
+	input_blinding_keys: &[SecretKey],
+	output: &SurjectionOutput,
+	seed: &[u8; 32],
+) -> Result<SurjectionProof, Error> {
+	let n = fixed_input_tags.len();
+	if n == 0
+		|| n > MAX_N_INPUTS
+		|| ephemeral_input_tags.len() != n
+		|| input_blinding_keys.len() != n
+		|| n_inputs_to_use > n
+	{
+		return Err(err!(IllegalArgument));
+	}
+	create_impl(
+		secp,
+		fixed_input_tags,
+		n_inputs_to_use,
+		ephemeral_input_tags,
+		input_blinding_keys,
+		output,
+		seed,
+	)
+}
+
+/// Produces surjection proofs for a slice of outputs against the shared
+/// input set in one pass, validating the inputs once and reusing one
+/// proof workspace instead of round-tripping per output
+/// Returns: Ok(Vec<SurjectionProof>) in output order
+pub fn create_batch(
+	secp: &Secp256k1,
+	fixed_input_tags: &[FixedAssetTag],
+	n_inputs_to_use: usize,
+	ephemeral_input_tags: &[Generator],
+	input_blinding_keys: &[SecretKey],
+	outputs: &[SurjectionOutput],
+	seed: &[u8; 32],
+) -> Result<Vec<SurjectionProof>, Error> {
+	let n = fixed_input_tags.len();
+	if n == 0
+		|| n > MAX_N_INPUTS
+		|| ephemeral_input_tags.len() != n
+		|| input_blinding_keys.len() != n
+		|| n_inputs_to_use > n
+		|| outputs.len() == 0
+	{
+		return Err(err!(IllegalArgument));
+	}
+	let mut proofs: Vec<SurjectionProof> = Vec::new();
+	match proofs.reserve(outputs.len()) {
+		Ok(_) => {}
+		Err(e) => return Err(e),
+	}
+	let mut i = 0;
+	for output in outputs {
+		// decorrelate input selection across outputs without asking
+		// the caller for one seed per output
+		let mut oseed = *seed;
+		oseed[0] ^= i as u8;
+		oseed[1] ^= (i >> 8) as u8;
+		let proof = match create_impl(
+			secp,
+			fixed_input_tags,
+			n_inputs_to_use,
+			ephemeral_input_tags,
+			input_blinding_keys,
+			output,
+			&oseed,
+		) {
+			Ok(proof) => proof,
+			Err(e) => return Err(e),
+		};
+		match proofs.push(proof) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+		i += 1;
+	}
+	Ok(proofs)
+}
+
+/// Verifies a surjection proof against the input set and output tag
+/// Returns: true if the output tag maps to one of the input tags
+pub fn verify(
+	secp: &Secp256k1,
+	proof: &SurjectionProof,
+	ephemeral_input_tags: &[Generator],
+	ephemeral_output_tag: &Generator,
+) -> bool {
+	if ephemeral_input_tags.len() == 0 {
+		return false;
+	}
+	let retval = unsafe {
+		ffi::secp256k1_surjectionproof_verify(
+			secp.ctx,
+			proof.as_ptr(),
+			ephemeral_input_tags.as_ptr() as *const u8,
+			ephemeral_input_tags.len(),
+			ephemeral_output_tag.0.as_ptr(),
+		)
+	};
+	retval == 1
+}
+
+/// Serializes a proof into its well-defined wire format
+/// Returns: Ok(len) with the number of bytes written to output
+pub fn serialize(
+	secp: &Secp256k1,
+	proof: &SurjectionProof,
+	output: &mut [u8; MAX_PROOF_SIZE],
+) -> Result<usize, Error> {
+	let mut outputlen = MAX_PROOF_SIZE;
+	let retval = unsafe {
+		ffi::secp256k1_surjectionproof_serialize(
+			secp.ctx,
+			output.as_mut_ptr(),
+			&mut outputlen,
+			proof.as_ptr(),
+		)
+	};
+	if retval == 0 {
+		return Err(err!(SecpErr));
+	}
+	Ok(outputlen)
+}
+
+/// Parses a serialized proof
+pub fn parse(secp: &Secp256k1, input: &[u8]) -> Result<SurjectionProof, Error> {
+	let mut proof = SurjectionProof::new();
+	let retval = unsafe {
+		ffi::secp256k1_surjectionproof_parse(
+			secp.ctx,
+			proof.as_mut_ptr(),
+			input.as_ptr(),
+			input.len(),
+		)
+	};
+	if retval == 0 {
+		return Err(err!(SecpErr));
+	}
+	Ok(proof)
+}
+
+#[cfg(test)]
+mod test {
+	use super::{blind_tag, create_batch, parse, serialize, verify, FixedAssetTag, MAX_PROOF_SIZE};
+	use ffi::{cpsrng_context_create, cpsrng_context_destroy, getalloccount};
+	use prelude::*;
+	use secp256k1::types::{ContextFlag, Secp256k1, SecretKey};
+
+	#[test]
+	fn test_surjection_batch() {
+		let initial = unsafe { getalloccount() };
+		{
+			let secp = Secp256k1::with_caps(ContextFlag::Commit).unwrap();
+			let rand = unsafe { cpsrng_context_create() };
+
+			// three inputs with distinct fixed tags
+			let mut fixed = Vec::new();
+			let mut blinds = Vec::new();
+			let mut ephemeral = Vec::new();
+			for _ in 0..3 {
+				let tag = FixedAssetTag(SecretKey::generate(rand).0);
+				let blind = SecretKey::generate(rand);
+				ephemeral.push(blind_tag(&secp, &tag, &blind).unwrap()).unwrap();
+				fixed.push(tag).unwrap();
+				blinds.push(blind).unwrap();
+			}
+
+			// two outputs spending inputs 0 and 2
+			let mut outputs = Vec::new();
+			for idx in [0usize, 2] {
+				let blind = SecretKey::generate(rand);
+				let tag = fixed[idx];
+				let eph = blind_tag(&secp, &tag, &blind).unwrap();
+				outputs
+					.push(super::SurjectionOutput {
+						fixed_tag: tag,
+						ephemeral_tag: eph,
+						blinding_key: blind,
+					})
+					.unwrap();
+			}
+
+			let seed = SecretKey::generate(rand).0;
+			let proofs = create_batch(
+				&secp,
+				&fixed[0..fixed.len()],
+				2,
+				&ephemeral[0..ephemeral.len()],
+				&blinds[0..blinds.len()],
+				&outputs[0..outputs.len()],
+				&seed,
+			)
+			.unwrap();
+			assert_eq!(proofs.len(), 2);
+			for i in 0..2 {
+				assert!(verify(
+					&secp,
+					&proofs[i],
+					&ephemeral[0..ephemeral.len()],
+					&outputs[i].ephemeral_tag
+				));
+			}
+			// a proof does not verify against the other output's tag
+			assert!(!verify(
+				&secp,
+				&proofs[0],
+				&ephemeral[0..ephemeral.len()],
+				&outputs[1].ephemeral_tag
+			));
+
+			// serialization roundtrip preserves validity
+			let mut ser = [0u8; MAX_PROOF_SIZE];
+			let len = serialize(&secp, &proofs[0], &mut ser).unwrap();
+			let parsed = parse(&secp, &ser[0..len]).unwrap();
+			assert!(verify(
+				&secp,
+				&parsed,
+				&ephemeral[0..ephemeral.len()],
+				&outputs[0].ephemeral_tag
+			));
+
+			// an output whose fixed tag is not in the input set fails
+			let blind = SecretKey::generate(rand);
+			let tag = FixedAssetTag(SecretKey::generate(rand).0);
+			let eph = blind_tag(&secp, &tag, &blind).unwrap();
+			let mut bad = Vec::new();
+			bad.push(super::SurjectionOutput {
+				fixed_tag: tag,
+				ephemeral_tag: eph,
+				blinding_key: blind,
+			})
+			.unwrap();
+			assert!(create_batch(
+				&secp,
+				&fixed[0..fixed.len()],
+				2,
+				&ephemeral[0..ephemeral.len()],
+				&blinds[0..blinds.len()],
+				&bad[0..bad.len()],
+				&seed,
+			)
+			.is_err());
+
+			unsafe {
+				cpsrng_context_destroy(rand);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+}
@@ -1,5 +1,5 @@
 use core::marker::{Copy, Send, Sync};
-use core::ptr::write_volatile;
+use core::ptr::{null, write_volatile};
 use ffi::cpsrng_rand_bytes_ctx;
 use prelude::*;
 
@@ -84,6 +84,29 @@ impl PublicKey {
 	}
 }
 
+/// Library-internal precomputed multiplication table for a pinned
+/// public key (secp256k1_aggsig_pinned_key). Built once per key via
+/// [`crate::secp256k1::aggsig::pin_pubkey`] and reused across verify
+/// calls; u64 storage keeps the alignment the table entries need
+#[repr(C)]
+#[derive(Clone)]
+pub struct PinnedPublicKey(pub [u64; 512]);
+
+impl PinnedPublicKey {
+	/// Create a new (zeroed) pinned-key table for the FFI interface
+	pub fn new() -> PinnedPublicKey {
+		PinnedPublicKey([0; 512])
+	}
+
+	pub fn as_mut_ptr(&mut self) -> *mut Self {
+		&mut self.0 as *mut u64 as *mut Self
+	}
+
+	pub fn as_ptr(&self) -> *const Self {
+		&self.0 as *const u64 as *const Self
+	}
+}
+
 pub const SECRET_KEY_SIZE: usize = 32;
 #[repr(C)]
 pub struct SecretKey(pub [u8; SECRET_KEY_SIZE]);
@@ -194,6 +217,10 @@ impl SharedSecret {
 	pub fn new() -> SharedSecret {
 		SharedSecret([0; 32])
 	}
+	/// Byte view of the secret, for feeding a KDF
+	pub fn as_bytes(&self) -> &[u8; 32] {
+		&self.0
+	}
 	/// Create a new (uninitialized) signature usable for the FFI interface
 	pub unsafe fn blank() -> Self {
 		Self::new()
@@ -203,11 +230,198 @@ impl SharedSecret {
 pub struct Secp256k1 {
 	pub(crate) ctx: *mut Context,
 	pub(crate) caps: ContextFlag,
+	// true when ctx lives in caller-provided memory; the block itself
+	// stays owned by the caller and must outlive the context
+	prealloc: bool,
+	// nonzero when ctx lives in a file mapping from load_cached; the
+	// mapping is unmapped on drop instead of destroying the context
+	mmap_len: usize,
 }
 
 unsafe impl Send for Secp256k1 {}
 unsafe impl Sync for Secp256k1 {}
 
+impl Secp256k1 {
+	/// Creates a new Secp256k1 context with all capabilities
+	pub fn new() -> Result<Secp256k1, Error> {
+		Secp256k1::with_caps(ContextFlag::Full)
+	}
+
+	/// Creates a new Secp256k1 context with the specified capabilities.
+	/// Context creation precomputes the ecmult tables, so a context should
+	/// be created once and reused across operations rather than per call.
+	/// Each capability adds a table: SignOnly builds only the small
+	/// ecmult_gen table, VerifyOnly only the large ecmult table, and
+	/// Full/Commit both. The window sizes themselves are fixed when the
+	/// vendored library is compiled, so capability selection is the
+	/// memory/speed knob available at runtime: signing-heavy nodes keep a
+	/// Full context, verify-only nodes skip the signing table entirely.
+	pub fn with_caps(caps: ContextFlag) -> Result<Secp256k1, Error> {
+		let ctx = unsafe { crate::ffi::secp256k1_context_create(Self::flags_for(caps)) };
+		if ctx.is_null() {
+			return Err(err!(SecpInit));
+		}
+		Ok(Secp256k1 {
+			ctx,
+			caps,
+			prealloc: false,
+			mmap_len: 0,
+		})
+	}
+
+	/// Creates a context with the specified capabilities inside
+	/// caller-provided memory of at least `preallocated_size(caps)`
+	/// bytes, suitably aligned. The caller chooses placement (hugepage
+	/// backed, shared) and keeps ownership of the block, which must not
+	/// be touched or freed until the returned context is dropped.
+	pub fn with_caps_in(caps: ContextFlag, mem: *mut u8) -> Result<Secp256k1, Error> {
+		if mem.is_null() {
+			return Err(err!(IllegalArgument));
+		}
+		let ctx =
+			unsafe { crate::ffi::secp256k1_context_preallocated_create(mem, Self::flags_for(caps)) };
+		if ctx.is_null() {
+			return Err(err!(SecpInit));
+		}
+		Ok(Secp256k1 {
+			ctx,
+			caps,
+			prealloc: true,
+			mmap_len: 0,
+		})
+	}
+
+	/// Bytes of caller-provided memory `clone_into` needs for a copy of
+	/// this context.
+	pub fn clone_size(&self) -> usize {
+		unsafe { crate::ffi::secp256k1_context_preallocated_clone_size(self.ctx) }
+	}
+
+	/// Copy this context into caller-provided memory of at least
+	/// `clone_size()` bytes. The precomputed tables are copied rather
+	/// than rebuilt, so handing each worker its own verify context at
+	/// spawn costs a memcpy instead of a table precomputation.
+	pub fn clone_into(&self, mem: *mut u8) -> Result<Secp256k1, Error> {
+		if mem.is_null() {
+			return Err(err!(IllegalArgument));
+		}
+		let ctx = unsafe { crate::ffi::secp256k1_context_preallocated_clone(self.ctx, mem) };
+		if ctx.is_null() {
+			return Err(err!(SecpInit));
+		}
+		Ok(Secp256k1 {
+			ctx,
+			caps: self.caps,
+			prealloc: true,
+			mmap_len: 0,
+		})
+	}
+
+	/// Bytes a context with the given capabilities will occupy, tables
+	/// included. Lets a node confirm the footprint of its capability
+	/// choice before creating contexts.
+	pub fn preallocated_size(caps: ContextFlag) -> usize {
+		unsafe { crate::ffi::secp256k1_context_preallocated_size(Self::flags_for(caps)) }
+	}
+
+	/// Serializes this context, precomputed tables included, into a
+	/// cache file. The blob records the virtual address it was built
+	/// at; `load_cached` maps it back there, so the file is only
+	/// meaningful to the same build of this binary and should be
+	/// treated as a per-deploy artifact, not a portable format.
+	pub fn save_cache(&self, path: &str) -> Result<(), Error> {
+		let mut p = [0u8; 256];
+		if path.len() >= p.len() {
+			return Err(err!(IllegalArgument));
+		}
+		copy_from_slice(&mut p[0..path.len()], path.as_bytes());
+		let len = self.clone_size();
+		let mem = unsafe { crate::ffi::ctx_cache_reserve(len) };
+		if mem.is_null() {
+			return Err(err!(Alloc));
+		}
+		let ret;
+		{
+			// the clone must stay alive until the blob is on disk;
+			// dropping it scrubs the block
+			let _clone = match self.clone_into(mem) {
+				Ok(clone) => clone,
+				Err(e) => {
+					unsafe {
+						crate::ffi::ctx_cache_release(mem, len);
+					}
+					return Err(e);
+				}
+			};
+			ret = unsafe { crate::ffi::ctx_cache_save(p.as_ptr(), mem, len) };
+		}
+		unsafe {
+			crate::ffi::ctx_cache_release(mem, len);
+		}
+		if ret < 0 {
+			return Err(err!(IO));
+		}
+		Ok(())
+	}
+
+	/// Maps a cache written by `save_cache` copy-on-write at its
+	/// original address, so startup pays page faults instead of table
+	/// precomputation and the table pages are shared between every
+	/// process mapping the same file. Fails (cleanly) when the file is
+	/// missing, was written by a different build, or the address range
+	/// is already taken; callers should fall back to `with_caps` and
+	/// resave. The error callbacks are re-pointed at this process's
+	/// handlers after mapping; that write lands in private pages.
+	pub fn load_cached(caps: ContextFlag, path: &str) -> Result<Secp256k1, Error> {
+		let mut p = [0u8; 256];
+		if path.len() >= p.len() {
+			return Err(err!(IllegalArgument));
+		}
+		copy_from_slice(&mut p[0..path.len()], path.as_bytes());
+		let len = Self::preallocated_size(caps);
+		let base = unsafe { crate::ffi::ctx_cache_load(p.as_ptr(), len) };
+		if base.is_null() {
+			return Err(err!(SecpInit));
+		}
+		let ctx = base as *mut Context;
+		unsafe {
+			crate::ffi::secp256k1_context_set_illegal_callback(ctx, null(), null());
+			crate::ffi::secp256k1_context_set_error_callback(ctx, null(), null());
+		}
+		Ok(Secp256k1 {
+			ctx,
+			caps,
+			prealloc: true,
+			mmap_len: len,
+		})
+	}
+
+	fn flags_for(caps: ContextFlag) -> u32 {
+		match caps {
+			ContextFlag::None => SECP256K1_START_NONE,
+			ContextFlag::SignOnly => SECP256K1_START_SIGN,
+			ContextFlag::VerifyOnly => SECP256K1_START_VERIFY,
+			ContextFlag::Full | ContextFlag::Commit => {
+				SECP256K1_START_SIGN | SECP256K1_START_VERIFY
+			}
+		}
+	}
+}
+
+impl Drop for Secp256k1 {
+	fn drop(&mut self) {
+		unsafe {
+			if self.mmap_len > 0 {
+				crate::ffi::ctx_cache_release(self.ctx as *mut u8, self.mmap_len);
+			} else if self.prealloc {
+				crate::ffi::secp256k1_context_preallocated_destroy(self.ctx);
+			} else {
+				crate::ffi::secp256k1_context_destroy(self.ctx);
+			}
+		}
+	}
+}
+
 /// Flags used to determine the capabilities of a `Secp256k1` object;
 /// the more capabilities, the more expensive it is to create.
 #[derive(PartialEq, Eq, Copy, Clone)]
@@ -238,3 +452,261 @@ impl Message {
 		self.0.as_ptr() as *const Self
 	}
 }
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use ffi::{cpsrng_context_create, cpsrng_context_destroy, getalloccount};
+	use secp256k1::aggsig::{aggregate_half, sign_single, verify_half, verify_single};
+
+	#[test]
+	fn test_context_caps() {
+		let initial = unsafe { getalloccount() };
+		{
+			// each capability adds a precomputed table, so the context
+			// footprint must rise with the capability set
+			let none = Secp256k1::preallocated_size(ContextFlag::None);
+			let sign = Secp256k1::preallocated_size(ContextFlag::SignOnly);
+			let verify = Secp256k1::preallocated_size(ContextFlag::VerifyOnly);
+			let full = Secp256k1::preallocated_size(ContextFlag::Full);
+			assert!(sign > none);
+			assert!(verify > sign);
+			assert!(full > verify);
+
+			// a sign-only context signs, a verify-only context verifies
+			let sign_ctx = Secp256k1::with_caps(ContextFlag::SignOnly).unwrap();
+			let verify_ctx = Secp256k1::with_caps(ContextFlag::VerifyOnly).unwrap();
+			let rand = unsafe { cpsrng_context_create() };
+
+			let sk = SecretKey::generate(rand);
+			let mut pk = PublicKey::new();
+			let retval = unsafe {
+				crate::ffi::secp256k1_ec_pubkey_create(
+					sign_ctx.ctx,
+					pk.as_mut_ptr(),
+					sk.as_ptr() as *const u8,
+				)
+			};
+			assert_eq!(retval, 1);
+
+			let msg = Message([3u8; MESSAGE_SIZE]);
+			let sig = sign_single(&sign_ctx, &msg, &sk, None, None, None, None, None, rand)
+				.unwrap();
+			assert!(verify_single(
+				&verify_ctx,
+				&sig,
+				&msg,
+				None,
+				&pk,
+				None,
+				None,
+				false
+			));
+			let wrong = Message([4u8; MESSAGE_SIZE]);
+			assert!(!verify_single(
+				&verify_ctx,
+				&sig,
+				&wrong,
+				None,
+				&pk,
+				None,
+				None,
+				false
+			));
+
+			unsafe {
+				cpsrng_context_destroy(rand);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_prealloc_context() {
+		let initial = unsafe { getalloccount() };
+		{
+			let rand = unsafe { cpsrng_context_create() };
+
+			// a context created in caller-provided memory behaves like a
+			// heap one; the caller keeps ownership of the block
+			let size = Secp256k1::preallocated_size(ContextFlag::Full);
+			let mem = unsafe { crate::ffi::alloc(size) };
+			assert!(!mem.is_null());
+			let secp = Secp256k1::with_caps_in(ContextFlag::Full, mem as *mut u8).unwrap();
+
+			let sk = SecretKey::generate(rand);
+			let mut pk = PublicKey::new();
+			let retval = unsafe {
+				crate::ffi::secp256k1_ec_pubkey_create(
+					secp.ctx,
+					pk.as_mut_ptr(),
+					sk.as_ptr() as *const u8,
+				)
+			};
+			assert_eq!(retval, 1);
+			let msg = Message([7u8; MESSAGE_SIZE]);
+			let sig = sign_single(&secp, &msg, &sk, None, None, None, None, None, rand).unwrap();
+
+			// cloning copies the precomputed tables instead of rebuilding
+			// them; the clone verifies independently of the original
+			let clone_mem = unsafe { crate::ffi::alloc(secp.clone_size()) };
+			assert!(!clone_mem.is_null());
+			{
+				let secp2 = secp.clone_into(clone_mem as *mut u8).unwrap();
+				assert!(verify_single(&secp2, &sig, &msg, None, &pk, None, None, false));
+			}
+			// moving into a binding that leaves scope drops the context
+			// before its backing block is released; `let _ = secp` would
+			// not move and the drop would run after the release below
+			{
+				let _secp = secp;
+			}
+			unsafe {
+				crate::ffi::release(clone_mem);
+				crate::ffi::release(mem);
+				cpsrng_context_destroy(rand);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_ctx_cache() {
+		let initial = unsafe { getalloccount() };
+		{
+			let rand = unsafe { cpsrng_context_create() };
+			let path = "/tmp/fam_ctx_cache_test.bin";
+
+			let secp = Secp256k1::with_caps(ContextFlag::Full).unwrap();
+			secp.save_cache(path).unwrap();
+
+			// a signature from the built context verifies against the
+			// mapped one, so the cached tables came back intact
+			let cached = Secp256k1::load_cached(ContextFlag::Full, path).unwrap();
+			let sk = SecretKey::generate(rand);
+			let mut pk = PublicKey::new();
+			let retval = unsafe {
+				crate::ffi::secp256k1_ec_pubkey_create(
+					secp.ctx,
+					pk.as_mut_ptr(),
+					sk.as_ptr() as *const u8,
+				)
+			};
+			assert_eq!(retval, 1);
+			let msg = Message([11u8; MESSAGE_SIZE]);
+			let sig = sign_single(&secp, &msg, &sk, None, None, None, None, None, rand).unwrap();
+			assert!(verify_single(&cached, &sig, &msg, None, &pk, None, None, false));
+
+			// and the mapping signs too; callers can drop the built
+			// context entirely once the cache exists
+			let sig2 = sign_single(&cached, &msg, &sk, None, None, None, None, None, rand).unwrap();
+			assert!(verify_single(&secp, &sig2, &msg, None, &pk, None, None, false));
+
+			// a missing file fails cleanly so callers can fall back to
+			// with_caps and resave
+			assert!(Secp256k1::load_cached(ContextFlag::Full, "/tmp/fam_ctx_cache_none.bin").is_err());
+
+			unsafe {
+				crate::ffi::remove("/tmp/fam_ctx_cache_test.bin\0".as_ptr());
+				cpsrng_context_destroy(rand);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_schnorr_half_agg() {
+		let initial = unsafe { getalloccount() };
+		{
+			let secp = Secp256k1::new().unwrap();
+			let rand = unsafe { cpsrng_context_create() };
+
+			// sign with pubkey_for_e so the challenge matches the
+			// schnorrsig form the aggregate is verified against
+			let mut agg_batch = Vec::new();
+			let mut ver_batch = Vec::new();
+			for i in 0..8usize {
+				let sk = SecretKey::generate(rand);
+				let mut pk = PublicKey::new();
+				let retval = unsafe {
+					crate::ffi::secp256k1_ec_pubkey_create(
+						secp.ctx,
+						pk.as_mut_ptr(),
+						sk.as_ptr() as *const u8,
+					)
+				};
+				assert_eq!(retval, 1);
+				let msg = Message([i as u8 + 1; MESSAGE_SIZE]);
+				let sig = sign_single(
+					&secp,
+					&msg,
+					&sk,
+					None,
+					None,
+					None,
+					Some(&pk),
+					None,
+					rand,
+				)
+				.unwrap();
+				assert!(verify_single(
+					&secp,
+					&sig,
+					&msg,
+					None,
+					&pk,
+					Some(&pk),
+					None,
+					false
+				));
+				agg_batch
+					.push((sig, pk, Message([i as u8 + 1; MESSAGE_SIZE])))
+					.unwrap();
+				ver_batch
+					.push((pk, Message([i as u8 + 1; MESSAGE_SIZE])))
+					.unwrap();
+			}
+
+			let aggsig = aggregate_half(&secp, &agg_batch[0..agg_batch.len()]).unwrap();
+			// n signatures collapse to 32*(n+1) bytes
+			assert_eq!(aggsig.len(), 32 * 9);
+			assert!(verify_half(&secp, &aggsig[0..aggsig.len()], &ver_batch[0..ver_batch.len()]));
+
+			// any tampered message must fail
+			ver_batch[3].1 = Message([99u8; MESSAGE_SIZE]);
+			assert!(!verify_half(
+				&secp,
+				&aggsig[0..aggsig.len()],
+				&ver_batch[0..ver_batch.len()]
+			));
+
+			unsafe {
+				cpsrng_context_destroy(rand);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_scalar_rep_kernels() {
+		// both scalar representations are compiled into the binary
+		// (c/scalarbench.c); they must agree on the math -- timing is
+		// the only difference (fam bench --filter=bench_scalar_reps)
+		let mut a = [0u8; 32];
+		let mut b = [0u8; 32];
+		for op in 0..3 {
+			let r64 = unsafe { crate::ffi::scalar_bench_rep(64, op, 1000, a.as_mut_ptr()) };
+			let r32 = unsafe { crate::ffi::scalar_bench_rep(32, op, 1000, b.as_mut_ptr()) };
+			assert!(r32 >= 0);
+			// 4x64 is absent only on targets without __int128
+			if r64 >= 0 {
+				assert_eq!(a, b);
+			}
+		}
+		// the startup probe names a representation that exists
+		let active = unsafe { crate::ffi::scalar_rep_active() };
+		let preferred = unsafe { crate::ffi::scalar_rep_preferred() };
+		assert!(active == 64 || active == 32);
+		assert!(preferred == 64 || preferred == 32);
+	}
+}
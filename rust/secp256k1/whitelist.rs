@@ -0,0 +1,282 @@
+// Rust secp256k1 bindings for whitelist proof functions
+//
+// To the extent possible under law, the author(s) have dedicated all
+// copyright and related and neighboring rights to this software to
+// the public domain worldwide. This software is distributed without
+// any warranty.
+//
+// You should have received a copy of the CC0 Public Domain Dedication
+// along with this software.
+// If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//
+
+//! # Whitelist Proof Functionality
+//!
+//! Ring signatures proving that a key being whitelisted was endorsed
+//! by one of n authorized signers without revealing which one. The
+//! signer set rarely changes while verification volume is high, so the
+//! per-whitelist key state lives in a [`Whitelist`] built once and
+//! reused across every sign/verify call against that set.
+
+use core::marker::Copy;
+use core::ptr::null;
+use ffi;
+use prelude::*;
+use secp256k1::types::*;
+
+/// The maximum number of keys a whitelist may hold
+/// (SECP256K1_WHITELIST_MAX_N_KEYS in the vendored library)
+pub const MAX_N_KEYS: usize = 256;
+
+/// The maximum size (in bytes) of a serialized whitelist signature:
+/// a 1-byte key count, e0 and one scalar per key
+pub const MAX_SIG_SIZE: usize = 33 + 32 * MAX_N_KEYS;
+
+/// A whitelist signature in the in-memory representation of the
+/// vendored library (secp256k1_whitelist_signature). Use
+/// serialize/parse for a well-defined wire format
+#[repr(C)]
+#[derive(Clone)]
+pub struct WhitelistSignature {
+	n_keys: usize,
+	data: [u8; 32 * (1 + MAX_N_KEYS)],
+}
+impl Copy for WhitelistSignature {}
+
+impl WhitelistSignature {
+	fn new() -> Self {
+		WhitelistSignature {
+			n_keys: 0,
+			data: [0u8; 32 * (1 + MAX_N_KEYS)],
+		}
+	}
+
+	fn as_mut_ptr(&mut self) -> *mut u8 {
+		self as *mut WhitelistSignature as *mut u8
+	}
+
+	fn as_ptr(&self) -> *const u8 {
+		self as *const WhitelistSignature as *const u8
+	}
+
+	/// The number of keys this signature rings over
+	pub fn n_keys(&self) -> usize {
+		self.n_keys
+	}
+}
+
+/// Serializes a whitelist signature (1-byte n_keys, 32-byte e0,
+/// n_keys 32-byte scalars)
+pub fn serialize(secp: &Secp256k1, sig: &WhitelistSignature) -> Result<Vec<u8>, Error> {
+	let mut out = [0u8; MAX_SIG_SIZE];
+	let mut out_len = MAX_SIG_SIZE;
+	let retval = unsafe {
+		ffi::secp256k1_whitelist_signature_serialize(
+			secp.ctx,
+			&mut out as *mut u8,
+			&mut out_len,
+			sig.as_ptr(),
+		)
+	};
+	if retval == 0 {
+		return Err(err!(SecpErr));
+	}
+	let mut v = Vec::new();
+	match v.append_ptr(&out as *const u8, out_len) {
+		Ok(_) => Ok(v),
+		Err(e) => Err(e),
+	}
+}
+
+/// Parses a serialized whitelist signature
+pub fn parse(secp: &Secp256k1, bytes: &[u8]) -> Result<WhitelistSignature, Error> {
+	let mut sig = WhitelistSignature::new();
+	let retval = unsafe {
+		ffi::secp256k1_whitelist_signature_parse(
+			secp.ctx,
+			sig.as_mut_ptr(),
+			bytes.as_ptr(),
+			bytes.len(),
+		)
+	};
+	if retval == 0 {
+		return Err(err!(SecpErr));
+	}
+	Ok(sig)
+}
+
+/// A whitelist: the online/offline key lists of all authorized signers
+/// held in the library's internal (parsed) form. Building one validates
+/// the set once; sign and verify then reuse the cached state, which is
+/// what a verification-heavy gateway wants when the signer set changes
+/// rarely
+pub struct Whitelist {
+	online: Vec<PublicKey>,
+	offline: Vec<PublicKey>,
+}
+
+impl Whitelist {
+	/// Builds the cached key state. online/offline must be the same
+	/// nonzero length, at most MAX_N_KEYS, index-aligned per signer
+	pub fn new(online: &[PublicKey], offline: &[PublicKey]) -> Result<Self, Error> {
+		let n = online.len();
+		if n == 0 || n > MAX_N_KEYS || offline.len() != n {
+			return Err(err!(IllegalArgument));
+		}
+		let mut on: Vec<PublicKey> = Vec::new();
+		match on.append_ptr(online.as_ptr() as *const u8, n) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+		let mut off: Vec<PublicKey> = Vec::new();
+		match off.append_ptr(offline.as_ptr() as *const u8, n) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+		Ok(Whitelist {
+			online: on,
+			offline: off,
+		})
+	}
+
+	pub fn n_keys(&self) -> usize {
+		self.online.len()
+	}
+
+	/// Produces a whitelist signature endorsing sub_pubkey
+	/// In:
+	/// sub_pubkey: the key being whitelisted
+	/// online_seckey: the signer's online secret key
+	/// summed_seckey: the secret key to (sub key + signer's offline key)
+	/// index: the signer's position in the key lists
+	pub fn sign(
+		&self,
+		secp: &Secp256k1,
+		sub_pubkey: &PublicKey,
+		online_seckey: &SecretKey,
+		summed_seckey: &SecretKey,
+		index: usize,
+	) -> Result<WhitelistSignature, Error> {
+		if index >= self.n_keys() {
+			return Err(err!(IllegalArgument));
+		}
+		let mut sig = WhitelistSignature::new();
+		let retval = unsafe {
+			ffi::secp256k1_whitelist_sign(
+				secp.ctx,
+				sig.as_mut_ptr(),
+				self.online.as_slice().as_ptr(),
+				self.offline.as_slice().as_ptr(),
+				self.n_keys(),
+				sub_pubkey.as_ptr(),
+				online_seckey.0.as_ptr(),
+				summed_seckey.0.as_ptr(),
+				index,
+				null(),
+				null(),
+			)
+		};
+		if retval == 0 {
+			return Err(err!(SecpErr));
+		}
+		Ok(sig)
+	}
+
+	/// Verifies that sig whitelists sub_pubkey under this key set
+	pub fn verify(&self, secp: &Secp256k1, sig: &WhitelistSignature, sub_pubkey: &PublicKey) -> bool {
+		if sig.n_keys != self.n_keys() {
+			return false;
+		}
+		unsafe {
+			ffi::secp256k1_whitelist_verify(
+				secp.ctx,
+				sig.as_ptr(),
+				self.online.as_slice().as_ptr(),
+				self.offline.as_slice().as_ptr(),
+				self.n_keys(),
+				sub_pubkey.as_ptr(),
+			) == 1
+		}
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use ffi::{cpsrng_context_create, cpsrng_context_destroy, getalloccount};
+	use secp256k1::types::ContextFlag;
+
+	fn keypair(secp: &Secp256k1, rand: *mut u8) -> (SecretKey, PublicKey) {
+		let sk = SecretKey::generate(rand);
+		let mut pk = PublicKey::new();
+		let retval = unsafe {
+			ffi::secp256k1_ec_pubkey_create(secp.ctx, pk.as_mut_ptr(), sk.0.as_ptr())
+		};
+		assert_eq!(retval, 1);
+		(sk, pk)
+	}
+
+	#[test]
+	fn test_whitelist() {
+		let initial = unsafe { getalloccount() };
+		{
+			let secp = Secp256k1::with_caps(ContextFlag::Full).unwrap();
+			let rand = unsafe { cpsrng_context_create() };
+
+			let n = 4;
+			let index = 2;
+			let mut online_sks = Vec::new();
+			let mut online_pks = Vec::new();
+			let mut offline_sks = Vec::new();
+			let mut offline_pks = Vec::new();
+			for _i in 0..n {
+				let (sk, pk) = keypair(&secp, rand);
+				online_sks.push(sk).unwrap();
+				online_pks.push(pk).unwrap();
+				let (sk, pk) = keypair(&secp, rand);
+				offline_sks.push(sk).unwrap();
+				offline_pks.push(pk).unwrap();
+			}
+			let (sub_sk, sub_pk) = keypair(&secp, rand);
+
+			// summed = offline + sub (secret side of the tweak)
+			let mut summed = SecretKey(offline_sks[index].0);
+			let retval = unsafe {
+				ffi::secp256k1_ec_privkey_tweak_add(
+					secp.ctx,
+					summed.0.as_mut_ptr(),
+					sub_sk.0.as_ptr(),
+				)
+			};
+			assert_eq!(retval, 1);
+
+			let wl = Whitelist::new(
+				&online_pks[0..online_pks.len()],
+				&offline_pks[0..offline_pks.len()],
+			)
+			.unwrap();
+			assert_eq!(wl.n_keys(), n);
+
+			let sig = wl
+				.sign(&secp, &sub_pk, &online_sks[index], &summed, index)
+				.unwrap();
+			assert_eq!(sig.n_keys(), n);
+			assert!(wl.verify(&secp, &sig, &sub_pk));
+
+			// a key nobody endorsed does not verify
+			let (_other_sk, other_pk) = keypair(&secp, rand);
+			assert!(!wl.verify(&secp, &sig, &other_pk));
+
+			// wire roundtrip preserves validity
+			let ser = serialize(&secp, &sig).unwrap();
+			assert_eq!(ser.len(), 33 + 32 * n);
+			let sig2 = parse(&secp, &ser[0..ser.len()]).unwrap();
+			assert!(wl.verify(&secp, &sig2, &sub_pk));
+
+			unsafe {
+				cpsrng_context_destroy(rand);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+}
@@ -0,0 +1,72 @@
+use ffi::{arena_alloc, arena_create, arena_destroy, arena_reset};
+use prelude::*;
+
+/// Bump arena for request-scoped scratch allocations. Allocations are
+/// 16 byte aligned slices of a single backing block; reset reclaims all
+/// of them at once, so per-message scratch costs no malloc/free pairs.
+/// Pointers handed out by alloc are invalidated by reset and by drop.
+pub struct Arena {
+	handle: *mut u8,
+}
+
+impl Arena {
+	pub fn new(capacity: usize) -> Result<Self, Error> {
+		let handle = unsafe { arena_create(capacity as u64) };
+		if handle.is_null() {
+			Err(err!(Alloc))
+		} else {
+			Ok(Self { handle })
+		}
+	}
+
+	pub fn alloc(&mut self, size: usize) -> Result<Ptr<u8>, Error> {
+		let ptr = unsafe { arena_alloc(self.handle, size as u64) };
+		if ptr.is_null() {
+			Err(err!(Alloc))
+		} else {
+			Ok(Ptr::new(ptr))
+		}
+	}
+
+	pub fn reset(&mut self) {
+		unsafe { arena_reset(self.handle) }
+	}
+}
+
+impl Drop for Arena {
+	fn drop(&mut self) {
+		unsafe { arena_destroy(self.handle) }
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use ffi::getalloccount;
+
+	#[test]
+	fn test_arena1() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut arena = Arena::new(64).unwrap();
+			let p1 = arena.alloc(10).unwrap();
+			let p2 = arena.alloc(10).unwrap();
+			// allocations are 16 byte aligned bumps of one block
+			assert_eq!(p2.raw() as usize - p1.raw() as usize, 16);
+			unsafe {
+				*p1.raw() = 7;
+			}
+			assert_eq!(unsafe { *p1.raw() }, 7);
+
+			// the third 16 byte slice fills the arena
+			assert!(arena.alloc(32).is_ok());
+			assert!(arena.alloc(1).is_err());
+
+			// reset makes the whole block reusable
+			arena.reset();
+			assert!(arena.alloc(64).is_ok());
+			assert!(arena.alloc(1).is_err());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+}
@@ -3,7 +3,7 @@ use core::ptr::null;
 use core::slice::from_raw_parts;
 use ffi::{alloc, backtrace_free, backtrace_ptr, backtrace_size, release};
 #[cfg(test)]
-use ffi::{backtrace_to_string, cstring_len};
+use ffi::{backtrace_prewarm, backtrace_to_string, cstring_len};
 use prelude::*;
 
 #[derive(PartialEq)]
@@ -38,6 +38,20 @@ impl Backtrace {
 		Ok(Self { bt })
 	}
 
+	// resolves the current stack into the symbol cache in backtrace.c
+	// so a later burst of captures on this path symbolizes from memory
+	// instead of one popen round trip per frame. Meant to run once at
+	// startup; only test builds know the binary path, as to_string
+	pub fn prewarm() {
+		#[cfg(test)]
+		{
+			let s = "./bin/test_fam\0";
+			unsafe {
+				backtrace_prewarm(s.as_ptr());
+			}
+		}
+	}
+
 	pub fn print(&self) -> Result<(), Error> {
 		match self.to_string() {
 			Ok(s) => {
@@ -89,6 +103,7 @@ mod test {
 
 	#[test]
 	fn test_bt() {
+		Backtrace::prewarm();
 		let _bt = Backtrace::new().unwrap();
 		//_bt.print().unwrap();
 	}
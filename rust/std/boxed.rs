@@ -1,9 +1,9 @@
 use core::marker::{Sized, Unsize};
-use core::mem::size_of;
+use core::mem::{size_of, size_of_val};
 use core::ops::{CoerceUnsized, Deref, DerefMut, Index, IndexMut};
 use core::ptr::{drop_in_place, null_mut, write, write_bytes, NonNull};
 use core::slice::from_raw_parts_mut;
-use ffi::{alloc, release};
+use ffi::{alloc_slab, release_sized};
 use prelude::*;
 
 pub struct Box<T: ?Sized> {
@@ -16,8 +16,9 @@ impl<T: ?Sized> Drop for Box<T> {
 			let value_ptr = self.ptr.raw();
 			if !value_ptr.is_null() {
 				unsafe {
+					let size = size_of_val(&*value_ptr);
 					drop_in_place(value_ptr);
-					release(value_ptr as *mut u8);
+					release_sized(value_ptr as *mut u8, size);
 				}
 			}
 		}
@@ -62,7 +63,7 @@ impl<T> Box<T> {
 			ptr
 		} else {
 			let mut ptr = unsafe {
-				let rptr = alloc(size) as *mut T;
+				let rptr = alloc_slab(size) as *mut T;
 				if rptr.is_null() {
 					return Err(err!(Alloc));
 				}
@@ -87,7 +88,7 @@ impl<T> Box<[T]> {
 				return Ok(ret);
 			}
 		}
-		let ptr = unsafe { alloc(len * size_of::<T>()) };
+		let ptr = unsafe { alloc_slab(len * size_of::<T>()) };
 		if ptr.is_null() {
 			return Err(err!(Alloc));
 		}
@@ -171,6 +172,32 @@ mod test {
 		assert_eq!(initial, unsafe { getalloccount() });
 	}
 
+	#[test]
+	fn test_memstats() {
+		// cumulative production counters: parallel tests also move
+		// them, so only monotone deltas can be asserted
+		let (mut allocs, mut frees, mut bytes) = (0u64, 0u64, 0u64);
+		unsafe {
+			crate::ffi::memstats(&mut allocs, &mut frees, &mut bytes);
+		}
+		let (a0, f0, b0) = (allocs, frees, bytes);
+		{
+			let mut v = Vec::new();
+			for _i in 0..100 {
+				v.push(Box::new([0u8; 100]).unwrap()).unwrap();
+			}
+			unsafe {
+				crate::ffi::memstats(&mut allocs, &mut frees, &mut bytes);
+			}
+			assert!(allocs >= a0 + 100);
+			assert!(bytes >= b0 + 100 * 100);
+		}
+		unsafe {
+			crate::ffi::memstats(&mut allocs, &mut frees, &mut bytes);
+		}
+		assert!(frees >= f0 + 100);
+	}
+
 	trait GetData {
 		fn get_data(&self) -> i32;
 	}
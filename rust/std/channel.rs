@@ -1,8 +1,9 @@
 use core::marker::PhantomData;
+use core::mem::size_of;
 use core::ptr;
 use ffi::{
-	channel_destroy, channel_handle_size, channel_init, channel_pending, channel_recv,
-	channel_send, release,
+	channel_destroy, channel_handle_size, channel_init, channel_init_bounded, channel_pending,
+	channel_recv, channel_send, channel_try_recv, channel_try_send, getmicros, release_sized,
 };
 use prelude::*;
 
@@ -48,6 +49,33 @@ pub fn channel<T>() -> Result<(Sender<T>, Receiver<T>), Error> {
 	}
 }
 
+/// A channel that holds at most `capacity` undelivered messages. Use
+/// Sender::try_send to apply backpressure: it fails with
+/// CapacityExceeded instead of queueing unboundedly when the consumer
+/// falls behind.
+pub fn channel_bounded<T>(capacity: usize) -> Result<(Sender<T>, Receiver<T>), Error> {
+	if unsafe { channel_handle_size() } > 128 {
+		exit!("channel_handle_size() > 128");
+	}
+	let handle = [0u8; 128];
+	let send_inner = match Rc::new(ChannelInner {
+		handle,
+		_marker: PhantomData,
+	}) {
+		Ok(inner) => inner,
+		Err(e) => return Err(e),
+	};
+
+	// SAFETY: rc.clone does not fail
+	let mut recv_inner = send_inner.clone().unwrap();
+
+	if unsafe { channel_init_bounded(&mut recv_inner.handle as *mut u8, capacity as u64) } < 0 {
+		Err(err!(ChannelInit))
+	} else {
+		Ok((Sender { inner: send_inner }, Receiver { inner: recv_inner }))
+	}
+}
+
 impl<T> Drop for ChannelInner<T> {
 	fn drop(&mut self) {
 		while self.pending() {
@@ -61,19 +89,46 @@ impl<T> Drop for ChannelInner<T> {
 }
 
 impl<T> ChannelInner<T> {
-	pub fn recv(&self) -> T {
-		let handle = &self.handle;
-		let recv = unsafe { channel_recv(handle as *const u8) } as *mut ChannelMessage<T>;
+	// take ownership of a message the C side handed back and return
+	// its allocation to the per-thread slab cache; a plain release
+	// would send the hottest allocation in the system back to the
+	// allocator
+	fn unbox(recv: *mut ChannelMessage<T>) -> T {
 		let ptr = Ptr::new(recv);
 		let mut nbox = Box::from_raw(ptr);
 		nbox.leak();
 		let v = unsafe { ptr::read(nbox.as_ptr().raw()) };
 		unsafe {
-			release(recv as *mut u8);
+			release_sized(recv as *mut u8, size_of::<ChannelMessage<T>>());
 		}
 		v.value
 	}
 
+	pub fn recv(&self) -> T {
+		let handle = &self.handle;
+		let recv = unsafe { channel_recv(handle as *const u8) } as *mut ChannelMessage<T>;
+		Self::unbox(recv)
+	}
+
+	// recv that records how long the caller sat blocked in channel_recv.
+	// Opt-in so the default path does not pay two clock reads per message
+	pub fn recv_timed(&self, hist: &mut Histogram) -> T {
+		let handle = &self.handle;
+		let start = unsafe { getmicros() };
+		let recv = unsafe { channel_recv(handle as *const u8) } as *mut ChannelMessage<T>;
+		hist.record((unsafe { getmicros() } - start) as u64);
+		Self::unbox(recv)
+	}
+
+	pub fn try_recv(&self) -> Option<T> {
+		let handle = &self.handle;
+		let recv = unsafe { channel_try_recv(handle as *const u8) } as *mut ChannelMessage<T>;
+		if recv.is_null() {
+			return None;
+		}
+		Some(Self::unbox(recv))
+	}
+
 	pub fn send(&self, value: T) -> Result<(), Error> {
 		let msg = ChannelMessage {
 			_reserved: 0,
@@ -93,6 +148,30 @@ impl<T> ChannelInner<T> {
 		}
 	}
 
+	pub fn try_send(&self, value: T) -> Result<(), Error> {
+		let msg = ChannelMessage {
+			_reserved: 0,
+			value,
+		};
+		match Box::new(msg) {
+			Ok(mut b) => {
+				b.leak();
+				let handle = &self.handle;
+				if unsafe { channel_try_send(handle as *const u8, b.as_ptr().raw() as *mut u8) }
+					< 0
+				{
+					// the channel is full and did not take ownership;
+					// unleak so the value drops normally
+					b.unleak();
+					Err(err!(CapacityExceeded))
+				} else {
+					Ok(())
+				}
+			}
+			Err(e) => Err(e),
+		}
+	}
+
 	pub fn pending(&self) -> bool {
 		unsafe { channel_pending(&self.handle as *const u8) }
 	}
@@ -120,6 +199,13 @@ impl<T> Sender<T> {
 	pub fn send(&self, value: T) -> Result<(), Error> {
 		self.inner.send(value)
 	}
+
+	/// Non-blocking send. On a bounded channel this fails with
+	/// CapacityExceeded (dropping `value`) when the channel is full; on
+	/// an unbounded channel it always succeeds.
+	pub fn try_send(&self, value: T) -> Result<(), Error> {
+		self.inner.try_send(value)
+	}
 }
 
 impl<T> Receiver<T> {
@@ -127,6 +213,16 @@ impl<T> Receiver<T> {
 		self.inner.recv()
 	}
 
+	/// Like recv but records the time spent blocked waiting for a
+	/// message into `hist` (microseconds)
+	pub fn recv_timed(&self, hist: &mut Histogram) -> T {
+		self.inner.recv_timed(hist)
+	}
+
+	pub fn try_recv(&self) -> Option<T> {
+		self.inner.try_recv()
+	}
+
 	pub fn pending(&self) -> bool {
 		self.inner.pending()
 	}
@@ -320,6 +416,32 @@ mod test {
 		assert_eq!(initial, unsafe { getalloccount() });
 	}
 
+	#[test]
+	fn test_channel_bounded() {
+		let initial = unsafe { getalloccount() };
+		{
+			let (send, recv) = channel_bounded(2).unwrap();
+			assert!(send.try_send(10).is_ok());
+			assert!(send.try_send(20).is_ok());
+			// full: the value is shed, not queued
+			match send.try_send(30) {
+				Ok(_) => panic!("expected CapacityExceeded"),
+				Err(e) => assert!(e.kind == ErrorKind::CapacityExceeded),
+			}
+			assert_eq!(recv.recv(), 10);
+			// room again after a recv
+			assert!(send.try_send(40).is_ok());
+			assert_eq!(recv.recv(), 20);
+			assert_eq!(recv.recv(), 40);
+
+			// unbounded channels always have room
+			let (send, _recv) = channel().unwrap();
+			assert!(send.try_send(1).is_ok());
+			assert!(send.try_send(2).is_ok());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
 	#[test]
 	fn test_multisend_chan() {
 		let initial = unsafe { getalloccount() };
@@ -338,4 +460,28 @@ mod test {
 		}
 		assert_eq!(initial, unsafe { getalloccount() });
 	}
+
+	#[test]
+	fn test_channel_pool() {
+		let initial = unsafe { getalloccount() };
+		{
+			let (send, recv) = channel().unwrap();
+			let (mut hits, mut misses, mut recycled) = (0u64, 0u64, 0u64);
+			unsafe {
+				crate::ffi::slab_stats(&mut hits, &mut misses, &mut recycled);
+			}
+			let before = recycled;
+			// a single-thread ping-pong keeps one message in flight, so
+			// every recv must hand its message back to the pool
+			for i in 0..100 {
+				send.send(i).unwrap();
+				assert_eq!(recv.recv(), i);
+			}
+			unsafe {
+				crate::ffi::slab_stats(&mut hits, &mut misses, &mut recycled);
+			}
+			assert!(recycled >= before + 100);
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
 }
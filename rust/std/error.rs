@@ -1,3 +1,4 @@
+use core::marker::Copy;
 use core::ptr::null;
 use prelude::*;
 
@@ -68,13 +69,20 @@ impl Error {
 		let backtrace;
 		#[cfg(test)]
 		{
-			match Backtrace::new() {
-				Ok(bt) => {
-					backtrace = bt;
-				}
-				Err(_) => {
-					backtrace = Backtrace { bt: null() };
+			// skip the capture allocation entirely unless RUST_BACKTRACE
+			// is set; the flag is cached on the c side so this is a call
+			// and a load, not a getenv per error
+			if unsafe { crate::ffi::backtrace_enabled() } != 0 {
+				match Backtrace::new() {
+					Ok(bt) => {
+						backtrace = bt;
+					}
+					Err(_) => {
+						backtrace = Backtrace { bt: null() };
+					}
 				}
+			} else {
+				backtrace = Backtrace { bt: null() };
 			}
 		}
 		#[cfg(not(test))]
@@ -91,6 +99,51 @@ impl Error {
 			},
 		}
 	}
+
+	// for flow-control errors on hot paths (closed-connection and
+	// EAGAIN-style early returns): never captures, whatever the
+	// environment says, so construction is a few field writes
+	pub fn new_nobt(kind: ErrorKind, line: u32, file: &str) -> Self {
+		Self {
+			backtrace: Backtrace { bt: null() },
+			kind,
+			line,
+			file: match String::new(file) {
+				Ok(file) => file,
+				Err(_) => String::empty(),
+			},
+		}
+	}
+}
+
+// code-only error for hot-path results. repr(u8) with no zero value
+// gives Result<(), ErrCode> and Result<usize, ErrCode> a niche, so an
+// i/o result fits in a register and the caller branches on an integer
+// compare; expansion to a full Error happens only at the public
+// boundary via err_from_code!
+#[derive(PartialEq, Clone)]
+#[repr(u8)]
+pub enum ErrCode {
+	/// the peer closed the connection or the socket errored
+	Closed = 1,
+	/// the operation would block; retry when the multiplexer fires
+	Again = 2,
+}
+impl Copy for ErrCode {}
+
+impl ErrCode {
+	pub fn kind(&self) -> ErrorKind {
+		match self {
+			ErrCode::Closed => ErrorKind::ConnectionClosed,
+			ErrCode::Again => ErrorKind::IO,
+		}
+	}
+
+	// expand into a full Error; never captures a backtrace, same as
+	// err_nobt, since these originate on hot paths
+	pub fn to_error(&self, line: u32, file: &str) -> Error {
+		Error::new_nobt(self.kind(), line, file)
+	}
 }
 
 impl Display for Error {
@@ -119,4 +172,27 @@ mod test {
 		let _x = err!(Alloc);
 		//println!("x=\n'{}'", _x);
 	}
+
+	#[test]
+	fn test_err_code() {
+		use core::mem::size_of;
+		// the niche keeps the hot-path result register sized
+		assert_eq!(size_of::<Result<(), ErrCode>>(), 1);
+		let x: Result<(), ErrCode> = Err(ErrCode::Again);
+		match x {
+			Err(c) => {
+				let e = err_from_code!(c);
+				assert!(e.kind == ErrorKind::IO);
+				assert!(e.backtrace.bt.is_null());
+			}
+			Ok(_) => assert!(false),
+		}
+	}
+
+	#[test]
+	fn test_err_nobt() {
+		let x = err_nobt!(ConnectionClosed);
+		assert!(x.kind == ErrorKind::ConnectionClosed);
+		assert!(x.backtrace.bt.is_null());
+	}
 }
@@ -7,6 +7,9 @@ use prelude::*;
 pub struct Formatter {
 	buffer: Vec<u8>,
 	pos: usize,
+	// reallocation floor set by reserve; the buffer will not resize
+	// below it, so a correctly sized reserve means one allocation
+	min: usize,
 }
 
 impl Formatter {
@@ -14,6 +17,16 @@ impl Formatter {
 		Self {
 			buffer: Vec::new(),
 			pos: 0,
+			min: 0,
+		}
+	}
+
+	// ensure the buffer holds at least n more bytes before its next
+	// reallocation; repeated calls only ever raise the floor
+	pub fn reserve(&mut self, n: usize) {
+		if self.pos + n > self.min {
+			self.min = self.pos + n;
+			self.buffer.set_min(self.min);
 		}
 	}
 	pub fn write_str(&mut self, s: &str, len: usize) -> Result<(), Error> {
@@ -224,5 +237,12 @@ mod test {
 
 		let x = format!("this is a test {} {}", 7, 8).unwrap();
 		assert_eq!(x.to_str(), "this is a test 7 8");
+
+		// placeholders without arguments pass through literally
+		let y = format!("a{}b{}", 7).unwrap();
+		assert_eq!(y.to_str(), "a7b{}");
+		// adjacent placeholders have no static segment between them
+		let z = format!("{}{}!", 1, 2).unwrap();
+		assert_eq!(z.to_str(), "12!");
 	}
 }
@@ -0,0 +1,153 @@
+use prelude::*;
+
+// log-linear bucket layout: 16 linear sub-buckets per power-of-two
+// group, so every bucket is within ~6% of the recorded value. Group 0
+// holds exact values below 16; the last bucket absorbs anything past
+// ~2^31 microseconds. 28 groups keeps the whole table at 448 counters
+const SUB_BITS: u32 = 4;
+const SUB: usize = 1 << SUB_BITS;
+const GROUPS: usize = 28;
+const NBUCKETS: usize = GROUPS * SUB;
+
+/// Fixed-memory, lock-free latency histogram (HDR-style log-linear
+/// buckets). record is a single relaxed atomic add on one counter, so
+/// instances can be shared between a recording worker and a scraping
+/// thread without locks; per-worker instances are combined with merge
+/// at scrape time. Values are microseconds by convention, but nothing
+/// here depends on the unit.
+pub struct Histogram {
+	counts: [u64; NBUCKETS],
+	count: u64,
+}
+
+impl Clone for Histogram {
+	fn clone(&self) -> Result<Self, Error> {
+		let mut ret = Histogram::new();
+		ret.merge(self);
+		Ok(ret)
+	}
+}
+
+impl Histogram {
+	pub fn new() -> Self {
+		Self {
+			counts: [0u64; NBUCKETS],
+			count: 0,
+		}
+	}
+
+	fn bucket_index(v: u64) -> usize {
+		if v < SUB as u64 {
+			return v as usize;
+		}
+		let msb = 63 - v.leading_zeros();
+		let group = (msb - SUB_BITS + 1) as usize;
+		let sub = ((v >> (msb - SUB_BITS)) & (SUB as u64 - 1)) as usize;
+		let index = group * SUB + sub;
+		if index >= NBUCKETS {
+			NBUCKETS - 1
+		} else {
+			index
+		}
+	}
+
+	// upper bound of a bucket; percentiles report this so they never
+	// understate a latency
+	fn bucket_value(index: usize) -> u64 {
+		let group = index / SUB;
+		let sub = index % SUB;
+		if group == 0 {
+			sub as u64
+		} else {
+			let shift = group as u32 - 1;
+			(((SUB + sub + 1) as u64) << shift) - 1
+		}
+	}
+
+	pub fn record(&mut self, v: u64) {
+		let index = Self::bucket_index(v);
+		aadd!(&mut self.counts[index], 1);
+		aadd!(&mut self.count, 1);
+	}
+
+	// add another instance's counters into this one; used to combine
+	// per-worker instances into one view at scrape time. The loads are
+	// relaxed like the ws stats snapshot: individually accurate, not a
+	// consistent cut
+	pub fn merge(&mut self, other: &Histogram) {
+		for i in 0..NBUCKETS {
+			let v = aload!(&other.counts[i]);
+			if v > 0 {
+				aadd!(&mut self.counts[i], v);
+			}
+		}
+		aadd!(&mut self.count, aload!(&other.count));
+	}
+
+	pub fn count(&self) -> u64 {
+		aload!(&self.count)
+	}
+
+	/// Value at or below which `p` percent of recordings fall, rounded
+	/// up to its bucket boundary. p is clamped to 0..=100; 0 recordings
+	/// give 0
+	pub fn percentile(&self, p: u64) -> u64 {
+		let p = if p > 100 { 100 } else { p };
+		let count = self.count();
+		if count == 0 {
+			return 0;
+		}
+		// ceil so p50 of a single sample is that sample
+		let target = (count * p + 99) / 100;
+		let mut cum = 0u64;
+		for i in 0..NBUCKETS {
+			cum += aload!(&self.counts[i]);
+			if cum >= target {
+				return Self::bucket_value(i);
+			}
+		}
+		Self::bucket_value(NBUCKETS - 1)
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+
+	#[test]
+	fn test_histogram() {
+		let mut h = Histogram::new();
+		assert_eq!(h.count(), 0);
+		assert_eq!(h.percentile(50), 0);
+
+		// exact region: single-microsecond resolution below 16
+		for _ in 0..99 {
+			h.record(3);
+		}
+		h.record(9000);
+		assert_eq!(h.count(), 100);
+		assert_eq!(h.percentile(50), 3);
+		assert_eq!(h.percentile(99), 3);
+		// the one outlier defines the tail; log-linear buckets bound
+		// the error at one sub-bucket width (~6%)
+		let p100 = h.percentile(100);
+		assert!(p100 >= 9000 && p100 < 9000 + 9000 / 8);
+
+		// merge combines per-worker instances
+		let mut other = Histogram::new();
+		for _ in 0..100 {
+			other.record(1_000_000);
+		}
+		h.merge(&other);
+		assert_eq!(h.count(), 200);
+		let p99 = h.percentile(99);
+		assert!(p99 >= 1_000_000 && p99 < 1_000_000 + 1_000_000 / 8);
+		assert_eq!(h.percentile(25), 3);
+
+		// overflow clamps into the last bucket rather than indexing out
+		let mut big = Histogram::new();
+		big.record(u64::MAX);
+		assert_eq!(big.count(), 1);
+		assert!(big.percentile(100) > 0);
+	}
+}
@@ -0,0 +1,333 @@
+use ffi::{
+	journal_append, journal_close, journal_commit, journal_committed, journal_handle_size,
+	journal_open, journal_pending, journal_read,
+};
+use prelude::*;
+
+/// Geometry and group-commit policy for a [`Journal`]. A record is
+/// durable in batches: an append only triggers msync once
+/// `sync_threshold` dirty bytes accumulate, and a background timer
+/// commits whatever is pending every `sync_interval_millis` so a quiet
+/// journal never sits dirty for long. An interval of 0 disables the
+/// timer and leaves commit cadence entirely to the threshold and
+/// explicit [`Journal::commit`] calls.
+pub struct JournalConfig {
+	pub segment_size: usize,
+	pub sync_threshold: usize,
+	pub sync_interval_millis: u64,
+}
+
+impl Default for JournalConfig {
+	fn default() -> Self {
+		Self {
+			segment_size: 8 * 1024 * 1024,
+			sync_threshold: 64 * 1024,
+			sync_interval_millis: 5,
+		}
+	}
+}
+
+struct JournalInner {
+	handle: [u8; 256],
+	lock: Lock,
+	stop: u64,
+}
+
+impl Drop for JournalInner {
+	fn drop(&mut self) {
+		// the last holder (writer clone or timer thread) unmaps; any
+		// bytes still dirty get one final commit on the way out
+		let handle = &self.handle;
+		unsafe {
+			journal_close(handle as *const u8);
+		}
+	}
+}
+
+/// Append-only message journal over mmap'd segment files (see
+/// c/journal.c). `append` is a length-prefixed memcpy into the live
+/// segment plus at most one msync per group commit, so a WebSocket
+/// handler can journal the frame bytes straight out of `req.msg()` --
+/// no serialize, no copy to a logger process -- before acking. Clones
+/// share one journal and may live on different worker threads; appends
+/// serialize on an internal lock. Segments rotate automatically when
+/// full and a reopened journal resumes at the durable watermark of its
+/// newest segment.
+pub struct Journal {
+	inner: Rc<JournalInner>,
+}
+
+impl Clone for Journal {
+	fn clone(&self) -> Result<Self, Error> {
+		// SAFETY: clone always succeeds on rc
+		Ok(Self {
+			inner: self.inner.clone().unwrap(),
+		})
+	}
+}
+
+impl Journal {
+	/// Open (or resume) the journal rooted at `path`; segments land at
+	/// `<path>.<segno>`. Fails with IllegalArgument for a path that
+	/// does not fit the handle or a segment size that is not a
+	/// multiple of the 4096 byte header page.
+	pub fn new(path: &str, config: JournalConfig) -> Result<Self, Error> {
+		if unsafe { journal_handle_size() } > 256 {
+			exit!("journal_handle_size() > 256");
+		}
+		let mut p = [0u8; 160];
+		if path.len() >= p.len() {
+			return Err(err!(IllegalArgument));
+		}
+		copy_from_slice(&mut p[0..path.len()], path.as_bytes());
+		if config.segment_size < 2 * 4096 || config.segment_size % 4096 != 0 {
+			return Err(err!(IllegalArgument));
+		}
+
+		let mut inner = match Rc::new(JournalInner {
+			handle: [0u8; 256],
+			lock: Lock::new(),
+			stop: 0,
+		}) {
+			Ok(inner) => inner,
+			Err(e) => return Err(e),
+		};
+		let ret = unsafe {
+			journal_open(
+				&mut inner.handle as *mut [u8; 256] as *mut u8,
+				p.as_ptr(),
+				config.segment_size as u64,
+				config.sync_threshold as u64,
+			)
+		};
+		if ret < 0 {
+			// journal_close is a no-op on the never-opened handle
+			return Err(err!(IO));
+		}
+
+		if config.sync_interval_millis > 0 {
+			// SAFETY: rc.clone does not fail
+			let timer = inner.clone().unwrap();
+			let interval = config.sync_interval_millis;
+			match spawn(move || loop {
+				unsafe {
+					crate::ffi::sleep_millis(interval);
+				}
+				if aload!(&timer.stop) != 0 {
+					break;
+				}
+				let _l = timer.lock.write();
+				unsafe {
+					journal_commit(&timer.handle as *const u8);
+				}
+			}) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			}
+		}
+		Ok(Self { inner })
+	}
+
+	/// Append one record and return its stable offset. Durability is
+	/// deferred to the next group commit; call [`commit`] first if this
+	/// particular record must be on disk before proceeding.
+	///
+	/// [`commit`]: Self::commit
+	pub fn append(&mut self, msg: &[u8]) -> Result<u64, Error> {
+		let inner = &self.inner;
+		let _l = inner.lock.write();
+		let ret =
+			unsafe { journal_append(&inner.handle as *const u8, msg.as_ptr(), msg.len() as u64) };
+		if ret < 0 {
+			Err(err!(IO))
+		} else {
+			Ok(ret as u64)
+		}
+	}
+
+	/// Force a group commit of everything appended so far.
+	pub fn commit(&mut self) -> Result<(), Error> {
+		let inner = &self.inner;
+		let _l = inner.lock.write();
+		let ret = unsafe { journal_commit(&inner.handle as *const u8) };
+		if ret < 0 {
+			Err(err!(IO))
+		} else {
+			Ok(())
+		}
+	}
+
+	/// Read back the record at an offset [`append`] returned, from the
+	/// live segment only. Returns the bytes copied (capped at `buf`).
+	///
+	/// [`append`]: Self::append
+	pub fn read(&self, off: u64, buf: &mut [u8]) -> Result<usize, Error> {
+		let inner = &self.inner;
+		let _l = inner.lock.read();
+		let ret = unsafe {
+			journal_read(
+				&inner.handle as *const u8,
+				off,
+				buf.as_mut_ptr(),
+				buf.len() as u64,
+			)
+		};
+		if ret < 0 {
+			Err(err!(OutOfBounds))
+		} else {
+			Ok(ret as usize)
+		}
+	}
+
+	/// Dirty bytes awaiting the next group commit.
+	pub fn pending(&self) -> u64 {
+		let inner = &self.inner;
+		let _l = inner.lock.read();
+		unsafe { journal_pending(&inner.handle as *const u8) }
+	}
+
+	/// Global durable offset: every record below it survives a crash.
+	pub fn committed(&self) -> u64 {
+		let inner = &self.inner;
+		let _l = inner.lock.read();
+		unsafe { journal_committed(&inner.handle as *const u8) }
+	}
+
+	/// Stop the commit timer (if any) and flush. The mapping itself is
+	/// released when the last clone drops.
+	pub fn close(&mut self) -> Result<(), Error> {
+		astore!(&mut self.inner.stop, 1);
+		self.commit()
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use ffi::{getalloccount, getfdcount};
+
+	fn cleanup(paths: &[&str]) {
+		for p in paths {
+			unsafe {
+				crate::ffi::remove(p.as_ptr());
+			}
+		}
+	}
+
+	#[test]
+	fn test_journal() {
+		let initial = unsafe { getalloccount() };
+		let initial_fds = unsafe { getfdcount() };
+		cleanup(&["/tmp/fam_test_journal.0\0", "/tmp/fam_test_journal.1\0"]);
+		{
+			let resumed;
+			{
+				let config = JournalConfig {
+					segment_size: 8192,
+					sync_threshold: 1024,
+					sync_interval_millis: 0,
+				};
+				let mut j = Journal::new("/tmp/fam_test_journal", config).unwrap();
+
+				// nothing durable yet beyond the header page
+				let off = j.append(b"hello journal").unwrap();
+				assert_eq!(off, 4096);
+				assert_eq!(j.pending(), 8 + 16);
+				assert_eq!(j.committed(), 4096);
+				j.commit().unwrap();
+				assert_eq!(j.pending(), 0);
+				assert_eq!(j.committed(), 4096 + 8 + 16);
+
+				let mut buf = [0u8; 64];
+				assert_eq!(j.read(off, &mut buf).unwrap(), 13);
+				assert_eq!(&buf[0..13], b"hello journal");
+
+				// crossing the byte threshold commits without being asked
+				let big = [7u8; 1024];
+				j.append(&big[0..1024]).unwrap();
+				assert_eq!(j.pending(), 0);
+
+				// a record the remainder cannot hold rotates to segment 1
+				let fill = [9u8; 3000];
+				let a = j.append(&fill[0..3000]).unwrap();
+				let b = j.append(&fill[0..3000]).unwrap();
+				assert!(a < 8192 && b >= 8192);
+				// rotated-out offsets are no longer readable
+				assert!(j.read(off, &mut buf).is_err());
+				assert_eq!(j.read(b, &mut buf).unwrap(), 64);
+
+				// a record that can never fit a segment is refused
+				let huge = [0u8; 8192];
+				assert!(j.append(&huge[0..8192]).unwrap_err().kind == ErrorKind::IO);
+
+				j.close().unwrap();
+				resumed = j.committed();
+			}
+
+			// reopen resumes the newest segment at its watermark
+			let config = JournalConfig {
+				segment_size: 8192,
+				sync_threshold: 1024,
+				sync_interval_millis: 0,
+			};
+			let mut j = Journal::new("/tmp/fam_test_journal", config).unwrap();
+			assert_eq!(j.committed(), resumed);
+			let c = j.append(b"after resume").unwrap();
+			assert_eq!(c, resumed);
+			j.close().unwrap();
+		}
+		cleanup(&["/tmp/fam_test_journal.0\0", "/tmp/fam_test_journal.1\0"]);
+		assert_eq!(initial, unsafe { getalloccount() });
+		assert_eq!(initial_fds, unsafe { getfdcount() });
+	}
+
+	#[test]
+	fn test_journal_timer_threads() {
+		let initial = unsafe { getalloccount() };
+		let initial_fds = unsafe { getfdcount() };
+		cleanup(&["/tmp/fam_test_journal_t.0\0"]);
+		{
+			let config = JournalConfig {
+				segment_size: 8192,
+				// threshold too high to ever trip: only the timer
+				// (or close) can commit
+				sync_threshold: 1024 * 1024,
+				sync_interval_millis: 1,
+			};
+			let mut j = Journal::new("/tmp/fam_test_journal_t", config).unwrap();
+			let mut w = j.clone().unwrap();
+			let (done_send, done_recv) = channel().unwrap();
+			let mut jh = spawnj(move || {
+				// a writer clone on another thread, as a ws worker
+				// would hold
+				for _ in 0..50 {
+					w.append(b"from worker").unwrap();
+				}
+				done_send.send(()).unwrap();
+			})
+			.unwrap();
+			done_recv.recv();
+			assert!(jh.join().is_ok());
+
+			// the timer commits without any explicit flush
+			loop {
+				if j.pending() == 0 {
+					break;
+				}
+				unsafe {
+					crate::ffi::sleep_millis(1);
+				}
+			}
+			assert_eq!(j.committed(), 4096 + 50 * (8 + 16));
+			j.close().unwrap();
+			// give the timer thread its wakeup to observe stop and
+			// drop its clone before the alloc count check
+			unsafe {
+				crate::ffi::sleep_millis(10);
+			}
+		}
+		cleanup(&["/tmp/fam_test_journal_t.0\0"]);
+		assert_eq!(initial, unsafe { getalloccount() });
+		assert_eq!(initial_fds, unsafe { getfdcount() });
+	}
+}
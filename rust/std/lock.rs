@@ -1,8 +1,14 @@
 use core::cell::UnsafeCell;
+use core::mem::forget;
+use ffi::{lock_park, lock_wake_all, thread_slot};
 use prelude::*;
 
 const WFLAG: u64 = 0x1u64 << 63u64;
 const WREQUEST: u64 = 0x1u64 << 62u64;
+// bounded spin before parking: spinning is cheapest when the holder is
+// running on another core, but under oversubscription it burns the
+// holder's own timeslice, so contended waiters fall back to a park
+const SPIN_LIMIT: u32 = 100;
 
 pub struct Lock {
 	pub state: UnsafeCell<u64>,
@@ -32,6 +38,9 @@ impl LockWriteGuard<'_> {
 			let state = unsafe { &mut *self.lock.state.get() };
 			astore!(&mut *state, 0);
 			self.need_unlock = false;
+			unsafe {
+				lock_wake_all();
+			}
 		}
 	}
 }
@@ -42,6 +51,10 @@ impl LockReadGuard<'_> {
 			let state = unsafe { &mut *self.lock.state.get() };
 			asub!(&mut *state, 1);
 			self.need_unlock = false;
+			// a writer may be parked waiting for readers to drain
+			unsafe {
+				lock_wake_all();
+			}
 		}
 	}
 }
@@ -65,15 +78,32 @@ impl Lock {
 		}
 	}
 
+	// spin with sched_yield up to SPIN_LIMIT, then park until the lock
+	// word changes. lock_park re-checks the word before sleeping so a
+	// release between our load and the park is never missed
+	fn backoff(state: &mut u64, spins: u32) -> u32 {
+		if spins < SPIN_LIMIT {
+			sched_yield!();
+			spins + 1
+		} else {
+			let cur = aload!(state);
+			unsafe {
+				lock_park(state as *mut u64, cur);
+			}
+			spins
+		}
+	}
+
 	pub fn read<'a>(&'a self) -> LockReadGuard<'a> {
 		let state = unsafe { &mut *self.state.get() };
+		let mut spins = 0;
 		loop {
 			let x = aload!(state) & !(WFLAG | WREQUEST);
 			let y = x + 1;
 			if cas!(state, &x, y) {
 				break;
 			}
-			sched_yield!();
+			spins = Self::backoff(state, spins);
 		}
 		LockReadGuard {
 			lock: self,
@@ -84,19 +114,21 @@ impl Lock {
 	pub fn write<'a>(&'a self) -> LockWriteGuard<'a> {
 		let state = unsafe { &mut *self.state.get() };
 
+		let mut spins = 0;
 		loop {
 			let x = aload!(state) & !(WFLAG | WREQUEST);
 			if cas!(state, &x, x | WREQUEST) {
 				break;
 			}
-			sched_yield!();
+			spins = Self::backoff(state, spins);
 		}
+		let mut spins = 0;
 		loop {
 			let x = WREQUEST;
 			if cas!(state, &x, WFLAG) {
 				break;
 			}
-			sched_yield!();
+			spins = Self::backoff(state, spins);
 		}
 		LockWriteGuard {
 			lock: self,
@@ -105,6 +137,81 @@ impl Lock {
 	}
 }
 
+// big-reader lock for read-mostly data: every reader takes the lock of
+// its own cacheline-padded shard, chosen by a stable per-thread slot,
+// so concurrent read acquisitions on different threads never touch the
+// same counter line. Writers sweep all shards in index order, making
+// writes proportionally dearer -- worth it only when reads vastly
+// outnumber writes (configuration, routing tables and the like)
+const LOCK_SHARDS: usize = 16;
+
+#[repr(align(64))]
+struct LockShard {
+	lock: Lock,
+}
+
+pub struct ShardedLock {
+	shards: [LockShard; LOCK_SHARDS],
+}
+
+pub struct ShardedLockWriteGuard<'a> {
+	lock: &'a ShardedLock,
+	need_unlock: bool,
+}
+
+impl ShardedLockWriteGuard<'_> {
+	pub fn unlock(&mut self) {
+		if self.need_unlock {
+			for i in 0..LOCK_SHARDS {
+				let state = unsafe { &mut *self.lock.shards[i].lock.state.get() };
+				astore!(&mut *state, 0);
+			}
+			self.need_unlock = false;
+			// one broadcast once every shard is released, not one per
+			// shard
+			unsafe {
+				lock_wake_all();
+			}
+		}
+	}
+}
+
+impl Drop for ShardedLockWriteGuard<'_> {
+	fn drop(&mut self) {
+		self.unlock();
+	}
+}
+
+impl ShardedLock {
+	pub fn new() -> Self {
+		Self {
+			shards: [(); LOCK_SHARDS].map(|_| LockShard { lock: Lock::new() }),
+		}
+	}
+
+	// the read guard is the plain per-shard guard: dropping it releases
+	// exactly the shard it incremented
+	pub fn read<'a>(&'a self) -> LockReadGuard<'a> {
+		let idx = unsafe { thread_slot() } as usize & (LOCK_SHARDS - 1);
+		self.shards[idx].lock.read()
+	}
+
+	pub fn write<'a>(&'a self) -> ShardedLockWriteGuard<'a> {
+		// sweep in index order so two writers cannot deadlock: shard 0
+		// serializes them while the rest drain their readers. The
+		// per-shard guards are forgotten here; the sharded guard owns
+		// all the shards and releases them together on drop
+		for i in 0..LOCK_SHARDS {
+			let guard = self.shards[i].lock.write();
+			forget(guard);
+		}
+		ShardedLockWriteGuard {
+			lock: self,
+			need_unlock: true,
+		}
+	}
+}
+
 impl Clone for LockBox {
 	fn clone(&self) -> Result<Self, Error> {
 		// SAFETY: clone always succeeds on rc
@@ -166,6 +273,99 @@ mod test {
 		assert_eq!(unsafe { *x.state.get() }, 0);
 	}
 
+	#[test]
+	fn test_lock_park() {
+		let lock = lock_box!().unwrap();
+		let lock_clone = lock.clone().unwrap();
+		let rc = Rc::new(false).unwrap();
+		let mut rc_clone = rc.clone().unwrap();
+		let mut guard = lock.write();
+		let mut jh = spawnj(move || {
+			// spins through SPIN_LIMIT then parks until the writer
+			// below releases
+			let _v = lock_clone.write();
+			*rc_clone = true;
+		})
+		.unwrap();
+		unsafe {
+			crate::ffi::sleep_millis(50);
+		}
+		assert_eq!(*rc, false);
+		guard.unlock();
+		loop {
+			{
+				let _v = lock.read();
+				if *rc {
+					break;
+				}
+			}
+			unsafe {
+				crate::ffi::sleep_millis(1);
+			}
+		}
+		assert!(jh.join().is_ok());
+	}
+
+	#[test]
+	fn test_sharded_lock() {
+		use std::lock::{ShardedLock, LOCK_SHARDS};
+		let x = ShardedLock::new();
+		// this thread's reads all land on one shard and nest there
+		{
+			let _r1 = x.read();
+			let _r2 = x.read();
+			let mut total = 0u64;
+			for i in 0..LOCK_SHARDS {
+				total += unsafe { *x.shards[i].lock.state.get() };
+			}
+			assert_eq!(total, 2);
+		}
+		// a writer holds every shard and releases them all on drop
+		{
+			let _w = x.write();
+			for i in 0..LOCK_SHARDS {
+				assert_eq!(unsafe { *x.shards[i].lock.state.get() }, WFLAG);
+			}
+		}
+		for i in 0..LOCK_SHARDS {
+			assert_eq!(unsafe { *x.shards[i].lock.state.get() }, 0);
+		}
+	}
+
+	#[test]
+	fn test_sharded_lock_threads() {
+		use std::lock::ShardedLock;
+		// a writer excludes readers on every shard, whichever slot the
+		// reading thread hashes to
+		let lock = Rc::new(ShardedLock::new()).unwrap();
+		let count = Rc::new(0u64).unwrap();
+		let mut jhs = Vec::new();
+		for _t in 0..4 {
+			let lock = lock.clone().unwrap();
+			let mut count = count.clone().unwrap();
+			let jh = spawnj(move || {
+				for _i in 0..1000 {
+					let _r = lock.read();
+					aadd!(&mut *count, 1);
+				}
+			})
+			.unwrap();
+			jhs.push(jh).unwrap();
+		}
+		let mut seen = 0u64;
+		while seen < 4000 {
+			{
+				let _w = lock.write();
+				seen = aload!(&*count);
+			}
+			sched_yield!();
+		}
+		for i in 0..jhs.len() {
+			assert!(jhs[i].join().is_ok());
+		}
+		assert_eq!(aload!(&*count), 4000);
+	}
+
 	#[test]
 	fn test_lock_box() {
 		let x = lock_box!().unwrap();
@@ -0,0 +1,408 @@
+use core::mem::swap;
+use core::ptr::read;
+use ffi::{sleep_millis, thread_self_id, write};
+use prelude::*;
+
+/// Geometry and cadence for a [`LogSink`]. `shards` bounds writer
+/// contention (size it near the worker count), `shard_capacity` is how
+/// many bytes a shard may accumulate between flushes before lines are
+/// dropped, and `flush_interval_millis` is the flusher cadence. Lines
+/// land on `fd` -- stderr by default, matching the print macros.
+pub struct LogConfig {
+	pub shards: usize,
+	pub shard_capacity: usize,
+	pub flush_interval_millis: u64,
+	pub fd: i32,
+}
+
+impl Default for LogConfig {
+	fn default() -> Self {
+		Self {
+			shards: 8,
+			shard_capacity: 64 * 1024,
+			flush_interval_millis: 5,
+			fd: 2,
+		}
+	}
+}
+
+struct Shard {
+	// 0 = free, 1 = claimed. Writers and the flusher hold the claim
+	// only across a memcpy or a buffer swap, never across a syscall,
+	// so a writer waits out nanoseconds in the worst case
+	claim: u64,
+	buf: Vec<u8>,
+	dropped: u64,
+}
+
+struct LogSinkInner {
+	shards: Vec<Ptr<Shard>>,
+	stop: u64,
+	fd: i32,
+	capacity: usize,
+	interval: u64,
+}
+
+impl Drop for LogSinkInner {
+	fn drop(&mut self) {
+		// the last holder (sink clone or flusher task) frees the
+		// shards; any bytes the flusher never saw get one final
+		// synchronous write on the way out
+		for i in 0..self.shards.len() {
+			let shard = self.shards[i];
+			if shard.buf.len() > 0 {
+				unsafe {
+					write(self.fd, shard.buf.as_ptr(), shard.buf.len());
+				}
+			}
+			LogSink::reap(shard);
+		}
+	}
+}
+
+/// Buffered line-oriented log sink. [`log`] appends the line to one of
+/// a set of sharded in-memory buffers -- a claim flag spin plus a
+/// memcpy, no syscall -- and a background flusher task on the caller's
+/// [`Runtime`] drains every shard to the configured fd each interval.
+/// A shard that fills between flushes drops lines rather than block
+/// the writer, and counts them (see [`dropped`]); a logging burst
+/// during an incident costs the flusher a bigger write, not every
+/// worker a write syscall. Clones share one sink and may live on
+/// different worker threads.
+///
+/// [`log`]: Self::log
+/// [`dropped`]: Self::dropped
+pub struct LogSink {
+	inner: Rc<LogSinkInner>,
+	flusher: Option<Handle<()>>,
+}
+
+impl Clone for LogSink {
+	fn clone(&self) -> Result<Self, Error> {
+		// SAFETY: clone always succeeds on rc
+		Ok(Self {
+			inner: self.inner.clone().unwrap(),
+			flusher: None,
+		})
+	}
+}
+
+impl LogSink {
+	/// Build a sink with the given geometry. Shard buffers are
+	/// allocated up front so the log path never allocates.
+	pub fn new(config: LogConfig) -> Result<Self, Error> {
+		if config.shards == 0 || config.shard_capacity == 0 {
+			return Err(err!(IllegalArgument));
+		}
+		let mut shards = Vec::new();
+		for _ in 0..config.shards {
+			let mut buf = Vec::new();
+			match buf.reserve(config.shard_capacity) {
+				Ok(_) => {}
+				Err(e) => {
+					Self::reap_all(&mut shards);
+					return Err(e);
+				}
+			}
+			let ptr = match Ptr::alloc(Shard {
+				claim: 0,
+				buf,
+				dropped: 0,
+			}) {
+				Ok(ptr) => ptr,
+				Err(e) => {
+					Self::reap_all(&mut shards);
+					return Err(e);
+				}
+			};
+			match shards.push(ptr) {
+				Ok(_) => {}
+				Err(e) => {
+					Self::reap(ptr);
+					Self::reap_all(&mut shards);
+					return Err(e);
+				}
+			}
+		}
+		// on Rc::new failure the inner drops, and its Drop frees the
+		// shards
+		let inner = match Rc::new(LogSinkInner {
+			shards,
+			stop: 0,
+			fd: config.fd,
+			capacity: config.shard_capacity,
+			interval: config.flush_interval_millis,
+		}) {
+			Ok(inner) => inner,
+			Err(e) => return Err(e),
+		};
+		Ok(Self {
+			inner,
+			flusher: None,
+		})
+	}
+
+	/// Queue one line for the flusher (a trailing newline is added).
+	/// The calling thread claims its home shard -- chosen by thread id
+	/// -- and walks to a sibling on contention, so a writer never
+	/// spins behind another writer's memcpy. When every shard it tries
+	/// is full the line is dropped and counted instead of blocking.
+	pub fn log(&self, line: &str) {
+		let inner = &self.inner;
+		let nshards = inner.shards.len();
+		let mut idx = (unsafe { thread_self_id() } as usize) % nshards;
+		let bytes = line.as_bytes();
+		let mut attempts = 0;
+		loop {
+			let mut shard = inner.shards[idx];
+			let expect = 0;
+			if cas!(&mut shard.claim, &expect, 1) {
+				if shard.buf.len() + bytes.len() + 1 > inner.capacity {
+					aadd!(&mut shard.dropped, 1);
+				} else {
+					// capacity was reserved up front: these do not
+					// allocate; a failure still just drops the line
+					let ok = match shard.buf.append_ptr(bytes.as_ptr(), bytes.len()) {
+						Ok(_) => shard.buf.push(b'\n').is_ok(),
+						Err(_) => false,
+					};
+					if !ok {
+						aadd!(&mut shard.dropped, 1);
+					}
+				}
+				astore!(&mut shard.claim, 0);
+				return;
+			}
+			idx = (idx + 1) % nshards;
+			attempts += 1;
+			if attempts >= nshards {
+				sched_yield!();
+				attempts = 0;
+			}
+		}
+	}
+
+	/// Start the background flusher on the runtime. The task occupies
+	/// one worker for the sink's lifetime (until [`stop`]), sleeping
+	/// out the interval and swapping each shard's buffer for an empty
+	/// spare -- writers only ever wait out the pointer exchange, the
+	/// write syscall happens with no claim held.
+	///
+	/// [`stop`]: Self::stop
+	pub fn start(&mut self, runtime: &mut Runtime<()>) -> Result<(), Error> {
+		match self.flusher {
+			Some(_) => return Err(err!(IllegalState)),
+			None => {}
+		}
+		// SAFETY: clone always succeeds on rc
+		let flusher = self.inner.clone().unwrap();
+		let mut spare = Vec::new();
+		match spare.reserve(self.inner.capacity) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+		let handle = match runtime.execute(move || loop {
+			unsafe {
+				sleep_millis(flusher.interval);
+			}
+			// sweep after observing stop so everything logged before
+			// the stop call is flushed before the task exits
+			let stopping = aload!(&flusher.stop) != 0;
+			for i in 0..flusher.shards.len() {
+				Self::drain(&flusher, i, &mut spare);
+			}
+			if stopping {
+				break;
+			}
+		}) {
+			Ok(handle) => handle,
+			Err(e) => return Err(e),
+		};
+		self.flusher = Some(handle);
+		Ok(())
+	}
+
+	/// Stop the flusher and block until it has drained every shard.
+	/// Lines logged after this point sit buffered until the last clone
+	/// drops, which writes them out synchronously.
+	pub fn stop(&mut self) -> Result<(), Error> {
+		astore!(&mut self.inner.stop, 1);
+		match &mut self.flusher {
+			Some(ref mut handle) => {
+				handle.block_on();
+			}
+			None => {}
+		}
+		self.flusher = None;
+		Ok(())
+	}
+
+	/// Lines dropped on shard overflow since the sink was built.
+	pub fn dropped(&self) -> u64 {
+		let inner = &self.inner;
+		let mut ret = 0;
+		for i in 0..inner.shards.len() {
+			let shard = inner.shards[i];
+			ret += aload!(&shard.dropped);
+		}
+		ret
+	}
+
+	fn drain(inner: &Rc<LogSinkInner>, idx: usize, spare: &mut Vec<u8>) {
+		let mut shard = inner.shards[idx];
+		let expect = 0;
+		while !cas!(&mut shard.claim, &expect, 1) {
+			sched_yield!();
+		}
+		swap(&mut shard.buf, spare);
+		astore!(&mut shard.claim, 0);
+		if spare.len() > 0 {
+			unsafe {
+				write(inner.fd, spare.as_ptr(), spare.len());
+			}
+			// truncate keeps the allocation for the next swap
+			spare.truncate(0);
+		}
+	}
+
+	fn reap(ptr: Ptr<Shard>) {
+		// move the shard out so its buffer frees exactly once
+		let _shard = unsafe { read(ptr.raw() as *const Shard) };
+		ptr.release_slab();
+	}
+
+	fn reap_all(shards: &mut Vec<Ptr<Shard>>) {
+		for i in 0..shards.len() {
+			Self::reap(shards[i]);
+		}
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use core::mem::drop;
+	use ffi::{getalloccount, getfdcount, open_pipe, socket_close, socket_recv};
+
+	#[test]
+	fn test_log_sink() {
+		let initial = unsafe { getalloccount() };
+		let initial_fds = unsafe { getfdcount() };
+		{
+			// a pipe stands in for the log fd so the test can read
+			// back what the flusher wrote
+			let mut fds = [0i32; 2];
+			assert!(unsafe { open_pipe(&mut fds as *mut i32 as *mut u8) } == 0);
+
+			let mut rt: Runtime<()> = Runtime::new(RuntimeConfig {
+				min_threads: 2,
+				max_threads: 3,
+				work_steal: false,
+			})
+			.unwrap();
+			rt.start().unwrap();
+
+			let mut sink = LogSink::new(LogConfig {
+				shards: 2,
+				shard_capacity: 4096,
+				flush_interval_millis: 1,
+				fd: fds[1],
+			})
+			.unwrap();
+			sink.start(&mut rt).unwrap();
+
+			// a writer clone on another thread, as a ws worker would
+			// hold
+			let w = sink.clone().unwrap();
+			let (done_send, done_recv) = channel().unwrap();
+			let mut jh = spawnj(move || {
+				for _ in 0..100 {
+					w.log("from worker");
+				}
+				done_send.send(()).unwrap();
+			})
+			.unwrap();
+			for _ in 0..100 {
+				sink.log("from main");
+			}
+			done_recv.recv();
+			assert!(jh.join().is_ok());
+
+			// the flusher delivers every line with no explicit flush
+			let expect = 100 * "from worker\n".len() + 100 * "from main\n".len();
+			let mut buf = [0u8; 8192];
+			let mut total = 0;
+			while total < expect {
+				let n = unsafe {
+					socket_recv(
+						&fds[0] as *const i32 as *const u8,
+						buf.as_mut_ptr(),
+						buf.len(),
+					)
+				};
+				if n > 0 {
+					total += n as usize;
+				} else {
+					unsafe {
+						sleep_millis(1);
+					}
+				}
+			}
+			assert_eq!(total, expect);
+			assert_eq!(sink.dropped(), 0);
+
+			sink.stop().unwrap();
+			rt.stop().unwrap();
+			drop(sink);
+			unsafe {
+				socket_close(&fds[0] as *const i32 as *const u8);
+				socket_close(&fds[1] as *const i32 as *const u8);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+		assert_eq!(initial_fds, unsafe { getfdcount() });
+	}
+
+	#[test]
+	fn test_log_sink_overflow() {
+		let initial = unsafe { getalloccount() };
+		let initial_fds = unsafe { getfdcount() };
+		{
+			let mut fds = [0i32; 2];
+			assert!(unsafe { open_pipe(&mut fds as *mut i32 as *mut u8) } == 0);
+
+			// no flusher: the single shard fills and further lines
+			// drop instead of blocking the writer
+			let sink = LogSink::new(LogConfig {
+				shards: 1,
+				shard_capacity: 64,
+				flush_interval_millis: 1,
+				fd: fds[1],
+			})
+			.unwrap();
+			for _ in 0..10 {
+				sink.log("0123456789");
+			}
+			// 64 / 11 = 5 lines fit
+			assert_eq!(sink.dropped(), 5);
+
+			// dropping the sink writes the buffered lines out
+			drop(sink);
+			let mut buf = [0u8; 128];
+			let n = unsafe {
+				socket_recv(
+					&fds[0] as *const i32 as *const u8,
+					buf.as_mut_ptr(),
+					buf.len(),
+				)
+			};
+			assert_eq!(n, 55);
+			unsafe {
+				socket_close(&fds[0] as *const i32 as *const u8);
+				socket_close(&fds[1] as *const i32 as *const u8);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+		assert_eq!(initial_fds, unsafe { getfdcount() });
+	}
+}
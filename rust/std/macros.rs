@@ -30,48 +30,51 @@ macro_rules! writeb {
             writeb!($f, "{}", $fmt)
         }};
         ($f:expr, $fmt:expr, $($t:expr),*) => {{
+            use core::str::from_utf8_unchecked;
             let mut err = err!(Unknown);
-            match String::new($fmt) {
-                Ok(fmt) => {
-                    let mut cur = 0;
-                    $(
-                        match fmt.findn("{}", cur) {
-                            Some(index) => {
-                                match fmt.substring( cur, cur + index) {
-                                    Ok(s) => {
-                                        let s = s.to_str();
-                                        match $f.write_str(s, s.len()) {
-                                            Ok(_) => {},
-                                            Err(e) => err = e,
-                                        }
-                                        cur += index + 2;
-                                    }
-                                    Err(e) => err = e,
-                                }
-                            },
-                            None => {
-                            },
-                        }
-                        match $t.format(&mut $f) {
-                            Ok(_) => {},
-                            Err(e) => err = e,
+            // the format string is a literal: its length is a constant, so
+            // the buffer is presized once and the static segments are
+            // copied straight out of the literal with no intermediate
+            // String and no per-segment allocation
+            let fmt: &str = $fmt;
+            let bytes = fmt.as_bytes();
+            $f.reserve(fmt.len());
+            let mut cur = 0;
+            $(
+                {
+                    let mut idx = cur;
+                    let mut found = false;
+                    while idx + 1 < bytes.len() {
+                        if bytes[idx] == b'{' && bytes[idx + 1] == b'}' {
+                            found = true;
+                            break;
                         }
-                    )*
-
-                    match fmt.substring( cur, fmt.len()) {
-                        Ok(s) => {
-                            let s = s.to_str();
-                            match $f.write_str(s, s.len()) {
-                                Ok(_) =>{},
+                        idx += 1;
+                    }
+                    if found {
+                        if idx > cur {
+                            let s = unsafe { from_utf8_unchecked(&bytes[cur..idx]) };
+                            match $f.write_str(s, idx - cur) {
+                                Ok(_) => {},
                                 Err(e) => err = e,
                             }
                         }
+                        cur = idx + 2;
+                    }
+                    match $t.format(&mut $f) {
+                        Ok(_) => {},
                         Err(e) => err = e,
                     }
                 }
-                Err(e) => err = e,
-            }
+            )*
 
+            if cur < bytes.len() {
+                let s = unsafe { from_utf8_unchecked(&bytes[cur..bytes.len()]) };
+                match $f.write_str(s, bytes.len() - cur) {
+                    Ok(_) => {},
+                    Err(e) => err = e,
+                }
+            }
 
             if err.kind == ErrorKind::Unknown {
                 Ok(())
@@ -175,6 +178,23 @@ macro_rules! err {
 	}};
 }
 
+// err! without backtrace capture, for flow-control errors constructed
+// on hot paths
+#[macro_export]
+macro_rules! err_nobt {
+	($kind:expr) => {{
+		Error::new_nobt($kind, line!(), file!())
+	}};
+}
+
+// expand a hot-path ErrCode into a full Error at the public boundary
+#[macro_export]
+macro_rules! err_from_code {
+	($code:expr) => {{
+		$code.to_error(line!(), file!())
+	}};
+}
+
 #[macro_export]
 macro_rules! aadd {
 	($a:expr, $v:expr) => {{
@@ -1,19 +1,26 @@
 #[macro_use]
 pub mod macros;
 
+pub mod arena;
 pub mod backtrace;
 pub mod boxed;
 pub mod channel;
 pub mod clone;
 pub mod error;
 pub mod format;
+pub mod histogram;
+pub mod journal;
 pub mod lock;
+pub mod log;
 pub mod murmur128;
 pub mod murmur32;
 pub mod option;
 pub mod ptr;
 pub mod rc;
 pub mod result;
+pub mod ringbuf;
+pub mod sha1;
+pub mod shmchannel;
 pub mod string;
 pub mod thread;
 pub mod traits;
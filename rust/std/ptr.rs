@@ -5,10 +5,17 @@ use core::mem::size_of;
 use core::ops::{CoerceUnsized, Deref, DerefMut};
 use core::ptr::{null, write};
 use core::str::from_utf8_unchecked;
-use ffi::{alloc, ptr_add, release, resize};
+use ffi::{alloc, alloc_slab, ptr_add, release, release_sized, resize};
 use prelude::*;
 use std::util::u128_to_str;
 
+// tag layout: the low bit is the mark flag (set_bit), the high 16 bits
+// hold a generation counter for ABA-safe compare-and-swap. The middle
+// bits are the canonical x86-64/aarch64 user address, so raw() strips
+// the whole tag before the pointer is dereferenced
+const GEN_SHIFT: u32 = 48;
+const TAG_MASK: usize = 1 | (0xffff << GEN_SHIFT);
+
 pub struct Ptr<T: ?Sized> {
 	ptr: *const T,
 }
@@ -95,11 +102,27 @@ impl<T: ?Sized> Ptr<T> {
 		self.ptr as *const u8 as usize % 2 != 0
 	}
 
+	pub fn set_gen(&mut self, gen: u16) {
+		// modular delta so the add wraps the old generation out and the
+		// new one in without touching the address or mark bit
+		let cur = self.get_gen();
+		let delta = ((gen as u64).wrapping_sub(cur as u64) << GEN_SHIFT) as i64;
+		let ptr = (&mut self.ptr) as *const _ as *const *const u8;
+		unsafe {
+			ptr_add(ptr as *mut _, delta);
+		}
+	}
+
+	pub fn get_gen(&self) -> u16 {
+		(self.ptr as *const u8 as usize >> GEN_SHIFT) as u16
+	}
+
 	pub fn raw(&self) -> *mut T {
-		if self.get_bit() {
+		let tag = self.ptr as *const u8 as usize & TAG_MASK;
+		if tag != 0 {
 			let mut ret = self.ptr;
 			unsafe {
-				ptr_add(&mut ret as *mut _ as *mut u8, -1);
+				ptr_add(&mut ret as *mut _ as *mut u8, (tag as i64).wrapping_neg());
 			}
 			ret as *mut T
 		} else {
@@ -143,7 +166,7 @@ impl<T: ?Sized> Ptr<T> {
 
 impl<T> Ptr<T> {
 	pub fn alloc(t: T) -> Result<Self, Error> {
-		let ptr = unsafe { alloc(size_of::<T>()) } as *const T;
+		let ptr = unsafe { alloc_slab(size_of::<T>()) } as *const T;
 
 		if ptr.is_null() {
 			Err(err!(Alloc))
@@ -160,6 +183,34 @@ impl<T> Ptr<T> {
 		Self { ptr }
 	}
 
+	// the sized pair of Ptr::alloc: routes the chunk back to the
+	// per-thread slab class it came from, so alloc/release cycles of
+	// one type recycle without touching malloc. Only valid for
+	// pointers that came from Ptr::alloc; resized or foreign pointers
+	// must go through release()
+	pub fn release_slab(&self) {
+		unsafe {
+			release_sized(self.raw() as *mut u8, size_of::<T>());
+		}
+	}
+
+	// atomically replace the whole tagged word (address, mark bit and
+	// generation) if it still equals expect. Lock-free structures CAS in
+	// expect.next_gen() so a node freed and recycled at the same address
+	// carries a different generation and cannot satisfy the compare (ABA)
+	pub fn tagged_cas(&mut self, expect: Ptr<T>, desired: Ptr<T>) -> bool {
+		let word = (&mut self.ptr) as *mut _ as *mut u64;
+		let e = expect.ptr as u64;
+		cas!(word, &e, desired.ptr as u64)
+	}
+
+	// same address and mark bit with the generation advanced by one
+	pub fn next_gen(&self) -> Ptr<T> {
+		let mut ret = *self;
+		ret.set_gen(self.get_gen().wrapping_add(1));
+		ret
+	}
+
 	pub fn offt(&mut self, n: usize) -> *mut T {
 		unsafe { (self.raw() as *mut u8).add(n) as *mut T }
 	}
@@ -235,4 +286,70 @@ mod test {
 		ptr3.release();
 		ptr4.release();
 	}
+
+	#[test]
+	fn test_ptr_slab() {
+		use ffi::{getalloccount, slab_flush, slab_stats};
+		let initial = unsafe { getalloccount() };
+		{
+			let mut hits = 0u64;
+			let mut misses = 0u64;
+			let mut recycled = 0u64;
+			let ptr = Ptr::alloc(7u64).unwrap();
+			ptr.release_slab();
+			unsafe {
+				slab_stats(&mut hits, &mut misses, &mut recycled);
+			}
+			let (h0, r0) = (hits, recycled);
+			// the chunk went back to this thread's magazine, so the next
+			// same-class alloc is a hit
+			let ptr2 = Ptr::alloc(9u64).unwrap();
+			assert_eq!(*ptr2, 9);
+			unsafe {
+				slab_stats(&mut hits, &mut misses, &mut recycled);
+			}
+			assert!(hits > h0);
+			assert!(r0 > 0);
+			ptr2.release_slab();
+			// flush hands the cached chunks back to the allocator
+			unsafe {
+				slab_flush();
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_ptr_gen() {
+		let mut ptr = Ptr::alloc(123usize).unwrap();
+		let addr = ptr.raw();
+		assert_eq!(ptr.get_gen(), 0);
+
+		// the generation and mark bit pack beside the address without
+		// disturbing raw() or each other
+		ptr.set_gen(7);
+		assert_eq!(ptr.get_gen(), 7);
+		assert_eq!(ptr.raw(), addr);
+		assert_eq!(*ptr, 123);
+		ptr.set_bit(true);
+		assert!(ptr.get_bit());
+		assert_eq!(ptr.get_gen(), 7);
+		assert_eq!(ptr.raw(), addr);
+		ptr.set_bit(false);
+		ptr.set_gen(0xffff);
+		assert_eq!(ptr.get_gen(), 0xffff);
+		assert_eq!(ptr.raw(), addr);
+		assert_eq!(ptr.next_gen().get_gen(), 0);
+
+		// a stale generation cannot satisfy the compare even though the
+		// address matches
+		let mut slot = ptr;
+		let stale = ptr.next_gen();
+		assert!(!slot.tagged_cas(stale, stale.next_gen()));
+		assert!(slot.tagged_cas(ptr, ptr.next_gen()));
+		assert_eq!(slot.get_gen(), 0);
+		assert_eq!(slot.raw(), addr);
+
+		ptr.release();
+	}
 }
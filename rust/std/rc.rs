@@ -2,6 +2,13 @@ use core::marker::Sized;
 use core::ops::{Deref, DerefMut, Drop};
 use prelude::*;
 
+// Shared ownership with an atomic refcount: clone and drop go through
+// the atomic macros, so clones may move to other threads and be
+// dropped there, and reads through get/Deref never take a lock. What
+// std calls Arc is this type; there is no separate non-atomic variant.
+// The count only synchronizes ownership — mutating the value through
+// shared clones still needs external synchronization (a Lock) unless
+// get_mut proves the handle unique.
 struct RcInner<T: ?Sized> {
 	count: u64,
 	value: T,
@@ -98,6 +105,32 @@ mod test {
 		assert_eq!(initial, unsafe { getalloccount() });
 	}
 
+	#[test]
+	fn test_rc_cross_thread() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut x = Rc::new(1234u64).unwrap();
+			let mut handles: Vec<JoinHandle> = Vec::new();
+			for _i in 0..4 {
+				// SAFETY: clone does not fail for rc
+				let c = x.clone().unwrap();
+				let jh = spawnj(move || {
+					// lock-free read from another thread; the clone
+					// drops there and releases its count atomically
+					assert_eq!(*c.get(), 1234);
+				})
+				.unwrap();
+				handles.push(jh).unwrap();
+			}
+			for i in 0..handles.len() {
+				assert!(handles[i].join().is_ok());
+			}
+			// all clones are gone, so the handle is unique again
+			assert!(x.get_mut().is_some());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
 	static mut VTEST: usize = 0;
 
 	struct MyType {
@@ -0,0 +1,158 @@
+use core::ptr::copy_nonoverlapping;
+use core::slice::{from_raw_parts, from_raw_parts_mut};
+use ffi::{ringbuf_create, ringbuf_destroy, ringbuf_round};
+use prelude::*;
+
+/// Byte ring buffer backed by doubly-mapped memory: the same physical
+/// pages appear twice back to back in virtual memory, so the readable
+/// and writable regions are always single contiguous slices even when
+/// they span the wrap point. Capacity is rounded up to a page multiple
+/// by the kernel mapping, so prefer page-sized requests.
+pub struct RingBuf {
+	base: *mut u8,
+	capacity: usize,
+	// monotonic byte counters; len is their difference and positions
+	// are taken modulo capacity
+	head: u64,
+	tail: u64,
+}
+
+impl RingBuf {
+	pub fn new(capacity: usize) -> Result<Self, Error> {
+		let capacity = unsafe { ringbuf_round(capacity as u64) };
+		let base = unsafe { ringbuf_create(capacity) };
+		if base.is_null() {
+			Err(err!(Alloc))
+		} else {
+			Ok(Self {
+				base,
+				capacity: capacity as usize,
+				head: 0,
+				tail: 0,
+			})
+		}
+	}
+
+	pub fn capacity(&self) -> usize {
+		self.capacity
+	}
+
+	pub fn len(&self) -> usize {
+		(self.tail - self.head) as usize
+	}
+
+	/// append bytes to the ring. fails without writing anything if the
+	/// bytes do not fit in the remaining capacity.
+	pub fn write(&mut self, bytes: &[u8]) -> Result<(), Error> {
+		if bytes.len() > self.capacity - self.len() {
+			return Err(err!(CapacityExceeded));
+		}
+		let off = (self.tail % self.capacity as u64) as usize;
+		unsafe {
+			// the mirror makes base[off..off+len] valid even when
+			// off + len crosses capacity
+			copy_nonoverlapping(
+				bytes.as_ptr(),
+				self.base.add(off),
+				bytes.len(),
+			);
+		}
+		self.tail += bytes.len() as u64;
+		Ok(())
+	}
+
+	/// all readable bytes as one contiguous slice, in arrival order.
+	pub fn read_slice(&self) -> &[u8] {
+		let off = (self.head % self.capacity as u64) as usize;
+		unsafe { from_raw_parts(self.base.add(off), self.len()) }
+	}
+
+	/// the writable region as one contiguous slice; pair with advance.
+	pub fn write_slice(&mut self) -> &mut [u8] {
+		let off = (self.tail % self.capacity as u64) as usize;
+		let avail = self.capacity - self.len();
+		unsafe { from_raw_parts_mut(self.base.add(off), avail) }
+	}
+
+	/// mark n bytes of the writable region as written.
+	pub fn advance(&mut self, n: usize) -> Result<(), Error> {
+		if n > self.capacity - self.len() {
+			return Err(err!(CapacityExceeded));
+		}
+		self.tail += n as u64;
+		Ok(())
+	}
+
+	/// discard n bytes from the front of the readable region.
+	pub fn consume(&mut self, n: usize) -> Result<(), Error> {
+		if n > self.len() {
+			return Err(err!(OutOfBounds));
+		}
+		self.head += n as u64;
+		Ok(())
+	}
+}
+
+impl Drop for RingBuf {
+	fn drop(&mut self) {
+		unsafe { ringbuf_destroy(self.base, self.capacity as u64) }
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use ffi::getalloccount;
+
+	#[test]
+	fn test_ringbuf1() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut rb = RingBuf::new(1).unwrap();
+			let cap = rb.capacity();
+			// capacity is page rounded
+			assert!(cap >= 4096 && cap % 4096 == 0);
+
+			assert!(rb.write(b"hello").is_ok());
+			assert_eq!(rb.len(), 5);
+			assert_eq!(rb.read_slice(), b"hello");
+			assert!(rb.consume(5).is_ok());
+			assert_eq!(rb.len(), 0);
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_ringbuf_wrap() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut rb = RingBuf::new(4096).unwrap();
+			let cap = rb.capacity();
+
+			// park the positions 8 bytes before the wrap point
+			let mut fill = Vec::new();
+			assert!(fill.resize(cap - 8).is_ok());
+			assert!(rb.write(&fill[0..cap - 8]).is_ok());
+			assert!(rb.consume(cap - 8).is_ok());
+
+			// this write spans the physical end of the mapping but
+			// reads back as one contiguous slice
+			assert!(rb.write(b"0123456789abcdef").is_ok());
+			assert_eq!(rb.read_slice(), b"0123456789abcdef");
+
+			// the writable region is contiguous across the wrap too
+			let ws = rb.write_slice();
+			assert_eq!(ws.len(), cap - 16);
+			ws[0] = b'x';
+			assert!(rb.advance(1).is_ok());
+			assert!(rb.consume(16).is_ok());
+			assert_eq!(rb.read_slice(), b"x");
+
+			// overfill is rejected without writing
+			assert!(rb.write(&fill[0..cap - 8]).is_ok());
+			assert!(rb.write(&fill[0..cap - 8]).is_err());
+			assert!(rb.consume(rb.len() + 1).is_err());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+}
@@ -0,0 +1,92 @@
+use ffi::{sha1_ctx_size, SHA1_Final, SHA1_Init, SHA1_Update, SHA1_2};
+
+/// The size (in bytes) of a SHA-1 digest
+pub const SHA1_SIZE: usize = 20;
+
+// must cover sizeof(SHA1_CTX) in c/sha1.c; checked in Sha1::new
+const SHA1_CTX_SIZE: usize = 128;
+
+/// Incremental SHA-1 hasher backed by the streaming entry points in
+/// c/sha1.c. Data can be fed in arbitrary chunks, so callers hashing
+/// streamed input never need to assemble it contiguously first.
+pub struct Sha1 {
+	ctx: [u8; SHA1_CTX_SIZE],
+}
+
+impl Sha1 {
+	/// Create a new hasher in its initial state
+	pub fn new() -> Self {
+		debug_assert!(unsafe { sha1_ctx_size() } as usize <= SHA1_CTX_SIZE);
+		let mut ctx = [0u8; SHA1_CTX_SIZE];
+		unsafe {
+			SHA1_Init(&mut ctx as *mut u8);
+		}
+		Self { ctx }
+	}
+
+	/// Absorb the next chunk of input
+	pub fn update(&mut self, data: &[u8]) {
+		unsafe {
+			SHA1_Update(&mut self.ctx as *mut u8, data.as_ptr(), data.len());
+		}
+	}
+
+	/// Complete the hash and return the digest. The hasher must not be
+	/// used again afterwards.
+	pub fn finalize(&mut self) -> [u8; SHA1_SIZE] {
+		let mut hash = [0u8; SHA1_SIZE];
+		unsafe {
+			SHA1_Final(&mut self.ctx as *mut u8, hash.as_mut_ptr());
+		}
+		hash
+	}
+
+	/// One-shot hash of two discontiguous slices
+	pub fn hash_two(data1: &[u8], data2: &[u8]) -> [u8; SHA1_SIZE] {
+		let mut hash = [0u8; SHA1_SIZE];
+		unsafe {
+			SHA1_2(
+				data1.as_ptr(),
+				data1.len(),
+				data2.as_ptr(),
+				data2.len(),
+				hash.as_mut_ptr(),
+			);
+		}
+		hash
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::{Sha1, SHA1_SIZE};
+	use ffi::SHA1;
+
+	#[test]
+	fn test_sha1_streaming() {
+		// known vector: sha1("abc")
+		let expected: [u8; SHA1_SIZE] = [
+			0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e, 0x25, 0x71, 0x78,
+			0x50, 0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d,
+		];
+		let mut hasher = Sha1::new();
+		hasher.update(b"a");
+		hasher.update(b"bc");
+		assert_eq!(hasher.finalize(), expected);
+		assert_eq!(Sha1::hash_two(b"ab", b"c"), expected);
+
+		// chunked updates across the 64 byte block boundary match the
+		// one-shot entry point
+		let data = [7u8; 150];
+		let mut expected = [0u8; SHA1_SIZE];
+		unsafe {
+			SHA1(data.as_ptr(), data.len(), expected.as_mut_ptr());
+		}
+		let mut hasher = Sha1::new();
+		hasher.update(&data[0..63]);
+		hasher.update(&data[63..64]);
+		hasher.update(&data[64..150]);
+		assert_eq!(hasher.finalize(), expected);
+		assert_eq!(Sha1::hash_two(&data[0..100], &data[100..150]), expected);
+	}
+}
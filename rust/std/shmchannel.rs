@@ -0,0 +1,289 @@
+use core::marker::{Copy, PhantomData};
+use core::mem::{size_of, MaybeUninit};
+use ffi::{
+	shmchannel_attach, shmchannel_create, shmchannel_destroy, shmchannel_handle_size,
+	shmchannel_pending, shmchannel_recv, shmchannel_send, shmchannel_try_recv,
+};
+use prelude::*;
+
+// shmchannel.c error for a ring with no free slot
+const ERROR_SHM_FULL: i32 = -3;
+
+/// Cross-process channel over a named shared-memory ring (see
+/// c/shmchannel.c). One process creates the segment with shm_channel,
+/// any other attaches to the same name with shm_channel_attach; both
+/// sides get the Sender/Receiver API of std::channel. Values are
+/// copied byte-for-byte into the segment, so T must be Copy and must
+/// not contain pointers, handles or anything else that only means
+/// something in the sending address space.
+struct ShmChannelInner<T: Copy> {
+	handle: [u8; 128],
+	_marker: PhantomData<T>,
+}
+
+pub struct ShmSender<T: Copy> {
+	inner: Rc<ShmChannelInner<T>>,
+}
+
+pub struct ShmReceiver<T: Copy> {
+	inner: Rc<ShmChannelInner<T>>,
+}
+
+// shmchannel.c wants a nul-terminated name it can keep a copy of
+fn name_bytes(name: &str) -> Result<[u8; 64], Error> {
+	let bytes = name.as_bytes();
+	if bytes.len() >= 64 {
+		return Err(err!(IllegalArgument));
+	}
+	let mut buf = [0u8; 64];
+	let mut i = 0;
+	while i < bytes.len() {
+		buf[i] = bytes[i];
+		i += 1;
+	}
+	Ok(buf)
+}
+
+fn shm_channel_impl<T: Copy>(
+	name: &str,
+	slots: usize,
+	create: bool,
+) -> Result<(ShmSender<T>, ShmReceiver<T>), Error> {
+	if unsafe { shmchannel_handle_size() } > 128 {
+		exit!("shmchannel_handle_size() > 128");
+	}
+	let nb = match name_bytes(name) {
+		Ok(nb) => nb,
+		Err(e) => return Err(e),
+	};
+	let handle = [0u8; 128];
+	let send_inner = match Rc::new(ShmChannelInner {
+		handle,
+		_marker: PhantomData,
+	}) {
+		Ok(inner) => inner,
+		Err(e) => return Err(e),
+	};
+
+	// SAFETY: rc.clone does not fail
+	let mut recv_inner = send_inner.clone().unwrap();
+
+	let ret = if create {
+		unsafe {
+			shmchannel_create(
+				&mut recv_inner.handle as *mut u8,
+				nb.as_ptr(),
+				size_of::<T>() as u64,
+				slots as u64,
+			)
+		}
+	} else {
+		unsafe { shmchannel_attach(&mut recv_inner.handle as *mut u8, nb.as_ptr()) }
+	};
+	if ret < 0 {
+		Err(err!(ChannelInit))
+	} else {
+		Ok((ShmSender { inner: send_inner }, ShmReceiver { inner: recv_inner }))
+	}
+}
+
+/// Create the named segment sized for `slots` in-flight messages
+/// (rounded up to a power of two) and return both halves. The creator
+/// owns the name: a stale segment from a crashed run is replaced, and
+/// the name is unlinked again when the creating pair drops.
+pub fn shm_channel<T: Copy>(
+	name: &str,
+	slots: usize,
+) -> Result<(ShmSender<T>, ShmReceiver<T>), Error> {
+	shm_channel_impl(name, slots, true)
+}
+
+/// Attach to a segment another process created. Fails until the
+/// creator has finished shm_channel, so start order matters; the
+/// caller coordinates it (ours retry on ChannelInit).
+pub fn shm_channel_attach<T: Copy>(name: &str) -> Result<(ShmSender<T>, ShmReceiver<T>), Error> {
+	shm_channel_impl(name, 0, false)
+}
+
+impl<T: Copy> Drop for ShmChannelInner<T> {
+	fn drop(&mut self) {
+		// T is Copy so undelivered values need no draining; the
+		// mapping just goes away (and the owner unlinks the name)
+		let handle = &self.handle;
+		unsafe {
+			shmchannel_destroy(handle as *const u8);
+		}
+	}
+}
+
+impl<T: Copy> ShmChannelInner<T> {
+	pub fn send(&self, value: T) -> Result<(), Error> {
+		let handle = &self.handle;
+		let ret = unsafe {
+			shmchannel_send(
+				handle as *const u8,
+				&value as *const T as *const u8,
+				size_of::<T>() as u64,
+			)
+		};
+		if ret == ERROR_SHM_FULL {
+			Err(err!(CapacityExceeded))
+		} else if ret < 0 {
+			Err(err!(ChannelSend))
+		} else {
+			Ok(())
+		}
+	}
+
+	pub fn recv(&self) -> T {
+		let handle = &self.handle;
+		// SAFETY: blocking recv only returns once a slot was copied out
+		unsafe {
+			let mut v: MaybeUninit<T> = MaybeUninit::uninit();
+			shmchannel_recv(
+				handle as *const u8,
+				v.as_mut_ptr() as *mut u8,
+				size_of::<T>() as u64,
+			);
+			v.assume_init()
+		}
+	}
+
+	pub fn try_recv(&self) -> Option<T> {
+		let handle = &self.handle;
+		unsafe {
+			let mut v: MaybeUninit<T> = MaybeUninit::uninit();
+			if shmchannel_try_recv(
+				handle as *const u8,
+				v.as_mut_ptr() as *mut u8,
+				size_of::<T>() as u64,
+			) < 0
+			{
+				None
+			} else {
+				Some(v.assume_init())
+			}
+		}
+	}
+
+	pub fn pending(&self) -> bool {
+		unsafe { shmchannel_pending(&self.handle as *const u8) }
+	}
+}
+
+impl<T: Copy> Clone for ShmSender<T> {
+	fn clone(&self) -> Result<Self, Error> {
+		// SAFETY: clone always succeeds on rc
+		Ok(Self {
+			inner: self.inner.clone().unwrap(),
+		})
+	}
+}
+
+impl<T: Copy> Clone for ShmReceiver<T> {
+	fn clone(&self) -> Result<Self, Error> {
+		// SAFETY: clone always succeeds on rc
+		Ok(Self {
+			inner: self.inner.clone().unwrap(),
+		})
+	}
+}
+
+impl<T: Copy> ShmSender<T> {
+	/// Non-blocking send: a full ring fails with CapacityExceeded
+	/// (shedding `value`) instead of stalling the producer behind a
+	/// slow consumer process.
+	pub fn send(&self, value: T) -> Result<(), Error> {
+		self.inner.send(value)
+	}
+}
+
+impl<T: Copy> ShmReceiver<T> {
+	pub fn recv(&self) -> T {
+		self.inner.recv()
+	}
+
+	pub fn try_recv(&self) -> Option<T> {
+		self.inner.try_recv()
+	}
+
+	pub fn pending(&self) -> bool {
+		self.inner.pending()
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use ffi::getalloccount;
+
+	#[test]
+	fn test_shm_channel() {
+		let initial = unsafe { getalloccount() };
+		{
+			let (sender, receiver) = shm_channel("/fam_test_shm1", 4).unwrap();
+			// a second handle on the same name stands in for the
+			// other process; it maps the same ring
+			let (sender2, receiver2) = shm_channel_attach::<u64>("/fam_test_shm1").unwrap();
+
+			sender.send(101u64).unwrap();
+			assert_eq!(receiver2.recv(), 101);
+			sender2.send(202).unwrap();
+			assert!(receiver.pending());
+			assert_eq!(receiver.recv(), 202);
+			assert!(receiver.try_recv().is_none());
+
+			// ring holds 4: the fifth is shed, not queued
+			for i in 0..4 {
+				sender.send(i).unwrap();
+			}
+			match sender.send(4) {
+				Ok(_) => panic!("expected CapacityExceeded"),
+				Err(e) => assert!(e.kind == ErrorKind::CapacityExceeded),
+			}
+			for i in 0..4 {
+				assert_eq!(receiver2.recv(), i);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_shm_channel_threads() {
+		let initial = unsafe { getalloccount() };
+		{
+			let (sender, _r) = shm_channel("/fam_test_shm2", 64).unwrap();
+			let (_s, receiver) = shm_channel_attach::<u64>("/fam_test_shm2").unwrap();
+			let (done_send, done_recv) = channel().unwrap();
+			let mut jh = spawnj(move || {
+				let mut sum = 0u64;
+				for _ in 0..100 {
+					sum += receiver.recv();
+				}
+				done_send.send(sum).unwrap();
+			})
+			.unwrap();
+
+			let mut expect = 0u64;
+			for i in 0..100u64 {
+				expect += i;
+				// the parked consumer keeps the ring nearly empty;
+				// retry the rare full window
+				loop {
+					match sender.send(i) {
+						Ok(_) => break,
+						Err(_e) => unsafe {
+							crate::ffi::sleep_millis(1);
+						},
+					}
+				}
+			}
+			assert_eq!(done_recv.recv(), expect);
+			assert!(jh.join().is_ok());
+
+			// attach to a name nobody created fails cleanly
+			assert!(shm_channel_attach::<u64>("/fam_test_shm_none").is_err());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+}
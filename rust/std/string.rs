@@ -1,14 +1,44 @@
 extern crate core;
+use core::cell::UnsafeCell;
 use core::cmp::PartialEq;
 use core::fmt::Debug;
-use core::ptr::copy_nonoverlapping;
+use core::ptr::{copy_nonoverlapping, drop_in_place, null_mut};
 use core::slice::from_raw_parts;
 use core::str::from_utf8_unchecked;
 use prelude::*;
 use std::util::strcmp;
 
+// Process-wide intern table for strings that recur constantly (header
+// values, protocol names). Interning returns a clone of one shared
+// Rc-backed String per distinct value, so repeated construction costs a
+// table probe instead of an allocation and equal interned strings share
+// one buffer. Entries live until intern_clear.
+const INTERN_BUCKETS: usize = 128;
+
+struct InternNode {
+	hash: u32,
+	string: String,
+	next: *mut InternNode,
+}
+
+static mut INTERN_LOCK: Lock = Lock {
+	state: UnsafeCell::new(0),
+};
+static mut INTERN_TABLE: [*mut InternNode; INTERN_BUCKETS] = [null_mut(); INTERN_BUCKETS];
+
+// strings up to this many bytes are stored inline in the struct (small
+// string optimization) instead of behind an Rc allocation; header
+// names, json keys and tickers almost all fit
+const SSO_MAX: usize = 23;
+
+enum StringValue {
+	Heap(Rc<Box<[u8]>>),
+	Inline([u8; SSO_MAX]),
+	Empty,
+}
+
 pub struct String {
-	value: Option<Rc<Box<[u8]>>>,
+	value: StringValue,
 	end: usize,
 	start: usize,
 }
@@ -27,6 +57,19 @@ impl Debug for String {
 
 impl PartialEq for String {
 	fn eq(&self, other: &String) -> bool {
+		// interned strings share one buffer, so identical slices of the
+		// same allocation are equal without touching the bytes
+		match (&self.value, &other.value) {
+			(StringValue::Heap(a), StringValue::Heap(b)) => {
+				if a.get().as_ptr().raw() as *const u8 == b.get().as_ptr().raw() as *const u8
+					&& self.start == other.start
+					&& self.end == other.end
+				{
+					return true;
+				}
+			}
+			_ => {}
+		}
 		strcmp(self.to_str(), other.to_str()) == 0
 	}
 }
@@ -34,18 +77,43 @@ impl PartialEq for String {
 impl Clone for String {
 	fn clone(&self) -> Result<Self, Error> {
 		match &self.value {
-			Some(value) => Ok(Self {
-				value: Some(value.clone().unwrap()),
+			// SAFETY: rc.clone does not fail
+			StringValue::Heap(value) => Ok(Self {
+				value: StringValue::Heap(value.clone().unwrap()),
+				start: self.start,
+				end: self.end,
+			}),
+			StringValue::Inline(buf) => Ok(Self {
+				value: StringValue::Inline(*buf),
 				start: self.start,
 				end: self.end,
 			}),
-			None => Ok(Self::empty()),
+			StringValue::Empty => Ok(Self::empty()),
 		}
 	}
 }
 
 impl String {
 	pub fn new(s: &str) -> Result<Self, Error> {
+		let end = s.len();
+		if end <= SSO_MAX {
+			let mut buf = [0u8; SSO_MAX];
+			unsafe {
+				copy_nonoverlapping(s.as_ptr(), buf.as_mut_ptr(), end);
+			}
+			return Ok(Self {
+				value: StringValue::Inline(buf),
+				start: 0,
+				end,
+			});
+		}
+		Self::new_heap(s)
+	}
+
+	// always heap-allocate, bypassing the inline representation. Used by
+	// intern so equal interned values share one buffer (and pointer-
+	// compare in eq) regardless of length
+	fn new_heap(s: &str) -> Result<Self, Error> {
 		let end = s.len();
 		let start = 0;
 		match Box::new_zeroed_byte_slice(end) {
@@ -56,7 +124,7 @@ impl String {
 				}
 				match Rc::new(value) {
 					Ok(rc) => Ok(Self {
-						value: Some(rc),
+						value: StringValue::Heap(rc),
 						start,
 						end,
 					}),
@@ -67,9 +135,65 @@ impl String {
 		}
 	}
 
+	// return the shared instance for s, allocating it on first sight.
+	// Clones of one interned value share a buffer, so equality starts
+	// with a pointer compare in eq before falling back to strcmp.
+	#[allow(static_mut_refs)]
+	pub fn intern(s: &str) -> Result<Self, Error> {
+		let hash = murmur3_32_of_slice(s.as_bytes(), get_murmur_seed());
+		let bucket = rem_usize(hash as usize, INTERN_BUCKETS);
+		let _l = unsafe { INTERN_LOCK.write() };
+		let mut cur = unsafe { INTERN_TABLE[bucket] };
+		while !cur.is_null() {
+			let node = unsafe { &*cur };
+			if node.hash == hash && strcmp(node.string.to_str(), s) == 0 {
+				return node.string.clone();
+			}
+			cur = node.next;
+		}
+		let string = match String::new_heap(s) {
+			Ok(string) => string,
+			Err(e) => return Err(e),
+		};
+		let ret = string.clone();
+		let node = match Ptr::alloc(InternNode {
+			hash,
+			string,
+			next: unsafe { INTERN_TABLE[bucket] },
+		}) {
+			Ok(node) => node,
+			Err(e) => return Err(e),
+		};
+		unsafe {
+			INTERN_TABLE[bucket] = node.raw();
+		}
+		ret
+	}
+
+	// drop every interned string. Intended for process shutdown (and
+	// tests, which assert the allocation count balances)
+	#[allow(static_mut_refs)]
+	pub fn intern_clear() {
+		let _l = unsafe { INTERN_LOCK.write() };
+		for i in 0..INTERN_BUCKETS {
+			let mut cur = unsafe { INTERN_TABLE[i] };
+			while !cur.is_null() {
+				let next = unsafe { (*cur).next };
+				unsafe {
+					drop_in_place(cur);
+				}
+				Ptr::new(cur).release_slab();
+				cur = next;
+			}
+			unsafe {
+				INTERN_TABLE[i] = null_mut();
+			}
+		}
+	}
+
 	pub fn empty() -> Self {
 		Self {
-			value: None,
+			value: StringValue::Empty,
 			start: 0,
 			end: 0,
 		}
@@ -77,12 +201,16 @@ impl String {
 
 	pub fn to_str(&self) -> &str {
 		match &self.value {
-			Some(value) => {
+			StringValue::Heap(value) => {
 				let ptr = value.get().as_ptr().raw() as *const u8;
 				let ptr = unsafe { ptr.add(self.start) };
 				unsafe { from_utf8_unchecked(from_raw_parts(ptr, self.end - self.start)) }
 			}
-			None => "",
+			StringValue::Inline(buf) => unsafe {
+				let ptr = buf.as_ptr().add(self.start);
+				from_utf8_unchecked(from_raw_parts(ptr, self.end - self.start))
+			},
+			StringValue::Empty => "",
 		}
 	}
 
@@ -90,13 +218,20 @@ impl String {
 		if start > end || end - start > self.len() {
 			Err(err!(OutOfBounds))
 		} else {
-			match self.value.clone() {
-				Ok(value) => Ok(Self {
-					value,
+			match &self.value {
+				// SAFETY: rc.clone does not fail
+				StringValue::Heap(value) => Ok(Self {
+					value: StringValue::Heap(value.clone().unwrap()),
 					start: start + self.start,
 					end: self.start + end,
 				}),
-				Err(e) => Err(e),
+				// the inline buffer is copied; start/end select into it
+				StringValue::Inline(buf) => Ok(Self {
+					value: StringValue::Inline(*buf),
+					start: start + self.start,
+					end: self.start + end,
+				}),
+				StringValue::Empty => Ok(Self::empty()),
 			}
 		}
 	}
@@ -114,11 +249,16 @@ impl String {
 			return Some(0);
 		}
 
+		// check the first byte before comparing the full needle so
+		// non-matching positions cost one load instead of a strcmp
+		let first = s.as_bytes()[0];
 		unsafe {
 			while len >= s_len {
-				let v = from_utf8_unchecked(from_raw_parts(x, s_len));
-				if strcmp(v, s) == 0 {
-					return Some(self.len() as usize - len);
+				if *x == first {
+					let v = from_utf8_unchecked(from_raw_parts(x, s_len));
+					if strcmp(v, s) == 0 {
+						return Some(self.len() as usize - len);
+					}
 				}
 				len -= 1;
 				x = x.wrapping_add(1);
@@ -209,4 +349,53 @@ mod test {
 
 		assert_eq!(initial, unsafe { getalloccount() });
 	}
+
+	#[test]
+	fn test_sso() {
+		let initial = unsafe { getalloccount() };
+		{
+			// short strings live inline in the struct: no allocation
+			let a = String::new("content-length").unwrap();
+			assert_eq!(initial, unsafe { getalloccount() });
+			assert_eq!(a.len(), 14);
+			assert_eq!(a.to_str(), "content-length");
+			assert_eq!(a.find("length"), Some(8));
+			assert_eq!(a.rfind("ent"), Some(4));
+			let b = a.substring(0, 7).unwrap();
+			assert_eq!(b.to_str(), "content");
+			let c = a.clone().unwrap();
+			assert!(c == a);
+			assert_eq!(initial, unsafe { getalloccount() });
+
+			// one byte past the inline limit heap-allocates
+			let d = String::new("abcdefghijklmnopqrstuvwx").unwrap();
+			assert_eq!(d.len(), 24);
+			assert!(unsafe { getalloccount() } > initial);
+			let e = d.substring(0, 23).unwrap();
+			assert!(e == String::new("abcdefghijklmnopqrstuvw").unwrap());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_intern() {
+		let initial = unsafe { getalloccount() };
+		{
+			let a = String::intern("websocket").unwrap();
+			let b = String::intern("websocket").unwrap();
+			let c = String::intern("permessage-deflate").unwrap();
+			assert_eq!(a, b);
+			assert_eq!(a.to_str(), "websocket");
+			assert!(!(a == c));
+			// both clones come from one shared buffer
+			assert!(a.to_str().as_ptr() == b.to_str().as_ptr());
+			assert!(a.to_str().as_ptr() != c.to_str().as_ptr());
+			// still equal to an uninterned copy of the same bytes
+			assert_eq!(a, String::new("websocket").unwrap());
+			// outstanding clones survive a clear
+			String::intern_clear();
+			assert_eq!(a.to_str(), "websocket");
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
 }
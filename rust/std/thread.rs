@@ -1,7 +1,8 @@
 use core::ops::FnOnce;
 use core::ptr;
 use ffi::{
-	release, thread_create, thread_create_joinable, thread_detach, thread_handle_size, thread_join,
+	release, thread_create, thread_create_joinable, thread_create_joinable_stacksize,
+	thread_create_stacksize, thread_detach, thread_handle_size, thread_join,
 };
 use prelude::*;
 
@@ -53,6 +54,11 @@ where
 		ret
 	};
 	closure();
+	// hand any slab chunks this thread cached back to the allocator;
+	// the thread-local lists die with the thread
+	unsafe {
+		crate::ffi::slab_flush();
+	}
 }
 
 pub fn spawn<F>(f: F) -> Result<(), Error>
@@ -71,6 +77,34 @@ where
 	}
 }
 
+/// Detached spawn with an explicit stack size in bytes. The pthread
+/// default (8MB on most systems) is wasted address space for small
+/// workers; a burst workload spawning thousands of them should size
+/// the stack to what the closure actually needs. Requests below the
+/// platform minimum are rounded up by the C side.
+pub fn spawn_stack<F>(f: F, stack_size: usize) -> Result<(), Error>
+where
+	F: FnOnce(),
+{
+	match Box::new(f) {
+		Ok(mut b) => {
+			if unsafe {
+				thread_create_stacksize(
+					start_thread::<F>,
+					b.as_ptr().raw() as *mut u8,
+					stack_size as u64,
+				)
+			} != 0
+			{
+				return Err(err!(ThreadCreate));
+			}
+			b.leak();
+			Ok(())
+		}
+		Err(e) => Err(e),
+	}
+}
+
 pub fn spawnj<F>(f: F) -> Result<JoinHandle, Error>
 where
 	F: FnOnce(),
@@ -103,6 +137,167 @@ where
 	}
 }
 
+/// Joinable spawn with an explicit stack size in bytes (see
+/// spawn_stack).
+pub fn spawnj_stack<F>(f: F, stack_size: usize) -> Result<JoinHandle, Error>
+where
+	F: FnOnce(),
+{
+	if unsafe { thread_handle_size() } > 8 {
+		exit!("thread_handle_size() > 8 ({})", unsafe {
+			thread_handle_size()
+		});
+	}
+	let jh = JoinHandle {
+		handle: [0u8; 8],
+		need_detach: true,
+	};
+	match Box::new(f) {
+		Ok(mut b) => {
+			if unsafe {
+				thread_create_joinable_stacksize(
+					&jh.handle as *const u8,
+					start_thread::<F>,
+					b.as_ptr().raw() as *mut u8,
+					stack_size as u64,
+				)
+			} != 0
+			{
+				return Err(err!(ThreadCreate));
+			}
+			b.leak();
+			Ok(jh)
+		}
+		Err(e) => Err(e),
+	}
+}
+
+enum PoolMessage {
+	Task(Box<dyn FnMut()>),
+	Halt,
+}
+
+struct PoolState {
+	recv: Receiver<PoolMessage>,
+	// workers parked in recv; execute only spawns when it hits zero
+	idle: u64,
+}
+
+pub struct ThreadPoolConfig {
+	pub max_threads: usize,
+	pub stack_size: usize,
+}
+
+impl Default for ThreadPoolConfig {
+	fn default() -> Self {
+		Self {
+			max_threads: 8,
+			stack_size: 256 * 1024,
+		}
+	}
+}
+
+/// Cached thread pool for the spawn-per-task pattern. Unlike the
+/// structured Runtime there are no result handles, priorities or work
+/// stealing: execute queues a fire-and-forget closure and a parked
+/// worker picks it up, so a burst of short-lived helpers reuses warm
+/// threads instead of paying thread creation per task. Workers are
+/// spawned on demand up to max_threads, each with the configured
+/// (small) stack, and live until stop.
+pub struct ThreadPool {
+	config: ThreadPoolConfig,
+	send: Sender<PoolMessage>,
+	state: Rc<PoolState>,
+	jhs: Vec<JoinHandle>,
+	halt: bool,
+}
+
+impl Drop for ThreadPool {
+	fn drop(&mut self) {
+		let _ = self.stop();
+	}
+}
+
+impl ThreadPool {
+	pub fn new(config: ThreadPoolConfig) -> Result<Self, Error> {
+		let (send, recv) = match channel() {
+			Ok((send, recv)) => (send, recv),
+			Err(e) => return Err(e),
+		};
+		let state = match Rc::new(PoolState { recv, idle: 0 }) {
+			Ok(state) => state,
+			Err(e) => return Err(e),
+		};
+		Ok(Self {
+			config,
+			send,
+			state,
+			jhs: Vec::new(),
+			halt: false,
+		})
+	}
+
+	pub fn execute<F>(&mut self, f: F) -> Result<(), Error>
+	where
+		F: FnMut() + 'static,
+	{
+		if self.halt {
+			return Err(err!(NotInitialized));
+		}
+		let task: Box<dyn FnMut()> = match Box::new(f) {
+			Ok(b) => b,
+			Err(e) => return Err(e),
+		};
+		// grow before queueing so a burst does not sit behind zero
+		// workers; at the cap the task just waits for a warm thread
+		if aload!(&self.state.idle) == 0 && self.jhs.len() < self.config.max_threads {
+			match self.grow() {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			}
+		}
+		self.send.send(PoolMessage::Task(task))
+	}
+
+	fn grow(&mut self) -> Result<(), Error> {
+		// SAFETY: clone does not fail for rc
+		let mut state = self.state.clone().unwrap();
+		let jh = match spawnj_stack(
+			move || loop {
+				aadd!(&mut state.idle, 1);
+				let msg = state.recv.recv();
+				asub!(&mut state.idle, 1);
+				match msg {
+					PoolMessage::Task(mut t) => t(),
+					PoolMessage::Halt => break,
+				}
+			},
+			self.config.stack_size,
+		) {
+			Ok(jh) => jh,
+			Err(e) => return Err(e),
+		};
+		self.jhs.push(jh)
+	}
+
+	pub fn stop(&mut self) -> Result<(), Error> {
+		if self.halt {
+			return Err(err!(NotInitialized));
+		}
+		self.halt = true;
+		for _i in 0..self.jhs.len() {
+			match self.send.send(PoolMessage::Halt) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			}
+		}
+		for i in 0..self.jhs.len() {
+			let _ = self.jhs[i].join();
+		}
+		Ok(())
+	}
+}
+
 #[cfg(test)]
 mod test {
 	use super::*;
@@ -168,6 +363,84 @@ mod test {
 		assert_eq!(initial, unsafe { getalloccount() });
 	}
 
+	#[test]
+	fn test_spawn_stack() {
+		let initial = unsafe { getalloccount() };
+		{
+			let lock = lock_box!().unwrap();
+			let lock_clone = lock.clone().unwrap();
+			let rc = Rc::new(0u32).unwrap();
+			let mut rc_clone = rc.clone().unwrap();
+			// 64k is plenty for this closure and far below the
+			// platform default
+			spawn_stack(
+				move || {
+					let _v = lock_clone.write();
+					*rc_clone = 1;
+				},
+				64 * 1024,
+			)
+			.unwrap();
+
+			loop {
+				{
+					let _v = lock.read();
+					if *rc == 1 {
+						break;
+					}
+				}
+				unsafe {
+					sleep_millis(1);
+				}
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_thread_pool() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut pool = ThreadPool::new(ThreadPoolConfig {
+				max_threads: 2,
+				..ThreadPoolConfig::default()
+			})
+			.unwrap();
+			let lock = lock_box!().unwrap();
+			let lock_clone = lock.clone().unwrap();
+			let rc = Rc::new(0u32).unwrap();
+
+			// more tasks than threads: the two cached workers take
+			// turns instead of ten spawns
+			for _i in 0..10 {
+				let lock = lock.clone().unwrap();
+				let mut rc = rc.clone().unwrap();
+				pool.execute(move || {
+					let _v = lock.write();
+					*rc += 1;
+				})
+				.unwrap();
+			}
+
+			loop {
+				{
+					let _v = lock_clone.read();
+					if *rc == 10 {
+						break;
+					}
+				}
+				unsafe {
+					sleep_millis(1);
+				}
+			}
+
+			pool.stop().unwrap();
+			// a stopped pool refuses work
+			assert!(pool.execute(|| {}).is_err());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
 	#[test]
 	fn test_thread_join() {
 		let initial = unsafe { getalloccount() };
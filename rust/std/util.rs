@@ -314,6 +314,272 @@ pub fn get_murmur_seed() -> u32 {
 	}
 }
 
+// below this length a partition is finished with insertion sort, which
+// beats partitioning on slices that fit in a couple of cache lines
+const SORT_INSERTION_MAX: usize = 20;
+
+fn insertion_sort<T: Ord>(s: &mut [T]) {
+	for i in 1..s.len() {
+		let mut j = i;
+		while j > 0 && s[j].compare(&s[j - 1]) < 0 {
+			s.swap(j, j - 1);
+			j -= 1;
+		}
+	}
+}
+
+fn sift_down<T: Ord>(s: &mut [T], mut root: usize, end: usize) {
+	loop {
+		let mut child = 2 * root + 1;
+		if child >= end {
+			break;
+		}
+		if child + 1 < end && s[child].compare(&s[child + 1]) < 0 {
+			child += 1;
+		}
+		if s[child].compare(&s[root]) <= 0 {
+			break;
+		}
+		s.swap(root, child);
+		root = child;
+	}
+}
+
+// guaranteed O(n log n) fallback once the quicksort depth budget runs
+// out; in place and allocation free like the rest of the kernel
+fn heapsort<T: Ord>(s: &mut [T]) {
+	let n = s.len();
+	for start in (0..n / 2).rev() {
+		sift_down(s, start, n);
+	}
+	for end in (1..n).rev() {
+		s.swap(0, end);
+		sift_down(s, 0, end);
+	}
+}
+
+fn sort3<T: Ord>(s: &mut [T], a: usize, b: usize, c: usize) {
+	if s[b].compare(&s[a]) < 0 {
+		s.swap(a, b);
+	}
+	if s[c].compare(&s[b]) < 0 {
+		s.swap(b, c);
+		if s[b].compare(&s[a]) < 0 {
+			s.swap(a, b);
+		}
+	}
+}
+
+// move a pivot into s[0]: median of three for most slices, a
+// pseudomedian of nine for large ones so a skewed distribution still
+// yields balanced partitions
+fn select_pivot<T: Ord>(s: &mut [T]) {
+	let len = s.len();
+	let mid = len / 2;
+	if len >= 128 {
+		sort3(s, 0, mid, len - 1);
+		sort3(s, 1, mid - 1, len - 2);
+		sort3(s, 2, mid + 1, len - 3);
+		sort3(s, mid - 1, mid, mid + 1);
+	} else {
+		sort3(s, 0, mid, len - 1);
+	}
+	s.swap(0, mid);
+}
+
+// Hoare partition around the pivot in s[0]; returns the pivot's final
+// position, with [0..p) strictly less and (p..len) greater or equal
+fn partition<T: Ord>(s: &mut [T]) -> usize {
+	let mut l = 1;
+	let mut r = s.len();
+	loop {
+		while l < r && s[l].compare(&s[0]) < 0 {
+			l += 1;
+		}
+		while l < r && s[r - 1].compare(&s[0]) >= 0 {
+			r -= 1;
+		}
+		if l >= r {
+			break;
+		}
+		s.swap(l, r - 1);
+		l += 1;
+		r -= 1;
+	}
+	s.swap(0, l - 1);
+	l - 1
+}
+
+fn sort_rec<T: Ord>(s: &mut [T], mut depth: usize) {
+	let mut s = s;
+	loop {
+		let len = s.len();
+		if len <= SORT_INSERTION_MAX {
+			insertion_sort(s);
+			return;
+		}
+		if depth == 0 {
+			heapsort(s);
+			return;
+		}
+		depth -= 1;
+		select_pivot(s);
+		let p = partition(s);
+		// skip the run of keys equal to the pivot: with few distinct
+		// keys (subscriber ids cluster hard) whole partitions collapse
+		// here instead of degrading the recursion to quadratic
+		let mut q = p + 1;
+		while q < len && s[p].compare(&s[q]) >= 0 {
+			q += 1;
+		}
+		// recurse into the smaller side, loop on the larger, so the
+		// stack stays logarithmic even before the heapsort backstop
+		let (left, rest) = s.split_at_mut(p);
+		let right = &mut rest[q - p..];
+		if left.len() < right.len() {
+			sort_rec(left, depth);
+			s = right;
+		} else {
+			sort_rec(right, depth);
+			s = left;
+		}
+	}
+}
+
+/// In-place unstable sort in the pdqsort family: median-of-three (or
+/// pseudomedian of nine) quicksort with insertion sort leaves, an
+/// equal-key fast path and a heapsort backstop at twice the log2 depth,
+/// so the worst case stays O(n log n) with no allocation. Usable on a
+/// `Vec<T>` via `as_mut_slice`.
+pub fn sort_unstable<T: Ord>(s: &mut [T]) {
+	let mut depth = 0;
+	let mut n = s.len();
+	while n > 0 {
+		depth += 1;
+		n >>= 1;
+	}
+	sort_rec(s, depth * 2);
+}
+
+/// Binary search over a sorted slice (by the same [`Ord`] the sort
+/// and the `RbTree` use). Returns Ok(index) of a matching
+/// element (any one of them under duplicates) or Err(insertion point)
+/// that keeps the slice sorted, as the std slice API does.
+pub fn binary_search<T: Ord>(s: &[T], key: &T) -> Result<usize, usize> {
+	let mut lo = 0;
+	let mut hi = s.len();
+	while lo < hi {
+		let mid = lo + (hi - lo) / 2;
+		let c = s[mid].compare(key);
+		if c < 0 {
+			lo = mid + 1;
+		} else if c > 0 {
+			hi = mid;
+		} else {
+			return Ok(mid);
+		}
+	}
+	Err(lo)
+}
+
+// two-digit lookup table for the fast decimal formatters below: each
+// probe emits two digits at once, halving the divide chain that the
+// digit-at-a-time converters above walk
+const DIGIT_PAIRS: &[u8; 200] = b"0001020304050607080910111213141516171819\
+2021222324252627282930313233343536373839\
+4041424344454647484950515253545556575859\
+6061626364656667686970717273747576777879\
+8081828384858687888990919293949596979899";
+
+// digits of n written right-aligned into buf; returns the index of the
+// first digit (20 digits cover u64::MAX)
+fn u64_digits(mut n: u64, buf: &mut [u8; 20]) -> usize {
+	let mut i = 20;
+	while n >= 100 {
+		let pair = ((n % 100) as usize) * 2;
+		n /= 100;
+		i -= 2;
+		buf[i] = DIGIT_PAIRS[pair];
+		buf[i + 1] = DIGIT_PAIRS[pair + 1];
+	}
+	if n >= 10 {
+		let pair = (n as usize) * 2;
+		i -= 2;
+		buf[i] = DIGIT_PAIRS[pair];
+		buf[i + 1] = DIGIT_PAIRS[pair + 1];
+	} else {
+		i -= 1;
+		buf[i] = b'0' + n as u8;
+	}
+	i
+}
+
+/// Append the decimal digits of `n` to `out`. Pair-table conversion
+/// straight into the vector with no intermediate `String` or
+/// `Formatter`; meant for hot paths that build many numeric fields per
+/// message.
+pub fn append_u64(out: &mut Vec<u8>, n: u64) -> Result<(), Error> {
+	let mut buf = [0u8; 20];
+	let i = u64_digits(n, &mut buf);
+	out.append_ptr(buf[i..20].as_ptr(), 20 - i)
+}
+
+/// Signed form of [`append_u64`]; a leading `-` then the magnitude
+/// (i64::MIN included).
+pub fn append_i64(out: &mut Vec<u8>, n: i64) -> Result<(), Error> {
+	if n < 0 {
+		match out.push(b'-') {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+		append_u64(out, (n as u64).wrapping_neg())
+	} else {
+		append_u64(out, n as u64)
+	}
+}
+
+/// Append `n` as a fixed-point decimal with `decimals` fractional
+/// digits, where `n` is the value pre-scaled by 10^decimals (so
+/// 123456 with 2 decimals prints `1234.56`, and -5 with 3 prints
+/// `-0.005`). `decimals` of zero is plain [`append_i64`]; more than
+/// the 19 digits a u64 magnitude can carry is refused.
+pub fn append_fixed(out: &mut Vec<u8>, n: i64, decimals: usize) -> Result<(), Error> {
+	if decimals == 0 {
+		return append_i64(out, n);
+	}
+	if decimals > 19 {
+		return Err(err!(IllegalArgument));
+	}
+	if n < 0 {
+		match out.push(b'-') {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+	}
+	let mag = if n < 0 {
+		(n as u64).wrapping_neg()
+	} else {
+		n as u64
+	};
+	let mut buf = [0u8; 20];
+	let mut i = u64_digits(mag, &mut buf);
+	// zero-pad to at least one integer digit ahead of the point
+	while 20 - i < decimals + 1 {
+		i -= 1;
+		buf[i] = b'0';
+	}
+	let split = 20 - decimals;
+	match out.append_ptr(buf[i..split].as_ptr(), split - i) {
+		Ok(_) => {}
+		Err(e) => return Err(e),
+	}
+	match out.push(b'.') {
+		Ok(_) => {}
+		Err(e) => return Err(e),
+	}
+	out.append_ptr(buf[split..20].as_ptr(), decimals)
+}
+
 #[cfg(test)]
 mod test {
 	use super::strcmp;
@@ -324,4 +590,131 @@ mod test {
 		assert_eq!(strcmp("abc", "def"), -1);
 		assert_eq!(strcmp("def", "abc"), 1);
 	}
+
+	#[test]
+	fn test_sort_unstable() {
+		use super::sort_unstable;
+		use prelude::*;
+
+		// deterministic lcg keyset, large enough to leave the insertion
+		// sort leaves and exercise partitioning and the dup fast path
+		let mut v: Vec<u64> = Vec::new();
+		let mut x = 0x243f6a8885a308d3u64;
+		for _ in 0..10_000 {
+			x = x
+				.wrapping_mul(6364136223846793005)
+				.wrapping_add(1442695040888963407);
+			// cluster the keys so duplicates occur
+			v.push(x % 1024).unwrap();
+		}
+		sort_unstable(v.as_mut_slice());
+		for i in 1..v.len() {
+			assert!(v[i - 1] <= v[i]);
+		}
+
+		// adversarial shapes: sorted, reversed, constant
+		let mut v: Vec<u64> = Vec::new();
+		for i in 0..1000u64 {
+			v.push(i).unwrap();
+		}
+		sort_unstable(v.as_mut_slice());
+		for i in 0..1000usize {
+			assert_eq!(v[i], i as u64);
+		}
+		let mut v: Vec<u64> = Vec::new();
+		for i in (0..1000u64).rev() {
+			v.push(i).unwrap();
+		}
+		sort_unstable(v.as_mut_slice());
+		for i in 0..1000usize {
+			assert_eq!(v[i], i as u64);
+		}
+		let mut v: Vec<u64> = Vec::new();
+		for _ in 0..1000u64 {
+			v.push(7).unwrap();
+		}
+		sort_unstable(v.as_mut_slice());
+		for i in 0..1000usize {
+			assert_eq!(v[i], 7);
+		}
+
+		// degenerate sizes
+		let mut v: Vec<u64> = Vec::new();
+		sort_unstable(v.as_mut_slice());
+		v.push(1).unwrap();
+		sort_unstable(v.as_mut_slice());
+		assert_eq!(v[0], 1);
+	}
+
+	#[test]
+	fn test_binary_search() {
+		use super::binary_search;
+		use prelude::*;
+
+		let mut v: Vec<u64> = Vec::new();
+		for i in 0..100u64 {
+			v.push(i * 2).unwrap();
+		}
+		for i in 0..100u64 {
+			assert!(binary_search(v.as_slice(), &(i * 2)) == Ok(i as usize));
+		}
+		// misses land on the insertion point that keeps the slice sorted
+		assert!(binary_search(v.as_slice(), &1) == Err(1));
+		assert!(binary_search(v.as_slice(), &199) == Err(100));
+		let empty: Vec<u64> = Vec::new();
+		assert!(binary_search(empty.as_slice(), &1) == Err(0));
+	}
+
+	#[test]
+	fn test_append_num() {
+		use super::{append_fixed, append_i64, append_u64};
+		use prelude::*;
+
+		let mut v: Vec<u8> = Vec::new();
+		append_u64(&mut v, 0).unwrap();
+		append_u64(&mut v, 7).unwrap();
+		append_u64(&mut v, 42).unwrap();
+		append_u64(&mut v, 1234567890).unwrap();
+		append_u64(&mut v, u64::MAX).unwrap();
+		assert_eq!(&v[0..v.len()], b"0742123456789018446744073709551615" as &[u8]);
+
+		let mut v: Vec<u8> = Vec::new();
+		append_i64(&mut v, -1).unwrap();
+		append_i64(&mut v, 100).unwrap();
+		append_i64(&mut v, i64::MIN).unwrap();
+		assert_eq!(&v[0..v.len()], b"-1100-9223372036854775808" as &[u8]);
+
+		// every u64_digits branch: the pair loop, the two-digit head
+		// and the one-digit head, against the digit-at-a-time converter
+		let mut x = 0x243f6a8885a308d3u64;
+		for _ in 0..1000 {
+			x = x
+				.wrapping_mul(6364136223846793005)
+				.wrapping_add(1442695040888963407);
+			let n = x >> (x % 64) as u32;
+			let mut v: Vec<u8> = Vec::new();
+			append_u64(&mut v, n).unwrap();
+			let mut buf = [0u8; 64];
+			let len = super::u128_to_str(n as u128, 0, &mut buf, 10);
+			assert_eq!(&v[0..v.len()], &buf[0..len]);
+		}
+
+		// fixed point: the scaled value prints with the point placed
+		// decimals in, zero-padded below one
+		let mut v: Vec<u8> = Vec::new();
+		append_fixed(&mut v, 123456, 2).unwrap();
+		v.push(b' ').unwrap();
+		append_fixed(&mut v, -5, 3).unwrap();
+		v.push(b' ').unwrap();
+		append_fixed(&mut v, 5, 1).unwrap();
+		v.push(b' ').unwrap();
+		append_fixed(&mut v, -123456, 2).unwrap();
+		v.push(b' ').unwrap();
+		append_fixed(&mut v, 42, 0).unwrap();
+		assert_eq!(&v[0..v.len()], b"1234.56 -0.005 0.5 -1234.56 42" as &[u8]);
+
+		// more fractional digits than a u64 magnitude carries
+		let mut v: Vec<u8> = Vec::new();
+		assert!(append_fixed(&mut v, 1, 20).unwrap_err().kind == ErrorKind::IllegalArgument);
+	}
 }
@@ -1,6 +1,6 @@
 use core::cmp::PartialEq;
 use core::iter::{IntoIterator, Iterator};
-use core::marker::PhantomData;
+use core::marker::{Copy, PhantomData};
 use core::mem::{needs_drop, replace, size_of, zeroed};
 use core::ops::{Drop, Index, IndexMut, Range};
 use core::option::Option as CoreOption;
@@ -10,26 +10,67 @@ use core::slice::{from_raw_parts, from_raw_parts_mut};
 use ffi::{alloc, release, resize};
 use prelude::*;
 
+// byte buffers (every rbuf, wbuf and frame build) are the dominant
+// instantiation, and their fast path is a property of this one Vec
+// rather than a separate type: every element-walking loop below sits
+// behind needs_drop::<T>(), a const intrinsic that folds to false for
+// plain bytes, so for Vec<u8> truncate, drain, clear and drop compile
+// to pointer/length updates and the bulk moves (shift, append_ptr,
+// extend_from_slice) are single memcpys. Pinned here so the guarantee
+// is stated in compilable form next to the loops that honor it
+const _: () = assert!(!needs_drop::<u8>());
+
+// backing storage comes from alloc/resize (malloc), whose 16 byte
+// alignment is what the vector kernels in c/util.c (unmask_bytes,
+// set_bytes) and the base64/aes paths get to assume for a buffer's base
 pub struct Vec<T> {
 	value: Ptr<u8>,
 	capacity: usize,
 	elements: usize,
 	min: usize,
+	// non-null once cow() has been called: shared refcount for the
+	// backing allocation. Clones bump it and share value; the first
+	// mutation of a shared instance copies the buffer (see make_unique)
+	refs: Ptr<u64>,
 	_marker: PhantomData<T>,
 }
 
 impl<T> Clone for Vec<T> {
 	fn clone(&self) -> Result<Self, Error> {
+		if !self.refs.is_null() {
+			// cow mode: share the backing allocation; whoever writes
+			// next pays for the copy
+			let mut refs = self.refs;
+			aadd!(&mut *refs, 1);
+			return Ok(Self {
+				value: self.value,
+				capacity: self.capacity,
+				elements: self.elements,
+				min: self.min,
+				refs,
+				_marker: PhantomData,
+			});
+		}
 		let value_ptr = unsafe { alloc(size_of::<T>() * self.capacity) };
 		if value_ptr.is_null() {
 			return Err(err!(Alloc));
 		}
+		if self.elements > 0 {
+			unsafe {
+				copy_nonoverlapping(
+					self.value.raw() as *const u8,
+					value_ptr as *mut u8,
+					size_of::<T>() * self.elements,
+				);
+			}
+		}
 		let value = Ptr::new(value_ptr);
 		Ok(Self {
 			value,
 			capacity: self.capacity,
 			elements: self.elements,
 			min: self.min,
+			refs: Ptr::null(),
 			_marker: PhantomData,
 		})
 	}
@@ -37,16 +78,17 @@ impl<T> Clone for Vec<T> {
 
 impl<T: PartialEq> PartialEq for Vec<T> {
 	fn eq(&self, other: &Vec<T>) -> bool {
+		// slice compare: core specializes byte-element slices down to a
+		// memcmp, so Vec<u8> equality is one bulk compare instead of a
+		// per-element loop. The length gate also keeps an empty vec's
+		// null buffer out of as_slice's from_raw_parts
 		if self.len() != other.len() {
-			false
-		} else {
-			for i in 0..self.len() {
-				if self[i] != other[i] {
-					return false;
-				}
-			}
-			true
+			return false;
+		}
+		if self.len() == 0 {
+			return true;
 		}
+		self.as_slice() == other.as_slice()
 	}
 }
 
@@ -77,7 +119,11 @@ impl<T> IntoIterator for Vec<T> {
 	type Item = T;
 	type IntoIter = VecIterator<T>;
 
-	fn into_iter(self) -> Self::IntoIter {
+	fn into_iter(mut self) -> Self::IntoIter {
+		// the iterator moves elements out of the buffer in place
+		if !self.make_unique() {
+			panic!("could not copy cow buffer!");
+		}
 		let ret = VecIterator {
 			vec: self,
 			index: 0,
@@ -122,6 +168,14 @@ impl<T> Drop for Vec<T> {
 		if self.value.get_bit() {
 			return;
 		}
+		if !self.refs.is_null() {
+			let mut refs = self.refs;
+			if asub!(&mut *refs, 1) != 1 {
+				// other cow owners remain; the last one frees
+				return;
+			}
+			refs.release_slab();
+		}
 		if needs_drop::<T>() {
 			for i in 0..self.elements {
 				unsafe {
@@ -162,6 +216,9 @@ impl<T> IndexMut<usize> for Vec<T> {
 		if index >= self.elements as usize {
 			panic!("array index out of bounds!");
 		}
+		if !self.make_unique() {
+			panic!("could not copy cow buffer!");
+		}
 
 		unsafe {
 			let target = self.value.raw() as *const T;
@@ -197,6 +254,9 @@ impl<T> IndexMut<Range<usize>> for Vec<T> {
 		if range.end > self.len() {
 			panic!("Index out of bounds");
 		}
+		if !self.make_unique() {
+			panic!("could not copy cow buffer!");
+		}
 
 		if self.len() == 0 {
 			&mut []
@@ -218,21 +278,127 @@ impl<T> Vec<T> {
 			capacity: 0,
 			elements: 0,
 			min: 16,
+			refs: Ptr::null(),
 			_marker: PhantomData,
 		}
 	}
 
+	// give this instance sole ownership of its buffer ahead of a write:
+	// a cow buffer shared with other owners is copied and this instance
+	// moves to a fresh refcount. On a unique or non-cow instance this is
+	// a null check
+	fn make_unique(&mut self) -> bool {
+		if self.refs.is_null() {
+			return true;
+		}
+		let mut refs = self.refs;
+		if aload!(&mut *refs) == 1 {
+			return true;
+		}
+		let nptr = if self.capacity == 0 {
+			null_mut()
+		} else {
+			let nptr = unsafe { alloc(size_of::<T>() * self.capacity) };
+			if nptr.is_null() {
+				return false;
+			}
+			unsafe {
+				copy_nonoverlapping(
+					self.value.raw() as *const u8,
+					nptr as *mut u8,
+					size_of::<T>() * self.capacity,
+				);
+			}
+			nptr
+		};
+		let nrefs = match Ptr::alloc(1u64) {
+			Ok(nrefs) => nrefs,
+			Err(_e) => {
+				if !nptr.is_null() {
+					unsafe {
+						release(nptr);
+					}
+				}
+				return false;
+			}
+		};
+		if asub!(&mut *refs, 1) == 1 {
+			// the other owners dropped while we copied: free what was
+			// the shared buffer
+			refs.release_slab();
+			let raw = self.value.raw();
+			if !raw.is_null() {
+				unsafe {
+					release(raw);
+				}
+			}
+		}
+		self.value = Ptr::new(nptr as *mut u8);
+		self.refs = nrefs;
+		true
+	}
+
+	// allocates exactly n elements up front, bypassing the
+	// power-of-two growth policy for known-size buffers
+	pub fn with_capacity(n: usize) -> Result<Self, Error> {
+		let mut v = Self::new();
+		match v.reserve(n) {
+			Ok(_) => Ok(v),
+			Err(e) => Err(e),
+		}
+	}
+
+	// grow capacity to at least n elements without changing the length.
+	// unlike push growth the requested capacity is not rounded up, so a
+	// following sequence of pushes up to n triggers no reallocation
+	pub fn reserve(&mut self, n: usize) -> Result<(), Error> {
+		if n <= self.capacity {
+			return Ok(());
+		}
+		if !self.make_unique() {
+			return Err(err!(Alloc));
+		}
+		let rptr = self.value.raw();
+		let nptr = if rptr.is_null() {
+			unsafe { alloc(n * size_of::<T>()) }
+		} else {
+			unsafe { resize(rptr as *mut u8, n * size_of::<T>()) }
+		};
+		if nptr.is_null() {
+			return Err(err!(Alloc));
+		}
+		let old_size = self.capacity * size_of::<T>();
+		let new_size = n * size_of::<T>();
+		unsafe {
+			write_bytes((nptr as *mut u8).add(old_size), 0, new_size - old_size);
+		}
+		self.capacity = n;
+		self.value = Ptr::new(nptr as *mut u8);
+		Ok(())
+	}
+
 	pub fn set_min(&mut self, n: usize) {
 		self.min = n;
 	}
 
+	// discard the first n elements and move the rest down. The dropped
+	// slots are not drop_in_place'd: callers either hold plain bytes or
+	// have already moved the front elements out by value
 	pub fn shift(&mut self, n: usize) -> Result<(), Error> {
 		if n > self.elements {
 			return Err(err!(OutOfBounds));
 		}
+		if !self.make_unique() {
+			return Err(err!(Alloc));
+		}
+		let size = size_of::<T>();
 		self.elements -= n;
 		unsafe {
-			copy(self.value.raw().add(n), self.value.raw(), self.elements);
+			copy(
+				self.value.raw().add(n * size) as *const T,
+				self.value.raw() as *mut T,
+				self.elements,
+			);
 		}
 		Ok(())
 	}
@@ -240,6 +406,9 @@ impl<T> Vec<T> {
 	pub fn push(&mut self, v: T) -> Result<(), Error> {
 		let size = size_of::<T>();
 
+		if !self.make_unique() {
+			return Err(err!(Alloc));
+		}
 		if self.elements + 1 > self.capacity {
 			if !self.resize_impl(self.elements + 1) {
 				return Err(err!(Alloc));
@@ -320,13 +489,113 @@ impl<T> Vec<T> {
 		self.elements
 	}
 
+	pub fn capacity(&self) -> usize {
+		self.capacity
+	}
+
 	pub fn clear(&mut self) {
+		if !self.make_unique() {
+			panic!("could not copy cow buffer!");
+		}
 		self.resize_impl(self.min);
 		self.elements = 0;
 		self.capacity = self.min;
 	}
 
+	// drop the length to n and keep the capacity. Unlike clear this
+	// never touches the allocation, so a long-lived buffer holds its
+	// high-water mark and refilling it after a large message costs no
+	// reallocs; pair with shrink_to_fit when the memory should go back
+	pub fn truncate(&mut self, n: usize) {
+		if n >= self.elements {
+			return;
+		}
+		if !self.make_unique() {
+			panic!("could not copy cow buffer!");
+		}
+		if needs_drop::<T>() {
+			for i in n..self.elements {
+				unsafe {
+					let ptr = (self.value.raw() as *const u8).add(i * size_of::<T>()) as *mut T;
+					drop_in_place(ptr);
+				}
+			}
+		}
+		self.elements = n;
+	}
+
+	// remove the elements in range and move the tail down; the
+	// generalization of shift to an interior span. Capacity is kept,
+	// like truncate
+	pub fn drain(&mut self, range: Range<usize>) -> Result<(), Error> {
+		if range.start > range.end || range.end > self.elements {
+			return Err(err!(OutOfBounds));
+		}
+		if range.start == range.end {
+			return Ok(());
+		}
+		if !self.make_unique() {
+			return Err(err!(Alloc));
+		}
+		let size = size_of::<T>();
+		if needs_drop::<T>() {
+			for i in range.start..range.end {
+				unsafe {
+					let ptr = (self.value.raw() as *const u8).add(i * size) as *mut T;
+					drop_in_place(ptr);
+				}
+			}
+		}
+		unsafe {
+			copy(
+				self.value.raw().add(range.end * size) as *const T,
+				self.value.raw().add(range.start * size) as *mut T,
+				self.elements - range.end,
+			);
+		}
+		self.elements -= range.end - range.start;
+		Ok(())
+	}
+
+	// give excess capacity back to the allocator, down to the length
+	// (never below min). The explicit inverse of truncate's retention:
+	// callers decide when a buffer's high-water mark stops paying rent
+	pub fn shrink_to_fit(&mut self) -> Result<(), Error> {
+		if !self.make_unique() {
+			return Err(err!(Alloc));
+		}
+		let target = if self.elements < self.min {
+			self.min
+		} else {
+			self.elements
+		};
+		if target >= self.capacity {
+			return Ok(());
+		}
+		let rptr = self.value.raw();
+		if target == 0 {
+			if !rptr.is_null() {
+				unsafe {
+					release(rptr);
+				}
+			}
+			self.value = Ptr::null();
+			self.capacity = 0;
+			return Ok(());
+		}
+		let nptr = unsafe { resize(rptr as *mut u8, target * size_of::<T>()) };
+		if nptr.is_null() {
+			return Err(err!(Alloc));
+		}
+		self.value = Ptr::new(nptr as *mut u8);
+		self.capacity = target;
+		Ok(())
+	}
+
 	pub fn as_mut_ptr(&mut self) -> *mut u8 {
+		if !self.make_unique() {
+			panic!("could not copy cow buffer!");
+		}
 		self.value.raw()
 	}
 
@@ -334,15 +603,45 @@ impl<T> Vec<T> {
 		self.value.raw()
 	}
 
+	// Unchecked element access for audited hot loops (the ws frame
+	// parser byte scans). Index panics block autovectorization; the
+	// caller guarantees index < len and debug builds still assert it.
+	pub unsafe fn get_unchecked(&self, index: usize) -> &T {
+		debug_assert!(index < self.elements);
+		&*(self.value.raw() as *const T).add(index)
+	}
+
+	pub unsafe fn get_unchecked_mut(&mut self, index: usize) -> &mut T {
+		debug_assert!(index < self.elements);
+		if !self.make_unique() {
+			panic!("could not copy cow buffer!");
+		}
+		&mut *(self.value.raw() as *mut T).add(index)
+	}
+
 	pub fn as_slice(&self) -> &[T] {
+		// an empty vec's buffer is null and from_raw_parts requires a
+		// non-null pointer even for a zero-length slice
+		if self.elements == 0 {
+			return &[];
+		}
 		unsafe { from_raw_parts(self.value.raw() as *const T, self.elements) }
 	}
 
 	pub fn as_mut_slice(&mut self) -> &mut [T] {
+		if self.elements == 0 {
+			return &mut [];
+		}
+		if !self.make_unique() {
+			panic!("could not copy cow buffer!");
+		}
 		unsafe { from_raw_parts_mut(self.value.raw() as *mut T, self.elements) }
 	}
 
 	pub fn resize(&mut self, n: usize) -> Result<(), Error> {
+		if !self.make_unique() {
+			return Err(err!(Alloc));
+		}
 		if self.resize_impl(n) {
 			self.elements = n;
 			Ok(())
@@ -351,10 +650,31 @@ impl<T> Vec<T> {
 		}
 	}
 
+	// set the length to n, growing capacity when needed but never
+	// shrinking it: the buffer-reuse complement of resize. resize frees
+	// down to the power-of-two for the new length, so alternating large
+	// and small lengths on a long-lived buffer reallocs every swing;
+	// this keeps the high-water allocation in place
+	pub fn resize_keep(&mut self, n: usize) -> Result<(), Error> {
+		if !self.make_unique() {
+			return Err(err!(Alloc));
+		}
+		if n > self.capacity {
+			if !self.resize_impl(n) {
+				return Err(err!(Alloc));
+			}
+		}
+		self.elements = n;
+		Ok(())
+	}
+
 	pub fn append_ptr(&mut self, ptr: *const u8, elems: usize) -> Result<(), Error> {
 		if ptr.is_null() {
 			return Err(err!(IllegalArgument));
 		}
+		if !self.make_unique() {
+			return Err(err!(Alloc));
+		}
 		let size = size_of::<T>();
 		let needed = size * (self.elements + elems);
 		if needed > self.capacity {
@@ -375,6 +695,9 @@ impl<T> Vec<T> {
 	}
 
 	pub fn append(&mut self, v: &Vec<T>) -> Result<(), Error> {
+		if !self.make_unique() {
+			return Err(err!(Alloc));
+		}
 		let size = size_of::<T>();
 		let len = v.len();
 		let needed = size * (self.elements + len);
@@ -395,6 +718,69 @@ impl<T> Vec<T> {
 	}
 }
 
+impl<T: Copy> Vec<T> {
+	/// Enable copy-on-write clones for this instance. Subsequent clones
+	/// share the backing allocation behind a refcount instead of deep
+	/// copying; the first mutation of a shared instance copies the
+	/// buffer. Intended for fan-out patterns that clone a buffer once
+	/// per consumer and almost never touch it. Limited to Copy element
+	/// types so a byte copy is a valid clone and no element drop can
+	/// run twice.
+	pub fn cow(&mut self) -> Result<(), Error> {
+		if !self.refs.is_null() {
+			return Ok(());
+		}
+		self.refs = match Ptr::alloc(1u64) {
+			Ok(refs) => refs,
+			Err(e) => return Err(e),
+		};
+		Ok(())
+	}
+
+	/// Typed bulk append: one intrinsic-backed copy of the whole slice
+	/// through the same grow-and-make-unique path as push, with no
+	/// per-element work. The byte-wise append_ptr stays for callers
+	/// that only hold a raw pointer; merges of large typed vectors
+	/// should come through here. Limited to Copy element types so the
+	/// flat copy is a valid clone of every element.
+	pub fn extend_from_slice(&mut self, s: &[T]) -> Result<(), Error> {
+		let elems = s.len();
+		// an empty slice's pointer may be null (see as_slice); skip the
+		// copy rather than hand it to copy_nonoverlapping
+		if elems == 0 {
+			return Ok(());
+		}
+		if !self.make_unique() {
+			return Err(err!(Alloc));
+		}
+		let size = size_of::<T>();
+		let needed = size * (self.elements + elems);
+		if needed > self.capacity {
+			if !self.resize_impl(needed) {
+				return Err(err!(Alloc));
+			}
+		}
+
+		unsafe {
+			let dest_ptr = (self.value.raw() as *mut T).add(self.elements);
+			copy_nonoverlapping(s.as_ptr(), dest_ptr, elems);
+		}
+
+		self.elements += elems;
+		Ok(())
+	}
+
+	/// Construct a vector holding a copy of `s`: one allocation sized
+	/// up front and one flat copy.
+	pub fn from_slice(s: &[T]) -> Result<Self, Error> {
+		let mut v = Vec::new();
+		match v.extend_from_slice(s) {
+			Ok(_) => Ok(v),
+			Err(e) => Err(e),
+		}
+	}
+}
+
 #[cfg(test)]
 mod test {
 	use super::*;
@@ -405,6 +791,46 @@ mod test {
 	use core::result::Result as CoreResult;
 	use ffi::getalloccount;
 
+	#[test]
+	fn test_vec_bytes() {
+		let initial = unsafe { getalloccount() };
+		{
+			// equality is a bulk compare with the same results as the
+			// old element loop
+			let a: Vec<u8> = Vec::from_slice(b"hello world" as &[u8]).unwrap();
+			let b: Vec<u8> = Vec::from_slice(b"hello world" as &[u8]).unwrap();
+			let c: Vec<u8> = Vec::from_slice(b"hello worle" as &[u8]).unwrap();
+			let d: Vec<u8> = Vec::from_slice(b"hello" as &[u8]).unwrap();
+			assert!(a == b);
+			assert!(!(a == c));
+			assert!(!(a == d));
+			let e: Vec<u8> = Vec::new();
+			let f: Vec<u8> = Vec::new();
+			assert!(e == f);
+			assert!(!(e == d));
+
+			// byte buffers come back on the allocator's 16 byte
+			// alignment for the vector kernels, through growth and
+			// shrink, and truncate leaves the retained prefix alone
+			let mut v: Vec<u8> = Vec::new();
+			for i in 0..4096 {
+				v.push(i as u8).unwrap();
+			}
+			assert_eq!(v.as_ptr() as usize % 16, 0);
+			v.truncate(16);
+			assert_eq!(v.capacity(), 4096);
+			for i in 0..16 {
+				assert_eq!(v[i], i as u8);
+			}
+			v.shrink_to_fit().unwrap();
+			assert_eq!(v.as_ptr() as usize % 16, 0);
+			for i in 0..16 {
+				assert_eq!(v[i], i as u8);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
 	#[test]
 	fn test_vec1() {
 		let mut x = vec![1, 2, 3, 4, 5, 6].unwrap();
@@ -531,6 +957,55 @@ mod test {
 		assert_eq!(v.len(), 0);
 	}
 
+	#[test]
+	fn test_vec_unchecked() {
+		let mut v = vec![10, 20, 30].unwrap();
+		// SAFETY: indices are < len
+		unsafe {
+			assert_eq!(*v.get_unchecked(0), 10);
+			assert_eq!(*v.get_unchecked(2), 30);
+			*v.get_unchecked_mut(1) = 25;
+		}
+		assert_eq!(v[1], 25);
+
+		// get_unchecked_mut must still honor cow: the clone keeps the
+		// original bytes
+		let v2 = v.clone().unwrap();
+		unsafe {
+			*v.get_unchecked_mut(0) = 99;
+		}
+		assert_eq!(v[0], 99);
+		assert_eq!(v2[0], 10);
+	}
+
+	#[test]
+	fn test_vec_reserve() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut v = Vec::with_capacity(100).unwrap();
+			assert_eq!(v.len(), 0);
+			for i in 0..100 {
+				assert!(v.push(i).is_ok());
+			}
+			assert_eq!(v.len(), 100);
+			for i in 0..100 {
+				assert_eq!(v[i], i);
+			}
+			// reserve below current capacity is a no-op
+			assert!(v.reserve(10).is_ok());
+			assert!(v.push(100).is_ok());
+			assert_eq!(v.len(), 101);
+
+			let mut v2: Vec<u64> = Vec::new();
+			assert!(v2.reserve(37).is_ok());
+			for i in 0..37 {
+				assert!(v2.push(i).is_ok());
+			}
+			assert_eq!(v2.len(), 37);
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
 	#[test]
 	fn test_set_min0() {
 		let initial = unsafe { getalloccount() };
@@ -554,4 +1029,174 @@ mod test {
 		}
 		assert_eq!(initial, unsafe { getalloccount() });
 	}
+
+	#[test]
+	fn test_vec_cow() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut v1 = vec![1u64, 2, 3, 4].unwrap();
+			v1.cow().unwrap();
+			let v2 = v1.clone().unwrap();
+			let mut v3 = v1.clone().unwrap();
+			// all three share one buffer until a write
+			assert!(v1.as_ptr() == v2.as_ptr());
+			assert!(v1.as_ptr() == v3.as_ptr());
+			// a write detaches only the writer
+			v3[0] = 100;
+			assert!(v1.as_ptr() != v3.as_ptr());
+			assert_eq!(v1[0], 1);
+			assert_eq!(v2[0], 1);
+			assert_eq!(v3[0], 100);
+			assert_eq!(v3[3], 4);
+			// push on a shared instance detaches too
+			let mut v4 = v2.clone().unwrap();
+			v4.push(5).unwrap();
+			assert_eq!(v4.len(), 5);
+			assert_eq!(v4[4], 5);
+			assert_eq!(v2.len(), 4);
+			assert_eq!(v2[3], 4);
+			// once unique again, writes stay in place
+			let p = v4.as_ptr();
+			v4[0] = 7;
+			assert!(v4.as_ptr() == p);
+
+			// without cow, clone deep copies
+			let mut v5 = vec![9u64, 8].unwrap();
+			let v6 = v5.clone().unwrap();
+			assert!(v5.as_ptr() != v6.as_ptr());
+			v5[0] = 1;
+			assert_eq!(v6[0], 9);
+			assert_eq!(v6[1], 8);
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_vec_truncate_drain() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut v: Vec<u8> = Vec::new();
+			assert!(v.resize(1024).is_ok());
+			for i in 0..1024 {
+				v[i] = (i % 256) as u8;
+			}
+			let p = v.as_ptr();
+
+			// truncate keeps the allocation, so refilling to the old
+			// high-water mark moves no memory
+			v.truncate(0);
+			assert_eq!(v.len(), 0);
+			assert!(v.resize_keep(1024).is_ok());
+			assert!(v.as_ptr() == p);
+			assert_eq!(v.len(), 1024);
+
+			// resize_keep grows past capacity like push would
+			assert!(v.resize_keep(2048).is_ok());
+			assert_eq!(v.len(), 2048);
+
+			// drain an interior span; the tail moves down
+			for i in 0..10 {
+				v[i] = i as u8;
+			}
+			v.truncate(10);
+			assert!(v.drain(2..5).is_ok());
+			assert_eq!(v.len(), 7);
+			assert_eq!(v[0], 0);
+			assert_eq!(v[1], 1);
+			assert_eq!(v[2], 5);
+			assert_eq!(v[6], 9);
+			assert!(v.drain(5..8).is_err());
+			assert!(v.drain(3..3).is_ok());
+			assert_eq!(v.len(), 7);
+
+			// shrink_to_fit gives the excess back down to the length
+			assert!(v.shrink_to_fit().is_ok());
+			assert!(v.push(7).is_ok());
+			assert_eq!(v.len(), 8);
+			assert_eq!(v[7], 7);
+
+			// truncate runs drops for element types that need them
+			unsafe {
+				VTEST = 0;
+			}
+			let mut d: Vec<DropTest> = Vec::new();
+			assert!(d.push(DropTest { x: 1 }).is_ok());
+			assert!(d.push(DropTest { x: 2 }).is_ok());
+			assert!(d.push(DropTest { x: 3 }).is_ok());
+			d.truncate(1);
+			assert_eq!(unsafe { VTEST }, 2);
+			assert_eq!(d[0].x, 1);
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_vec_hugepage() {
+		use ffi::set_hugepage_threshold;
+		let initial = unsafe { getalloccount() };
+		{
+			// with a threshold set, large backing arrays are advised
+			// onto hugepages; behavior must be unchanged either way
+			unsafe {
+				set_hugepage_threshold(1024 * 1024);
+			}
+			let mut v: Vec<u8> = Vec::new();
+			assert!(v.resize(4 * 1024 * 1024).is_ok());
+			v[0] = 1;
+			v[4 * 1024 * 1024 - 1] = 2;
+			assert_eq!(v[0], 1);
+			assert_eq!(v[4 * 1024 * 1024 - 1], 2);
+			assert!(v.resize(8 * 1024 * 1024).is_ok());
+			assert_eq!(v[0], 1);
+			unsafe {
+				set_hugepage_threshold(0);
+			}
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_vec_extend_from_slice() {
+		let initial = unsafe { getalloccount() };
+		{
+			// typed merge agrees with element-wise push
+			let mut a: Vec<u64> = Vec::new();
+			let mut b: Vec<u64> = Vec::new();
+			for i in 0..10_000u64 {
+				assert!(a.push(i).is_ok());
+				assert!(b.push(i * 2).is_ok());
+			}
+			assert!(a.extend_from_slice(b.as_slice()).is_ok());
+			assert_eq!(a.len(), 20_000);
+			for i in 0..10_000usize {
+				assert_eq!(a[i], i as u64);
+				assert_eq!(a[10_000 + i], (i * 2) as u64);
+			}
+
+			// empty slices are no-ops on either side
+			let empty: Vec<u64> = Vec::new();
+			assert!(a.extend_from_slice(empty.as_slice()).is_ok());
+			assert_eq!(a.len(), 20_000);
+			let mut e: Vec<u64> = Vec::new();
+			assert!(e.extend_from_slice(&a.as_slice()[0..3]).is_ok());
+			assert_eq!(e.len(), 3);
+			assert_eq!(e[2], 2);
+
+			// from_slice round trip
+			let f: Vec<u64> = Vec::from_slice(b.as_slice()).unwrap();
+			assert_eq!(f.len(), 10_000);
+			assert_eq!(f[9_999], 19_998);
+
+			// a cow clone is copied out before the append mutates it
+			let mut g: Vec<u64> = Vec::from_slice(&[1, 2, 3]).unwrap();
+			g.cow().unwrap();
+			let h = g.clone().unwrap();
+			assert!(g.extend_from_slice(&[4, 5]).is_ok());
+			assert_eq!(g.len(), 5);
+			assert_eq!(h.len(), 3);
+			assert_eq!(h[2], 3);
+			assert_eq!(g[4], 5);
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
 }
@@ -1,10 +1,26 @@
 use core::iter::IntoIterator;
 use core::iter::Iterator;
+use core::marker::Copy;
+use core::mem::swap;
 use core::ops::{Deref, DerefMut};
 use core::option::Option as CoreOption;
-use core::ptr::null_mut;
+use core::ptr::{drop_in_place, null_mut};
 use prelude::*;
 
+// one-word atomic views of the link pointers shared with snapshot
+// readers (see Hashtable::snap): a Ptr to a sized node is a single
+// word, so the acquire/release u64 primitives from c/atomic.c observe
+// and publish it whole
+fn pload<V: PartialEq + Hash>(p: &Ptr<Node<V>>) -> Ptr<Node<V>> {
+	let raw = aload!(p as *const Ptr<Node<V>> as *const u64);
+	Ptr::new(raw as *mut Node<V>)
+}
+
+fn pstore<V: PartialEq + Hash>(p: &mut Ptr<Node<V>>, v: Ptr<Node<V>>) {
+	let word = unsafe { *(&v as *const Ptr<Node<V>> as *const u64) };
+	astore!(p as *mut Ptr<Node<V>> as *mut u64, word);
+}
+
 pub struct Node<V: PartialEq> {
 	next: Ptr<Node<V>>,
 	pub value: V,
@@ -41,6 +57,11 @@ impl<V: PartialEq> Node<V> {
 
 pub struct Hashtable<V: PartialEq + Hash> {
 	arr: Vec<Ptr<Node<V>>>,
+	// snapshot support (see snap/defer): count of active snapshot
+	// readers, and nodes unlinked while one was live, parked until the
+	// table is quiescent again
+	readers: u64,
+	limbo: Vec<Ptr<Node<V>>>,
 }
 
 pub struct HashtableIterator<V: PartialEq + Hash> {
@@ -55,6 +76,53 @@ pub struct HashtableRefIterator<'a, V: PartialEq + Hash> {
 	index: usize,
 }
 
+// RCU-style snapshot iteration (see Hashtable::snap): the walk itself
+// takes no lock, reading bucket heads and links through the atomic
+// pointer views while writers keep mutating. Every node present for
+// the whole scan is visited once; nodes inserted or removed mid-scan
+// may or may not appear. Drop unregisters the reader, which is what
+// lets writers start releasing deferred nodes again
+pub struct HashtableSnapIterator<'a, V: PartialEq + Hash> {
+	hashtable: &'a Hashtable<V>,
+	cur: Ptr<Node<V>>,
+	index: usize,
+}
+
+impl<'a, V: PartialEq + Hash> Iterator for HashtableSnapIterator<'a, V> {
+	type Item = Ptr<Node<V>>;
+
+	fn next(&mut self) -> CoreOption<Self::Item> {
+		while self.cur.is_null() && self.index < self.hashtable.arr.len() {
+			self.cur = pload(&self.hashtable.arr[self.index]);
+			if !self.cur.is_null() {
+				break;
+			}
+			self.index += 1;
+		}
+
+		match self.cur.is_null() {
+			true => CoreOption::None,
+			false => {
+				let ret = self.cur;
+				let next = pload(&self.cur.next);
+				if next.is_null() {
+					self.index += 1;
+					self.cur = Ptr::null();
+				} else {
+					self.cur = next;
+				}
+				CoreOption::Some(ret)
+			}
+		}
+	}
+}
+
+impl<'a, V: PartialEq + Hash> Drop for HashtableSnapIterator<'a, V> {
+	fn drop(&mut self) {
+		asub!(&self.hashtable.readers as *const u64 as *mut u64, 1);
+	}
+}
+
 impl<'a, V: PartialEq + Hash> Iterator for HashtableRefIterator<'a, V> {
 	type Item = Ptr<Node<V>>;
 
@@ -147,12 +215,17 @@ impl<V: PartialEq + Hash> Hashtable<V> {
 	pub fn new(size: usize) -> Result<Self, Error> {
 		let mut arr = Vec::new();
 		match arr.resize(size) {
-			Ok(_) => Ok(Self { arr }),
+			Ok(_) => Ok(Self {
+				arr,
+				readers: 0,
+				limbo: Vec::new(),
+			}),
 			Err(e) => Err(e),
 		}
 	}
 
 	pub fn insert(&mut self, mut node: Ptr<Node<V>>) -> bool {
+		self.reclaim();
 		(*node).next = Ptr::null();
 		let value = &*node;
 		if self.arr.len() == 0 {
@@ -161,7 +234,9 @@ impl<V: PartialEq + Hash> Hashtable<V> {
 		let index = value.hash() % self.arr.len();
 		let mut ptr = self.arr[index];
 		if ptr.is_null() {
-			self.arr[index] = node;
+			// release store: a snapshot reader that sees the link also
+			// sees the node's initialized next/value
+			pstore(&mut self.arr[index], node);
 		} else {
 			let mut prev = Ptr::new(null_mut());
 			while !ptr.is_null() {
@@ -172,7 +247,7 @@ impl<V: PartialEq + Hash> Hashtable<V> {
 				ptr = (*ptr).next;
 			}
 
-			(*prev).next = node;
+			pstore(&mut (*prev).next, node);
 		}
 		true
 	}
@@ -192,19 +267,22 @@ impl<V: PartialEq + Hash> Hashtable<V> {
 	}
 
 	pub fn remove(&mut self, value: &V) -> Option<Ptr<Node<V>>> {
+		self.reclaim();
 		if self.arr.len() > 0 {
 			let index = value.hash() % self.arr.len();
 			let mut ptr = self.arr[index];
 
 			if !ptr.is_null() && (*ptr).value == *value {
-				self.arr[index] = (*ptr).next;
+				let next = (*ptr).next;
+				pstore(&mut self.arr[index], next);
 				return Some(Ptr::new(ptr.raw()));
 			}
 			let mut prev = self.arr[index];
 
 			while !ptr.is_null() {
 				if (*ptr).value == *value {
-					(*prev).next = (*ptr).next;
+					let next = (*ptr).next;
+					pstore(&mut (*prev).next, next);
 					return Some(Ptr::new(ptr.raw()));
 				}
 				prev = ptr;
@@ -213,6 +291,471 @@ impl<V: PartialEq + Hash> Hashtable<V> {
 		}
 		None
 	}
+
+	// begin a snapshot scan. The caller holds whatever lock serializes
+	// writers only long enough to take the handle; the walk itself runs
+	// lock-free against concurrent mutation, so a scrape of a large
+	// table no longer stalls the write path for its duration. While any
+	// snapshot is live, removed nodes handed to defer stay readable
+	// instead of going back to the allocator
+	pub fn snap(&self) -> HashtableSnapIterator<'_, V> {
+		aadd!(&self.readers as *const u64 as *mut u64, 1);
+		HashtableSnapIterator {
+			hashtable: self,
+			cur: Ptr::null(),
+			index: 0,
+		}
+	}
+
+	// hand a just-removed node back to the table instead of releasing
+	// it: a snapshot reader may still be walking the chain it came
+	// from. Ownership transfers to the table — once no snapshot is
+	// live the value is dropped and the node released. Free is
+	// immediate when the table is already quiescent
+	pub fn defer(&mut self, node: Ptr<Node<V>>) {
+		self.reclaim();
+		if aload!(&self.readers) == 0 {
+			Self::reap(node);
+			return;
+		}
+		match self.limbo.push(node) {
+			Ok(_) => {}
+			Err(_e) => {
+				// no memory to park it; wait out the readers rather
+				// than handing a still-reachable node to the allocator
+				while aload!(&self.readers) != 0 {}
+				Self::reap(node);
+			}
+		}
+	}
+
+	fn reap(mut node: Ptr<Node<V>>) {
+		unsafe {
+			drop_in_place(&mut (*node).value as *mut V);
+		}
+		node.release();
+	}
+
+	// drain the limbo list if no snapshot is live; hooked into the
+	// mutation paths so a quiescent table frees its parked nodes
+	// without the owner polling
+	fn reclaim(&mut self) {
+		if self.limbo.len() == 0 || aload!(&self.readers) != 0 {
+			return;
+		}
+		for i in 0..self.limbo.len() {
+			Self::reap(self.limbo[i]);
+		}
+		self.limbo.clear();
+	}
+}
+
+impl<V: PartialEq + Hash> Drop for Hashtable<V> {
+	fn drop(&mut self) {
+		// teardown happens once no snapshot can be live, so anything
+		// still parked is safe to release
+		for i in 0..self.limbo.len() {
+			Self::reap(self.limbo[i]);
+		}
+		self.limbo.clear();
+	}
+}
+
+// number of old-table buckets migrated per mutation. Growth doubles the
+// bucket count, so draining two buckets per insert finishes the
+// migration well before the new table can trigger the next resize even
+// if every insert lands while one is in flight
+const MIGRATE_STEP: usize = 2;
+
+// Variant of Hashtable that grows and shrinks with load instead of
+// fixing the bucket array at construction. Resizes are incremental: a
+// resize swaps in a fresh bucket array and keeps the old one aside,
+// then every mutation migrates MIGRATE_STEP old buckets, so the cost is
+// amortized across operations and no single insert pays a
+// stop-the-world rehash over the whole table. Lookups during a
+// migration probe the new array first and fall back to the not yet
+// drained part of the old one. Node ownership follows Hashtable: the
+// caller allocates and releases nodes, the table only links them.
+pub struct ResizingHashtable<V: PartialEq + Hash> {
+	arr: Vec<Ptr<Node<V>>>,
+	// the array being drained; empty when no resize is in flight
+	old: Vec<Ptr<Node<V>>>,
+	migrate_pos: usize,
+	elements: usize,
+	min_size: usize,
+}
+
+impl<V: PartialEq + Hash> ResizingHashtable<V> {
+	// size is the floor the table never shrinks below, not a capacity
+	pub fn new(size: usize) -> Result<Self, Error> {
+		let mut arr = Vec::new();
+		match arr.resize(size) {
+			Ok(_) => Ok(Self {
+				arr,
+				old: Vec::new(),
+				migrate_pos: 0,
+				elements: 0,
+				min_size: size,
+			}),
+			Err(e) => Err(e),
+		}
+	}
+
+	pub fn len(&self) -> usize {
+		self.elements
+	}
+
+	// current bucket count, old array included while one is draining;
+	// this is what the table actually has mapped
+	pub fn buckets(&self) -> usize {
+		self.arr.len() + self.old.len()
+	}
+
+	fn link(arr: &mut Vec<Ptr<Node<V>>>, mut node: Ptr<Node<V>>) {
+		let index = (*node).value.hash() % arr.len();
+		(*node).next = arr[index];
+		arr[index] = node;
+	}
+
+	// drain up to MIGRATE_STEP old buckets into arr; called from every
+	// mutation so an in-flight resize always makes progress
+	fn migrate(&mut self) {
+		let olen = self.old.len();
+		if olen == 0 {
+			return;
+		}
+		let mut moved = 0;
+		while self.migrate_pos < olen && moved < MIGRATE_STEP {
+			let mut ptr = self.old[self.migrate_pos];
+			while !ptr.is_null() {
+				let next = (*ptr).next;
+				Self::link(&mut self.arr, ptr);
+				ptr = next;
+			}
+			self.old[self.migrate_pos] = Ptr::null();
+			self.migrate_pos += 1;
+			moved += 1;
+		}
+		if self.migrate_pos == olen {
+			// SAFETY: shrinking to zero cannot fail
+			let _ = self.old.resize(0);
+			self.migrate_pos = 0;
+		}
+	}
+
+	// start a resize to new_size if none is in flight. Allocation
+	// failure is not an error: the table keeps working at its current
+	// size and the next mutation past the threshold retries
+	fn start_resize(&mut self, new_size: usize) {
+		let mut fresh: Vec<Ptr<Node<V>>> = Vec::new();
+		match fresh.resize(new_size) {
+			Ok(_) => {}
+			Err(_e) => return,
+		}
+		swap(&mut self.arr, &mut fresh);
+		self.old = fresh;
+		self.migrate_pos = 0;
+	}
+
+	fn maybe_resize(&mut self) {
+		if self.old.len() != 0 {
+			return;
+		}
+		let cap = self.arr.len();
+		if self.elements >= cap {
+			self.start_resize(cap * 2);
+		} else if cap / 2 >= self.min_size && self.elements < cap / 4 {
+			// half the buckets still leaves the load factor under 1/2,
+			// so a grow does not immediately follow the shrink
+			self.start_resize(cap / 2);
+		}
+	}
+
+	pub fn insert(&mut self, mut node: Ptr<Node<V>>) -> bool {
+		(*node).next = Ptr::null();
+		if self.arr.len() == 0 {
+			return false;
+		}
+		self.migrate();
+		if self.find(&(*node).value).is_some() {
+			return false;
+		}
+		Self::link(&mut self.arr, node);
+		self.elements += 1;
+		self.maybe_resize();
+		true
+	}
+
+	pub fn find(&self, value: &V) -> Option<Ptr<Node<V>>> {
+		if self.arr.len() == 0 {
+			return None;
+		}
+		let mut ptr = self.arr[value.hash() % self.arr.len()];
+		while !ptr.is_null() {
+			if &ptr.value == value {
+				return Some(Ptr::new(ptr.raw()));
+			}
+			ptr = (ptr.as_ref()).next;
+		}
+		// anything not migrated yet still hangs off the old array
+		if self.old.len() != 0 {
+			let mut ptr = self.old[value.hash() % self.old.len()];
+			while !ptr.is_null() {
+				if &ptr.value == value {
+					return Some(Ptr::new(ptr.raw()));
+				}
+				ptr = (ptr.as_ref()).next;
+			}
+		}
+		None
+	}
+
+	fn unlink(arr: &mut Vec<Ptr<Node<V>>>, value: &V) -> Option<Ptr<Node<V>>> {
+		if arr.len() == 0 {
+			return None;
+		}
+		let index = value.hash() % arr.len();
+		let mut ptr = arr[index];
+		if !ptr.is_null() && (*ptr).value == *value {
+			arr[index] = (*ptr).next;
+			return Some(Ptr::new(ptr.raw()));
+		}
+		let mut prev = ptr;
+		while !ptr.is_null() {
+			if (*ptr).value == *value {
+				(*prev).next = (*ptr).next;
+				return Some(Ptr::new(ptr.raw()));
+			}
+			prev = ptr;
+			ptr = (*ptr).next;
+		}
+		None
+	}
+
+	pub fn remove(&mut self, value: &V) -> Option<Ptr<Node<V>>> {
+		self.migrate();
+		let found = match Self::unlink(&mut self.arr, value) {
+			Some(ptr) => Some(ptr),
+			None => Self::unlink(&mut self.old, value),
+		};
+		match found {
+			Some(ptr) => {
+				self.elements -= 1;
+				self.maybe_resize();
+				Some(ptr)
+			}
+			None => None,
+		}
+	}
+}
+
+// Concurrent wrapper over Hashtable for read-mostly shared maps: N
+// independent shards each with its own Lock, so workers touching
+// different shards never contend and lookups take a read lock only.
+// The shard is picked from the high bits of the same murmur hash the
+// shard's table then uses for bucket selection, keeping the two
+// choices uncorrelated. Share across threads the same way the other
+// shared state in this crate is: behind an Rc, with each thread
+// holding its own clone.
+struct Shard<V: PartialEq + Hash> {
+	lock: Lock,
+	table: Hashtable<V>,
+}
+
+pub struct ShardedHashtable<V: PartialEq + Hash> {
+	shards: Vec<Shard<V>>,
+}
+
+impl<V: PartialEq + Hash> ShardedHashtable<V> {
+	// size is the bucket count of each shard, so capacity scales with
+	// the shard count like the single-table equivalent would
+	pub fn new(shards: usize, size: usize) -> Result<Self, Error> {
+		let mut v = Vec::new();
+		for _i in 0..shards {
+			let table = match Hashtable::new(size) {
+				Ok(table) => table,
+				Err(e) => return Err(e),
+			};
+			match v.push(Shard {
+				lock: lock!(),
+				table,
+			}) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			}
+		}
+		Ok(Self { shards: v })
+	}
+
+	fn shard_index(&self, value: &V) -> usize {
+		(value.hash() >> 16) % self.shards.len()
+	}
+
+	pub fn insert(&mut self, node: Ptr<Node<V>>) -> bool {
+		if self.shards.len() == 0 {
+			return false;
+		}
+		let index = self.shard_index(&*node);
+		let shard = &mut self.shards[index];
+		let _l = shard.lock.write();
+		shard.table.insert(node)
+	}
+
+	pub fn find(&self, value: &V) -> Option<Ptr<Node<V>>> {
+		if self.shards.len() == 0 {
+			return None;
+		}
+		let shard = &self.shards[self.shard_index(value)];
+		let _l = shard.lock.read();
+		shard.table.find(value)
+	}
+
+	pub fn remove(&mut self, value: &V) -> Option<Ptr<Node<V>>> {
+		if self.shards.len() == 0 {
+			return None;
+		}
+		let index = self.shard_index(value);
+		let shard = &mut self.shards[index];
+		let _l = shard.lock.write();
+		shard.table.remove(value)
+	}
+}
+
+// Open-addressing variant of Hashtable with inline value storage for
+// small POD values. Robin hood probing keeps probe sequences short and
+// remove uses backward-shift deletion so no tombstones accumulate.
+// Unlike Hashtable there is no per-entry allocation: find touches only
+// the slot array. Capacity is fixed at construction; insert returns
+// false when the table is full or the value is already present.
+struct Slot<V> {
+	// probe distance + 1. 0 means the slot is empty (Vec zeroes its
+	// memory on resize so a fresh table is all-empty).
+	dist: u8,
+	value: V,
+}
+
+pub struct OpenHashtable<V: PartialEq + Hash + Copy> {
+	slots: Vec<Slot<V>>,
+	elements: usize,
+}
+
+impl<V: PartialEq + Hash + Copy> OpenHashtable<V> {
+	pub fn new(size: usize) -> Result<Self, Error> {
+		let mut slots = Vec::new();
+		match slots.resize(size) {
+			Ok(_) => Ok(Self { slots, elements: 0 }),
+			Err(e) => Err(e),
+		}
+	}
+
+	pub fn len(&self) -> usize {
+		self.elements
+	}
+
+	pub fn insert(&mut self, value: V) -> bool {
+		let cap = self.slots.len();
+		if cap == 0 || self.elements == cap {
+			return false;
+		}
+		let mut index = value.hash() % cap;
+		let mut dist: u8 = 1;
+		let mut cur = value;
+		// once an entry has been displaced it is known not to be a
+		// duplicate, so only compare while probing the original
+		let mut original = true;
+		loop {
+			if self.slots[index].dist == 0 {
+				self.slots[index].dist = dist;
+				self.slots[index].value = cur;
+				self.elements += 1;
+				return true;
+			}
+			if original && self.slots[index].value == cur {
+				return false;
+			}
+			if self.slots[index].dist < dist {
+				// rob the rich: swap in the entry that has
+				// probed further and keep placing the old one
+				let tmpv = self.slots[index].value;
+				let tmpd = self.slots[index].dist;
+				self.slots[index].value = cur;
+				self.slots[index].dist = dist;
+				cur = tmpv;
+				dist = tmpd;
+				original = false;
+			}
+			if dist == u8::MAX {
+				return false;
+			}
+			dist += 1;
+			index = (index + 1) % cap;
+		}
+	}
+
+	fn find_index(&self, value: &V) -> Option<usize> {
+		let cap = self.slots.len();
+		if cap == 0 {
+			return None;
+		}
+		let mut index = value.hash() % cap;
+		let mut dist: u8 = 1;
+		loop {
+			let slot = &self.slots[index];
+			// robin hood invariant: once we pass the probe
+			// distance the value cannot be further along
+			if slot.dist == 0 || slot.dist < dist {
+				return None;
+			}
+			if slot.value == *value {
+				return Some(index);
+			}
+			if dist == u8::MAX {
+				return None;
+			}
+			dist += 1;
+			index = (index + 1) % cap;
+		}
+	}
+
+	pub fn find(&self, value: &V) -> Option<&V> {
+		match self.find_index(value) {
+			Some(index) => Some(&self.slots[index].value),
+			None => None,
+		}
+	}
+
+	// the returned reference must not be mutated in a way that changes
+	// the value's hash or equality
+	pub fn find_mut(&mut self, value: &V) -> Option<&mut V> {
+		match self.find_index(value) {
+			Some(index) => Some(&mut self.slots[index].value),
+			None => None,
+		}
+	}
+
+	pub fn remove(&mut self, value: &V) -> Option<V> {
+		let index = match self.find_index(value) {
+			Some(index) => index,
+			None => return None,
+		};
+		let ret = self.slots[index].value;
+		let cap = self.slots.len();
+		// backward-shift: pull displaced entries one slot closer to
+		// home until a hole or an at-home entry is reached
+		let mut cur = index;
+		loop {
+			let next = (cur + 1) % cap;
+			if self.slots[next].dist <= 1 {
+				self.slots[cur].dist = 0;
+				break;
+			}
+			self.slots[cur].value = self.slots[next].value;
+			self.slots[cur].dist = self.slots[next].dist - 1;
+			cur = next;
+		}
+		self.elements -= 1;
+		Some(ret)
+	}
 }
 
 #[cfg(test)]
@@ -224,6 +767,7 @@ mod test {
 	use ffi::getalloccount;
 	use std::murmur32::MURMUR_SEED;
 
+	#[derive(Clone, Copy)]
 	struct TestValue {
 		k: i32,
 		v: i32,
@@ -342,6 +886,223 @@ mod test {
 		assert_eq!(unsafe { getalloccount() }, initial);
 	}
 
+	#[test]
+	fn test_sharded_hashtable1() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut hash = Rc::new(ShardedHashtable::new(4, 64).unwrap()).unwrap();
+			for i in 0..32 {
+				let v = Ptr::alloc(Node::new(TestValue { k: i, v: i + 100 })).unwrap();
+				assert!(hash.insert(v));
+			}
+			let dup = Ptr::alloc(Node::new(TestValue { k: 7, v: 0 })).unwrap();
+			assert!(!hash.insert(dup));
+			dup.release();
+
+			// concurrent readers across a shared clone
+			// SAFETY: clone does not fail for rc
+			let hash_clone = hash.clone().unwrap();
+			let mut jh = spawnj(move || {
+				for i in 0..32 {
+					assert_eq!(hash_clone.find(&i.into()).unwrap().v, i + 100);
+				}
+			})
+			.unwrap();
+			for i in 0..32 {
+				assert_eq!(hash.find(&i.into()).unwrap().v, i + 100);
+			}
+			assert!(jh.join().is_ok());
+
+			assert!(hash.find(&99i32.into()).is_none());
+			for i in 0..32 {
+				let n = hash.remove(&i.into()).unwrap();
+				assert_eq!(n.v, i + 100);
+				n.release();
+			}
+			assert!(hash.remove(&0i32.into()).is_none());
+		}
+		assert_eq!(unsafe { getalloccount() }, initial);
+	}
+
+	#[test]
+	fn test_resizing_hashtable1() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut hash = ResizingHashtable::new(4).unwrap();
+			assert_eq!(hash.buckets(), 4);
+
+			// push past the load threshold; every value stays findable
+			// while migrations are in flight
+			for i in 0..256 {
+				let v = Ptr::alloc(Node::new(TestValue { k: i, v: i + 100 })).unwrap();
+				assert!(hash.insert(v));
+				for j in 0..i + 1 {
+					assert_eq!(hash.find(&j.into()).unwrap().v, j + 100);
+				}
+			}
+			assert_eq!(hash.len(), 256);
+			assert!(hash.buckets() >= 256);
+
+			let dup = Ptr::alloc(Node::new(TestValue { k: 7, v: 0 })).unwrap();
+			assert!(!hash.insert(dup));
+			dup.release();
+			assert_eq!(hash.find(&7i32.into()).unwrap().v, 107);
+
+			// drain back down; the table shrinks toward its floor and
+			// the survivors remain reachable through the shrink
+			for i in 0..250 {
+				let n = hash.remove(&i.into()).unwrap();
+				assert_eq!(n.v, i + 100);
+				n.release();
+				for j in i + 1..256 {
+					assert_eq!(hash.find(&j.into()).unwrap().v, j + 100);
+				}
+			}
+			assert_eq!(hash.len(), 6);
+			assert!(hash.remove(&0i32.into()).is_none());
+
+			// shrinks are as incremental as grows, so the table only
+			// steps toward its floor as operations keep arriving; churn
+			// a single key until the halvings complete
+			for _ in 0..400 {
+				let v = Ptr::alloc(Node::new(TestValue { k: 1000, v: 0 })).unwrap();
+				assert!(hash.insert(v));
+				let n = hash.remove(&1000i32.into()).unwrap();
+				n.release();
+			}
+			assert!(hash.buckets() <= 32);
+			for i in 250..256 {
+				assert_eq!(hash.find(&i.into()).unwrap().v, i + 100);
+			}
+
+			for i in 250..256 {
+				let n = hash.remove(&i.into()).unwrap();
+				n.release();
+			}
+			assert_eq!(hash.len(), 0);
+		}
+		assert_eq!(unsafe { getalloccount() }, initial);
+	}
+
+	#[test]
+	fn test_open_hashtable1() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut hash = OpenHashtable::new(1024).unwrap();
+			assert!(hash.insert(TestValue { k: 1, v: 2 }));
+			assert!(!hash.insert(TestValue { k: 1, v: 9 }));
+			assert_eq!(hash.len(), 1);
+
+			let n = hash.find_mut(&1i32.into()).unwrap();
+			assert_eq!(n.v, 2);
+			n.v = 3;
+			assert!(hash.find(&4i32.into()).is_none());
+			let n = hash.find(&1i32.into()).unwrap();
+			assert_eq!(n.v, 3);
+			let n = hash.remove(&1i32.into()).unwrap();
+			assert_eq!(n.v, 3);
+			assert!(hash.remove(&1i32.into()).is_none());
+			assert_eq!(hash.len(), 0);
+		}
+		assert_eq!(unsafe { getalloccount() }, initial);
+	}
+
+	#[test]
+	fn test_open_hashtable_probing() {
+		let initial = unsafe { getalloccount() };
+		{
+			// small table so every insert collides and probes
+			let mut hash = OpenHashtable::new(4).unwrap();
+			for i in 0..4 {
+				assert!(hash.insert(TestValue { k: i, v: i + 10 }));
+			}
+			// full
+			assert!(!hash.insert(TestValue { k: 5, v: 0 }));
+			for i in 0..4 {
+				assert_eq!(hash.find(&i.into()).unwrap().v, i + 10);
+			}
+
+			// backward-shift deletion keeps the rest findable
+			let n = hash.remove(&1i32.into()).unwrap();
+			assert_eq!(n.v, 11);
+			assert!(hash.find(&1i32.into()).is_none());
+			assert_eq!(hash.find(&0i32.into()).unwrap().v, 10);
+			assert_eq!(hash.find(&2i32.into()).unwrap().v, 12);
+			assert_eq!(hash.find(&3i32.into()).unwrap().v, 13);
+			assert_eq!(hash.len(), 3);
+
+			assert!(hash.insert(TestValue { k: 6, v: 16 }));
+			assert_eq!(hash.find(&6i32.into()).unwrap().v, 16);
+		}
+		assert_eq!(unsafe { getalloccount() }, initial);
+	}
+
+	#[test]
+	fn test_hashtable_snapshot() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut hash = Rc::new(Hashtable::new(64).unwrap()).unwrap();
+			for i in 0..32 {
+				let v = Ptr::alloc(Node::new(TestValue { k: i, v: i + 100 })).unwrap();
+				assert!(hash.insert(v));
+			}
+
+			// a snapshot reader walks while a writer clone churns the
+			// table mid-scan; removed nodes are deferred, not freed, so
+			// the walk stays on live memory throughout
+			// SAFETY: clone does not fail for rc
+			let hash_reader = hash.clone().unwrap();
+			let (start_send, start_recv) = channel().unwrap();
+			let (mid_send, mid_recv) = channel().unwrap();
+			let mut jh = spawnj(move || {
+				let mut seen = 0u64;
+				let mut snap = hash_reader.snap();
+				// visit half, then let the writer churn before resuming
+				for _ in 0..16 {
+					assert!(snap.next().is_some());
+					seen += 1;
+				}
+				let _ = start_send.send(());
+				let _ = mid_recv.recv();
+				loop {
+					match snap.next() {
+						CoreOption::Some(n) => {
+							// values stay readable even when the node
+							// was removed (and deferred) mid-scan
+							assert!((*n).v >= 100);
+							seen += 1;
+						}
+						CoreOption::None => break,
+					}
+				}
+				assert!(seen >= 16);
+			})
+			.unwrap();
+
+			let _ = start_recv.recv();
+			// remove everything under the live snapshot, parking the
+			// nodes, and insert a few replacements
+			for i in 0..32 {
+				let n = hash.remove(&i.into()).unwrap();
+				hash.defer(n);
+			}
+			for i in 100..104 {
+				let v = Ptr::alloc(Node::new(TestValue { k: i, v: i + 100 })).unwrap();
+				assert!(hash.insert(v));
+			}
+			let _ = mid_send.send(());
+			assert!(jh.join().is_ok());
+
+			// the first mutation after the last reader leaves drains
+			// the limbo list
+			for i in 100..104 {
+				let n = hash.remove(&i.into()).unwrap();
+				n.release();
+			}
+		}
+		assert_eq!(unsafe { getalloccount() }, initial);
+	}
+
 	#[test]
 	fn test_hashtable_iter() {
 		let mut hash = Hashtable::new(3).unwrap();
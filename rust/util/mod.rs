@@ -1,3 +1,5 @@
 pub mod hashtable;
+pub mod merkle;
 pub mod rbtree;
+pub mod rbtreearena;
 pub mod runtime;
@@ -0,0 +1,569 @@
+use core::marker::Copy;
+use prelude::*;
+
+// slot indices replace the 8-byte parent/left/right pointers of
+// RbTreeNode: half the link memory, and every node lives in one
+// contiguous slab so an in-order scan walks a single allocation
+// instead of chasing heap pointers. NIL is an index, not a pointer,
+// and the color rides the top bit of parent the same way the pointer
+// tree keeps it in the low bit
+pub const RB_ARENA_NIL: u32 = 0x7fffffff;
+const RED_BIT: u32 = 0x80000000;
+
+struct RbArenaNode<V: Ord + Copy> {
+	// slot index of the parent, RB_ARENA_NIL at the root; RED_BIT set
+	// while the node is red
+	parent: u32,
+	left: u32,
+	right: u32,
+	value: V,
+}
+
+/// Arena-backed red-black tree: nodes live in a contiguous slab owned
+/// by the tree and links are u32 slot indices. Compared to [`RbTree`]
+/// this halves link memory, keeps in-order scans on one allocation
+/// (the scans order books care about are memory-latency-bound), and
+/// makes full teardown O(1) — [`RbTreeArena::clear`] drops the whole
+/// population without walking it. The tree owns its values, so
+/// ordering comes from [`Ord`] directly rather than a search closure,
+/// and the Copy bound keeps slot recycling free of drop bookkeeping.
+/// Freed slots are threaded into a free list through their right link
+/// and reused before the slab grows.
+pub struct RbTreeArena<V: Ord + Copy> {
+	slab: Vec<RbArenaNode<V>>,
+	root: u32,
+	free: u32,
+	len: usize,
+}
+
+impl<V: Ord + Copy> RbTreeArena<V> {
+	pub fn new() -> Self {
+		Self {
+			slab: Vec::new(),
+			root: RB_ARENA_NIL,
+			free: RB_ARENA_NIL,
+			len: 0,
+		}
+	}
+
+	pub fn len(&self) -> usize {
+		self.len
+	}
+
+	/// Drops the entire population in O(1): the slab is truncated in
+	/// place with its capacity retained, so a tree that empties and
+	/// refills at the same scale never touches the allocator.
+	pub fn clear(&mut self) {
+		self.slab.truncate(0);
+		self.root = RB_ARENA_NIL;
+		self.free = RB_ARENA_NIL;
+		self.len = 0;
+	}
+
+	fn parent(&self, n: u32) -> u32 {
+		self.slab[n as usize].parent & !RED_BIT
+	}
+
+	fn is_red(&self, n: u32) -> bool {
+		n != RB_ARENA_NIL && self.slab[n as usize].parent & RED_BIT != 0
+	}
+
+	fn is_black(&self, n: u32) -> bool {
+		!self.is_red(n)
+	}
+
+	fn set_parent(&mut self, n: u32, p: u32) {
+		let color = self.slab[n as usize].parent & RED_BIT;
+		self.slab[n as usize].parent = p | color;
+	}
+
+	fn set_red(&mut self, n: u32, red: bool) {
+		if red {
+			self.slab[n as usize].parent |= RED_BIT;
+		} else {
+			self.slab[n as usize].parent &= !RED_BIT;
+		}
+	}
+
+	// pops a recycled slot or grows the slab by one; the new node
+	// arrives red with all links NIL
+	fn alloc_slot(&mut self, value: V) -> Result<u32, Error> {
+		if self.free != RB_ARENA_NIL {
+			let n = self.free;
+			self.free = self.slab[n as usize].right;
+			self.slab[n as usize].parent = RB_ARENA_NIL | RED_BIT;
+			self.slab[n as usize].left = RB_ARENA_NIL;
+			self.slab[n as usize].right = RB_ARENA_NIL;
+			self.slab[n as usize].value = value;
+			return Ok(n);
+		}
+		if self.slab.len() >= RB_ARENA_NIL as usize {
+			return Err(err!(CapacityExceeded));
+		}
+		let n = self.slab.len() as u32;
+		match self.slab.push(RbArenaNode {
+			parent: RB_ARENA_NIL | RED_BIT,
+			left: RB_ARENA_NIL,
+			right: RB_ARENA_NIL,
+			value,
+		}) {
+			Ok(_) => Ok(n),
+			Err(e) => Err(e),
+		}
+	}
+
+	fn free_slot(&mut self, n: u32) {
+		self.slab[n as usize].right = self.free;
+		self.free = n;
+	}
+
+	fn find_idx(&self, value: &V) -> u32 {
+		let mut cur = self.root;
+		while cur != RB_ARENA_NIL {
+			let cmp = value.compare(&self.slab[cur as usize].value);
+			if cmp == 0 {
+				break;
+			} else if cmp < 0 {
+				cur = self.slab[cur as usize].left;
+			} else {
+				cur = self.slab[cur as usize].right;
+			}
+		}
+		cur
+	}
+
+	pub fn find(&self, value: &V) -> Option<V> {
+		let n = self.find_idx(value);
+		if n == RB_ARENA_NIL {
+			None
+		} else {
+			Some(self.slab[n as usize].value)
+		}
+	}
+
+	/// Inserts value, returning the displaced value when one compared
+	/// equal, as [`RbTree::insert`] hands back the replaced node.
+	pub fn insert(&mut self, value: V) -> Result<Option<V>, Error> {
+		let mut parent = RB_ARENA_NIL;
+		let mut cur = self.root;
+		let mut is_right = false;
+		while cur != RB_ARENA_NIL {
+			let cmp = value.compare(&self.slab[cur as usize].value);
+			if cmp == 0 {
+				// equal keys replace in place: no relink, no rebalance
+				let prev = self.slab[cur as usize].value;
+				self.slab[cur as usize].value = value;
+				return Ok(Some(prev));
+			} else if cmp < 0 {
+				parent = cur;
+				is_right = false;
+				cur = self.slab[cur as usize].left;
+			} else {
+				parent = cur;
+				is_right = true;
+				cur = self.slab[cur as usize].right;
+			}
+		}
+		let n = match self.alloc_slot(value) {
+			Ok(n) => n,
+			Err(e) => return Err(e),
+		};
+		self.set_parent(n, parent);
+		if parent == RB_ARENA_NIL {
+			self.root = n;
+		} else if is_right {
+			self.slab[parent as usize].right = n;
+		} else {
+			self.slab[parent as usize].left = n;
+		}
+		self.len += 1;
+		self.insert_fixup(n);
+		Ok(None)
+	}
+
+	/// Removes the node comparing equal to value and returns its
+	/// value; the slot goes to the free list for reuse.
+	pub fn remove(&mut self, value: &V) -> Option<V> {
+		let z = self.find_idx(value);
+		if z == RB_ARENA_NIL {
+			return None;
+		}
+		let ret = self.slab[z as usize].value;
+		let mut y = z;
+		let mut y_was_black = self.is_black(y);
+		let x;
+		let xp;
+		if self.slab[z as usize].left == RB_ARENA_NIL {
+			x = self.slab[z as usize].right;
+			xp = self.parent(z);
+			self.transplant(z, x);
+		} else if self.slab[z as usize].right == RB_ARENA_NIL {
+			x = self.slab[z as usize].left;
+			xp = self.parent(z);
+			self.transplant(z, x);
+		} else {
+			y = self.slab[z as usize].right;
+			while self.slab[y as usize].left != RB_ARENA_NIL {
+				y = self.slab[y as usize].left;
+			}
+			y_was_black = self.is_black(y);
+			x = self.slab[y as usize].right;
+			if self.parent(y) == z {
+				xp = y;
+			} else {
+				xp = self.parent(y);
+				self.transplant(y, x);
+				let zr = self.slab[z as usize].right;
+				self.slab[y as usize].right = zr;
+				self.set_parent(zr, y);
+			}
+			self.transplant(z, y);
+			let zl = self.slab[z as usize].left;
+			self.slab[y as usize].left = zl;
+			self.set_parent(zl, y);
+			let z_red = self.is_red(z);
+			self.set_red(y, z_red);
+		}
+		if y_was_black {
+			self.remove_fixup(x, xp);
+		}
+		self.free_slot(z);
+		self.len -= 1;
+		// xp silences the unused-assignment lint when both fixup-free
+		// paths ran; the compiler cannot see that
+		let _ = xp;
+		Some(ret)
+	}
+
+	/// In-order scan: f sees every value ascending until it returns
+	/// false. The walk follows parent links, so no stack and no
+	/// recursion — with the slab contiguous this is the layout the
+	/// latency-bound scans are for.
+	pub fn scan(&self, f: &mut dyn FnMut(&V) -> bool) {
+		let mut cur = self.root;
+		if cur == RB_ARENA_NIL {
+			return;
+		}
+		while self.slab[cur as usize].left != RB_ARENA_NIL {
+			cur = self.slab[cur as usize].left;
+		}
+		while cur != RB_ARENA_NIL {
+			if !f(&self.slab[cur as usize].value) {
+				return;
+			}
+			let mut next = self.slab[cur as usize].right;
+			if next != RB_ARENA_NIL {
+				while self.slab[next as usize].left != RB_ARENA_NIL {
+					next = self.slab[next as usize].left;
+				}
+			} else {
+				next = self.parent(cur);
+				while next != RB_ARENA_NIL && self.slab[next as usize].right == cur {
+					cur = next;
+					next = self.parent(cur);
+				}
+			}
+			cur = next;
+		}
+	}
+
+	// replaces the subtree rooted at u with the one rooted at v
+	fn transplant(&mut self, u: u32, v: u32) {
+		let p = self.parent(u);
+		if p == RB_ARENA_NIL {
+			self.root = v;
+		} else if self.slab[p as usize].left == u {
+			self.slab[p as usize].left = v;
+		} else {
+			self.slab[p as usize].right = v;
+		}
+		if v != RB_ARENA_NIL {
+			self.set_parent(v, p);
+		}
+	}
+
+	fn rotate_left(&mut self, x: u32) {
+		let y = self.slab[x as usize].right;
+		let yl = self.slab[y as usize].left;
+		self.slab[x as usize].right = yl;
+		if yl != RB_ARENA_NIL {
+			self.set_parent(yl, x);
+		}
+		let xp = self.parent(x);
+		self.set_parent(y, xp);
+		if xp == RB_ARENA_NIL {
+			self.root = y;
+		} else if self.slab[xp as usize].left == x {
+			self.slab[xp as usize].left = y;
+		} else {
+			self.slab[xp as usize].right = y;
+		}
+		self.slab[y as usize].left = x;
+		self.set_parent(x, y);
+	}
+
+	fn rotate_right(&mut self, x: u32) {
+		let y = self.slab[x as usize].left;
+		let yr = self.slab[y as usize].right;
+		self.slab[x as usize].left = yr;
+		if yr != RB_ARENA_NIL {
+			self.set_parent(yr, x);
+		}
+		let xp = self.parent(x);
+		self.set_parent(y, xp);
+		if xp == RB_ARENA_NIL {
+			self.root = y;
+		} else if self.slab[xp as usize].right == x {
+			self.slab[xp as usize].right = y;
+		} else {
+			self.slab[xp as usize].left = y;
+		}
+		self.slab[y as usize].right = x;
+		self.set_parent(x, y);
+	}
+
+	fn insert_fixup(&mut self, mut k: u32) {
+		while k != self.root && self.is_red(self.parent(k)) {
+			let parent = self.parent(k);
+			let gparent = self.parent(parent);
+			if parent == self.slab[gparent as usize].left {
+				let uncle = self.slab[gparent as usize].right;
+				if self.is_red(uncle) {
+					self.set_red(parent, false);
+					self.set_red(uncle, false);
+					self.set_red(gparent, true);
+					k = gparent;
+				} else {
+					if k == self.slab[parent as usize].right {
+						k = parent;
+						self.rotate_left(k);
+					}
+					let parent = self.parent(k);
+					let gparent = self.parent(parent);
+					self.set_red(parent, false);
+					self.set_red(gparent, true);
+					self.rotate_right(gparent);
+				}
+			} else {
+				let uncle = self.slab[gparent as usize].left;
+				if self.is_red(uncle) {
+					self.set_red(parent, false);
+					self.set_red(uncle, false);
+					self.set_red(gparent, true);
+					k = gparent;
+				} else {
+					if k == self.slab[parent as usize].left {
+						k = parent;
+						self.rotate_right(k);
+					}
+					let parent = self.parent(k);
+					let gparent = self.parent(parent);
+					self.set_red(parent, false);
+					self.set_red(gparent, true);
+					self.rotate_left(gparent);
+				}
+			}
+		}
+		let root = self.root;
+		self.set_red(root, false);
+	}
+
+	// x may be NIL, so its parent rides alongside as p
+	fn remove_fixup(&mut self, mut x: u32, mut p: u32) {
+		while x != self.root && self.is_black(x) {
+			if p == RB_ARENA_NIL {
+				break;
+			}
+			if x == self.slab[p as usize].left {
+				let mut w = self.slab[p as usize].right;
+				if self.is_red(w) {
+					self.set_red(w, false);
+					self.set_red(p, true);
+					self.rotate_left(p);
+					w = self.slab[p as usize].right;
+				}
+				if self.is_black(self.slab[w as usize].left)
+					&& self.is_black(self.slab[w as usize].right)
+				{
+					self.set_red(w, true);
+					x = p;
+					p = self.parent(x);
+				} else {
+					if self.is_black(self.slab[w as usize].right) {
+						let wl = self.slab[w as usize].left;
+						self.set_red(wl, false);
+						self.set_red(w, true);
+						self.rotate_right(w);
+						w = self.slab[p as usize].right;
+					}
+					let p_red = self.is_red(p);
+					self.set_red(w, p_red);
+					self.set_red(p, false);
+					let wr = self.slab[w as usize].right;
+					self.set_red(wr, false);
+					self.rotate_left(p);
+					x = self.root;
+					p = RB_ARENA_NIL;
+				}
+			} else {
+				let mut w = self.slab[p as usize].left;
+				if self.is_red(w) {
+					self.set_red(w, false);
+					self.set_red(p, true);
+					self.rotate_right(p);
+					w = self.slab[p as usize].left;
+				}
+				if self.is_black(self.slab[w as usize].left)
+					&& self.is_black(self.slab[w as usize].right)
+				{
+					self.set_red(w, true);
+					x = p;
+					p = self.parent(x);
+				} else {
+					if self.is_black(self.slab[w as usize].left) {
+						let wr = self.slab[w as usize].right;
+						self.set_red(wr, false);
+						self.set_red(w, true);
+						self.rotate_left(w);
+						w = self.slab[p as usize].left;
+					}
+					let p_red = self.is_red(p);
+					self.set_red(w, p_red);
+					self.set_red(p, false);
+					let wl = self.slab[w as usize].left;
+					self.set_red(wl, false);
+					self.rotate_right(p);
+					x = self.root;
+					p = RB_ARENA_NIL;
+				}
+			}
+		}
+		if x != RB_ARENA_NIL {
+			self.set_red(x, false);
+		}
+	}
+}
+
+#[cfg(test)]
+mod test {
+	use super::*;
+	use std::murmur32::murmur3_32_of_u64;
+
+	fn validate_node(
+		tree: &RbTreeArena<u64>,
+		node: u32,
+		mut black_count: Ptr<i32>,
+		mut current_black_count: i32,
+	) {
+		if node == RB_ARENA_NIL {
+			if *black_count == 0 {
+				*black_count = current_black_count;
+			} else {
+				assert_eq!(current_black_count, *black_count);
+			}
+			return;
+		}
+
+		if tree.is_black(node) {
+			current_black_count += 1;
+		} else {
+			assert!(tree.is_black(tree.parent(node)));
+		}
+		validate_node(tree, tree.slab[node as usize].right, black_count, current_black_count);
+		validate_node(tree, tree.slab[node as usize].left, black_count, current_black_count);
+	}
+
+	fn validate_tree(tree: &RbTreeArena<u64>) {
+		let black_count = Ptr::alloc(0).unwrap();
+		if tree.root != RB_ARENA_NIL {
+			assert!(tree.is_black(tree.root));
+			validate_node(tree, tree.root, black_count, 0);
+		}
+		black_count.release();
+	}
+
+	#[test]
+	fn test_rbtree_arena() {
+		let initial = unsafe { crate::ffi::getalloccount() };
+		{
+			let mut tree = RbTreeArena::new();
+			let size = 100u64;
+			for x in 0..5 {
+				let seed = 0x1234 + x;
+				for i in 0..size {
+					let v = murmur3_32_of_u64(i, seed) as u64;
+					assert!(tree.insert(v).unwrap().is_none());
+					validate_tree(&tree);
+				}
+				assert_eq!(tree.len(), size as usize);
+
+				for i in 0..size {
+					let v = murmur3_32_of_u64(i, seed) as u64;
+					assert_eq!(tree.find(&v), Some(v));
+					// replacement hands the displaced value back
+					assert_eq!(tree.insert(v).unwrap(), Some(v));
+				}
+				assert_eq!(tree.len(), size as usize);
+
+				// a scan visits every value in ascending order and can
+				// stop early
+				let mut last = 0u64;
+				let mut count = 0usize;
+				tree.scan(&mut |v: &u64| {
+					assert!(count == 0 || *v > last);
+					last = *v;
+					count += 1;
+					true
+				});
+				assert_eq!(count, size as usize);
+				count = 0;
+				tree.scan(&mut |_v: &u64| {
+					count += 1;
+					count < 10
+				});
+				assert_eq!(count, 10);
+
+				// freed slots recycle: removing half and reinserting
+				// leaves the slab at its high-water length
+				for i in 0..size / 2 {
+					let v = murmur3_32_of_u64(i, seed) as u64;
+					assert_eq!(tree.remove(&v), Some(v));
+					validate_tree(&tree);
+					assert_eq!(tree.find(&v), None);
+				}
+				let high_water = tree.slab.len();
+				for i in 0..size / 2 {
+					let v = murmur3_32_of_u64(i, seed) as u64;
+					assert!(tree.insert(v).unwrap().is_none());
+					validate_tree(&tree);
+				}
+				assert_eq!(tree.slab.len(), high_water);
+
+				for i in 0..size {
+					let v = murmur3_32_of_u64(i, seed) as u64;
+					assert_eq!(tree.remove(&v), Some(v));
+					validate_tree(&tree);
+					assert_eq!(tree.remove(&v), None);
+				}
+				assert_eq!(tree.len(), 0);
+				assert!(tree.root == RB_ARENA_NIL);
+
+				// O(1) teardown between rounds; capacity is retained so
+				// the next round allocates nothing new
+				for i in 0..size {
+					let v = murmur3_32_of_u64(i, seed) as u64;
+					assert!(tree.insert(v).unwrap().is_none());
+				}
+				let a = unsafe { crate::ffi::getalloccount() };
+				tree.clear();
+				for i in 0..size {
+					let v = murmur3_32_of_u64(i, seed) as u64;
+					assert!(tree.insert(v).unwrap().is_none());
+				}
+				assert_eq!(a, unsafe { crate::ffi::getalloccount() });
+				tree.clear();
+			}
+		}
+		assert_eq!(initial, unsafe { crate::ffi::getalloccount() });
+	}
+}
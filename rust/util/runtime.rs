@@ -1,10 +1,124 @@
+use core::marker::Copy;
+use core::mem::{align_of, size_of};
+use core::ops::Fn;
+use core::ptr::{read, write};
+use core::slice::from_raw_parts;
 use prelude::*;
 
-type Task<T> = Box<dyn FnMut() -> T>;
+// closures whose captures fit here are stored by value in the queue
+// entry instead of boxed; sub-microsecond tasks otherwise pay more for
+// the allocation than for the work
+const TASK_INLINE_WORDS: usize = 8;
+
+// a task slot with small-closure optimization. The capture state lives
+// in buf: small closures are written there directly, large ones fall
+// back to a Box whose handle is written there instead, so the queue
+// entry is the same size either way and the trampolines hide which
+// case it is.
+struct Task<T> {
+	buf: [u64; TASK_INLINE_WORDS],
+	call: unsafe fn(*mut u8) -> T,
+	dropfn: unsafe fn(*mut u8),
+}
+
+unsafe fn task_call<T, F: FnMut() -> T>(p: *mut u8) -> T {
+	(*(p as *mut F))()
+}
+
+unsafe fn task_drop<T, F: FnMut() -> T>(p: *mut u8) {
+	let _ = read(p as *mut F);
+}
+
+// the fallback case calls through the box handle (deref, not FnMut)
+unsafe fn task_call_boxed<T>(p: *mut u8) -> T {
+	(*(p as *mut Box<dyn FnMut() -> T>))()
+}
+
+unsafe fn task_drop_boxed<T>(p: *mut u8) {
+	let _ = read(p as *mut Box<dyn FnMut() -> T>);
+}
+
+impl<T> Task<T> {
+	fn new<F: FnMut() -> T + 'static>(task: F) -> Result<Self, Error> {
+		if size_of::<F>() <= size_of::<[u64; TASK_INLINE_WORDS]>()
+			&& align_of::<F>() <= align_of::<u64>()
+		{
+			let mut ret = Task {
+				buf: [0u64; TASK_INLINE_WORDS],
+				call: task_call::<T, F>,
+				dropfn: task_drop::<T, F>,
+			};
+			// SAFETY: the size and alignment checks above guarantee the
+			// capture fits in buf
+			unsafe {
+				write(ret.buf.as_mut_ptr() as *mut F, task);
+			}
+			Ok(ret)
+		} else {
+			let boxed: Box<dyn FnMut() -> T> = match Box::new(task) {
+				Ok(boxed) => boxed,
+				Err(e) => return Err(e),
+			};
+			let mut ret = Task {
+				buf: [0u64; TASK_INLINE_WORDS],
+				call: task_call_boxed::<T>,
+				dropfn: task_drop_boxed::<T>,
+			};
+			// SAFETY: the box handle is a couple of words, well within buf
+			unsafe {
+				write(ret.buf.as_mut_ptr() as *mut Box<dyn FnMut() -> T>, boxed);
+			}
+			Ok(ret)
+		}
+	}
+
+	fn call(&mut self) -> T {
+		// SAFETY: buf holds whatever capture state the matching
+		// trampoline was instantiated for
+		unsafe { (self.call)(self.buf.as_mut_ptr() as *mut u8) }
+	}
+}
+
+impl<T> Drop for Task<T> {
+	fn drop(&mut self) {
+		// SAFETY: same invariant as call; dropping the box handle frees
+		// the heap capture in the fallback case
+		unsafe { (self.dropfn)(self.buf.as_mut_ptr() as *mut u8) }
+	}
+}
+
+// task, result channel, completion flag, enqueue timestamp (micros)
+type TaskEntry<T> = (Task<T>, Sender<T>, Rc<bool>, i64);
+
+/// Priority lane a task is queued on. Dequeue is strict: a worker always
+/// drains High before Normal and Normal before Low, so small
+/// latency-critical tasks are not stuck behind bulk batches that were
+/// submitted earlier.
+#[derive(Clone)]
+pub enum Priority {
+	High,
+	Normal,
+	Low,
+}
+impl Copy for Priority {}
+
+const LANES: usize = 3;
+
+fn lane_index(priority: Priority) -> usize {
+	match priority {
+		Priority::High => 0,
+		Priority::Normal => 1,
+		Priority::Low => 2,
+	}
+}
 
 pub struct RuntimeConfig {
 	pub min_threads: u64,
 	pub max_threads: u64,
+	// when set, tasks are distributed round-robin over per-worker queues
+	// and idle workers steal from siblings instead of contending on one
+	// shared channel. The pool is fixed at min_threads in this mode.
+	pub work_steal: bool,
 }
 
 pub struct Handle<T> {
@@ -17,15 +131,30 @@ struct JhEntry {
 	jh: Option<JoinHandle>,
 }
 
-struct State {
+struct State<T> {
 	total_workers: u64,
 	waiting_workers: u64,
 	halt: bool,
+	counter: u64,
 	jhs: Hashtable<JhEntry>,
+	// one FIFO per priority, guarded by the runtime lock. Tasks queue
+	// here and a Ticket on the shared channel wakes a worker, which pops
+	// from the highest non-empty lane.
+	lanes: Vec<Vec<TaskEntry<T>>>,
+	// latency histograms shared by all workers; records are atomic so
+	// they are updated outside the runtime lock
+	hist_queue: Histogram,
+	hist_chan: Histogram,
+	// pending timers as a binary min-heap on (deadline micros, entry),
+	// guarded by the runtime lock. One timer thread sleeps against the
+	// top and dispatches due entries onto the lanes, so an outstanding
+	// timeout costs a heap slot instead of a sleeping thread's stack
+	timers: Vec<(i64, Ptr<TaskEntry<T>>)>,
 }
 
 enum Message<T> {
-	Task((Task<T>, Sender<T>, Rc<bool>)),
+	Task(TaskEntry<T>),
+	Ticket,
 	Halt,
 }
 
@@ -33,9 +162,30 @@ pub struct Runtime<T> {
 	config: RuntimeConfig,
 	send: Sender<Message<T>>,
 	recv: Receiver<Message<T>>,
-	state: Rc<State>,
+	wsend: Vec<Sender<Message<T>>>,
+	wrecv: Vec<Receiver<Message<T>>>,
+	state: Rc<State<T>>,
 	lock: LockBox,
-	counter: u64,
+	rr: u64,
+	// nudge channel for the timer thread: a send wakes it to rescan
+	// the heap after an arm or a halt
+	tsend: Sender<()>,
+	trecv: Receiver<()>,
+}
+
+// Handle a task can move into its closure to wrap a blocking section.
+// block_in_place takes the calling worker out of the pool accounting for
+// the duration of the section and, when no idle worker remains, stands up
+// a replacement (up to max_threads) so the queue keeps draining while the
+// section blocks. In work_steal mode the pool is fixed, so the section
+// simply runs inline.
+pub struct Blocker<T> {
+	recv: Receiver<Message<T>>,
+	state: Rc<State<T>>,
+	lock: LockBox,
+	min: u64,
+	max: u64,
+	work_steal: bool,
 }
 
 impl PartialEq for JhEntry {
@@ -55,6 +205,7 @@ impl Default for RuntimeConfig {
 		Self {
 			min_threads: 4,
 			max_threads: 8,
+			work_steal: false,
 		}
 	}
 }
@@ -75,6 +226,56 @@ impl<T> Handle<T> {
 	}
 }
 
+impl<T> Blocker<T> {
+	// Run f, which is expected to block (e.g. a synchronous channel
+	// recv), without cutting pool throughput. Must only be called from
+	// inside a task executing on the runtime: the calling worker leaves
+	// the pool accounting while f runs and rejoins afterwards; the
+	// existing retire logic sheds any excess workers once things settle.
+	pub fn block_in_place<F, R>(&mut self, mut f: F) -> R
+	where
+		F: FnMut() -> R,
+	{
+		if self.work_steal {
+			return f();
+		}
+		let mut do_spawn = false;
+		{
+			let _l = self.lock.write();
+			self.state.total_workers -= 1;
+			if self.state.waiting_workers == 0
+				&& self.state.total_workers < self.max
+				&& !self.state.halt
+			{
+				self.state.total_workers += 1;
+				do_spawn = true;
+			}
+		}
+		if do_spawn {
+			// SAFETY: unwraps are ok because clone does not fail for
+			// rc, lock, and channels
+			match Runtime::worker(
+				self.recv.clone().unwrap(),
+				self.state.clone().unwrap(),
+				self.lock.clone().unwrap(),
+				self.min,
+				self.max,
+			) {
+				Ok(_) => {}
+				Err(e) => {
+					println!("WARN: Could not start replacement thread: ", e)
+				}
+			}
+		}
+		let ret = f();
+		{
+			let _l = self.lock.write();
+			self.state.total_workers += 1;
+		}
+		ret
+	}
+}
+
 impl<T> Runtime<T> {
 	pub fn new(config: RuntimeConfig) -> Result<Self, Error> {
 		let (send, recv) = match channel() {
@@ -85,11 +286,23 @@ impl<T> Runtime<T> {
 			Ok(jhs) => jhs,
 			Err(e) => return Err(e),
 		};
+		let mut lanes = Vec::new();
+		for _i in 0..LANES {
+			match lanes.push(Vec::new()) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			}
+		}
 		let state = match Rc::new(State {
 			waiting_workers: 0,
 			total_workers: config.min_threads,
 			halt: false,
+			counter: 0,
 			jhs,
+			lanes,
+			hist_queue: Histogram::new(),
+			hist_chan: Histogram::new(),
+			timers: Vec::new(),
 		}) {
 			Ok(state) => state,
 			Err(e) => return Err(e),
@@ -98,14 +311,22 @@ impl<T> Runtime<T> {
 			Ok(lock) => lock,
 			Err(e) => return Err(e),
 		};
+		let (tsend, trecv) = match channel() {
+			Ok((tsend, trecv)) => (tsend, trecv),
+			Err(e) => return Err(e),
+		};
 
 		Ok(Self {
 			config,
 			send,
 			recv,
+			wsend: Vec::new(),
+			wrecv: Vec::new(),
 			state,
 			lock,
-			counter: 0,
+			rr: 0,
+			tsend,
+			trecv,
 		})
 	}
 
@@ -118,13 +339,38 @@ impl<T> Runtime<T> {
 				return Err(err!(NotInitialized));
 			}
 		}
+		if self.config.work_steal {
+			for _i in 0..self.config.min_threads {
+				let (send, recv) = match channel() {
+					Ok((send, recv)) => (send, recv),
+					Err(e) => return Err(e),
+				};
+				match self.wsend.push(send) {
+					Ok(_) => {}
+					Err(e) => return Err(e),
+				}
+				match self.wrecv.push(recv) {
+					Ok(_) => {}
+					Err(e) => return Err(e),
+				}
+			}
+			for i in 0..self.config.min_threads as usize {
+				match self.steal_thread(i) {
+					Ok(_) => {}
+					Err(e) => return Err(e),
+				}
+			}
+			// after wsend is built so due timers can dispatch onto the
+			// per-worker queues
+			return self.timer_thread();
+		}
 		for _i in 0..self.config.min_threads {
 			match self.thread(self.config.min_threads, self.config.max_threads) {
 				Ok(_) => {}
 				Err(e) => return Err(e),
 			}
 		}
-		Ok(())
+		self.timer_thread()
 	}
 
 	pub fn stop(&mut self) -> Result<(), Error> {
@@ -141,6 +387,17 @@ impl<T> Runtime<T> {
 				Err(e) => return Err(e),
 			}
 		}
+		for wsend in &self.wsend {
+			match wsend.send(Message::Halt) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			}
+		}
+		// a parked timer thread is blocked on the nudge channel
+		match self.tsend.send(()) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
 		for mut ent in &self.state.jhs {
 			match &mut (*ent).value.jh {
 				Some(entry) => {
@@ -148,13 +405,36 @@ impl<T> Runtime<T> {
 				}
 				None => {}
 			}
-			ent.release();
+			ent.release_slab();
+		}
+		// timers still pending at shutdown never fire; release their
+		// entries so the captures and result channels free
+		while self.state.timers.len() > 0 {
+			let ptr = Self::timer_pop(&mut self.state);
+			// SAFETY: the entry is moved out by value and the slab slot
+			// freed without a second drop
+			let _entry = unsafe { read(ptr.raw() as *const TaskEntry<T>) };
+			ptr.release_slab();
 		}
 
 		Ok(())
 	}
 
 	pub fn execute<F>(&mut self, task: F) -> Result<Handle<T>, Error>
+	where
+		F: FnMut() -> T + 'static,
+	{
+		self.execute_with_priority(task, Priority::Normal)
+	}
+
+	// Queue a task on the given priority lane. Lanes apply to the shared
+	// pool; in work_steal mode tasks keep their per-worker round-robin
+	// placement and the priority is ignored.
+	pub fn execute_with_priority<F>(
+		&mut self,
+		task: F,
+		priority: Priority,
+	) -> Result<Handle<T>, Error>
 	where
 		F: FnMut() -> T + 'static,
 	{
@@ -174,12 +454,90 @@ impl<T> Runtime<T> {
 		};
 		// SAFETY: rc.clone always succeeds
 		let rc_clone = rc.clone().unwrap();
-		let task = match Box::new(task) {
+		let task = match Task::new(task) {
 			Ok(task) => task,
 			Err(e) => return Err(e),
 		};
-		let msg = Message::Task((task, send, rc));
-		match self.send.send(msg) {
+		let queued = unsafe { crate::ffi::getmicros() };
+		if self.config.work_steal && self.wsend.len() > 0 {
+			let idx = rem_usize(aadd!(&mut self.rr, 1) as usize, self.wsend.len());
+			match self.wsend[idx].send(Message::Task((task, send, rc, queued))) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			}
+		} else {
+			{
+				let _l = self.lock.write();
+				match self.state.lanes[lane_index(priority)].push((task, send, rc, queued)) {
+					Ok(_) => {}
+					Err(e) => return Err(e),
+				}
+			}
+			match self.send.send(Message::Ticket) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			}
+		}
+		Ok(Handle {
+			channel: recv,
+			is_complete: rc_clone,
+		})
+	}
+
+	/// Queue a task to run on the pool once delay_millis have elapsed.
+	/// Pending timers sit in a heap serviced by one timer thread, so
+	/// any number of outstanding timeouts costs one thread rather than
+	/// a sleeping thread each. A due task dispatches onto the Normal
+	/// lane (the per-worker queues in work_steal mode) and competes
+	/// like any other task; the handle behaves as with execute. Timers
+	/// still pending when the runtime stops are dropped unfired.
+	pub fn execute_after<F>(&mut self, delay_millis: u64, task: F) -> Result<Handle<T>, Error>
+	where
+		F: FnMut() -> T + 'static,
+	{
+		{
+			let _l = self.lock.read();
+			if self.state.halt {
+				return Err(err!(NotInitialized));
+			}
+		}
+		let (send, recv) = match channel() {
+			Ok((send, recv)) => (send, recv),
+			Err(e) => return Err(e),
+		};
+		let rc = match Rc::new(false) {
+			Ok(rc) => rc,
+			Err(e) => return Err(e),
+		};
+		// SAFETY: rc.clone always succeeds
+		let rc_clone = rc.clone().unwrap();
+		let task = match Task::new(task) {
+			Ok(task) => task,
+			Err(e) => return Err(e),
+		};
+		let deadline = unsafe { crate::ffi::getmicros() } + (delay_millis * 1000) as i64;
+		// the timestamp slot is rewritten at dispatch so hist_queue
+		// keeps measuring queue wait, not the armed delay
+		let ptr = match Ptr::alloc((task, send, rc, deadline)) {
+			Ok(ptr) => ptr,
+			Err(e) => return Err(e),
+		};
+		let pushed = {
+			let _l = self.lock.write();
+			Self::timer_push(&mut self.state, deadline, ptr)
+		};
+		match pushed {
+			Ok(_) => {}
+			Err(e) => {
+				// SAFETY: the entry never entered the heap; move it back
+				// out so the capture and channel free exactly once
+				let _entry = unsafe { read(ptr.raw() as *const TaskEntry<T>) };
+				ptr.release_slab();
+				return Err(e);
+			}
+		}
+		// wake the timer thread in case this deadline is the new top
+		match self.tsend.send(()) {
 			Ok(_) => {}
 			Err(e) => return Err(e),
 		}
@@ -189,6 +547,186 @@ impl<T> Runtime<T> {
 		})
 	}
 
+	/// Scoped parallel map over a slice: data splits into one chunk per
+	/// worker, f runs against each chunk on the pool, and the call
+	/// returns the per-chunk results in slice order once every chunk
+	/// has completed — a single join point instead of a handle per
+	/// chunk. f borrows its chunk and may borrow surrounding state:
+	/// the call blocks until all chunks finish, so nothing moves into
+	/// the tasks. The chunks run concurrently, so f must be safe to
+	/// call from several workers at once; that is the caller's
+	/// contract, as ordering is for the tree search closures.
+	pub fn map_slice<V, F>(&mut self, data: &[V], f: F) -> Result<Vec<T>, Error>
+	where
+		F: Fn(&[V]) -> T,
+	{
+		let mut ret = Vec::new();
+		if data.len() == 0 {
+			return Ok(ret);
+		}
+		let workers = self.config.min_threads as usize;
+		let chunks = if data.len() < workers {
+			data.len()
+		} else {
+			workers
+		};
+		let chunk = data.len() / chunks;
+		let rem = data.len() % chunks;
+		// the tasks see the borrow through raw words, which keeps the
+		// queue's 'static bound satisfied; joining below is what makes
+		// that sound
+		let base = data.as_ptr() as usize;
+		let fp = &f as *const F as usize;
+		let mut handles = Vec::new();
+		let mut off = 0usize;
+		let mut err = None;
+		for i in 0..chunks {
+			let len = if i < rem { chunk + 1 } else { chunk };
+			let o = off;
+			off += len;
+			let submitted = self.execute(move || {
+				// SAFETY: map_slice joins every handle before returning,
+				// so f and data outlive the task
+				let f = unsafe { &*(fp as *const F) };
+				let s = unsafe { from_raw_parts((base as *const V).add(o), len) };
+				f(s)
+			});
+			match submitted {
+				Ok(h) => match handles.push(h) {
+					Ok(_) => {}
+					Err(e) => {
+						err = Some(e);
+						break;
+					}
+				},
+				Err(e) => {
+					err = Some(e);
+					break;
+				}
+			}
+		}
+		// join everything that was submitted even on a partial failure;
+		// returning with chunks in flight would dangle the borrows
+		for i in 0..handles.len() {
+			let v = handles[i].block_on();
+			if err.is_none() {
+				match ret.push(v) {
+					Ok(_) => {}
+					Err(e) => err = Some(e),
+				}
+			}
+		}
+		match err {
+			Some(e) => Err(e),
+			None => Ok(ret),
+		}
+	}
+
+	// binary min-heap on (deadline, entry) pairs; the pairs are plain
+	// copies so sifting never touches the entries themselves. Callers
+	// hold the runtime lock.
+	fn timer_push(
+		state: &mut Rc<State<T>>,
+		deadline: i64,
+		ptr: Ptr<TaskEntry<T>>,
+	) -> Result<(), Error> {
+		match state.timers.push((deadline, ptr)) {
+			Ok(_) => {}
+			Err(e) => return Err(e),
+		}
+		let mut i = state.timers.len() - 1;
+		while i > 0 {
+			let p = (i - 1) / 2;
+			if state.timers[p].0 <= state.timers[i].0 {
+				break;
+			}
+			let tmp = state.timers[p];
+			state.timers[p] = state.timers[i];
+			state.timers[i] = tmp;
+			i = p;
+		}
+		Ok(())
+	}
+
+	// pops the earliest deadline; the heap must be non-empty
+	fn timer_pop(state: &mut Rc<State<T>>) -> Ptr<TaskEntry<T>> {
+		let ret = state.timers[0].1;
+		let n = state.timers.len();
+		state.timers[0] = state.timers[n - 1];
+		state.timers.truncate(n - 1);
+		let mut i = 0;
+		loop {
+			let l = i * 2 + 1;
+			let r = l + 1;
+			let mut min = i;
+			if l < n - 1 && state.timers[l].0 < state.timers[min].0 {
+				min = l;
+			}
+			if r < n - 1 && state.timers[r].0 < state.timers[min].0 {
+				min = r;
+			}
+			if min == i {
+				break;
+			}
+			let tmp = state.timers[min];
+			state.timers[min] = state.timers[i];
+			state.timers[i] = tmp;
+			i = min;
+		}
+		ret
+	}
+
+	// pop the front entry of the highest non-empty lane. One Ticket is
+	// sent per queued task, so a ticket always finds an entry unless a
+	// concurrent ticket already claimed a higher lane's entry on its
+	// behalf; the counts still match overall.
+	fn pop_lane(state: &mut Rc<State<T>>, lock: &LockBox) -> Option<TaskEntry<T>> {
+		let _l = lock.write();
+		for i in 0..state.lanes.len() {
+			if state.lanes[i].len() > 0 {
+				// SAFETY: the entry is moved out by value; shift only
+				// copies the remaining bytes down, so nothing is
+				// dropped twice
+				let entry =
+					unsafe { read(state.lanes[i].as_ptr() as *const TaskEntry<T>) };
+				let _ = state.lanes[i].shift(1);
+				return Some(entry);
+			}
+		}
+		None
+	}
+
+	// create a handle tasks can move into their closures to wrap
+	// blocking sections (see Blocker::block_in_place)
+	pub fn blocker(&self) -> Blocker<T> {
+		// SAFETY: unwraps are ok because clone does not fail for rc,
+		// lock, and channels
+		Blocker {
+			recv: self.recv.clone().unwrap(),
+			state: self.state.clone().unwrap(),
+			lock: self.lock.clone().unwrap(),
+			min: self.config.min_threads,
+			max: self.config.max_threads,
+			work_steal: self.config.work_steal,
+		}
+	}
+
+	/// Snapshot of how long tasks sat queued (micros between
+	/// execute and a worker picking the task up)
+	pub fn queue_latency(&self) -> Histogram {
+		let mut ret = Histogram::new();
+		ret.merge(&self.state.hist_queue);
+		ret
+	}
+
+	/// Snapshot of how long workers sat blocked on the shared channel
+	/// waiting for a ticket (idle time between tasks)
+	pub fn chan_wait_latency(&self) -> Histogram {
+		let mut ret = Histogram::new();
+		ret.merge(&self.state.hist_chan);
+		ret
+	}
+
 	#[cfg(test)]
 	fn cur_threads(&self) -> u64 {
 		let _l = self.lock.read();
@@ -201,16 +739,234 @@ impl<T> Runtime<T> {
 		self.state.waiting_workers
 	}
 
+	fn steal_thread(&mut self, index: usize) -> Result<(), Error> {
+		let n = self.wrecv.len();
+		// SAFETY: unwraps are ok because clone does not fail for channels
+		let own = self.wrecv[index].clone().unwrap();
+		let mut recvs = Vec::new();
+		let mut sends = Vec::new();
+		for i in 0..n {
+			match recvs.push(self.wrecv[i].clone().unwrap()) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			}
+			match sends.push(self.wsend[i].clone().unwrap()) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			}
+		}
+		let mut state_clone = self.state.clone().unwrap();
+		let mut hstate = self.state.clone().unwrap();
+		let lock_clone = self.lock.clone().unwrap();
+		let id = aadd!(&mut state_clone.counter, 1);
+
+		let jh = match spawnj(move || loop {
+			let mut msg = own.try_recv();
+			if msg.is_none() {
+				// own queue is empty, scan siblings for work
+				for j in 1..n {
+					let v = rem_usize(index + j, n);
+					match recvs[v].try_recv() {
+						Some(Message::Halt) => {
+							// halts are addressed to the owner; put it
+							// back so the owner wakes too
+							let _ = sends[v].send(Message::Halt);
+							msg = Some(Message::Halt);
+							break;
+						}
+						Some(m) => {
+							msg = Some(m);
+							break;
+						}
+						None => {}
+					}
+				}
+			}
+			let msg = match msg {
+				Some(msg) => msg,
+				// nothing anywhere. parking on our own queue would
+				// miss work queued behind a stalled sibling, so back
+				// off briefly and rescan instead
+				None => {
+					unsafe {
+						crate::ffi::sleep_millis(1);
+					}
+					continue;
+				}
+			};
+			match msg {
+				Message::Task(mut t) => {
+					hstate
+						.hist_queue
+						.record((unsafe { crate::ffi::getmicros() } - t.3) as u64);
+					let res = t.0.call();
+					*t.2 = true;
+					match t.1.send(res) {
+						Ok(_) => {}
+						Err(e) => {
+							println!("WARN: could not send result: ", e);
+						}
+					}
+				}
+				// tickets are only produced for the shared pool
+				Message::Ticket => {}
+				Message::Halt => break,
+			}
+		}) {
+			Ok(jh) => jh,
+			Err(e) => {
+				return Err(e);
+			}
+		};
+
+		let _l = lock_clone.write();
+		let jhent = JhEntry { jh: Some(jh), id };
+		let ptr = match Ptr::alloc(Node::new(jhent)) {
+			Ok(ptr) => ptr,
+			Err(e) => return Err(e),
+		};
+		state_clone.jhs.insert(ptr);
+
+		Ok(())
+	}
+
+	// the single thread behind execute_after: sleeps against the top of
+	// the timer heap, dispatches due entries to the pool, and parks on
+	// the nudge channel while the heap is empty
+	fn timer_thread(&mut self) -> Result<(), Error> {
+		// SAFETY: unwraps are ok because clone does not fail for rc,
+		// lock, and channels
+		let mut state = self.state.clone().unwrap();
+		let mut state_clone = self.state.clone().unwrap();
+		let lock = self.lock.clone().unwrap();
+		let lock_clone = self.lock.clone().unwrap();
+		let trecv = self.trecv.clone().unwrap();
+		let send = self.send.clone().unwrap();
+		let mut wsends = Vec::new();
+		for i in 0..self.wsend.len() {
+			match wsends.push(self.wsend[i].clone().unwrap()) {
+				Ok(_) => {}
+				Err(e) => return Err(e),
+			}
+		}
+		let id = aadd!(&mut state_clone.counter, 1);
+
+		let jh = match spawnj(move || {
+			let mut rr = 0usize;
+			loop {
+				{
+					let _l = lock.write();
+					if state.halt {
+						break;
+					}
+				}
+				let now = unsafe { crate::ffi::getmicros() };
+				let mut armed = false;
+				loop {
+					let due = {
+						let _l = lock.write();
+						if state.timers.len() == 0 {
+							None
+						} else if state.timers[0].0 <= now {
+							Some(Self::timer_pop(&mut state))
+						} else {
+							armed = true;
+							None
+						}
+					};
+					let ptr = match due {
+						Some(ptr) => ptr,
+						None => break,
+					};
+					// SAFETY: the entry is moved out by value and the
+					// slab slot freed without a second drop
+					let mut entry = unsafe { read(ptr.raw() as *const TaskEntry<T>) };
+					ptr.release_slab();
+					entry.3 = unsafe { crate::ffi::getmicros() };
+					if wsends.len() > 0 {
+						rr += 1;
+						match wsends[rem_usize(rr, wsends.len())].send(Message::Task(entry)) {
+							Ok(_) => {}
+							Err(e) => {
+								println!("WARN: could not dispatch timer: ", e);
+							}
+						}
+					} else {
+						let pushed = {
+							let _l = lock.write();
+							state.lanes[lane_index(Priority::Normal)].push(entry)
+						};
+						match pushed {
+							Ok(_) => {
+								let _ = send.send(Message::Ticket);
+							}
+							Err(e) => {
+								println!("WARN: could not dispatch timer: ", e);
+							}
+						}
+					}
+				}
+				if armed {
+					// a 1ms tick bounds both how late a due timer fires
+					// and how long a newly armed earlier deadline waits;
+					// drain any nudges so they do not pile up
+					while trecv.try_recv().is_some() {}
+					unsafe {
+						crate::ffi::sleep_millis(1);
+					}
+				} else {
+					// empty heap: park until an arm or a halt
+					trecv.recv();
+				}
+			}
+		}) {
+			Ok(jh) => jh,
+			Err(e) => {
+				return Err(e);
+			}
+		};
+
+		let _l = lock_clone.write();
+		let jhent = JhEntry { jh: Some(jh), id };
+		let ptr = match Ptr::alloc(Node::new(jhent)) {
+			Ok(ptr) => ptr,
+			Err(e) => return Err(e),
+		};
+		state_clone.jhs.insert(ptr);
+
+		Ok(())
+	}
+
 	fn thread(&mut self, min: u64, max: u64) -> Result<(), Error> {
-		let id = aadd!(&mut self.counter, 1);
 		// SAFETY: unwraps are ok because they are clone for rc, lock, and channels
 		// which do not fail
-		let recv = self.recv.clone().unwrap();
-		let mut state = self.state.clone().unwrap();
+		Self::worker(
+			self.recv.clone().unwrap(),
+			self.state.clone().unwrap(),
+			self.lock.clone().unwrap(),
+			min,
+			max,
+		)
+	}
+
+	fn worker(
+		recv: Receiver<Message<T>>,
+		mut state: Rc<State<T>>,
+		lock: LockBox,
+		min: u64,
+		max: u64,
+	) -> Result<(), Error> {
+		let id = aadd!(&mut state.counter, 1);
+		// SAFETY: unwraps are ok because they are clone for rc, lock, and channels
+		// which do not fail
 		let mut state_clone = state.clone().unwrap();
-		let lock = self.lock.clone().unwrap();
 		let lock_clone = lock.clone().unwrap();
 
+		// hold the lock across the spawn: the new thread's first act is
+		// to contend on it, so the jh entry below lands in state.jhs
+		// before the worker can reach the retire branch and remove it
+		let _l = lock_clone.write();
+
 		let jh = match spawnj(move || loop {
 			{
 				let _l = lock.write();
@@ -223,13 +979,13 @@ impl<T> Runtime<T> {
 						state.total_workers -= 1;
 						state.waiting_workers -= 1;
 						let jhent = state.jhs.remove(&JhEntry { id, jh: None }).unwrap();
-						jhent.release();
+						jhent.release_slab();
 						break;
 					}
 				}
 			}
-			match recv.recv() {
-				Message::Task(mut t) => {
+			match recv.recv_timed(&mut state.hist_chan) {
+				Message::Ticket => {
 					{
 						let mut do_spawn = false;
 						{
@@ -244,7 +1000,15 @@ impl<T> Runtime<T> {
 							}
 						}
 						if do_spawn {
-							match self.thread(min, max) {
+							// SAFETY: unwraps are ok because clone does
+							// not fail for rc, lock, and channels
+							match Self::worker(
+								recv.clone().unwrap(),
+								state.clone().unwrap(),
+								lock.clone().unwrap(),
+								min,
+								max,
+							) {
 								Ok(_) => {}
 								Err(e) => {
 									println!("WARN: Could not start additional thread: ", e)
@@ -252,7 +1016,34 @@ impl<T> Runtime<T> {
 							}
 						}
 					}
-					let res = t.0();
+					match Self::pop_lane(&mut state, &lock) {
+						Some(mut t) => {
+							state
+								.hist_queue
+								.record((unsafe { crate::ffi::getmicros() } - t.3) as u64);
+							let res = t.0.call();
+							*t.2 = true;
+							match t.1.send(res) {
+								Ok(_) => {}
+								Err(e) => {
+									println!("WARN: could not send result: ", e);
+								}
+							}
+						}
+						None => {}
+					}
+				}
+				// the shared channel only carries tickets; direct task
+				// messages ride the per-worker work_steal queues
+				Message::Task(mut t) => {
+					{
+						let _l = lock.write();
+						state.waiting_workers -= 1;
+					}
+					state
+						.hist_queue
+						.record((unsafe { crate::ffi::getmicros() } - t.3) as u64);
+					let res = t.0.call();
 					*t.2 = true;
 					match t.1.send(res) {
 						Ok(_) => {}
@@ -270,7 +1061,6 @@ impl<T> Runtime<T> {
 			}
 		};
 
-		let _l = lock_clone.write();
 		let jhent = JhEntry { jh: Some(jh), id };
 		let ptr = match Ptr::alloc(Node::new(jhent)) {
 			Ok(ptr) => ptr,
@@ -323,11 +1113,167 @@ mod test {
 		assert_eq!(initial, unsafe { getalloccount() });
 	}
 
+	#[test]
+	fn test_runtime_task_inline() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut x = Runtime::new(RuntimeConfig::default()).unwrap();
+			assert!(x.start().is_ok());
+			// a small capture rides inline in the queue entry
+			let small = 42u64;
+			let h = x.execute(move || -> u64 { small }).unwrap();
+			assert_eq!(h.block_on(), 42);
+			// a capture larger than the inline buffer takes the boxed
+			// fallback and still runs and frees correctly
+			let big = [7u64; 32];
+			let h = x
+				.execute(move || -> u64 {
+					let mut sum = 0u64;
+					for i in 0..big.len() {
+						sum += big[i];
+					}
+					sum
+				})
+				.unwrap();
+			assert_eq!(h.block_on(), 7 * 32);
+			assert!(x.stop().is_ok());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_runtime_latency_stats() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut x = Runtime::new(RuntimeConfig::default()).unwrap();
+			assert!(x.start().is_ok());
+			assert_eq!(x.queue_latency().count(), 0);
+			for _ in 0..10 {
+				let h = x.execute(move || -> i32 { 1 }).unwrap();
+				assert_eq!(h.block_on(), 1);
+			}
+			// one queue-to-run sample per executed task
+			let q = x.queue_latency();
+			assert_eq!(q.count(), 10);
+			// an idle pool picks tasks up in well under a second
+			assert!(q.percentile(100) < 1_000_000);
+			// each ticket receipt records one channel wait
+			assert!(x.chan_wait_latency().count() >= 10);
+			assert!(x.stop().is_ok());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_runtime_map_slice() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut x = Runtime::new(RuntimeConfig::default()).unwrap();
+			assert!(x.start().is_ok());
+
+			let mut data = Vec::new();
+			for i in 0..10_000u64 {
+				data.push(i).unwrap();
+			}
+			// the chunks borrow data and the closure borrows bias; both
+			// live on this frame, which the single join point allows
+			let bias = 1u64;
+			let sums = x
+				.map_slice(data.as_slice(), |chunk: &[u64]| -> u64 {
+					let mut s = 0u64;
+					for i in 0..chunk.len() {
+						s += chunk[i] * bias;
+					}
+					s
+				})
+				.unwrap();
+			// one chunk per worker at the default pool size
+			assert_eq!(sums.len(), 4);
+			let mut total = 0u64;
+			for i in 0..sums.len() {
+				total += sums[i];
+			}
+			assert_eq!(total, 9999 * 10_000 / 2);
+
+			// fewer elements than workers: one element per chunk, in
+			// slice order
+			let small = [7u64, 8, 9];
+			let out = x
+				.map_slice(&small, |chunk: &[u64]| -> u64 { chunk[0] })
+				.unwrap();
+			assert_eq!(out.len(), 3);
+			for i in 0..3 {
+				assert_eq!(out[i], small[i]);
+			}
+
+			// an empty slice is a no-op
+			let out = x
+				.map_slice(&[] as &[u64], |_chunk: &[u64]| -> u64 { 0 })
+				.unwrap();
+			assert_eq!(out.len(), 0);
+
+			assert!(x.stop().is_ok());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_runtime_execute_after() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut x = Runtime::new(RuntimeConfig::default()).unwrap();
+			assert!(x.start().is_ok());
+
+			// a single delayed task fires no earlier than its deadline
+			let start = unsafe { crate::ffi::getmicros() };
+			let h = x
+				.execute_after(50, move || -> i64 { unsafe { crate::ffi::getmicros() } })
+				.unwrap();
+			assert!(h.block_on() - start >= 50_000);
+
+			// many outstanding timers share the one timer thread; armed
+			// out of deadline order they all fire, each past its own
+			let mut handles = Vec::new();
+			let start = unsafe { crate::ffi::getmicros() };
+			for i in 0..10u64 {
+				let h = x
+					.execute_after(50 - i * 5, move || -> i64 {
+						unsafe { crate::ffi::getmicros() }
+					})
+					.unwrap();
+				handles.push(h).unwrap();
+			}
+			for i in 0..10u64 {
+				let fired = handles[i as usize].block_on();
+				assert!(fired - start >= ((50 - i * 5) * 1000) as i64);
+			}
+
+			assert!(x.stop().is_ok());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_runtime_execute_after_stop() {
+		let initial = unsafe { getalloccount() };
+		{
+			let mut x: Runtime<()> = Runtime::new(RuntimeConfig::default()).unwrap();
+			assert!(x.start().is_ok());
+			// a timer still pending at stop is dropped unfired and its
+			// entry released
+			let h = x.execute_after(60_000, move || {}).unwrap();
+			assert!(x.stop().is_ok());
+			assert!(!h.is_complete());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
 	#[test]
 	fn test_runtime2() {
 		let config = RuntimeConfig {
 			min_threads: 2,
 			max_threads: 3,
+			..RuntimeConfig::default()
 		};
 		let mut x: Runtime<()> = Runtime::new(config).unwrap();
 		assert!(x.start().is_ok());
@@ -370,6 +1316,158 @@ mod test {
 		assert!(x.stop().is_ok());
 	}
 
+	#[test]
+	fn test_runtime_steal() {
+		let initial = unsafe { getalloccount() };
+		{
+			let config = RuntimeConfig {
+				min_threads: 2,
+				max_threads: 2,
+				work_steal: true,
+			};
+			let mut x: Runtime<()> = Runtime::new(config).unwrap();
+			assert!(x.start().is_ok());
+
+			// stall one worker so its queued tasks must be stolen
+			let (stall_send, stall_recv) = channel().unwrap();
+			let stalled = x
+				.execute(move || {
+					stall_recv.recv();
+				})
+				.unwrap();
+
+			let mut handles = Vec::new();
+			for i in 0..4 {
+				let h = x
+					.execute(move || {
+						let _v = i;
+					})
+					.unwrap();
+				let _ = handles.push(h);
+			}
+
+			// round robin queued some of these behind the stalled worker;
+			// the free worker must steal them to complete
+			for i in 0..handles.len() {
+				handles[i].block_on();
+			}
+
+			stall_send.send(()).unwrap();
+			stalled.block_on();
+
+			assert!(x.stop().is_ok());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_runtime_priority() {
+		let initial = unsafe { getalloccount() };
+		{
+			let config = RuntimeConfig {
+				min_threads: 1,
+				max_threads: 1,
+				..RuntimeConfig::default()
+			};
+			let mut x: Runtime<()> = Runtime::new(config).unwrap();
+			assert!(x.start().is_ok());
+
+			// stall the only worker so both lanes fill while it is busy
+			let (stall_send, stall_recv) = channel().unwrap();
+			let stalled = x
+				.execute(move || {
+					stall_recv.recv();
+				})
+				.unwrap();
+
+			let (order_send, order_recv) = channel().unwrap();
+			// SAFETY: clone does not fail for channels
+			let order_send2 = order_send.clone().unwrap();
+			let low = x
+				.execute_with_priority(
+					move || {
+						order_send.send(2).unwrap();
+					},
+					Priority::Low,
+				)
+				.unwrap();
+			let high = x
+				.execute_with_priority(
+					move || {
+						order_send2.send(1).unwrap();
+					},
+					Priority::High,
+				)
+				.unwrap();
+
+			stall_send.send(()).unwrap();
+			stalled.block_on();
+
+			// the high lane drains first even though low was queued
+			// earlier
+			assert_eq!(order_recv.recv(), 1);
+			assert_eq!(order_recv.recv(), 2);
+			low.block_on();
+			high.block_on();
+
+			assert!(x.stop().is_ok());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
+	#[test]
+	fn test_block_in_place() {
+		let initial = unsafe { getalloccount() };
+		{
+			let config = RuntimeConfig {
+				min_threads: 1,
+				max_threads: 2,
+				..RuntimeConfig::default()
+			};
+			let mut x: Runtime<()> = Runtime::new(config).unwrap();
+			assert!(x.start().is_ok());
+
+			// two tasks block at once with the pool capped at two
+			// workers. without block_in_place the third task could
+			// never run and these would deadlock; the blockers hand
+			// their slots back so a replacement drains the queue.
+			let (send1, recv1) = channel().unwrap();
+			let (send2, recv2) = channel().unwrap();
+
+			let mut blocker1 = x.blocker();
+			let h1 = x
+				.execute(move || {
+					blocker1.block_in_place(|| recv1.recv());
+				})
+				.unwrap();
+
+			let mut blocker2 = x.blocker();
+			let h2 = x
+				.execute(move || {
+					blocker2.block_in_place(|| recv2.recv());
+				})
+				.unwrap();
+
+			// only a replacement worker can run this releaser
+			let h3 = x
+				.execute(move || {
+					send1.send(()).unwrap();
+					send2.send(()).unwrap();
+				})
+				.unwrap();
+
+			assert_eq!(h1.block_on(), ());
+			assert_eq!(h2.block_on(), ());
+			assert_eq!(h3.block_on(), ());
+
+			// excess workers retire back down to min before stop
+			while x.cur_threads() != 1 {}
+
+			assert!(x.stop().is_ok());
+		}
+		assert_eq!(initial, unsafe { getalloccount() });
+	}
+
 	#[test]
 	fn test_thread_pool_size() {
 		let initial = unsafe { getalloccount() };
@@ -377,6 +1475,7 @@ mod test {
 			let mut r = Runtime::new(RuntimeConfig {
 				min_threads: 2,
 				max_threads: 4,
+				..RuntimeConfig::default()
 			})
 			.unwrap();
 			r.start().unwrap();
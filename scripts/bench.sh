@@ -0,0 +1,97 @@
+#!/bin/sh
+
+# Parses the `bench: name=... ops=... ns_per_op=... ops_per_sec=...`
+# lines a `./fam bench` run leaves in /tmp/bench.txt, prints a report
+# and gates against docs/bench_baseline.txt: a bench slower than
+# baseline * (100 + BENCH_TOLERANCE) / 100 fails the run. Pass
+# --update-docs to rewrite the baseline from the current run instead.
+
+update_docs=0;
+for var in "$@"
+do
+case "$var" in --update-docs)
+	update_docs=1;
+	;;
+esac
+done
+
+if [ "$BENCH_TOLERANCE" = "" ]; then
+	BENCH_TOLERANCE=50;
+fi
+
+baseline=./docs/bench_baseline.txt
+
+if [ "$NO_COLOR" = "" ]; then
+   GREEN="\033[32m";
+   CYAN="\033[36m";
+   YELLOW="\033[33m";
+   BRIGHT_RED="\033[91m";
+   RESET="\033[0m";
+   BLUE="\033[34m";
+else
+   GREEN="";
+   CYAN="";
+   YELLOW="";
+   BRIGHT_RED="";
+   RESET="";
+   BLUE="";
+fi
+
+echo "Benchmark Report for commit: $GREEN`git log -1 | grep "^commit " | cut -f2 -d ' '`$RESET";
+echo "$BLUE----------------------------------------------------------------------------------------------------$RESET";
+
+fail=0;
+count=0;
+rm -f /tmp/bench_results.txt;
+
+# the harness prints its own "test ..." prefix on the same line, so
+# match the bench payload anywhere in the line
+grep -o "bench: name=.*" /tmp/bench.txt | while read line
+do
+	name=`echo $line | cut -f2 -d ' ' | cut -f2 -d '='`;
+	ops=`echo $line | cut -f3 -d ' ' | cut -f2 -d '='`;
+	ns_per_op=`echo $line | cut -f4 -d ' ' | cut -f2 -d '='`;
+	ops_per_sec=`echo $line | cut -f5 -d ' ' | cut -f2 -d '='`;
+	echo "$name $ns_per_op $ops $ops_per_sec" >> /tmp/bench_results.txt;
+done
+
+if [ ! -e /tmp/bench_results.txt ]; then
+	echo "${BRIGHT_RED}No bench output found in /tmp/bench.txt!$RESET";
+	exit 1;
+fi
+
+while read name ns_per_op ops ops_per_sec
+do
+	count=$((1 + count));
+	base='';
+	if [ -e "$baseline" ]; then
+		base=`grep "^$name " $baseline | cut -f2 -d ' '`;
+	fi
+	if [ "$base" = "" ]; then
+		printf "Bench: $CYAN%-20s$RESET ns/op: $YELLOW%12s$RESET ops/sec: $YELLOW%12s$RESET (no baseline)\n" \
+			"$name" "$ns_per_op" "$ops_per_sec";
+	else
+		limit=$(((base * (100 + BENCH_TOLERANCE)) / 100));
+		if [ $ns_per_op -gt $limit ]; then
+			printf "Bench: $CYAN%-20s$RESET ns/op: $BRIGHT_RED%12s$RESET ops/sec: $YELLOW%12s$RESET baseline: %s (limit %s) ${BRIGHT_RED}REGRESSION$RESET\n" \
+				"$name" "$ns_per_op" "$ops_per_sec" "$base" "$limit";
+			fail=$((1 + fail));
+		else
+			printf "Bench: $CYAN%-20s$RESET ns/op: $GREEN%12s$RESET ops/sec: $YELLOW%12s$RESET baseline: %s\n" \
+				"$name" "$ns_per_op" "$ops_per_sec" "$base";
+		fi
+	fi
+done < /tmp/bench_results.txt
+
+echo "$BLUE----------------------------------------------------------------------------------------------------$RESET";
+
+if [ $update_docs = 1 ]; then
+	cut -f1,2 -d ' ' /tmp/bench_results.txt > $baseline;
+	echo "Baseline updated: $GREEN$baseline$RESET ($count benches)";
+fi
+
+if [ $fail != 0 ]; then
+	echo "Summary: $BRIGHT_RED$fail/$count benches regressed beyond ${BENCH_TOLERANCE}%!$RESET";
+	exit 1;
+fi
+echo "Summary: $GREEN$count benches within ${BENCH_TOLERANCE}% of baseline!$RESET";
@@ -1,6 +1,6 @@
 #!/bin/sh
 
-usage="Usage: fam [ all | test | fasttest | coverage ] [options]";
+usage="Usage: fam [ all | test | fasttest | coverage | bench ] [options]";
 
 for var in "$@"; do
 	case "$var" in
@@ -34,13 +34,35 @@ for var in "$@"; do
 	--with-cc=*)
                 cc=${var#*=}
                 ;;
+	--with-iouring)
+		iouring=-DUSE_IORING
+		;;
 	--with-mrustc=*)
 		mrustc=${var#*=}
 		;;
+	--with-scalar=*)
+		# 64bit|32bit: bake this scalar/field representation into
+		# the vendored secp256k1-zkp instead of configure's pick;
+		# exported so scripts/secp256k1zkp.sh sees it
+		SCALAR_REP=${var#*=}
+		export SCALAR_REP
+		;;
+	--with-asm=*)
+		# x86_64|no: bake this field_5x52 inner multiply into the
+		# vendored secp256k1-zkp (see c/fieldbench.c for timing the
+		# two on a host); exported so scripts/secp256k1zkp.sh sees it
+		FIELD_ASM=${var#*=}
+		export FIELD_ASM
+		;;
 	coverage)
 		coverage=1;
 		rustflags="-C instrument-coverage -C opt-level=0"
 		;;
+	bench)
+		bench=1;
+		ccflags=-O3
+		rustflags="-C opt-level=3"
+		;;
 	test)
 		test=1;
 		;;
@@ -54,7 +76,12 @@ for var in "$@"; do
 	esac
 done
 
-if [ "$test" != "1" ]  && [ "$coverage" != "1" ] && [ "$fasttest" != "1" ] && [ "$clean" != "1" ]; then
+if [ "$test" != "1" ]  && [ "$coverage" != "1" ] && [ "$fasttest" != "1" ] && [ "$bench" != "1" ] && [ "$clean" != "1" ]; then
 	all=1;
 fi
 
+# appended after the mode cases so the mode-specific ccflags are kept
+if [ "$iouring" = "-DUSE_IORING" ]; then
+	ccflags="$ccflags $iouring";
+fi
+
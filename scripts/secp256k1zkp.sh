@@ -1,15 +1,65 @@
 #!/bin/sh
 
 cd c/secp256k1-zkp
+# requested scalar/field representation (fam --with-scalar=64bit|32bit,
+# see c/scalarbench.c for probing which one a host wants); reconfigure
+# when the baked config disagrees
+repflags=
+if [ "$SCALAR_REP" = "64bit" ] || [ "$SCALAR_REP" = "32bit" ]; then
+	repflags="--with-scalar=$SCALAR_REP --with-field=$SCALAR_REP"
+	if [ -f "./src/libsecp256k1-config.h" ]; then
+		if [ "$SCALAR_REP" = "64bit" ] && ! grep -q "define USE_SCALAR_4X64" ./src/libsecp256k1-config.h; then
+			rm -f ./configure
+		fi
+		if [ "$SCALAR_REP" = "32bit" ] && ! grep -q "define USE_SCALAR_8X32" ./src/libsecp256k1-config.h; then
+			rm -f ./configure
+		fi
+	fi
+fi
+# requested field_5x52 inner multiply (fam --with-asm=x86_64|no, see
+# c/fieldbench.c for timing the asm and __int128 paths on a host);
+# reconfigure when the baked config disagrees
+asmflags=
+if [ "$FIELD_ASM" = "x86_64" ] || [ "$FIELD_ASM" = "no" ]; then
+	asmflags="--with-asm=$FIELD_ASM"
+	if [ -f "./src/libsecp256k1-config.h" ]; then
+		if [ "$FIELD_ASM" = "x86_64" ] && ! grep -q "define USE_ASM_X86_64" ./src/libsecp256k1-config.h; then
+			rm -f ./configure
+		fi
+		if [ "$FIELD_ASM" = "no" ] && grep -q "define USE_ASM_X86_64" ./src/libsecp256k1-config.h; then
+			rm -f ./configure
+		fi
+	fi
+fi
+# reconfigure an existing tree that predates the whitelist module
+if [ -f "./src/libsecp256k1-config.h" ]; then
+	if ! grep -q "define ENABLE_MODULE_WHITELIST" ./src/libsecp256k1-config.h; then
+		rm -f ./configure
+	fi
+fi
+# likewise for the ecdh module
+if [ -f "./src/libsecp256k1-config.h" ]; then
+	if ! grep -q "define ENABLE_MODULE_ECDH" ./src/libsecp256k1-config.h; then
+		rm -f ./configure
+	fi
+fi
 if [ ! -f "./configure" ]; then
 	./autogen.sh || exit 1;
+	# the vendored tree does not carry the upstream bench sources for
+	# every module, so benchmarks stay off
 	./configure \
+		${repflags} \
+		${asmflags} \
+		--disable-benchmark \
 		--enable-module-schnorrsig \
+		--enable-module-ecdh \
 		--enable-module-rangeproof \
 		--enable-module-generator \
 		--enable-experimental \
 		--enable-module-aggsig \
-		--enable-module-commitment || exit 1;
+		--enable-module-commitment \
+		--enable-module-surjectionproof \
+		--enable-module-whitelist || exit 1;
 fi
 make || exit 1;
 cp .libs/libsecp256k1.a ../../.obj